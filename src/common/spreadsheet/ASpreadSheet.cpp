@@ -19,6 +19,22 @@
 //=====================================================================
 
 #include "ASpreadSheet.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+ASpreadSheet::~ASpreadSheet()
+{
+  SimForth& forth = SimForth::instance();
+  if (this == forth.m_spreadsheet)
+    {
+      forth.m_spreadsheet = nullptr;
+    }
+}
 
 void ASpreadSheet::parse(SimForth &forth)
 {
@@ -38,68 +54,320 @@ void ASpreadSheet::parse(SimForth &forth)
   //TODO effacer ce flag quand on modifie une cellule
 }
 
-std::pair<bool, std::string>
-ASpreadSheet::evaluate(SimForth &forth)
+// **************************************************************
+//! Only names of cells are interned: other words (Forth words,
+//! numbers) are rejected quickly by isACell() and would fill the
+//! table with words never referring to a cell.
+// **************************************************************
+ASpreadSheetCell *ASpreadSheet::reference(std::string const& word)
 {
-  LOGI("ASpreadSheet::evaluate %p", forth.m_spreadsheet);
-  //TODO if (!m_parsed) { parse(); }
-  forth.m_spreadsheet = this;
+  auto it = m_names.find(word);
+  if (m_names.end() != it)
+    return it->second;
 
-  // Empty containers
+  ASpreadSheetCell *cell = isACell(word);
+  if (nullptr != cell)
+    {
+      m_names.emplace(word, cell);
+    }
+  return cell;
+}
+
+// **************************************************************
+//! Cells are unbound from the columns of values before they are
+//! released: call it before destroying cells. Words compiled for the
+//! formulae of cells are given back to the dictionary.
+// **************************************************************
+void ASpreadSheet::forgetCells()
+{
+  for (auto& cell: m_cells)
+    {
+      cell->unbind();
+    }
+
+  SimForth& forth = SimForth::instance();
   resetCellIterator();
+  while (hasCell())
+    {
+      forth.releaseCell(*nextCell());
+    }
+
+  m_names.clear();
+  m_cells.clear();
+  m_values.clear();
+  m_cycles.clear();
+  m_dirty.clear();
+  m_suspended.clear();
+  m_suspendedCells.clear();
   clearQueue(m_topologicalList);
+  m_dependenciesStale = true;
+  m_evaluated = false;
+  resetSimulation();
+}
+
+inline size_t ASpreadSheet::slot(ASpreadSheetCell const& cell) const
+{
+  return cell.id() - m_firstKey;
+}
+
+// **************************************************************
+//! Build the map of dependencies between cells and fill the
+//! topological queue with cells having no references on other cells.
+// **************************************************************
+void ASpreadSheet::initTopologicalSort()
+{
+  // Empty containers
+  clearQueue(m_topologicalList);
+  m_evaluated = false;
+  buildDependencies();
+  // Values of cells no longer match the ones of the last step
+  m_restart = true;
 
   // Filter cells: which ones can be directly evaluated
   // formulae with cell references versus. formulaes with
   // literals or operations without references on cells.
-  //std::cout << "1st step -------------" << std::endl;
+  for (auto& cell: m_cells)
+    {
+      cell->m_unresolvedRefs = cell->references().size();
+      if (!cell->hasReferences())
+        {
+          m_topologicalList.push(cell);
+        }
+    }
+}
+
+// **************************************************************
+//! Build the reverse dependencies (the cells referencing a cell) as
+//! CSR (Compressed Sparse Row) arrays indexed by the key of cells:
+//! cells referencing the cell c are m_dependents[i] with i in
+//! [m_depOffsets[k], m_depOffsets[k + 1][ and k = c.id() - m_firstKey.
+// **************************************************************
+void ASpreadSheet::buildDependencies()
+{
+  m_cells.clear();
+  resetCellIterator();
   while (hasCell())
     {
       ASpreadSheetCell* cell = nextCell();
       assert(cell != nullptr);
+      m_cells.push_back(cell);
+    }
+
+  // Range of keys
+  Key last = 0;
+  m_firstKey = m_cells.empty() ? 0 : m_cells.front()->id();
+  for (const auto& cell: m_cells)
+    {
+      m_firstKey = std::min(m_firstKey, cell->id());
+      last = std::max(last, cell->id());
+    }
+  const size_t range = m_cells.empty() ? 0 : last - m_firstKey + 1;
+  bindValues(range);
 
-      if (cell->hasReferences())
+  // Count the dependents of each cell
+  m_depOffsets.assign(range + 1, 0);
+  for (const auto& cell: m_cells)
+    {
+      for (const auto& ref: cell->references())
         {
-          //std::cout << "  add Dep " << cell->name()
-          //          << " '" << cell->formulae()
-          //          << "'" << std::endl;
-          addToDependenciesMap(*cell); // FIXME: pas mieux si cell->addDep(this); qui du coup est le tableau des Observers
-          //debugDependenciesMap();
+          assert(slot(*ref) < range);
+          ++m_depOffsets[slot(*ref) + 1];
         }
-      else
+    }
+  for (size_t k = 1; k <= range; ++k)
+    {
+      m_depOffsets[k] += m_depOffsets[k - 1];
+    }
+
+  // Store them
+  m_dependents.resize(m_depOffsets[range]);
+  std::vector<uint32_t> next(m_depOffsets.begin(), m_depOffsets.end() - 1);
+  for (const auto& cell: m_cells)
+    {
+      for (const auto& ref: cell->references())
         {
-          //std::cout << "  ************** add topo " << cell->name()
-          //          << " '" << cell->formulae()
-          //          << "'" << std::endl;
-          m_topologicalList.push(cell);
+          m_dependents[next[slot(*ref)]++] = cell;
+        }
+    }
+  findCycles();
+  m_dependenciesStale = false;
+  m_stepsStale = true;
+}
+
+// **************************************************************
+//! Values are copied in new columns then cells are bound to them:
+//! cells created since the previous call and a change of the
+//! smallest key are taken into account.
+// **************************************************************
+void ASpreadSheet::bindValues(const size_t range)
+{
+  CellValues values(m_firstKey, range);
+  for (const auto& cell: m_cells)
+    {
+      if (nullptr != cell->values())
+        {
+          values.copy(values.index(cell->id()), *cell->values(), cell->index());
         }
-      //cell->modified = false;
     }
-  //debugDependenciesMap();
+
+  m_values = std::move(values);
+  for (const auto& cell: m_cells)
+    {
+      cell->bind(m_values, m_values.index(cell->id()));
+    }
+}
+
+// **************************************************************
+//! Find cycles of references between cells with the Tarjan's
+//! algorithm: cycles are the strongly connected components having
+//! more than one cell or a cell referencing itself. The depth-first
+//! search uses its own stack because chains of references can be as
+//! long as the spreadsheet.
+// **************************************************************
+void ASpreadSheet::findCycles()
+{
+  m_cycles.clear();
+
+  // Order of visit of cells (0 for cells not yet visited) and
+  // smallest order reachable from them.
+  const size_t range = m_depOffsets.size() - 1;
+  std::vector<uint32_t> order(range, 0);
+  std::vector<uint32_t> lowlink(range, 0);
+  std::vector<bool> stacked(range, false);
+  std::vector<ASpreadSheetCell*> component;
+  // Cells visited and the index of their next reference to visit
+  std::vector<std::pair<ASpreadSheetCell*, size_t>> calls;
+  uint32_t visited = 0;
+
+  for (const auto& root: m_cells)
+    {
+      if (0 != order[slot(*root)])
+        continue;
+
+      calls.emplace_back(root, 0);
+      while (!calls.empty())
+        {
+          ASpreadSheetCell* cell = calls.back().first;
+          const size_t k = slot(*cell);
+          if (0 == order[k])
+            {
+              order[k] = lowlink[k] = ++visited;
+              component.push_back(cell);
+              stacked[k] = true;
+            }
+
+          // Visit the next reference
+          auto const& refs = cell->references();
+          if (calls.back().second < refs.size())
+            {
+              ASpreadSheetCell* ref = refs[calls.back().second++];
+              const size_t r = slot(*ref);
+              if (0 == order[r])
+                {
+                  calls.emplace_back(ref, 0);
+                }
+              else if (stacked[r])
+                {
+                  lowlink[k] = std::min(lowlink[k], order[r]);
+                }
+              continue;
+            }
+
+          // All references visited
+          calls.pop_back();
+          if (!calls.empty())
+            {
+              const size_t p = slot(*calls.back().first);
+              lowlink[p] = std::min(lowlink[p], lowlink[k]);
+            }
+          if (lowlink[k] != order[k])
+            continue;
+
+          // The cell is the root of a component: the cells stacked
+          // after it
+          auto it = std::find(component.rbegin(), component.rend(), cell).base() - 1;
+          for (auto c = it; c != component.end(); ++c)
+            {
+              stacked[slot(**c)] = false;
+            }
+          if ((component.end() - it > 1) ||
+              (std::find(refs.begin(), refs.end(), cell) != refs.end()))
+            {
+              m_cycles.emplace_back(it, component.end());
+            }
+          component.erase(it, component.end());
+        }
+    }
+}
+
+// **************************************************************
+//! Cells left unevaluated are the ones of cycles and the ones
+//! depending on them. Cycles are logged to help fixing formulae.
+//! Values of these cells are forgotten: they would be the ones of a
+//! previous evaluation else.
+// **************************************************************
+std::pair<bool, std::string> ASpreadSheet::circularDependencies()
+{
+  std::vector<bool> visited(m_depOffsets.size(), false);
+  std::vector<ASpreadSheetCell*> stack;
+  for (const auto& cycle: m_cycles)
+    {
+      std::string names;
+      for (const auto& cell: cycle)
+        {
+          names += " " + cell->name();
+          stack.push_back(cell);
+        }
+      LOGW("Circular dependency between cells:%s", names.c_str());
+    }
+
+  while (!stack.empty())
+    {
+      ASpreadSheetCell* cell = stack.back();
+      stack.pop_back();
+      const size_t k = slot(*cell);
+      if (visited[k])
+        continue;
+
+      visited[k] = true;
+      m_values.reset(m_values.index(cell->id()));
+      for (uint32_t i = m_depOffsets[k]; i < m_depOffsets[k + 1]; ++i)
+        {
+          stack.push_back(m_dependents[i]);
+        }
+    }
+
+  // FIXME: faudrait afficher le nom du spreadsheet dans le message d'erreur du forth
+  AbortForth e("CircularDependencyFound: Unable to solve the spreadsheet");
+  return std::make_pair(false, e.message());
+}
+
+std::pair<bool, std::string>
+ASpreadSheet::evaluate(SimForth &forth)
+{
+  LOGI("ASpreadSheet::evaluate %p", forth.m_spreadsheet);
+  //TODO if (!m_parsed) { parse(); }
+  forth.m_spreadsheet = this;
+
+  initTopologicalSort();
+  m_suspended.clear();
+  m_suspendedCells.clear();
 
   // Evaluate cells which does not contain references on
   // other cells.
-  size_t unsolvedCells = howManyCells();
+  size_t unsolvedCells = m_cells.size();
   //std::cout << std::endl << "2nd step -------------" << std::endl;
   //std::cout << "  unsolved cells " << unsolvedCells << std::endl;
   try
     {
-      while (!m_topologicalList.empty())
+      while ((!m_topologicalList.empty()) || (!m_suspended.empty()))
         {
           std::cout << std::endl;
 
-          // Pop the cell
-          //std::cout << "Topo queue " << m_topologicalList.size() << std::endl;
-          if (0u == m_topologicalList.size())
-            forth.abort("Topological list shall not be empty");
-
-          ASpreadSheetCell* cell = m_topologicalList.front();
-          m_topologicalList.pop();
-          assert(cell != nullptr);
-
           // Interprete the cell
           //std::cout << "interpret " << cell->name() << ": " << cell->formulae() << std::endl;
-          std::pair<bool, std::string> res = forth.interpreteCell(*cell);
+          ASpreadSheetCell* cell;
+          std::pair<bool, std::string> res = evaluateNextCell(forth, cell);
 
           // Failure: cell has a bad formulae
           if (res.first == false)
@@ -108,6 +376,10 @@ ASpreadSheet::evaluate(SimForth &forth)
               return res;
             }
 
+          // Formulae suspended: continue it later
+          if (nullptr == cell)
+            continue;
+
           // Success
           --unsolvedCells;
           //std::cout << "  unsolved cells " << unsolvedCells << std::endl;
@@ -117,91 +389,612 @@ ASpreadSheet::evaluate(SimForth &forth)
       if (unsolvedCells != 0)
         {
           //setCircularDependent(true);
-          // FIXME: faudrait afficher le nom du spreadsheet dans le message d'erreur du forth
-          forth.abort("CircularDependencyFound: Unable to solve the spreadsheet");
+          return circularDependencies();
         }
     }
   catch (ForthException const& e)
     {
       return std::make_pair(false, e.message());
     }
+  m_dirty.clear();
+  m_evaluated = true;
   return std::make_pair(true, "ok");
 }
 
-void ASpreadSheet::debugDependenciesMap()
+// **************************************************************
+//! Re-evaluate cells marked as dirty (see ASpreadSheet::dirty()
+//! and ASpreadSheet::formulae()) and the cells depending directly or
+//! indirectly on them. Other cells keep their value. Cells are
+//! evaluated in topological order restricted to this subset. If the
+//! spreadsheet has never been evaluated the whole spreadsheet is
+//! evaluated.
+// **************************************************************
+std::pair<bool, std::string>
+ASpreadSheet::evaluateDirty(SimForth &forth)
 {
-  std::cout << "debugDependenciesMap():" << std::endl;
-  for (const auto& c: m_dependencies)
+  if (!m_evaluated)
     {
-      std::cout << c.first << ":";
-      for (const auto& c1: c.second)
+      return evaluate(forth);
+    }
+  forth.m_spreadsheet = this;
+  m_restart = true;
+
+  if (m_dependenciesStale)
+    {
+      buildDependencies();
+    }
+
+  // Collect dirty cells and their transitive dependents. Also count
+  // for each of them the number of references inside this subset
+  // (-1 for cells outside the subset).
+  std::vector<int32_t> unresolved(m_depOffsets.size(), -1);
+  std::vector<ASpreadSheetCell*> subset;
+  std::vector<ASpreadSheetCell*> stack(m_dirty);
+  while (!stack.empty())
+    {
+      ASpreadSheetCell* cell = stack.back();
+      stack.pop_back();
+      const size_t k = slot(*cell);
+      if (unresolved[k] >= 0)
+        continue;
+
+      unresolved[k] = 0;
+      subset.push_back(cell);
+      for (uint32_t i = m_depOffsets[k]; i < m_depOffsets[k + 1]; ++i)
         {
-          std::cout << "    '" << c1.second->name()  << "'";
+          stack.push_back(m_dependents[i]);
         }
-      std::cout << std::endl;
     }
+
+  clearQueue(m_topologicalList);
+  m_suspended.clear();
+  m_suspendedCells.clear();
+  for (auto& cell: subset)
+    {
+      int32_t& count = unresolved[slot(*cell)];
+      for (const auto& ref: cell->references())
+        {
+          if (unresolved[slot(*ref)] >= 0)
+            ++count;
+        }
+      if (0 == count)
+        {
+          m_topologicalList.push(cell);
+        }
+    }
+
+  size_t unsolvedCells = subset.size();
+  try
+    {
+      while ((!m_topologicalList.empty()) || (!m_suspended.empty()))
+        {
+          ASpreadSheetCell* cell;
+          std::pair<bool, std::string> res = evaluateNextCell(forth, cell);
+          if (res.first == false)
+            {
+              return res;
+            }
+          if (nullptr == cell)
+            continue;
+          --unsolvedCells;
+
+          // Release cells of the subset depending on this cell
+          const size_t k = slot(*cell);
+          for (uint32_t i = m_depOffsets[k]; i < m_depOffsets[k + 1]; ++i)
+            {
+              ASpreadSheetCell* dep = m_dependents[i];
+              int32_t& count = unresolved[slot(*dep)];
+              if ((count > 0) && (0 == --count))
+                {
+                  m_topologicalList.push(dep);
+                }
+            }
+        }
+
+      if (unsolvedCells != 0)
+        {
+          return circularDependencies();
+        }
+    }
+  catch (ForthException const& e)
+    {
+      return std::make_pair(false, e.message());
+    }
+  m_dirty.clear();
+  return std::make_pair(true, "ok");
 }
 
-void ASpreadSheet::addToDependenciesMap(ASpreadSheetCell& cell)
+// **************************************************************
+//! Cells of the topological queue are evaluated first. When the
+//! queue is empty, the oldest suspended formulae is continued. This
+//! way a long formulae does not delay the evaluation of the cells
+//! not depending on it.
+//! \param cell set to the evaluated cell or to nullptr if its
+//! formulae has been suspended again.
+// **************************************************************
+std::pair<bool, std::string>
+ASpreadSheet::evaluateNextCell(SimForth &forth, ASpreadSheetCell*& cell)
 {
-  //std::cout << "addToDependenciesMap " << cell.name() << std::endl;
-  for (const auto& c: cell.references())
+  ForthContinuation k;
+
+  if (!m_topologicalList.empty())
+    {
+      cell = m_topologicalList.front();
+      m_topologicalList.pop();
+    }
+  else
     {
-      //std::cout << "  addToDependenciesMap cell.references " << c->name()
-      //          << " '" << c->formulae() << "'" << std::endl;
+      cell = m_suspended.front().first;
+      k = std::move(m_suspended.front().second);
+      m_suspended.pop_front();
+    }
+  assert(cell != nullptr);
 
-      const auto& it = m_dependencies.find(c->name());
-      if (it != m_dependencies.end())
+  std::pair<bool, std::string> res = forth.interpreteCell(*cell, m_budget, k);
+  if ((res.first) && (k.suspended))
+    {
+      if (1u == k.suspensions)
         {
-          m_dependencies[c->name()][cell.name()] = &cell;
-          //std::cout << "  ************** Nieme fois: " << c->name()
-          //        << std::endl;
+          LOGW("Formulae of cell %s exhausted its budget: suspended",
+               cell->name().c_str());
+          m_suspendedCells.push_back(cell);
         }
-      else
+      if ((0u != m_maxSuspensions) && (k.suspensions > m_maxSuspensions))
         {
-          m_dependencies[c->name()][c->name()] = &cell;
-          //std::cout << "  ************** 1ere fois: '" << c->name()
-          //  << std::endl;
+          m_suspended.clear();
+          return std::make_pair(false, "Formulae of cell " + cell->name() +
+                                " exceeded its execution budget");
         }
-      //debugDependenciesMap();
+      m_suspended.emplace_back(cell, std::move(k));
+      cell = nullptr;
     }
+  return res;
 }
 
-void ASpreadSheet::resolveDependencies(ASpreadSheetCell& cell)
+// **************************************************************
+//! A formulae exhausting the budget is suspended and continued with
+//! a new budget once other cells have been evaluated.
+//! \param budget the limits of a formulae before being suspended
+//! (ForthBudget() for no limit).
+//! \param max_suspensions the number of times a formulae can be
+//! suspended before the evaluation fails (0 for no limit).
+// **************************************************************
+void ASpreadSheet::budget(ForthBudget const& budget, uint32_t max_suspensions)
+{
+  m_budget = budget;
+  m_maxSuspensions = max_suspensions;
+}
+
+// **************************************************************
+//! Same result than evaluate() but cells are grouped by wavefronts
+//! (cells of a wavefront only depend on cells of previous wavefronts)
+//! and cells of a wavefront are evaluated concurrently by a pool of
+//! workers. Each worker borrows a Forth context (SimForthContext)
+//! sharing the dictionary of forth. Formulae are compiled before starting
+//! workers because compilation modifies the dictionary. Formulae
+//! which cannot be compiled, or which may write in the dictionary
+//! (SimForth::shareable), are interpreted by forth after workers
+//! have finished the wavefront.
+//! \param forth the Forth owning the dictionary.
+//! \param nb_workers the number of threads. 0 for the number of
+//! cores.
+// **************************************************************
+std::pair<bool, std::string>
+ASpreadSheet::evaluateParallel(SimForth &forth, uint32_t nb_workers)
 {
-  //std::cout << "  resolveDependencies. find " << cell.name() << std::endl;
-  //debugDependenciesMap();
+  LOGI("ASpreadSheet::evaluateParallel %p", forth.m_spreadsheet);
+  forth.m_spreadsheet = this;
 
-  const auto& curCellDeps = m_dependencies.find(cell.name());
-  if (curCellDeps == m_dependencies.end())
+  if (0u == nb_workers)
     {
-      //std::cout << "    resolveDependencies return" << std::endl;
-      return ;
+      nb_workers = std::max(1u, std::thread::hardware_concurrency());
     }
 
-  //std::cout << "   resolveDependencies found: "
-  //  << curCellDeps->second.size() << std::endl;
+  initTopologicalSort();
 
-  // Get all the cells dependent on this cell
-  for (auto& depCell: curCellDeps->second)
+  // Compile all formulae (serial: this modifies the dictionary)
+  for (auto& cell: m_cells)
+    {
+      forth.compileCell(*cell);
+    }
+
+  // Contexts of workers (kept by forth for the next evaluations)
+  std::vector<ForthContextPool<SimForthContext, SimForth>::Lease> contexts;
+  contexts.reserve(nb_workers);
+  for (uint32_t i = 0; i < nb_workers; ++i)
+    {
+      contexts.emplace_back(forth.contexts().borrow());
+    }
+
+  // Wavefront shared with workers
+  std::vector<ASpreadSheetCell*> wavefront;
+  std::atomic<size_t> next_cell(0);
+  std::mutex mutex;
+  std::condition_variable cv_start;
+  std::condition_variable cv_done;
+  size_t generation = 0;
+  uint32_t running = 0;
+  bool quit = false;
+  std::pair<bool, std::string> error(true, "ok");
+
+  auto worker = [&](SimForthContext& context)
+  {
+    size_t seen = 0;
+    while (true)
+      {
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cv_start.wait(lock, [&]{ return quit || (seen != generation); });
+          if (quit)
+            return ;
+          seen = generation;
+        }
+
+        size_t i;
+        while ((i = next_cell++) < wavefront.size())
+          {
+            ASpreadSheetCell* cell = wavefront[i];
+            if (!forth.shareable(*cell))
+              continue; // Interpreted later by forth
+
+            std::pair<bool, std::string> res = context.interpreteCell(*cell);
+            if (!res.first)
+              {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (error.first)
+                  {
+                    error = std::make_pair(false, cell->name() + ": " + res.second);
+                  }
+              }
+          }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (0u == --running)
+          {
+            cv_done.notify_one();
+          }
+      }
+  };
+
+  std::vector<std::thread> threads;
+  for (auto& context: contexts)
+    {
+      threads.emplace_back(worker, std::ref(*context));
+    }
+
+  size_t unsolvedCells = m_cells.size();
+  try
+    {
+      while (!m_topologicalList.empty())
+        {
+          // Current wavefront
+          wavefront.clear();
+          while (!m_topologicalList.empty())
+            {
+              wavefront.push_back(m_topologicalList.front());
+              m_topologicalList.pop();
+            }
+
+          // Evaluate compiled formulae by workers
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            next_cell = 0;
+            running = nb_workers;
+            ++generation;
+            cv_start.notify_all();
+            cv_done.wait(lock, [&]{ return 0u == running; });
+          }
+          if (!error.first)
+            break;
+
+          // Interprete other formulae and prepare the next wavefront
+          for (auto& cell: wavefront)
+            {
+              if (!forth.shareable(*cell))
+                {
+                  error = forth.interpreteCell(*cell);
+                  if (!error.first)
+                    break;
+                }
+              --unsolvedCells;
+              resolveDependencies(*cell);
+            }
+          if (!error.first)
+            break;
+        }
+    }
+  catch (ForthException const& e)
+    {
+      error = std::make_pair(false, e.message());
+    }
+
+  // Stop workers
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+    cv_start.notify_all();
+  }
+  for (auto& thread: threads)
+    {
+      thread.join();
+    }
+
+  if (!error.first)
+    return error;
+
+  if (unsolvedCells != 0)
+    {
+      return circularDependencies();
+    }
+
+  m_dirty.clear();
+  m_evaluated = true;
+  return error;
+}
+
+// **************************************************************
+//! Sort cells in topological order and build the reverse
+//! dependencies on previous values. Values of the previous step are
+//! kept if cells still have the same keys.
+// **************************************************************
+std::pair<bool, std::string> ASpreadSheet::initSteps()
+{
+  if (m_dependenciesStale)
+    {
+      buildDependencies();
+    }
+  if (!m_cycles.empty())
+    {
+      return circularDependencies();
+    }
+
+  // Topological order
+  const size_t range = m_depOffsets.size() - 1;
+  std::vector<uint32_t> count(range, 0);
+  m_order.clear();
+  for (const auto& cell: m_cells)
+    {
+      count[slot(*cell)] = cell->references().size();
+      if (cell->references().empty())
+        {
+          m_order.push_back(cell);
+        }
+    }
+  for (size_t i = 0; i < m_order.size(); ++i)
+    {
+      const size_t k = slot(*m_order[i]);
+      for (uint32_t d = m_depOffsets[k]; d < m_depOffsets[k + 1]; ++d)
+        {
+          if (0 == --count[slot(*m_dependents[d])])
+            {
+              m_order.push_back(m_dependents[d]);
+            }
+        }
+    }
+
+  // Cells reading the previous value of cells
+  m_prevOffsets.assign(range + 1, 0);
+  for (const auto& cell: m_cells)
+    {
+      for (const auto& ref: cell->previousReferences())
+        {
+          ++m_prevOffsets[slot(*ref) + 1];
+        }
+    }
+  for (size_t k = 1; k <= range; ++k)
     {
-      assert(depCell.second != nullptr);
+      m_prevOffsets[k] += m_prevOffsets[k - 1];
+    }
+  m_prevDependents.resize(m_prevOffsets[range]);
+  std::vector<uint32_t> next(m_prevOffsets.begin(), m_prevOffsets.end() - 1);
+  for (const auto& cell: m_cells)
+    {
+      for (const auto& ref: cell->previousReferences())
+        {
+          m_prevDependents[next[slot(*ref)]++] = cell;
+        }
+    }
+
+  // Values of cells
+  if ((m_stepFirstKey != m_firstKey) || (m_stepValues[0].size() != range))
+    {
+      resetSimulation();
+      m_stepFirstKey = m_firstKey;
+      for (uint32_t b = 0; b < 2u; ++b)
+        {
+          m_stepValues[b].assign(range, 0);
+          m_stepFloats[b].assign(range, 0.0);
+        }
+    }
+  m_stepDirty.assign(range, false);
+  m_stepsStale = false;
+  return std::make_pair(true, "ok");
+}
+
+// **************************************************************
+//! At each step the values of the current step become the previous
+//! values. A cell is evaluated only if one of its inputs changed:
+//! a dirty cell (see ASpreadSheet::dirty()), a referenced cell
+//! whose value changed during this step or a cell read with P:
+//! whose value changed during the previous step. Formulae are
+//! supposed to depend only on their references. Only values which
+//! changed are copied in the buffer of the current step.
+//! \param n the number of steps.
+//! \return false and the error if a formulae failed or cells have
+//! circular dependencies. The failing step shall be done again.
+// **************************************************************
+std::pair<bool, std::string> ASpreadSheet::step(SimForth &forth, uint32_t n)
+{
+  forth.m_spreadsheet = this;
+  const auto start = std::chrono::steady_clock::now();
+  std::pair<bool, std::string> res(true, "ok");
 
-      /*std::cout << "resolveDependencies looping "
-        << depCell.second->name() << " "
-        << depCell.second->formulae() << " "
-        << std::endl;*/
+  if ((m_dependenciesStale) || (m_stepsStale))
+    {
+      res = initSteps();
+      if (!res.first)
+        return res;
+    }
+
+  while ((n--) && (res.first))
+    {
+      // Values of the last step become the previous values
+      m_current ^= 1u;
+      std::vector<Cell32>& values = m_stepValues[m_current];
+      std::vector<Float64>& floats = m_stepFloats[m_current];
+      std::vector<Cell32> const& prevValues = m_stepValues[m_current ^ 1u];
+      std::vector<Float64> const& prevFloats = m_stepFloats[m_current ^ 1u];
+      if (m_restart)
+        {
+          values = prevValues;
+          floats = prevFloats;
+          m_stepDirty.assign(m_stepDirty.size(), true);
+        }
+      else
+        {
+          for (const auto& cell: m_changed)
+            {
+              const size_t k = slot(*cell);
+              values[k] = prevValues[k];
+              floats[k] = prevFloats[k];
+              for (uint32_t d = m_prevOffsets[k]; d < m_prevOffsets[k + 1]; ++d)
+                {
+                  m_stepDirty[slot(*m_prevDependents[d])] = true;
+                }
+            }
+          for (const auto& cell: m_dirty)
+            {
+              m_stepDirty[slot(*cell)] = true;
+            }
+        }
+      m_changed.clear();
+
+      // Evaluate cells in topological order
+      for (const auto& cell: m_order)
+        {
+          const size_t k = slot(*cell);
+          if (!m_stepDirty[k])
+            {
+              ++m_stats.memoizedCells;
+              continue;
+            }
+
+          m_stepDirty[k] = false;
+          ++m_stats.evaluatedCells;
+          res = forth.interpreteCell(*cell);
+          if (!res.first)
+            {
+              res.second = cell->name() + ": " + res.second;
+              break;
+            }
+
+          const Cell32 value = cell->value().second;
+          const Float64 real = cell->fvalue().second;
+          if ((m_restart) || (value != prevValues[k]) || (real != prevFloats[k]))
+            {
+              values[k] = value;
+              floats[k] = real;
+              m_changed.push_back(cell);
+              for (uint32_t d = m_depOffsets[k]; d < m_depOffsets[k + 1]; ++d)
+                {
+                  m_stepDirty[slot(*m_dependents[d])] = true;
+                }
+            }
+        }
 
-      --depCell.second->m_unresolvedRefs; // FIXME: utiliser methode
-      //std::cout << "hasRef " << depCell.second->hasReferences() << std::endl;
-      if (!depCell.second->hasReferences())
+      if (res.first)
         {
-          //std::cout << "insert in topo list" << std::endl;
-          m_topologicalList.push(depCell.second);
+          m_restart = false;
+          m_dirty.clear();
+          ++m_stats.steps;
         }
       else
         {
-          //depCell.second->debugReferences();
+          // Come back to the last step and evaluate all cells again
+          m_current ^= 1u;
+          m_restart = true;
+        }
+    }
+
+  m_stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return res;
+}
+
+void ASpreadSheet::resetSimulation()
+{
+  for (uint32_t b = 0; b < 2u; ++b)
+    {
+      std::fill(m_stepValues[b].begin(), m_stepValues[b].end(), 0);
+      std::fill(m_stepFloats[b].begin(), m_stepFloats[b].end(), 0.0);
+    }
+  m_changed.clear();
+  m_restart = true;
+  m_stats = SimulationStats();
+}
+
+Cell32 ASpreadSheet::previousValue(ASpreadSheetCell const& cell) const
+{
+  const size_t k = cell.id() - m_stepFirstKey;
+  std::vector<Cell32> const& values = m_stepValues[m_current ^ 1u];
+  return (k < values.size()) ? values[k] : 0;
+}
+
+Float64 ASpreadSheet::previousFloat(ASpreadSheetCell const& cell) const
+{
+  const size_t k = cell.id() - m_stepFirstKey;
+  std::vector<Float64> const& floats = m_stepFloats[m_current ^ 1u];
+  return (k < floats.size()) ? floats[k] : 0.0;
+}
+
+// **************************************************************
+//! Replace the formulae of the cell and mark it as dirty. The
+//! dependencies between cells will be rebuilt by the next call of
+//! evaluateDirty().
+// **************************************************************
+void ASpreadSheet::formulae(ASpreadSheetCell& cell, std::string const& formulae)
+{
+  SimForth::instance().m_spreadsheet = this;
+  cell.formulae(formulae);
+  m_dependenciesStale = true;
+  dirty(cell);
+}
+
+// **************************************************************
+//! The cell will be evaluated by the next call of evaluateDirty().
+// **************************************************************
+void ASpreadSheet::dirty(ASpreadSheetCell& cell)
+{
+  m_dirty.push_back(&cell);
+}
+
+void ASpreadSheet::debugDependenciesMap()
+{
+  std::cout << "debugDependenciesMap():" << std::endl;
+  for (const auto& c: m_cells)
+    {
+      const size_t k = slot(*c);
+      std::cout << c->name() << ":";
+      for (uint32_t i = m_depOffsets[k]; i < m_depOffsets[k + 1]; ++i)
+        {
+          std::cout << "    '" << m_dependents[i]->name()  << "'";
+        }
+      std::cout << std::endl;
+    }
+}
+
+void ASpreadSheet::resolveDependencies(ASpreadSheetCell& cell)
+{
+  // Get all the cells dependent on this cell
+  const size_t k = slot(cell);
+  for (uint32_t i = m_depOffsets[k]; i < m_depOffsets[k + 1]; ++i)
+    {
+      ASpreadSheetCell* depCell = m_dependents[i];
+      assert(depCell != nullptr);
+
+      --depCell->m_unresolvedRefs; // FIXME: utiliser methode
+      if (!depCell->hasReferences())
+        {
+          m_topologicalList.push(depCell);
         }
     }
 }
@@ -22,12 +22,40 @@
 #  define SIMTADYN_SPREADSHEET_HPP_
 
 #  include "ASpreadSheetCell.hpp"
+#  include "CellValues.hpp"
+#  include "ClassCounter.tpp"
+#  include "Forth.hpp"
+#  include <deque>
 #  include <queue>
-#  include <map>
+#  include <unordered_map>
+#  include <vector>
 
 class SimForth;
 class ASpreadSheetCell;
 
+//! \brief Throughput of the simulation (see ASpreadSheet::step()).
+struct SimulationStats
+{
+  //! Number of steps done.
+  uint64_t steps = 0;
+  //! Number of formulae executed.
+  uint64_t evaluatedCells = 0;
+  //! Number of cells whose value was kept from the previous step.
+  uint64_t memoizedCells = 0;
+  //! Time spent in ASpreadSheet::step().
+  double seconds = 0.0;
+
+  inline double cellsPerSecond() const
+  {
+    return (seconds > 0.0) ? static_cast<double>(evaluatedCells) / seconds : 0.0;
+  }
+
+  inline double stepsPerSecond() const
+  {
+    return (seconds > 0.0) ? static_cast<double>(steps) / seconds : 0.0;
+  }
+};
+
 // **************************************************************
 //
 // **************************************************************
@@ -36,17 +64,70 @@ class ASpreadSheet
 public:
 
   ASpreadSheet()
+    : m_firstKey(0),
+      m_dependenciesStale(true),
+      m_maxSuspensions(0u),
+      m_evaluated(false)
   {
     //LOGI("New ASpreadSheet");
   }
 
-  virtual ~ASpreadSheet()
-  {
-  }
+  //! \brief Detach the spreadsheet from SimForth which shall not
+  //! look for cells in a destroyed spreadsheet.
+  virtual ~ASpreadSheet();
 
   void debugDependenciesMap();
   virtual ASpreadSheetCell *isACell(std::string const& word) = 0;
+  //! \brief Return the cell named by the word else nullptr. Same as
+  //! isACell() but names of cells are interned: they are parsed only
+  //! the first time they are met.
+  ASpreadSheetCell *reference(std::string const& word);
   std::pair<bool, std::string> evaluate(SimForth &forth); // FIXME: Forth et mauvais nom
+  //! \brief Evaluate cells with a pool of threads, wavefront by
+  //! wavefront.
+  std::pair<bool, std::string> evaluateParallel(SimForth &forth, uint32_t nb_workers = 0u);
+  //! \brief Evaluate only dirty cells and cells depending on them.
+  std::pair<bool, std::string> evaluateDirty(SimForth &forth);
+  //! \brief Change the formulae of a cell and mark it as dirty.
+  void formulae(ASpreadSheetCell& cell, std::string const& formulae);
+  //! \brief Mark a cell as needing to be evaluated again.
+  void dirty(ASpreadSheetCell& cell);
+  //! \brief Limit the execution of formulae by evaluate() and
+  //! evaluateDirty().
+  void budget(ForthBudget const& budget, uint32_t max_suspensions = 0u);
+  //! \brief Cells whose formulae exhausted their budget during the
+  //! last evaluation.
+  inline std::vector<ASpreadSheetCell*> const& suspendedCells() const
+  {
+    return m_suspendedCells;
+  }
+  //! \brief Simulate n time steps: evaluate cells whose inputs
+  //! changed since the previous step.
+  std::pair<bool, std::string> step(SimForth &forth, uint32_t n = 1u);
+  //! \brief Restart the simulation: values of the previous step are
+  //! reset to 0 and the next step evaluates all cells.
+  void resetSimulation();
+  //! \brief Throughput of step().
+  inline SimulationStats const& stats() const
+  {
+    return m_stats;
+  }
+  //! \brief Values of the cell at the previous step (0 before the
+  //! first step). Read by formulae with references prefixed by P:.
+  Cell32 previousValue(ASpreadSheetCell const& cell) const;
+  Float64 previousFloat(ASpreadSheetCell const& cell) const;
+  //! \brief Circular dependencies found between cells: the cells
+  //! of each cycle. Cells depending on them cannot be evaluated.
+  inline std::vector<std::vector<ASpreadSheetCell*>> const& cycles() const
+  {
+    return m_cycles;
+  }
+  //! \brief Values of cells stored as columns indexed by the key of
+  //! cells (filled by the evaluation).
+  inline CellValues const& values() const
+  {
+    return m_values;
+  }
   void parse(SimForth &forth);
   virtual const std::string& name() const = 0;
 
@@ -56,11 +137,29 @@ protected:
   virtual bool hasCell() const = 0;
   virtual ASpreadSheetCell* nextCell() /*const*/ = 0; // FIXME
   virtual size_t howManyCells() const = 0;
+  //! \brief Forget everything known about cells (interned names,
+  //! dependencies, dirty and suspended cells, values). To be called
+  //! when cells are created or before they are destroyed.
+  void forgetCells();
 
 private:
 
-  void addToDependenciesMap(ASpreadSheetCell& cell);
+  void initTopologicalSort();
+  void buildDependencies();
+  //! \brief Move values of cells in columns indexed by their key.
+  void bindValues(size_t range);
+  void findCycles();
+  //! \brief Prepare step() after a change of the dependencies.
+  std::pair<bool, std::string> initSteps();
+  //! \brief Error returned when cells are left unevaluated. Their
+  //! values are forgotten.
+  std::pair<bool, std::string> circularDependencies();
   void resolveDependencies(ASpreadSheetCell& cell);
+  //! \brief Evaluate a cell of the topological queue or continue a
+  //! suspended formulae.
+  std::pair<bool, std::string> evaluateNextCell(SimForth &forth, ASpreadSheetCell*& cell);
+  //! \brief Index of the cell in arrays of dependencies.
+  size_t slot(ASpreadSheetCell const& cell) const;
 
   inline void clearQueue(std::queue<ASpreadSheetCell*> &q)
   {
@@ -68,9 +167,60 @@ private:
     std::swap(q, empty);
   }
 
-  //using hashCell = std::map<std::string, ASpreadSheetCell*>;
-  std::map<std::string, std::map<std::string, ASpreadSheetCell*>> m_dependencies;
+  //! Cells of the spreadsheet (filled by buildDependencies()).
+  std::vector<ASpreadSheetCell*> m_cells;
+  //! Values of cells read by ASpreadSheetCell::value().
+  CellValues m_values;
+  //! Smallest key of cells: cells are indexed by their key minus it.
+  Key m_firstKey;
+  //! Reverse dependencies as CSR arrays: cells referencing the cell
+  //! indexed k are m_dependents[m_depOffsets[k] .. m_depOffsets[k + 1]].
+  std::vector<uint32_t> m_depOffsets;
+  std::vector<ASpreadSheetCell*> m_dependents;
+  //! Strongly connected components of the graph of references
+  //! having a cycle (filled by buildDependencies()).
+  std::vector<std::vector<ASpreadSheetCell*>> m_cycles;
+  //! A formulae has changed since buildDependencies().
+  bool m_dependenciesStale;
   std::queue<ASpreadSheetCell*> m_topologicalList;
+  //! Cells modified since the last evaluation.
+  std::vector<ASpreadSheetCell*> m_dirty;
+  //! Budget of a formulae before being suspended (no limit by default).
+  ForthBudget m_budget;
+  //! Number of times a formulae can be suspended before being
+  //! aborted (0: no limit).
+  uint32_t m_maxSuspensions;
+  //! Formulae suspended, continued when the topological queue is empty.
+  std::deque<std::pair<ASpreadSheetCell*, ForthContinuation>> m_suspended;
+  //! Cells whose formulae have been suspended.
+  std::vector<ASpreadSheetCell*> m_suspendedCells;
+  //! Names of cells already resolved by reference().
+  std::unordered_map<std::string, ASpreadSheetCell*> m_names;
+  //! Values of cells at the previous and the current step (indexed
+  //! like m_depOffsets). Only values which changed are written.
+  std::vector<Cell32> m_stepValues[2];
+  std::vector<Float64> m_stepFloats[2];
+  //! Index of the buffer of the current step.
+  uint32_t m_current = 0u;
+  //! Smallest key of cells when the buffers were allocated.
+  Key m_stepFirstKey = 0;
+  //! Cells in topological order (filled by initSteps()).
+  std::vector<ASpreadSheetCell*> m_order;
+  //! Reverse dependencies on previous values as CSR arrays (see
+  //! m_depOffsets).
+  std::vector<uint32_t> m_prevOffsets;
+  std::vector<ASpreadSheetCell*> m_prevDependents;
+  //! Cells whose value changed during the last step.
+  std::vector<ASpreadSheetCell*> m_changed;
+  //! Cells to evaluate during the current step.
+  std::vector<bool> m_stepDirty;
+  //! The next step evaluates all cells.
+  bool m_restart = true;
+  //! Dependencies have been rebuilt since initSteps().
+  bool m_stepsStale = true;
+  SimulationStats m_stats;
+  //! Has the whole spreadsheet been evaluated with success ?
+  bool m_evaluated;
 };
 
 #endif /* SIMTADYN_SPREADSHEET_HPP_ */
@@ -20,16 +20,66 @@
 
 #include "ASpreadSheetCell.hpp"
 
+ASpreadSheetCell::ASpreadSheetCell(ASpreadSheetCell const& other)
+  : m_values(nullptr),
+    m_index(0)
+{
+  *this = other;
+}
+
+ASpreadSheetCell& ASpreadSheetCell::operator=(ASpreadSheetCell const& other)
+{
+  if (this == &other)
+    return *this;
+
+  m_formulae = other.m_formulae;
+  m_parsed = other.m_parsed;
+  m_references = other.m_references;
+  m_previousReferences = other.m_previousReferences;
+  m_unresolvedRefs = other.m_unresolvedRefs;
+  m_token = other.m_token;
+  m_compiled = other.m_compiled;
+  m_dataKey = other.m_dataKey;
+
+  if ((nullptr != other.m_values) && (other.m_values == other.m_detached.get()))
+    {
+      bindDetached();
+      m_values->copy(0, *other.m_values, 0);
+    }
+  else
+    {
+      m_values = other.m_values;
+      m_index = other.m_index;
+      m_detached.reset();
+    }
+  return *this;
+}
+
 void ASpreadSheetCell::update()
 {
   SimForth::instance().interpreteCell(*this);
 }
 
+void ASpreadSheetCell::bindDetached()
+{
+  if (nullptr == m_detached)
+    {
+      m_detached.reset(new CellValues(0, 1u));
+    }
+  m_values = m_detached.get();
+  m_index = 0;
+}
+
 //FIXME
 void ASpreadSheetCell::parse()
 {
+  // References are kept until the formulae is modified
+  if (m_parsed)
+    return ;
+
   m_references.clear();
-  SimForth::instance().parseCell(*this);
+  m_previousReferences.clear();
+  m_parsed = SimForth::instance().parseCell(*this);
   m_unresolvedRefs = m_references.size();
 }
 
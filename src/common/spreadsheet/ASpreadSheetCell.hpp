@@ -23,8 +23,12 @@
 
 #  include "Logger.hpp"
 #  include "SimTaDynForth.hpp"
+#  include "ForthHelper.hpp"
 #  include "ClassCounter.tpp"
+#  include "CellValues.hpp"
 #  include <vector>
+#  include <algorithm>
+#  include <memory>
 
 // **************************************************************
 //! \brief Define an Excel-like spreadsheet cell.
@@ -38,16 +42,28 @@ public:
   //-------------------------------------------------------------
   ASpreadSheetCell(std::string const& formulae)
     : m_formulae(formulae),
-      m_evaluatedValue(0),
-      m_evaluated(false),
+      m_values(nullptr),
+      m_index(0),
+      m_parsed(false),
       m_unresolvedRefs(0),
+      m_token(0),
+      m_compiled(false),
       m_dataKey(0)
   {
     // parse(); // Risque de crash si la cellule n'est pas encore connue
   }
 
   //-------------------------------------------------------------
-  //! \brief
+  //! \brief Copy the cell. A copy shares the columns of the
+  //! spreadsheet of the original cell but not the storage of a cell
+  //! evaluated outside a spreadsheet.
+  //-------------------------------------------------------------
+  ASpreadSheetCell(ASpreadSheetCell const& other);
+  ASpreadSheetCell& operator=(ASpreadSheetCell const& other);
+
+  //-------------------------------------------------------------
+  //! \brief The Forth word of the cell is given back by its
+  //! spreadsheet (see ASpreadSheet::forgetCells()).
   //-------------------------------------------------------------
   virtual ~ASpreadSheetCell()
   {
@@ -60,6 +76,8 @@ public:
   {
     //m_modified = true;
     m_formulae = formulae;
+    m_compiled = false;
+    m_parsed = false;
     parse();
   }
 
@@ -93,14 +111,103 @@ public:
   void addReference(ASpreadSheetCell& cell)
   {
     //cell.addObserver(this);
-    m_references.push_back(&cell);
+    // A cell referenced several times is a single dependency
+    if (std::find(m_references.begin(), m_references.end(), &cell) == m_references.end())
+      {
+        m_references.push_back(&cell);
+      }
+  }
+
+  //-------------------------------------------------------------
+  //! \brief Cells whose value at the previous step of the
+  //! simulation is read by the formulae (references prefixed by P:).
+  //! They are not dependencies of the cell.
+  //-------------------------------------------------------------
+  inline const std::vector<ASpreadSheetCell *> &previousReferences() const
+  {
+    return m_previousReferences;
+  }
+
+  void addPreviousReference(ASpreadSheetCell& cell)
+  {
+    if (std::find(m_previousReferences.begin(), m_previousReferences.end(), &cell)
+        == m_previousReferences.end())
+      {
+        m_previousReferences.push_back(&cell);
+      }
   }
 
   void reset()
   {
-    m_evaluatedValue = 0;
-    m_evaluated = false;
+    if (nullptr != m_values)
+      m_values->reset(m_index);
+    m_parsed = false;
     m_references.clear();
+    m_previousReferences.clear();
+    m_compiled = false;
+  }
+
+  //-------------------------------------------------------------
+  //! \brief Return the token of the Forth word compiled from the
+  //! formulae. 0 if the formulae is not yet compiled.
+  //-------------------------------------------------------------
+  inline Cell16 token() const
+  {
+    return m_compiled ? m_token : 0;
+  }
+
+  inline void token(const Cell16 token)
+  {
+    m_token = token;
+    m_compiled = (0 != token);
+  }
+
+  //-------------------------------------------------------------
+  //! \brief Return the token of the hidden Forth word owned by the
+  //! cell, even if it was compiled from a previous formulae (the
+  //! word is then compiled again in place), else 0.
+  //-------------------------------------------------------------
+  inline Cell16 word() const
+  {
+    return m_token;
+  }
+
+  //-------------------------------------------------------------
+  //! \brief Store the value of the cell in the columns of its
+  //! spreadsheet. The value already held by the cell is not copied:
+  //! ASpreadSheet fills the columns before binding cells.
+  //-------------------------------------------------------------
+  inline void bind(CellValues& values, const uint32_t index)
+  {
+    m_values = &values;
+    m_index = index;
+    m_detached.reset();
+  }
+
+  //-------------------------------------------------------------
+  //! \brief The cell leaves its spreadsheet (whose columns will be
+  //! released): its value is forgotten.
+  //-------------------------------------------------------------
+  inline void unbind()
+  {
+    m_values = nullptr;
+    m_index = 0;
+    m_detached.reset();
+  }
+
+  //-------------------------------------------------------------
+  //! \brief Columns holding the value of the cell and its index
+  //! inside them (nullptr if the cell has never been evaluated nor
+  //! attached to a spreadsheet).
+  //-------------------------------------------------------------
+  inline CellValues const* values() const
+  {
+    return m_values;
+  }
+
+  inline uint32_t index() const
+  {
+    return m_index;
   }
 
   //-------------------------------------------------------------
@@ -108,17 +215,37 @@ public:
   //-------------------------------------------------------------
   inline int32_t rawValue() const
   {
-    return m_evaluatedValue;
+    return (nullptr == m_values) ? 0 : m_values->value(m_index);
   }
 
-  inline int32_t& rawValue()
+  //-------------------------------------------------------------
+  //! \brief Return the integer view of the value (truncated when
+  //! the formulae left a floating point number).
+  //-------------------------------------------------------------
+  inline std::pair<bool, int32_t> value() const
   {
-    return m_evaluatedValue;
+    if (nullptr == m_values)
+      return std::make_pair(false, 0);
+    return std::make_pair(m_values->evaluated(m_index), m_values->value(m_index));
   }
 
-  inline std::pair<bool, int32_t> value() const
+  //-------------------------------------------------------------
+  //! \brief Return the floating point view of the value.
+  //-------------------------------------------------------------
+  inline std::pair<bool, Float64> fvalue() const
   {
-    return std::make_pair(m_evaluated, m_evaluatedValue);
+    if (nullptr == m_values)
+      return std::make_pair(false, 0.0);
+    return std::make_pair(m_values->evaluated(m_index), m_values->fvalue(m_index));
+  }
+
+  //-------------------------------------------------------------
+  //! \brief Return true if the formulae left a floating point
+  //! number on the float stack.
+  //-------------------------------------------------------------
+  inline bool isFloat() const
+  {
+    return (nullptr != m_values) && m_values->isFloat(m_index);
   }
 
   inline std::string& formulae()
@@ -128,8 +255,18 @@ public:
 
   void value(const int32_t val)
   {
-    m_evaluatedValue = val;
-    m_evaluated = true;
+    if (nullptr == m_values)
+      bindDetached();
+    m_values->set(m_index, val);
+    //setChanged();
+    //notifyObservers();
+  }
+
+  void value(const Float64 val)
+  {
+    if (nullptr == m_values)
+      bindDetached();
+    m_values->set(m_index, val);
     //setChanged();
     //notifyObservers();
   }
@@ -151,18 +288,37 @@ public: // FIXME private:
   void parse();
   //FIXME void parse(SimForth &forth);
 
+private:
+
+  //-------------------------------------------------------------
+  //! \brief Give its own storage to a cell evaluated outside a
+  //! spreadsheet.
+  //-------------------------------------------------------------
+  void bindDetached();
+
 private:
 
   std::string              m_formulae;
-  int32_t                  m_evaluatedValue;
-  bool                     m_evaluated;
+  //! Columns holding the value of the cell (owned by the spreadsheet).
+  CellValues              *m_values;
+  //! Index of the cell in m_values.
+  uint32_t                 m_index;
+  //! Storage of the value when the cell is not in a spreadsheet.
+  std::unique_ptr<CellValues> m_detached;
+  //! References are up to date with the formulae.
+  bool                     m_parsed;
   std::vector<ASpreadSheetCell *> m_references;
+  std::vector<ASpreadSheetCell *> m_previousReferences;
 
 public:
   size_t                 m_unresolvedRefs;
 
 protected:
 
+  //! \brief Token of the hidden Forth word compiled from the formulae.
+  Cell16 m_token;
+  //! \brief The word is compiled from the current formulae.
+  bool m_compiled;
   // TODO: for the moment we managed a single interger value
   //! \brief Key to database
   Key m_dataKey;
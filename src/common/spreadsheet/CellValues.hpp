@@ -0,0 +1,186 @@
+//=====================================================================
+// SimTaDyn: A GIS in a spreadsheet.
+// Copyright 2018 Quentin Quadrat <lecrapouille@gmail.com>
+//
+// This file is part of SimTaDyn.
+//
+// SimTaDyn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SimTaDyn.  If not, see <http://www.gnu.org/licenses/>.
+//=====================================================================
+
+#ifndef CELLVALUES_HPP_
+#  define CELLVALUES_HPP_
+
+#  include "ForthHelper.hpp"
+#  include "ClassCounter.tpp"
+#  include <vector>
+
+// **************************************************************
+//! \brief Values of the cells of a spreadsheet stored as columns
+//! (one array per attribute) indexed by the key of the cell minus
+//! the smallest key. Bulk reads, reductions and uploads to the GPU
+//! walk contiguous memory instead of cells scattered in the heap.
+//!
+//! Flags are stored as bytes and not as std::vector<bool> because
+//! cells are evaluated concurrently by ASpreadSheet::evaluateParallel().
+// **************************************************************
+class CellValues
+{
+public:
+
+  CellValues()
+    : m_firstKey(0)
+  {
+  }
+
+  CellValues(const Key first, const size_t count)
+    : m_firstKey(first),
+      m_values(count, 0),
+      m_floats(count, 0.0),
+      m_evaluated(count, 0u),
+      m_isFloat(count, 0u)
+  {
+  }
+
+  //-------------------------------------------------------------
+  //! \brief Release the columns.
+  //-------------------------------------------------------------
+  void clear()
+  {
+    *this = CellValues();
+  }
+
+  inline size_t size() const
+  {
+    return m_values.size();
+  }
+
+  //-------------------------------------------------------------
+  //! \brief Index of the cell of the given key.
+  //-------------------------------------------------------------
+  inline uint32_t index(const Key key) const
+  {
+    return static_cast<uint32_t>(key - m_firstKey);
+  }
+
+  inline Key firstKey() const
+  {
+    return m_firstKey;
+  }
+
+  inline void set(const uint32_t i, const int32_t val)
+  {
+    m_values[i] = val;
+    m_floats[i] = static_cast<Float64>(val);
+    m_isFloat[i] = 0u;
+    m_evaluated[i] = 1u;
+  }
+
+  inline void set(const uint32_t i, const Float64 val)
+  {
+    m_values[i] = static_cast<int32_t>(val);
+    m_floats[i] = val;
+    m_isFloat[i] = 1u;
+    m_evaluated[i] = 1u;
+  }
+
+  //-------------------------------------------------------------
+  //! \brief Copy the value of the cell j of another store.
+  //-------------------------------------------------------------
+  inline void copy(const uint32_t i, CellValues const& other, const uint32_t j)
+  {
+    m_values[i] = other.m_values[j];
+    m_floats[i] = other.m_floats[j];
+    m_isFloat[i] = other.m_isFloat[j];
+    m_evaluated[i] = other.m_evaluated[j];
+  }
+
+  //-------------------------------------------------------------
+  //! \brief Forget the value of the cell.
+  //-------------------------------------------------------------
+  inline void reset(const uint32_t i)
+  {
+    m_values[i] = 0;
+    m_floats[i] = 0.0;
+    m_isFloat[i] = 0u;
+    m_evaluated[i] = 0u;
+  }
+
+  inline int32_t value(const uint32_t i) const
+  {
+    return m_values[i];
+  }
+
+  inline Float64 fvalue(const uint32_t i) const
+  {
+    return m_floats[i];
+  }
+
+  inline bool evaluated(const uint32_t i) const
+  {
+    return 0u != m_evaluated[i];
+  }
+
+  inline bool isFloat(const uint32_t i) const
+  {
+    return 0u != m_isFloat[i];
+  }
+
+  //-------------------------------------------------------------
+  //! \brief Columns. Cells which are not evaluated hold 0.
+  //-------------------------------------------------------------
+  inline std::vector<int32_t> const& values() const
+  {
+    return m_values;
+  }
+
+  inline std::vector<Float64> const& floats() const
+  {
+    return m_floats;
+  }
+
+  inline std::vector<uint8_t> const& evaluated() const
+  {
+    return m_evaluated;
+  }
+
+  inline std::vector<uint8_t> const& isFloat() const
+  {
+    return m_isFloat;
+  }
+
+  //-------------------------------------------------------------
+  //! \brief Sum of the floating point view of evaluated cells.
+  //-------------------------------------------------------------
+  Float64 sum() const
+  {
+    Float64 res = 0.0;
+    const size_t n = m_floats.size();
+    for (size_t i = 0; i < n; ++i)
+      {
+        res += m_evaluated[i] ? m_floats[i] : 0.0;
+      }
+    return res;
+  }
+
+private:
+
+  //! Key of the cell stored at index 0.
+  Key m_firstKey;
+  std::vector<int32_t> m_values;
+  std::vector<Float64> m_floats;
+  std::vector<uint8_t> m_evaluated;
+  std::vector<uint8_t> m_isFloat;
+};
+
+#endif /* CELLVALUES_HPP_ */
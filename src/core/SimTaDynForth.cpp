@@ -21,6 +21,7 @@
 //#include "MapEditor.hpp"
 #include "SimTaDynForth.hpp"
 #include "PathManager.hpp"
+#include <algorithm>
 
 void SimForth::boot()
 {
@@ -28,18 +29,38 @@ void SimForth::boot()
 
   // Start the Forth core
   Forth::boot();
+  m_cell_words.assign(65536U, CellWord());
+  m_cell_words_full = false;
 
   // Add specialized words for SimTaDyn
   m_dictionary.add(SIMFORTH_PRIMITIVE_TOTO, FORTH_DICO_ENTRY("TOTO"), 0);
+  m_dictionary.add(SIMFORTH_PRIMITIVE_CELL_VALUE, FORTH_DICO_ENTRY("(CELL)"), 0);
+  m_dictionary.add(SIMFORTH_PRIMITIVE_FCELL_VALUE, FORTH_DICO_ENTRY("(FCELL)"), 0);
+  m_dictionary.add(SIMFORTH_PRIMITIVE_PCELL_VALUE, FORTH_DICO_ENTRY("(PCELL)"), 0);
+  m_dictionary.add(SIMFORTH_PRIMITIVE_PFCELL_VALUE, FORTH_DICO_ENTRY("(PFCELL)"), 0);
+  m_dictionary.smudge("(CELL)");
+  m_dictionary.smudge("(FCELL)");
+  m_dictionary.smudge("(PCELL)");
+  m_dictionary.smudge("(PFCELL)");
 
-  // Initialize basic Forth system
-  std::pair<bool, std::string> res
-    = Forth::interpreteFile(PathManager::instance().expand("forth/system.fs"));
+  // Initialize basic Forth system: restore the snapshot made by the
+  // previous boot if the system scripts and primitives did not change.
+  std::string const system = PathManager::instance().expand("forth/system.fs");
+  std::string const snapshot = config::tmp_path + "SimForth.img";
+  const uint64_t checksum = snapshotChecksum({ system });
+  if (loadSnapshot(snapshot, checksum))
+    {
+      LOGI("Forth interpreter: restored from '%s'", snapshot.c_str());
+      return ;
+    }
+
+  std::pair<bool, std::string> res = Forth::interpreteFile(system);
   ok(res);
 
   if (res.first)
     {
       LOGI("Forth interpreter: %s", res.second.c_str());
+      saveSnapshot(snapshot, checksum);
     }
   else
     {
@@ -50,10 +71,205 @@ void SimForth::boot()
   // Forth::displayDictionary(m_color);
 }
 
-void SimForth::compileCell(ASpreadSheetCell &/*cell*/)
+// **************************************************************
+//! Compile the formulae of the cell as a hidden (smudged) Forth word
+//! in the dictionary. References to other cells are compiled as the
+//! primitive (CELL) (or (FCELL) for references prefixed by F:)
+//! followed by the index of the reference in the list returned by
+//! cell.references() (filled by parseCell()). References to values
+//! of the previous step (prefixed by P: or FP:) are compiled the
+//! same way with (PCELL) or (PFCELL) and cell.previousReferences(). The
+//! token is memorized by the cell and stays valid
+//! until the formulae is modified.
+//!
+//! When the formulae is modified the cell keeps its token and the
+//! new definition replaces the old one when it fits in its place,
+//! else it is appended to the dictionary. Spreadsheets release the
+//! tokens of their cells before destroying them (see releaseCell()).
+//! The table of tokens and the dictionary are thus not consumed by
+//! editing formulae.
+//! \return true if the cell has a compiled formulae. Else the
+//! formulae shall be interpreted.
+// **************************************************************
+bool SimForth::compileCell(ASpreadSheetCell &cell)
+{
+  if (0 != cell.token())
+    return true;
+
+  // Word of the previous formulae of the cell
+  Cell16 reused = cell.word();
+  if ((0U != reused) && (&cell != m_cell_words[reused].cell))
+    reused = 0U;
+  const Cell32 old_xt = (0U == reused) ? 0U : m_dictionary.xt(reused);
+
+  m_err_stream = 0;
+  STREAM.loadString(cell.formulae(), cell.name());
+  m_compiling_cell = &cell;
+
+  try
+    {
+      std::string const name = cell.name().substr(0, MASK_FORTH_NAME_SIZE);
+      create(name, reused);
+      const Cell16 token = m_creating_token;
+      const Cell32 xt = m_dictionary.here() - 2U;
+#if FORTH_JIT
+      if (0U != reused)
+        jitForget(reused);
+#endif
+      m_dictionary.xt(token, xt);
+      m_state = forth::Compile;
+      while (STREAM.hasMoreWords())
+        {
+          interpreteWord(STREAM.nextWord());
+        }
+
+      // Formulae changing the Forth state (comments, definitions)
+      // are not compiled.
+      if (forth::Compile != m_state)
+        {
+          UnfinishedStream e(m_state); throw e;
+        }
+      m_dictionary.appendCell16(FORTH_PRIMITIVE_EXIT);
+      m_state = forth::Interprete;
+#if FORTH_STACK_EFFECTS
+      analyzeStackEffect(token);
+#endif
+#if FORTH_BYTECODE
+      if (m_compact)
+        compactDefinition(token);
+#endif
+
+      const Cell32 size = m_dictionary.here() - xt - 2U;
+      if ((0U != reused) && (size <= m_cell_words[reused].size))
+        {
+          // Replace the old definition and forget the new entry
+          m_dictionary.move(old_xt + 2U, xt + 2U, size);
+          m_dictionary.xt(token, old_xt);
+          m_dictionary.truncate(m_last_at_colon, m_here_at_colon);
+        }
+      else
+        {
+          // Hide the word to the user
+          m_dictionary.smudge(name);
+          m_cell_words[token].size = size;
+        }
+      m_cell_words[token].cell = &cell;
+      cell.token(token);
+    }
+  catch (ForthException const& e)
+    {
+      if (0U != reused)
+        m_dictionary.xt(reused, old_xt);
+      m_dictionary.truncate(m_last_at_colon, m_here_at_colon);
+      m_state = forth::Interprete;
+
+      // The formulae will be interpreted but all cells compiled
+      // after it will be interpreted too.
+      if (nullptr != dynamic_cast<NoSpaceDictionary const*>(&e))
+        {
+          if (!m_cell_words_full)
+            {
+              LOGE("Cannot compile cell %s: %s. Formulae of new cells will be interpreted",
+                   cell.name().c_str(), e.message().c_str());
+            }
+          m_cell_words_full = true;
+        }
+      else
+        {
+          LOGD("Cannot compile cell %s: %s", cell.name().c_str(), e.message().c_str());
+        }
+    }
+
+  m_compiling_cell = nullptr;
+  return 0 != cell.token();
+}
+
+// **************************************************************
+//! The token of the word is given back to the dictionary which gives
+//! it to a next word (and forgets the definitions ending it).
+// **************************************************************
+void SimForth::releaseCell(ASpreadSheetCell const& cell)
+{
+  const Cell16 token = cell.word();
+  if ((m_cell_words.size() <= token) || (&cell != m_cell_words[token].cell))
+    return ;
+
+  m_cell_words[token] = CellWord();
+#if FORTH_JIT
+  jitForget(token);
+#endif
+  m_dictionary.release(token);
+  m_cell_words_full = false;
+}
+
+// **************************************************************
+//! Purity is proven when the formulae is compiled (see
+//! Forth::analyzeStackEffect).
+// **************************************************************
+bool SimForth::shareable(ASpreadSheetCell const& cell) const
+{
+  if (0 == cell.token())
+    return false;
+
+  ForthWordEffect const& e = m_dictionary.effect(cell.token());
+  return e.valid && e.pure;
+}
+
+// **************************************************************
+//! Called by the primitives (CELL) and (FCELL) when executing a
+//! compiled formulae.
+//! \param nth the index of the reference.
+//! \return the referenced cell.
+//! \throw AbortForth if the referenced cell is not yet evaluated.
+// **************************************************************
+ASpreadSheetCell const& SimForth::referencedCell(const Cell16 nth)
+{
+  if ((nullptr == m_current_cell) || (nth >= m_current_cell->references().size()))
+    {
+      abort("Cell reference outside a cell formulae");
+    }
+
+  ASpreadSheetCell const& cell = *(m_current_cell->references()[nth]);
+  if (!cell.value().first)
+    {
+      abort("Cell not yet evaluated");
+    }
+  return cell;
+}
+
+// **************************************************************
+//! Called by the primitives (PCELL) and (PFCELL) when executing a
+//! compiled formulae.
+//! \param nth the index of the reference.
+//! \return the referenced cell.
+// **************************************************************
+ASpreadSheetCell const& SimForth::previousCell(const Cell16 nth)
 {
-  // Compile and add into the dictionary
-  // forth.compile(cell.name(), cell.formulae());
+  if ((nullptr == m_current_cell) || (nth >= m_current_cell->previousReferences().size()))
+    {
+      abort("Cell reference outside a cell formulae");
+    }
+  return *(m_current_cell->previousReferences()[nth]);
+}
+
+Cell32 SimForth::referencedCellValue(const Cell16 nth)
+{
+  return referencedCell(nth).value().second;
+}
+
+Float64 SimForth::referencedCellFloat(const Cell16 nth)
+{
+  return referencedCell(nth).fvalue().second;
+}
+
+Cell32 SimForth::previousCellValue(const Cell16 nth)
+{
+  return m_spreadsheet->previousValue(previousCell(nth));
+}
+
+Float64 SimForth::previousCellFloat(const Cell16 nth)
+{
+  return m_spreadsheet->previousFloat(previousCell(nth));
 }
 
 void SimForth::evaluate(ASpreadSheet& spreadsheet)
@@ -73,18 +289,70 @@ void SimForth::evaluate(ASpreadSheet& spreadsheet)
 std::pair<bool, std::string>
 SimForth::interpreteCell(ASpreadSheetCell &cell)
 {
-  m_err_stream = 0;
-  STREAM.loadString(cell.formulae(), cell.name());
+  ForthContinuation k;
+  return interpreteCell(cell, ForthBudget(), k);
+}
 
+// **************************************************************
+//! When the compiled formulae exhausts its budget, its execution is
+//! saved in k (k.suspended is true), the cell gets no value and
+//! the evaluation shall be continued by calling again this method
+//! with k. Formulae which cannot be compiled are interpreted without
+//! budget.
+// **************************************************************
+std::pair<bool, std::string>
+SimForth::interpreteCell(ASpreadSheetCell &cell, ForthBudget const& budget, ForthContinuation& k)
+{
   Cell32 value;
-  std::pair<bool, std::string> res = parseStream();
+  const int32_t fdepth = stackDepth(forth::FloatStack);
+  std::pair<bool, std::string> res;
+
+  if ((k.suspended) || (compileCell(cell)))
+    {
+      // Execute the compiled formulae
+      m_current_cell = &cell;
+      try
+        {
+          bool done = k.suspended
+            ? resume(budget, k)
+            : run(cell.token(), budget, k);
+          m_current_cell = nullptr;
+          if (!done)
+            {
+              return std::make_pair(true, "suspended");
+            }
+          res = std::make_pair(true, "ok");
+        }
+      catch (ForthException const& e)
+        {
+          res = std::make_pair(false, e.message());
+        }
+      m_current_cell = nullptr;
+    }
+  else
+    {
+      // Formulae which cannot be compiled are interpreted
+      m_err_stream = 0;
+      STREAM.loadString(cell.formulae(), cell.name());
+      res = parseStream();
+    }
+
   if (true == res.first)
     {
       try
         {
-          DPOP(value);
-          isStackUnderOverFlow(forth::DataStack);
-          cell.value(value);
+          // A formulae leaving a float returns a double-typed value
+          if (stackDepth(forth::FloatStack) > fdepth)
+            {
+              cell.value(FDROP());
+              value = cell.value().second;
+            }
+          else
+            {
+              DPOP(value);
+              isStackUnderOverFlow(forth::DataStack);
+              cell.value(static_cast<int32_t>(value));
+            }
         }
       catch (ForthException const& e)
         {
@@ -92,21 +360,177 @@ SimForth::interpreteCell(ASpreadSheetCell &cell)
         }
     }
 
-  std::cout << "interpretCell '" << cell.formulae() << "': "
-            << res.second << std::endl;
+  LOGD("interpretCell '%s': %s", cell.formulae().c_str(), res.second.c_str());
   if (true == res.first)
     {
-      std::cout << "Result " << value << std::endl;
+      LOGD("Result %d", value);
     }
   return res;
 }
 
-bool SimForth::parseCell(ASpreadSheetCell &cell)
+// **************************************************************
+//! \param forth the Forth owning the dictionary and the C functions.
+// **************************************************************
+SimForthContext::SimForthContext(SimForth& forth)
+  : Forth(forth.dictionary())
 {
-  bool res = true;
-  std::string word;
-  ASpreadSheetCell *c;
+  m_readonly = true;
+  attach(forth);
+}
+
+// **************************************************************
+//! C functions have been loaded by the main interpreter (C-LIB or
+//! JIT) maybe after the creation of the context.
+// **************************************************************
+void SimForthContext::attach(SimForth& forth)
+{
+  abort();
+  m_base = forth.m_base;
+  m_spreadsheet = forth.m_spreadsheet;
+  if (m_dynamic_libs.m_functions.size() != forth.m_dynamic_libs.m_functions.size())
+    {
+      m_dynamic_libs.m_functions = forth.m_dynamic_libs.m_functions;
+    }
+}
+
+// **************************************************************
+//! \param nth the index of the reference.
+//! \return the referenced cell.
+//! \throw AbortForth if the referenced cell is not yet evaluated.
+// **************************************************************
+ASpreadSheetCell const& SimForthContext::referencedCell(const Cell16 nth)
+{
+  if ((nullptr == m_current_cell) || (nth >= m_current_cell->references().size()))
+    {
+      abort("Cell reference outside a cell formulae");
+    }
+
+  ASpreadSheetCell const& cell = *(m_current_cell->references()[nth]);
+  if (!cell.value().first)
+    {
+      abort("Cell not yet evaluated");
+    }
+  return cell;
+}
+
+ASpreadSheetCell const& SimForthContext::previousCell(const Cell16 nth)
+{
+  if ((nullptr == m_current_cell) || (nth >= m_current_cell->previousReferences().size()))
+    {
+      abort("Cell reference outside a cell formulae");
+    }
+  return *(m_current_cell->previousReferences()[nth]);
+}
+
+void SimForthContext::execPrimitive(const Cell16 idPrimitive)
+{
+  switch (idPrimitive)
+    {
+    case SIMFORTH_PRIMITIVE_CELL_VALUE:
+      DPUSH(m_tos);
+      m_ip += 2U; // Skip the index of the referenced cell
+      m_tos = referencedCell(m_dictionary.read16at(m_ip)).value().second;
+      break;
+    case SIMFORTH_PRIMITIVE_FCELL_VALUE:
+      checkFloatStack(0, 1);
+      m_ip += 2U; // Skip the index of the referenced cell
+      FPUSH(referencedCell(m_dictionary.read16at(m_ip)).fvalue().second);
+      break;
+    case SIMFORTH_PRIMITIVE_PCELL_VALUE:
+      DPUSH(m_tos);
+      m_ip += 2U; // Skip the index of the referenced cell
+      m_tos = m_spreadsheet->previousValue(previousCell(m_dictionary.read16at(m_ip)));
+      break;
+    case SIMFORTH_PRIMITIVE_PFCELL_VALUE:
+      checkFloatStack(0, 1);
+      m_ip += 2U; // Skip the index of the referenced cell
+      FPUSH(m_spreadsheet->previousFloat(previousCell(m_dictionary.read16at(m_ip))));
+      break;
+    default:
+      Forth::execPrimitive(idPrimitive);
+      break;
+    }
+}
+
+// **************************************************************
+//! Contrary to SimForth::interpreteCell() the formulae shall have
+//! been compiled and nothing is displayed.
+// **************************************************************
+std::pair<bool, std::string>
+SimForthContext::interpreteCell(ASpreadSheetCell &cell)
+{
+  if (0 == cell.token())
+    {
+      return std::make_pair(false, "Cell " + cell.name() + " is not compiled");
+    }
+  ForthWordEffect const& e = m_dictionary.effect(cell.token());
+  if (!(e.valid && e.pure))
+    {
+      return std::make_pair(false, SharedDictionaryStore(cell.name()).message());
+    }
+
+  m_current_cell = &cell;
+  try
+    {
+      const int32_t fdepth = stackDepth(forth::FloatStack);
+      Cell32 value;
+
+      execToken(cell.token());
+      if (stackDepth(forth::FloatStack) > fdepth)
+        {
+          cell.value(FDROP());
+        }
+      else
+        {
+          DPOP(value);
+          isStackUnderOverFlow(forth::DataStack);
+          cell.value(static_cast<int32_t>(value));
+        }
+    }
+  catch (ForthException const& e)
+    {
+      m_current_cell = nullptr;
+      abort();
+      return std::make_pair(false, e.message());
+    }
+  m_current_cell = nullptr;
+  return std::make_pair(true, "ok");
+}
+
+//! \brief Delimiters of words (same than ForthStream: " \t\n\v\f\r").
+static inline bool isDelimiter(const char c)
+{
+  return (' ' == c) || (('\t' <= c) && (c <= '\r'));
+}
+
+// **************************************************************
+//! References to cells can be prefixed by F: (floating point view
+//! of the value), P: (value at the previous step of the simulation,
+//! see ASpreadSheet::step()) or FP: (both).
+//! \return the length of the prefix of the word.
+// **************************************************************
+static size_t cellPrefix(const char *word, const size_t length, bool& real, bool& previous)
+{
+  real = (length > 2U) && ('F' == word[0]);
+  const size_t p = real ? 1U : 0U;
+  previous = (length > p + 2U) && ('P' == word[p]) && (':' == word[p + 1U]);
+  if (previous)
+    return p + 2U;
+  if (real && (':' == word[1]))
+    return 2U;
+  real = false;
+  return 0U;
+}
 
+// **************************************************************
+//! Extract references to cells in a single pass over the formulae:
+//! words are delimited as ForthStream does but without copying the
+//! formulae into the stream. Names are resolved by the spreadsheet
+//! which interns them (see ASpreadSheet::reference()). References
+//! are stored in the cell and are kept until the formulae changes.
+// **************************************************************
+bool SimForth::parseCell(ASpreadSheetCell &cell)
+{
   LOGD("parseCell %s: %s", cell.name().c_str(),
        cell.formulae().c_str());
 
@@ -117,41 +541,75 @@ bool SimForth::parseCell(ASpreadSheetCell &cell)
       return false;
     }
 
-  m_err_stream = 0;
-  STREAM.loadString(cell.formulae(), cell.name());
+  std::string const& formulae = cell.formulae();
+  const char *str = formulae.c_str();
+  const size_t size = formulae.size();
+  std::string word;
+  size_t i = 0;
 
-  try
+  while (i < size)
     {
-      while (STREAM.hasMoreWords())
+      // Skip delimiters then find the end of the word
+      while ((i < size) && isDelimiter(str[i]))
+        ++i;
+      size_t start = i;
+      while ((i < size) && !isDelimiter(str[i]))
+        ++i;
+      if (start == i)
+        break;
+
+      bool real, previous;
+      start += cellPrefix(str + start, i - start, real, previous);
+      word.assign(str + start, i - start);
+      ASpreadSheetCell *c = m_spreadsheet->reference(word);
+      if (nullptr == c)
+        continue;
+
+      if (previous)
         {
-          c = isACell(STREAM.nextWord());
-          if (nullptr != c)
-            {
-              cell.addReference(*c);
-            }
+          cell.addPreviousReference(*c);
+        }
+      else
+        {
+          cell.addReference(*c);
         }
-    }
-  catch (ForthException const& e)
-    {
-      cell.reset();
-      res = false;
     }
 
-  return res;
+  return true;
 }
 
 ASpreadSheetCell *SimForth::isACell(std::string const& word)
 {
   if (nullptr == m_spreadsheet)
     return nullptr;
-  return m_spreadsheet->isACell(word);
+  return m_spreadsheet->reference(word);
+}
+
+ASpreadSheetCell *SimForth::isAReference(std::string const& word, bool& real, bool& previous)
+{
+  const size_t prefix = cellPrefix(word.c_str(), word.size(), real, previous);
+  return isACell((0U == prefix) ? word : word.substr(prefix));
 }
 
 void SimForth::interpreteWordCaseInterprete(std::string const& word)
 {
-  ASpreadSheetCell *c;
+  bool real, previous;
+  ASpreadSheetCell *c = isAReference(word, real, previous);
 
-  if ((c = isACell(word)) != nullptr)
+  if ((nullptr != c) && (previous))
+    {
+      if (real)
+        {
+          checkFloatStack(0, 1);
+          FPUSH(m_spreadsheet->previousFloat(*c));
+        }
+      else
+        {
+          DPUSH(m_spreadsheet->previousValue(*c));
+          isStackUnderOverFlow(forth::DataStack);
+        }
+    }
+  else if ((nullptr != c) && (!real))
     {
       //std::cout << "interpreteWordCaseInterprete: cell " << word << std::endl;
       auto cell = c->value();
@@ -163,6 +621,16 @@ void SimForth::interpreteWordCaseInterprete(std::string const& word)
       DPUSH(number);
       isStackUnderOverFlow(forth::DataStack);
     }
+  else if (nullptr != c)
+    {
+      auto cell = c->fvalue();
+      if (!cell.first)
+        {
+          abort("Cell not yet evaluated");
+        }
+      checkFloatStack(0, 1);
+      FPUSH(cell.second);
+    }
   else
     {
       //std::cout << "interpreteWordCaseInterprete: forth " << word << std::endl;
@@ -172,12 +640,55 @@ void SimForth::interpreteWordCaseInterprete(std::string const& word)
 
 void SimForth::interpreteWordCaseCompile(std::string const& word)
 {
-  ASpreadSheetCell *c;
+  bool real, previous;
+  ASpreadSheetCell *c = isAReference(word, real, previous);
 
-  if ((c = isACell(word)) != nullptr)
+  if (nullptr != c)
     {
+      if (nullptr != m_compiling_cell)
+        {
+          // Compiling a cell formulae: the value of the referenced
+          // cell will be read when executing the formulae.
+          auto const& refs = previous
+            ? m_compiling_cell->previousReferences()
+            : m_compiling_cell->references();
+          auto it = std::find(refs.begin(), refs.end(), c);
+          if (refs.end() == it)
+            {
+              abort("Cell reference not found by parseCell");
+            }
+          if (previous)
+            {
+              m_dictionary.appendCell16(real ? SIMFORTH_PRIMITIVE_PFCELL_VALUE
+                                        : SIMFORTH_PRIMITIVE_PCELL_VALUE);
+            }
+          else
+            {
+              m_dictionary.appendCell16(real ? SIMFORTH_PRIMITIVE_FCELL_VALUE
+                                        : SIMFORTH_PRIMITIVE_CELL_VALUE);
+            }
+          m_dictionary.appendCell16(it - refs.begin());
+          return ;
+        }
+
+      if (real)
+        {
+          auto cell = previous
+            ? std::make_pair(true, m_spreadsheet->previousFloat(*c))
+            : c->fvalue();
+          if (!cell.first)
+            {
+              abort("Cell not yet evaluated");
+            }
+          m_dictionary.appendCell16(FORTH_PRIMITIVE_FLITERAL);
+          m_dictionary.appendFloat(cell.second);
+          return ;
+        }
+
       // FIXME: temporaire car on ne va pas que gerer la fonction cout
-      auto cell = c->value();
+      auto cell = previous
+        ? std::make_pair(true, static_cast<int32_t>(m_spreadsheet->previousValue(*c)))
+        : c->value();
       if (!cell.first)
         {
           abort("Cell not yet evaluated");
@@ -24,43 +24,125 @@
 #  include "ASpreadSheet.hpp"
 #  include "Forth.hpp"
 #  include "SimTaDynForthPrimitives.hpp"
+#  include "ForthContextPool.tpp"
 //#  include "Names.hpp"
 
 class ASpreadSheetCell;
 class ASpreadSheet;
+class SimForth;
+
+//! Cell formulae are compiled in the dictionary: reserve a larger
+//! dictionary than the default one (pages are allocated when used).
+#  ifndef SIMFORTH_DICTIONARY_SIZE
+#    define SIMFORTH_DICTIONARY_SIZE (16U * 1024U * 1024U) // of bytes
+#  endif
 
 class SimForthDictionary : public ForthDictionary
 {
 public:
 
-  SimForthDictionary()
-    : ForthDictionary()
+  SimForthDictionary(const uint32_t capacity = SIMFORTH_DICTIONARY_SIZE)
+    : ForthDictionary(capacity)
   {
     LOGI("Creating SimForthDictionary");
   }
 };
 
+// **************************************************************
+//! \brief A Forth context (stacks, registers) sharing the dictionary
+//! of SimForth. Used by worker threads for executing cell formulae
+//! already compiled by SimForth::compileCell(). The dictionary is
+//! only read (creating words throws ReadOnlyDictionary and words
+//! which may write in it throw SharedDictionaryStore), so several
+//! contexts can run concurrently as long as SimForth does not modify
+//! the dictionary in the meantime. Borrow them with
+//! SimForth::contexts().
+// **************************************************************
+class SimForthContext : public Forth
+{
+public:
+
+  SimForthContext(SimForth& forth);
+  //! \brief Reset the context and get the C functions of forth.
+  //! Called when the context is borrowed from the pool.
+  void attach(SimForth& forth);
+  //! \brief Execute the compiled formulae of the cell and store the
+  //! result in the cell.
+  std::pair<bool, std::string> interpreteCell(ASpreadSheetCell &cell);
+
+protected:
+
+  //! \brief Return the nth cell referenced by the cell currently
+  //! evaluated.
+  ASpreadSheetCell const& referencedCell(const Cell16 nth);
+  //! \brief Return the nth cell whose previous value is read by the
+  //! cell currently evaluated.
+  ASpreadSheetCell const& previousCell(const Cell16 nth);
+
+  virtual inline uint32_t maxPrimitives() const override
+  {
+    return SIMFORTH_MAX_PRIMITIVES;
+  }
+
+  virtual void execPrimitive(const Cell16 idPrimitive) override;
+
+  //! The cell currently evaluated.
+  ASpreadSheetCell *m_current_cell = nullptr;
+  //! The spreadsheet of SimForth when the context was borrowed.
+  ASpreadSheet *m_spreadsheet = nullptr;
+};
+
 class SimForth : public Forth, public Singleton<SimForth>
 {
   friend class Singleton<SimForth>;
+  friend class SimForthContext;
 
 public:
 
   ASpreadSheet *m_spreadsheet = nullptr;
 
   virtual void boot() override;
-  void compileCell(ASpreadSheetCell &cell);
+  bool compileCell(ASpreadSheetCell &cell);
+  //! \brief Called by the spreadsheet before destroying its cells:
+  //! the token of the Forth word of the cell is given back to the
+  //! dictionary.
+  void releaseCell(ASpreadSheetCell const& cell);
+  //! \brief Return true if the formulae of the cell is compiled and
+  //! does not write in the dictionary: a SimForthContext can
+  //! execute it.
+  bool shareable(ASpreadSheetCell const& cell) const;
   void evaluate(ASpreadSheet& spreadsheet);
   std::pair<bool, std::string>
   interpreteCell(ASpreadSheetCell &cell);
+  //! \brief Evaluate the formulae of the cell (or continue its
+  //! evaluation saved in k) within a budget.
+  std::pair<bool, std::string>
+  interpreteCell(ASpreadSheetCell &cell, ForthBudget const& budget, ForthContinuation& k);
   bool parseCell(ASpreadSheetCell &cell);
+  //! \brief Accessor. Return the pool of contexts sharing the dictionary.
+  inline ForthContextPool<SimForthContext, SimForth>& contexts()
+  {
+    return m_contexts;
+  }
 
 protected:
 
   ASpreadSheetCell *isACell(std::string const& word);
+  //! \brief Return the cell referenced by the word, maybe prefixed
+  //! by F: (floating point value), P: (value at the previous step)
+  //! or FP: (both), else nullptr.
+  ASpreadSheetCell *isAReference(std::string const& word, bool& real, bool& previous);
   virtual void interpreteWordCaseInterprete(std::string const& word) override;
   virtual void interpreteWordCaseCompile(std::string const& word) override;
   bool isACell(std::string const& word, Cell32& number);
+  ASpreadSheetCell const& referencedCell(const Cell16 nth);
+  //! \brief Return the nth cell whose previous value is read by the
+  //! cell currently evaluated.
+  ASpreadSheetCell const& previousCell(const Cell16 nth);
+  Cell32 referencedCellValue(const Cell16 nth);
+  Float64 referencedCellFloat(const Cell16 nth);
+  Cell32 previousCellValue(const Cell16 nth);
+  Float64 previousCellFloat(const Cell16 nth);
 
   virtual inline uint32_t maxPrimitives() const override
   {
@@ -74,12 +156,62 @@ protected:
       case SIMFORTH_PRIMITIVE_TOTO:
         std::cout << "TOTOTOTOTO\n";
         break;
+        // Push the value of the nth cell referenced by the cell
+        // currently evaluated.
+      case SIMFORTH_PRIMITIVE_CELL_VALUE:
+        DPUSH(m_tos);
+        m_ip += 2U; // Skip the index of the referenced cell
+        m_tos = referencedCellValue(m_dictionary.read16at(m_ip));
+        break;
+        // Same but push the floating point view of the value on the
+        // float stack.
+      case SIMFORTH_PRIMITIVE_FCELL_VALUE:
+        checkFloatStack(0, 1);
+        m_ip += 2U; // Skip the index of the referenced cell
+        FPUSH(referencedCellFloat(m_dictionary.read16at(m_ip)));
+        break;
+        // Same but push the value of the cell at the previous step
+        // of the simulation.
+      case SIMFORTH_PRIMITIVE_PCELL_VALUE:
+        DPUSH(m_tos);
+        m_ip += 2U; // Skip the index of the referenced cell
+        m_tos = previousCellValue(m_dictionary.read16at(m_ip));
+        break;
+      case SIMFORTH_PRIMITIVE_PFCELL_VALUE:
+        checkFloatStack(0, 1);
+        m_ip += 2U; // Skip the index of the referenced cell
+        FPUSH(previousCellFloat(m_dictionary.read16at(m_ip)));
+        break;
       default:
         Forth::execPrimitive(idPrimitive);
         break;
       }
   }
 
+  virtual uint32_t operands(const Cell16 token) const override
+  {
+    return ((SIMFORTH_PRIMITIVE_CELL_VALUE <= token) &&
+            (SIMFORTH_PRIMITIVE_PFCELL_VALUE >= token))
+      ? 1U : Forth::operands(token);
+  }
+
+  virtual bool stackEffect(const Cell16 token, ForthStackEffect& effect) const override
+  {
+    if ((SIMFORTH_PRIMITIVE_CELL_VALUE == token) ||
+        (SIMFORTH_PRIMITIVE_PCELL_VALUE == token))
+      {
+        effect = { 0, 1, 0, 0 };
+        return true;
+      }
+    if ((SIMFORTH_PRIMITIVE_FCELL_VALUE == token) ||
+        (SIMFORTH_PRIMITIVE_PFCELL_VALUE == token))
+      {
+        effect = { 0, 0, 0, 0 };
+        return true;
+      }
+    return Forth::stackEffect(token, effect);
+  }
+
 private:
 
   SimForth()
@@ -96,6 +228,25 @@ private:
 protected:
 
   SimForthDictionary m_dictionaries;
+  //! The cell currently evaluated by its compiled formulae.
+  ASpreadSheetCell *m_current_cell = nullptr;
+  //! The cell currently compiled.
+  ASpreadSheetCell *m_compiling_cell = nullptr;
+  //! Contexts executing compiled definitions concurrently.
+  ForthContextPool<SimForthContext, SimForth> m_contexts{ *this };
+  //! \brief Hidden word compiled from the formulae of a cell.
+  struct CellWord
+  {
+    //! The cell owning the word (nullptr once the cell is destroyed).
+    ASpreadSheetCell const *cell = nullptr;
+    //! Number of bytes of the definition (0 if not a cell word).
+    Cell32 size = 0U;
+  };
+  //! Words of cells indexed by their token (filled by compileCell()).
+  std::vector<CellWord> m_cell_words;
+  //! The last failure of compileCell() was a full dictionary (only
+  //! reported once until a word is released).
+  bool m_cell_words_full = false;
 };
 
 #endif /* SIMFORTH_HPP_ */
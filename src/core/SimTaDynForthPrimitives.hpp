@@ -26,6 +26,10 @@
 enum SimForthPrimitives
   {
     SIMFORTH_PRIMITIVE_TOTO = FORTH_MAX_PRIMITIVES,
+    SIMFORTH_PRIMITIVE_CELL_VALUE,
+    SIMFORTH_PRIMITIVE_FCELL_VALUE,
+    SIMFORTH_PRIMITIVE_PCELL_VALUE,
+    SIMFORTH_PRIMITIVE_PFCELL_VALUE,
     SIMFORTH_MAX_PRIMITIVES
   };
 
@@ -107,11 +107,13 @@ public:
          this->name().c_str(), getID());
   }
 
-  //! \brief Destructor.
+  //! \brief Destructor. Forth words of cells are released before
+  //! the graph destroys them.
   ~SimTaDynSheet()
   {
     LOGI("Deleting SimTaDynSheet named '%s' with ID #%u\n",
          this->name().c_str(), getID());
+    forgetCells();
   }
 
   virtual const std::string& name() const override
@@ -19,140 +19,256 @@
 //=====================================================================
 
 #include "ClassicSpreadSheet.hpp"
-#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <string>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-ClassicSpreadSheet::~ClassicSpreadSheet()
+//! Minimal number of bytes of formulae read by a thread when
+//! loading a spreadsheet.
+#define CHUNK_MIN_SIZE (64U * 1024U)
+
+// **************************************************************
+//! \brief File mapped in memory in read-only mode.
+// **************************************************************
+class MappedFile
 {
-  for (size_t row = 0; row < m_row; ++row)
+public:
+
+  MappedFile(std::string const& filename)
+    : m_data(nullptr), m_size(0)
+  {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      return ;
+
+    struct stat st;
+    if ((0 == fstat(fd, &st)) && (st.st_size > 0))
+      {
+        void* memory = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED != memory)
+          {
+            // Chunks are read concurrently: prefetch the whole file
+            madvise(memory, st.st_size, MADV_WILLNEED);
+            m_data = static_cast<const char*>(memory);
+            m_size = st.st_size;
+          }
+      }
+    ::close(fd);
+  }
+
+  ~MappedFile()
+  {
+    if (nullptr != m_data)
+      {
+        munmap(const_cast<char*>(m_data), m_size);
+      }
+  }
+
+  //! nullptr if the file cannot be read or is empty.
+  const char *m_data;
+  size_t m_size;
+};
+
+//! \brief Read a positive number skipping spaces before it.
+static bool readNumber(const char*& p, const char* end, size_t& number)
+{
+  while ((p < end) && ((' ' == *p) || ('\t' == *p)))
+    ++p;
+
+  const char* start = p;
+  number = 0;
+  while ((p < end) && (*p >= '0') && (*p <= '9'))
     {
-      for (size_t col = 0; col < m_col; ++col)
-        {
-          delete m_cellMatrix[row][col];
-        }
+      number = number * 10U + *p - '0';
+      ++p;
     }
+  return p != start;
 }
 
-// Regular expression for an Excel cell name is: ([a-zA-Z]+)(\\d+)
-static bool regexpCell(std::string const& word)
+//! \brief Return the beginning of the line following the one
+//! containing p.
+static inline const char* nextLine(const char* p, const char* end)
 {
-  bool res = false;
-  size_t i = 0;
-
-  // Regexp: [a-zA-Z]+
-  while ((word[i] != '\0') && (word[i] >= 'A') && (word[i] <= 'Z'))
-    ++i;
+  const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+  return (nullptr == eol) ? end : eol + 1;
+}
 
-  // Regexp: \d+
-  if (i >= 1)
+//! \brief Run fn(0) .. fn(n - 1) on n threads.
+template<typename Function>
+static void parallelFor(const uint32_t n, Function const& fn)
+{
+  std::vector<std::thread> threads;
+  for (uint32_t i = 1; i < n; ++i)
     {
-      size_t j = i;
-      while ((word[i] != '\0') && (word[i] >= '0') && (word[i] <= '9'))
-        ++i;
-      res = ((i >= j + 1) && (word[i] == '\0'));
+      threads.emplace_back(fn, i);
     }
+  fn(0);
+  for (auto& thread: threads)
+    {
+      thread.join();
+    }
+}
 
-  return res;
+ClassicSpreadSheet::~ClassicSpreadSheet()
+{
+  clear();
 }
 
-ASpreadSheetCell *ClassicSpreadSheet::isACell(std::string const& word)
+void ClassicSpreadSheet::clear()
 {
-  //std::cerr << "isACell '" << word << "'" << std::endl;
+  if (nullptr == m_arena)
+    return ;
 
-  // Fast check
-  if (!regexpCell(word))
+  forgetCells();
+  for (size_t i = 0; i < m_row * m_col; ++i)
     {
-      //std::cerr << "KO1" << std::endl;
-      return nullptr;
+      m_arena[i].~CellNode();
     }
+  ::operator delete(m_arena);
+  m_arena = nullptr;
+  m_row = m_col = 0;
+}
 
+// **************************************************************
+//! Excel cell names match the regular expression ([A-Z]+)(\\d+).
+//! The word is checked and converted to the cell position in a
+//! single pass.
+// **************************************************************
+ASpreadSheetCell *ClassicSpreadSheet::isACell(std::string const& word)
+{
   size_t row = 0;
   size_t col = 0;
   size_t i = 0;
 
-  // Base 26
+  // Base 26: [A-Z]+
   while ((word[i] >= 'A') && (word[i] <= 'Z'))
     {
       row = row * 26U + word[i] - 'A' + 1;
       ++i;
     }
+  if (0 == i)
+    return nullptr;
 
-  // Base 10
-  while ((word[i] != '\0') && (word[i] >= '0') && (word[i] <= '9'))
+  // Base 10: \d+
+  const size_t j = i;
+  while ((word[i] >= '0') && (word[i] <= '9'))
     {
       col = col * 10U + word[i] - '0';
       ++i;
     }
+  if ((j == i) || (word[i] != '\0'))
+    return nullptr;
 
   --row;
   --col;
-  if ((row > m_row) || (col > m_col))
+  if ((row >= m_row) || (col >= m_col))
     {
       //std::cerr << "KO" << word << " while is a cell: " << row << ", " << col << std::endl;
       return nullptr;
     }
 
   //std::cout << "OK " << word << " is a cell: " << row << ", " << col << std::endl;
-  return m_cellMatrix[row][col];
-}
-
-ASpreadSheetCell* ClassicSpreadSheet::addCell(const size_t row,
-                                              const size_t col,
-                                              std::string const& formulae)
-{
-  //std::cerr << "new CellNode " << formulae << std::endl;
-  ASpreadSheetCell* node = new CellNode(formulae);
-  m_cellMatrix[row][col] = node;
-
-  // Parcequ'on utilise ASpreadSheetCell * au lieu de ID la cellule
-  // peut ne pas encore etre definie
-  // node->parse();
-  return node;
+  return cell(row, col);
 }
 
+// **************************************************************
+//! The file is mapped in memory and split in chunks of lines read
+//! by several threads. A first pass counts the lines of each chunk,
+//! giving the position of their first cell, then cells are built in
+//! place in a single array (row by row). Cells have consecutive
+//! keys as if they were created one by one. Missing lines give
+//! empty formulae, extra lines are ignored.
+// **************************************************************
 bool ClassicSpreadSheet::readInput(std::string const filename)
 {
   LOGD("Read file '%s'", filename.c_str());
-  std::ifstream infile(filename);
-  if (infile.fail())
+  MappedFile file(filename);
+  if (nullptr == file.m_data)
     {
       std::cerr << "Failed opening the file '" << filename
                 << "'" << std::endl;
       return false;
     }
-  std::string line;
+  const char* begin = file.m_data;
+  const char* end = file.m_data + file.m_size;
 
   // Get spreadsheet dimension array
-  std::getline(infile, line);
-  std::string::size_type sz;
-  m_col = std::stoi(line.c_str(), &sz, 10);
-  m_row = std::atoi(line.c_str() + sz);
-
-  // Resize the size of the spreadsheet
-  m_cellMatrix.resize(m_row);
-  for (size_t i = 0; i < m_row; ++i)
+  size_t cols, rows;
+  if ((!readNumber(begin, end, cols)) || (!readNumber(begin, end, rows)))
     {
-      m_cellMatrix[i].resize(m_col);
+      std::cerr << "Failed reading the dimension of the spreadsheet '"
+                << filename << "'" << std::endl;
+      return false;
     }
+  begin = nextLine(begin, end);
 
-  // Fill spreadsheet cells
-  for (size_t row = 0; row < m_row; ++row)
+  // Allocate the spreadsheet
+  if ((0 != cols) && (rows > SIZE_MAX / sizeof(CellNode) / cols))
     {
-      for (size_t col = 0; col < m_col; ++col)
-        {
-          try
-            {
-              std::getline(infile, line);
-            }
-          catch (std::exception const& e)
-            {
-              std::cerr << "Failed reading the file '" << filename
-                        << "'" << std::endl;
-              return false;
-            }
-          addCell(row, col, line); //si cellule pas trouvee => a parser plus tard
-        }
+      std::cerr << "Spreadsheet '" << filename << "' is too large"
+                << std::endl;
+      return false;
+    }
+  clear();
+  const size_t nb_cells = cols * rows;
+  m_arena = static_cast<CellNode*>(::operator new(nb_cells * sizeof(CellNode)));
+  const Key first_key = UniqueID<Node>::getID() + 1U;
+
+  // Split formulae in chunks starting at the beginning of a line
+  const size_t size = end - begin;
+  uint32_t nb_chunks = std::max(1u, std::thread::hardware_concurrency());
+  nb_chunks = static_cast<uint32_t>(std::min<size_t>(nb_chunks, 1U + size / CHUNK_MIN_SIZE));
+  std::vector<const char*> bounds(nb_chunks + 1U);
+  bounds[0] = begin;
+  bounds[nb_chunks] = end;
+  for (uint32_t c = 1; c < nb_chunks; ++c)
+    {
+      bounds[c] = std::max(bounds[c - 1], nextLine(begin + size * c / nb_chunks, end));
+    }
+
+  // Count lines of chunks: the index of the first cell of each chunk
+  std::vector<size_t> first(nb_chunks + 1U, 0);
+  parallelFor(nb_chunks, [&](uint32_t c)
+  {
+    size_t lines = 0;
+    for (const char* p = bounds[c]; p < bounds[c + 1]; p = nextLine(p, bounds[c + 1]))
+      ++lines;
+    first[c + 1] = lines;
+  });
+  for (uint32_t c = 1; c <= nb_chunks; ++c)
+    {
+      first[c] += first[c - 1];
+    }
+
+  // Build cells of chunks
+  parallelFor(nb_chunks, [&](uint32_t c)
+  {
+    size_t i = first[c];
+    const char* p = bounds[c];
+    while ((p < bounds[c + 1]) && (i < nb_cells))
+      {
+        const char* eol = nextLine(p, bounds[c + 1]);
+        size_t length = eol - p;
+        if ((length > 0) && ('\n' == p[length - 1]))
+          --length;
+        new (&m_arena[i]) CellNode(first_key + i, std::string(p, length));
+        p = eol;
+        ++i;
+      }
+  });
+  for (size_t i = std::min(first[nb_chunks], nb_cells); i < nb_cells; ++i)
+    {
+      new (&m_arena[i]) CellNode(first_key + i);
     }
+
+  m_col = cols;
+  m_row = rows;
   return true;
 }
 
@@ -163,7 +279,7 @@ void ClassicSpreadSheet::displayResult()
     {
       for (size_t col = 0; col < m_col; ++col)
         {
-          std::cout << m_cellMatrix[row][col]->rawValue() << "  ";
+          std::cout << cell(row, col)->rawValue() << "  ";
         }
       std::cout << std::endl;
     }
@@ -32,7 +32,7 @@ class ClassicSpreadSheet: public ASpreadSheet
 public:
 
   ClassicSpreadSheet(std::string const& name)
-    : ASpreadSheet(), m_name(name), m_row(0), m_col(0),
+    : ASpreadSheet(), m_name(name), m_arena(nullptr), m_row(0), m_col(0),
       m_itrow(0), m_itcol(0)
   {
   }
@@ -45,30 +45,32 @@ public:
   }
 
   virtual ASpreadSheetCell *isACell(std::string const& word) override;
+  //! \brief Load the spreadsheet from a file. The first line gives
+  //! the number of columns and rows, following lines give formulae
+  //! of cells row by row.
   bool readInput(std::string const filename);
   void displayResult();
 
-  std::vector<std::vector<ASpreadSheetCell*>> const&
-  cells() const
+  //! \brief Return the cell at the given position.
+  inline ASpreadSheetCell* cell(const size_t row, const size_t col) const
   {
-    return m_cellMatrix;
+    return &m_arena[row * m_col + col];
   }
 
   inline int rawValue(const size_t row, const size_t col) const
   {
-    return m_cellMatrix[row][col]->rawValue();
+    return cell(row, col)->rawValue();
   }
 
   inline  std::pair<bool, int32_t> value(const size_t row, const size_t col) const
   {
-    return m_cellMatrix[row][col]->value();
+    return cell(row, col)->value();
   }
 
 protected:
 
-  ASpreadSheetCell* addCell(const size_t row,
-                            const size_t col,
-                            std::string const& formulae);
+  //! \brief Destroy cells.
+  void clear();
 
   virtual void resetCellIterator() override
   {
@@ -83,7 +85,7 @@ protected:
 
   virtual ASpreadSheetCell* nextCell() /*const*/ override
   {
-    ASpreadSheetCell* cell = m_cellMatrix[m_itrow][m_itcol];
+    ASpreadSheetCell* cell = ClassicSpreadSheet::cell(m_itrow, m_itcol);
     //std::cout << "nextCell: " << cell->name() << ": '" << cell->formulae() << "'" << std::endl;
     ++m_itcol;
     if (m_itcol >= m_col)
@@ -104,7 +106,8 @@ protected:
 public:
 
   std::string m_name;
-  std::vector<std::vector<ASpreadSheetCell*>> m_cellMatrix;
+  //! Cells stored row by row in a single allocation.
+  CellNode *m_arena;
   size_t m_row;
   size_t m_col;
   mutable size_t m_itrow;
@@ -19,7 +19,9 @@
 //=====================================================================
 
 #include "Forth.hpp"
+#include <algorithm>
 #include <limits.h>
+#include <cstdlib>
 
 // **************************************************************
 //! Initialize the Forth interpretor context. The
@@ -45,6 +47,25 @@ Forth::Forth(ForthDictionary& dictionary)
   m_depth_at_colon = 0;
   m_last_at_colon = 0;
   m_here_at_colon = 0;
+  m_creating_token = 0;
+  m_readonly = false;
+#if FORTH_DIRECT_THREADING && FORTH_HAS_COMPUTED_GOTO
+  m_threaded_ready = false;
+#endif
+#if FORTH_JIT
+  m_jit_threshold = 0U;
+  m_jit_yielded = false;
+#endif
+#if FORTH_BYTECODE
+  m_compact = false;
+#endif
+  m_steps = 0U;
+  m_slice = UINT32_MAX;
+  m_ticks = UINT32_MAX;
+  m_exec_depth = 0U;
+  m_yield_depth = 0U;
+  m_yield_ip = FORTH_NO_IP;
+  m_yield_token = 0U;
 
   //
   abort();
@@ -60,8 +81,7 @@ void Forth::abort()
        (forth::Compile == m_saved_state)))
     {
       // Drop the Forth word not totaly compiled
-      m_dictionary.m_last = m_last_at_colon;
-      m_dictionary.m_here = m_here_at_colon;
+      m_dictionary.truncate(m_last_at_colon, m_here_at_colon);
     }
 
   m_ip = 0;
@@ -70,11 +90,19 @@ void Forth::abort()
   m_data_stack = m_data_stack_ + STACK_UNDERFLOW_MARGIN;
   m_alternative_stack = m_alternative_stack_ + STACK_UNDERFLOW_MARGIN;
   m_return_stack = m_return_stack_ + STACK_UNDERFLOW_MARGIN;
+  m_float_stack = m_float_stack_;
   m_dsp = m_data_stack;
   m_asp = m_alternative_stack;
   m_rsp = m_return_stack;
+  m_fsp = m_float_stack;
   m_opened_streams = 0;
   m_trace = false;
+  m_yielded = false;
+  m_resuming = false;
+#if FORTH_JIT
+  m_jit_yielded = false;
+#endif
+  m_profiler.unwind();
 }
 
 // **************************************************************
@@ -131,6 +159,17 @@ void Forth::displayStack(std::ostream& stream, const forth::StackID id) const
   int32_t depth;
   Cell32 *ptr;
 
+  // Floating point numbers are always displayed in decimal
+  if (forth::FloatStack == id)
+    {
+      for (const Float64* f = m_float_stack; f < m_fsp; ++f)
+        {
+          stream << *f << ' ';
+        }
+      stream << std::endl;
+      return ;
+    }
+
   switch (id)
     {
     case forth::DataStack:
@@ -166,9 +205,25 @@ void Forth::displayStack(std::ostream& stream, const forth::StackID id) const
 
 // **************************************************************
 //! \param word the Forth name to store in the dictionary.
+//! \throw ReadOnlyDictionary if the dictionary is shared by contexts.
 // **************************************************************
 void Forth::create(std::string const& word)
 {
+  create(word, 0U);
+}
+
+// **************************************************************
+//! \param word the Forth name to store in the dictionary.
+//! \param token the token of the entry, 0 for a new one.
+//! \throw ReadOnlyDictionary if the dictionary is shared by contexts.
+// **************************************************************
+void Forth::create(std::string const& word, const Cell16 token)
+{
+  if (m_readonly)
+    {
+      ReadOnlyDictionary e(word); throw e;
+    }
+
   if (m_dictionary.exists(word))
     {
       std::cout << FORTH_WARNING_COLOR << "[WARNING] Redefining '" << word << "'"
@@ -189,8 +244,243 @@ void Forth::create(std::string const& word)
   m_depth_at_colon = stackDepth(forth::DataStack);
 
   // Add it in the dictionary
-  Cell16 token = m_dictionary.here() + word.size() + 3U; // 3U: flags + NFA
-  m_dictionary.add(token, word, 0);
+  if (0U == token)
+    {
+      m_creating_token = m_dictionary.add(word, false);
+    }
+  else
+    {
+      m_dictionary.add(token, word, false);
+      m_creating_token = token;
+    }
+  // Not yet analyzed (recursive calls are unbounded)
+  m_dictionary.effect(m_creating_token, ForthWordEffect());
+}
+
+// **************************************************************
+//! Needed for walking a definition token by token.
+//! \param token the token of a primitive.
+// **************************************************************
+uint32_t Forth::operands(const Cell16 token) const
+{
+  switch (token)
+    {
+    case FORTH_PRIMITIVE_LITERAL_16:
+    case FORTH_PRIMITIVE_BRANCH:
+    case FORTH_PRIMITIVE_0BRANCH:
+    case FORTH_PRIMITIVE_COMPILE:
+    case FORTH_PRIMITIVE_EXEC_C_FUNC:
+    case FORTH_PRIMITIVE_EXEC_C_BATCH:
+    case FORTH_PRIMITIVE_DUP_TO_RSTACK:
+    case FORTH_PRIMITIVE_FROM_RSTACK_1PLUS:
+      return 1U;
+    case FORTH_PRIMITIVE_LITERAL_32:
+    case FORTH_PRIMITIVE_LITERAL_16_PLUS:
+    case FORTH_PRIMITIVE_0EQUAL_0BRANCH:
+      return 2U;
+    case FORTH_PRIMITIVE_FLITERAL:
+      return 4U;
+    default:
+      return 0U;
+    }
+}
+
+// **************************************************************
+//! Only the first token of a sequence is replaced: next tokens
+//! are kept and skipped by the superinstruction. So the definition
+//! keeps its size, branch offsets are still valid and a branch
+//! landing inside a fused sequence still executes the correct
+//! tokens. Use the words PROFILE-SEQUENCES and .SEQUENCES for
+//! finding new sequences to fuse.
+//! \param from the address of the first token of the definition.
+//! \param to the address after the last token of the definition.
+// **************************************************************
+void Forth::fuseSuperInstructions(const Cell32 from, const Cell32 to)
+{
+  uint32_t ip = from;
+
+  while (ip + 2U < to)
+    {
+      const Cell16 token = m_dictionary.read16at(ip);
+      const Cell16 next = m_dictionary.read16at(ip + 2U);
+
+      switch (token)
+        {
+        case FORTH_PRIMITIVE_DUP:
+          if (FORTH_PRIMITIVE_TO_RSTACK == next)
+            m_dictionary.write16at(ip, FORTH_PRIMITIVE_DUP_TO_RSTACK);
+          break;
+        case FORTH_PRIMITIVE_FROM_RSTACK:
+          if (FORTH_PRIMITIVE_1PLUS == next)
+            m_dictionary.write16at(ip, FORTH_PRIMITIVE_FROM_RSTACK_1PLUS);
+          break;
+        case FORTH_PRIMITIVE_0EQUAL:
+          if (FORTH_PRIMITIVE_0BRANCH == next)
+            m_dictionary.write16at(ip, FORTH_PRIMITIVE_0EQUAL_0BRANCH);
+          break;
+        case FORTH_PRIMITIVE_LITERAL_16:
+          if ((ip + 4U < to) &&
+              (FORTH_PRIMITIVE_PLUS == m_dictionary.read16at(ip + 4U)))
+            m_dictionary.write16at(ip, FORTH_PRIMITIVE_LITERAL_16_PLUS);
+          break;
+        default:
+          break;
+        }
+
+      // Do not read operands as tokens (fused tokens are operands
+      // of the superinstruction).
+      ip += 2U * (1U + operands(m_dictionary.read16at(ip)));
+    }
+}
+
+// **************************************************************
+//! Derived classes add the effect of their own primitives.
+// **************************************************************
+bool Forth::stackEffect(const Cell16 token, ForthStackEffect& effect) const
+{
+  return forthPrimitiveEffect(token, effect);
+}
+
+// **************************************************************
+//! Derived classes add their own primitives writing in the
+//! dictionary.
+// **************************************************************
+bool Forth::stores(const Cell16 token) const
+{
+  return forthPrimitiveStores(token);
+}
+
+// **************************************************************
+//! Contexts sharing the dictionary only execute primitives and
+//! definitions which do not write in it (see
+//! Forth::analyzeStackEffect), so they cannot modify it while other
+//! contexts are reading it.
+//! \param token the word to execute.
+//! \param word the name of the word (for the error message).
+//! \throw SharedDictionaryStore if the word may write in the
+//! dictionary.
+// **************************************************************
+void Forth::checkShared(const Cell16 token, std::string const& word) const
+{
+  const bool pure = isPrimitive(token)
+    ? !stores(token)
+    : (m_dictionary.effect(token).valid && m_dictionary.effect(token).pure);
+  if (!pure)
+    {
+      SharedDictionaryStore e(word); throw e;
+    }
+}
+
+// **************************************************************
+//! Walk all paths of the definition tracking the depth of the data
+//! stack (relative to the depth when entering) and the number of
+//! cells pushed on the return stack (starting at 1 for the return
+//! address). Called colon definitions are replaced by their own
+//! stack effect. The definition is bounded if paths joining at the
+//! same token have the same depths, if the return address is never
+//! popped and if all EXIT have the same effect. Recursive words,
+//! EXECUTE or primitives with an unknown effect make the definition
+//! unbounded: it is then checked after each primitive. The definition
+//! is also pure if it does not use primitives writing in the
+//! dictionary and only calls pure definitions.
+//! \param token the token of the colon definition.
+//! \return true if the definition is bounded.
+// **************************************************************
+bool Forth::analyzeStackEffect(const Cell16 token)
+{
+  struct Depths { int32_t d; int32_t r; };
+  const uint32_t start = m_dictionary.xt(token) + 2U;
+  const uint32_t end = m_dictionary.here();
+  const uint32_t max_primitives = maxPrimitives();
+  std::vector<std::pair<uint32_t, Depths>> paths;
+  std::vector<Depths> visited;
+  ForthWordEffect summary;
+  ForthStackEffect e;
+  bool exited = false;
+
+  m_dictionary.effect(token, summary);
+  if (start >= end)
+    return false;
+
+  visited.assign(end - start, Depths{ INT32_MIN, 0 });
+  summary.rmax = 1;
+  summary.pure = true;
+  paths.push_back(std::make_pair(start, Depths{ 0, 1 }));
+  while (!paths.empty())
+    {
+      uint32_t ip = paths.back().first;
+      Depths s = paths.back().second;
+      paths.pop_back();
+
+      while (true)
+        {
+          if ((ip < start) || (ip + 2U > end))
+            return false;
+
+          // Joining an already walked path
+          Depths& v = visited[ip - start];
+          if (INT32_MIN != v.d)
+            {
+              if ((v.d != s.d) || (v.r != s.r))
+                return false;
+              break;
+            }
+          v = s;
+
+          const Cell16 t = m_dictionary.read16at(ip);
+          uint32_t next = ip + 2U * (1U + operands(t));
+
+          if (FORTH_PRIMITIVE_EXIT == t)
+            {
+              if ((1 != s.r) || (exited && (summary.delta != s.d)))
+                return false;
+              exited = true;
+              summary.delta = s.d;
+              break;
+            }
+          else if (t >= max_primitives)
+            {
+              ForthWordEffect const& w = m_dictionary.effect(t);
+              if (!w.valid)
+                return false;
+              summary.dmin = std::min<int32_t>(summary.dmin, s.d + w.dmin);
+              summary.dmax = std::max<int32_t>(summary.dmax, s.d + w.dmax);
+              summary.rmax = std::max<int32_t>(summary.rmax, s.r + w.rmax);
+              summary.pure = summary.pure && w.pure;
+              s.d += w.delta;
+            }
+          else
+            {
+              // The return address shall not be consumed
+              if ((!stackEffect(t, e)) || (s.r <= e.rin))
+                return false;
+              summary.pure = summary.pure && !stores(t);
+              summary.dmin = std::min<int32_t>(summary.dmin, s.d - e.in);
+              s.d += e.out - e.in;
+              s.r += e.rout - e.rin;
+              summary.dmax = std::max<int32_t>(summary.dmax, s.d);
+              summary.rmax = std::max<int32_t>(summary.rmax, s.r);
+
+              // Branches: see the inner interpreter (IP is += 2 after
+              // them and offsets are signed)
+              if (FORTH_PRIMITIVE_BRANCH == t)
+                next = ip + static_cast<int16_t>(m_dictionary.read16at(ip + 2U)) + 2U;
+              else if (FORTH_PRIMITIVE_0BRANCH == t)
+                paths.push_back(std::make_pair(ip + static_cast<int16_t>(m_dictionary.read16at(ip + 2U)) + 2U, s));
+              else if (FORTH_PRIMITIVE_0EQUAL_0BRANCH == t)
+                paths.push_back(std::make_pair(ip + static_cast<int16_t>(m_dictionary.read16at(ip + 4U)) + 4U, s));
+            }
+
+          if ((summary.dmax - summary.dmin > (int32_t) STACK_SIZE) ||
+              (summary.rmax > (int32_t) STACK_SIZE))
+            return false;
+          ip = next;
+        }
+    }
+
+  summary.valid = exited;
+  m_dictionary.effect(token, summary);
+  return exited;
 }
 
 // **************************************************************
@@ -200,9 +490,30 @@ void Forth::create(std::string const& word)
 // **************************************************************
 void Forth::execToken(const Cell16 tx)
 {
-  int32_t depth;
   Cell16 token = tx;
-  m_ip = 65535U;
+
+  // Count nested executions (even when an exception is thrown)
+  struct Nesting
+  {
+    Nesting(uint32_t& depth) : m_depth(depth) { ++m_depth; }
+    ~Nesting() { --m_depth; }
+    uint32_t& m_depth;
+  } nesting(m_exec_depth);
+
+#if FORTH_DIRECT_THREADING
+  if (!m_trace)
+    {
+      execTokenThreaded(tx);
+#if FORTH_JIT
+      // Compile hot definitions when no definition is being executed
+      if ((!m_jit_pending.empty()) && (m_rsp == m_return_stack))
+        jitCompile();
+#endif
+      return ;
+    }
+#endif
+
+  m_ip = FORTH_NO_IP;
 
   if (m_trace) {
     LOGI("Execute Forth token %u", tx);
@@ -216,12 +527,22 @@ void Forth::execToken(const Cell16 tx)
   // Always eat the top of the stack and store the value in a working register.
   DPOP(m_tos);
 
+  // Continue an execution interrupted by its budget
+  if (m_resuming)
+    {
+      m_resuming = false;
+      m_ip = m_yield_ip;
+    }
+
   // Traverse the word definition like a tree
   do
     {
       // A non primitive word is a consecutive set of primitive identifier
       while (!isPrimitive(token))
         {
+          if ((0U == --m_ticks) && (0U == budgetSlice()))
+            goto yield;
+
           /* std::pair<bool, int32_t> res = m_dictionary.find(token);
           if (!res.first)
             {
@@ -235,6 +556,10 @@ void Forth::execToken(const Cell16 tx)
               << " is not a primitive " << "\n\n";//<< std::endl;
           }
 
+          FORTH_PROFILE_COUNT(m_profiler, token);
+          FORTH_PROFILE_ENTER(m_profiler, token);
+          FORTH_JIT_HIT(token);
+
           // Save the next token to exec after the end of the definition
           Cell32 c = m_ip;
           RPUSH(c);
@@ -245,7 +570,7 @@ void Forth::execToken(const Cell16 tx)
               << "\n";//<< std::endl;
           }
 
-          m_ip = m_dictionary.read16at(token);
+          m_ip = m_dictionary.xt(token);
           m_ip += 2U;
           token = m_dictionary.read16at(m_ip);
           if (m_trace) {
@@ -262,7 +587,23 @@ void Forth::execToken(const Cell16 tx)
           << "Token " << m_dictionary.displayToken(token)
           <<" is a primitive. Consum it" << "\n";//<< std::endl;
       }
+      if ((0U == --m_ticks) && (0U == budgetSlice()))
+        goto yield;
+      FORTH_PROFILE_COUNT(m_profiler, token);
+      if (FORTH_PRIMITIVE_EXIT == token)
+        {
+          FORTH_PROFILE_LEAVE(m_profiler);
+        }
       execPrimitive(token);
+#if FORTH_BYTECODE || FORTH_JIT
+      // Budget exhausted inside a compact definition (see execBytecode)
+      // or inside native code (see jitExecute)
+      if (m_yielded)
+        {
+          DPUSH(m_tos);
+          return ;
+        }
+#endif
 
       if (m_trace) {
         DPUSH(m_tos);
@@ -279,7 +620,7 @@ void Forth::execToken(const Cell16 tx)
       // Do not forget than non-primitive words have the
       // token EXIT to pop the return stack to get back
       // IP value.
-      if (65535U != m_ip)
+      if (FORTH_NO_IP != m_ip)
         {
           m_ip += 2U;
           token = m_dictionary.read16at(m_ip);
@@ -292,11 +633,15 @@ void Forth::execToken(const Cell16 tx)
         }
 
       // Return stack under/overflow ?
-      depth = isStackUnderOverFlow(forth::ReturnStack);
+      isStackUnderOverFlow(forth::ReturnStack);
       if (m_trace) {
         CPP_LOG(logger::Debug) << "RStack: " << ForthStackDiplayer(this, forth::ReturnStack);
       }
-    } while (depth > 0);
+
+      // The last EXIT restores the IP of the execution (like the
+      // threaded interpreter): nested executions (EXECUTE) stop
+      // there and do not unwind the definitions calling them.
+    } while (FORTH_NO_IP != m_ip);
 
   // Store the working register
   DPUSH(m_tos);
@@ -305,6 +650,177 @@ void Forth::execToken(const Cell16 tx)
     CPP_LOG(logger::Debug)
       << "================ Etat final ====================\n\n";
   }
+
+#if FORTH_JIT
+  if ((!m_jit_pending.empty()) && (m_rsp == m_return_stack))
+    jitCompile();
+#endif
+  return ;
+
+ yield:
+  // Budget exhausted: the token has not been executed yet
+  m_yielded = true;
+  m_yield_ip = m_ip;
+  m_yield_token = token;
+  DPUSH(m_tos);
+}
+
+// **************************************************************
+//! The execution is interrupted when the budget is exhausted: the
+//! cells it has pushed on the stacks are moved to k and stacks get
+//! back their depth before the call (or a smaller depth if the
+//! execution has consumed cells). The execution can then be
+//! continued with resume(), maybe after having executed other
+//! tokens. Budgets are checked at yield points only (see
+//! FORTH_BUDGET_CLOCK_PERIOD). Executions nested in the execution
+//! (ie. INCLUDE) are not interrupted.
+//! \param token the token to execute.
+//! \param budget the limits of the execution (no limit by default).
+//! \param k receive the state of the interrupted execution.
+//! \return true if the execution has ended, false if it has been
+//! interrupted (k.suspended is then true).
+//! \throw ForthException like execToken().
+// **************************************************************
+bool Forth::run(const Cell16 token, ForthBudget const& budget, ForthContinuation& k)
+{
+  k = ForthContinuation();
+  return execTokenBudgeted(token, budget, k, false);
+}
+
+// **************************************************************
+//! \param budget the limits for this new slice of execution.
+//! \param k the execution interrupted by run() or resume().
+//! \return true if the execution has ended (or was not interrupted),
+//! false if it has been interrupted again.
+// **************************************************************
+bool Forth::resume(ForthBudget const& budget, ForthContinuation& k)
+{
+  if (!k.suspended)
+    return true;
+  return execTokenBudgeted(k.token, budget, k, true);
+}
+
+// **************************************************************
+//!
+// **************************************************************
+bool Forth::execTokenBudgeted(const Cell16 token, ForthBudget const& budget,
+                              ForthContinuation& k, const bool resuming)
+{
+  Cell32 *const dsp = m_dsp;
+  Cell32 *const rsp = m_rsp;
+  Float64 *const fsp = m_fsp;
+
+  if (resuming)
+    {
+      // Restore the stacks of the interrupted execution
+      if ((stackDepth(forth::DataStack) + k.data.size() >= STACK_SIZE - STACK_UNDERFLOW_MARGIN) ||
+          (stackDepth(forth::ReturnStack) + k.returns.size() >= STACK_SIZE - STACK_UNDERFLOW_MARGIN) ||
+          (stackDepth(forth::FloatStack) + k.floats.size() >= STACK_SIZE - STACK_UNDERFLOW_MARGIN))
+        {
+          OutOfBoundStack e(forth::ReturnStack, stackDepth(forth::ReturnStack) + k.returns.size());
+          throw e;
+        }
+      for (auto const& c: k.data) { DPUSH(c); }
+      for (auto const& c: k.returns) { RPUSH(c); }
+      for (auto const& f: k.floats) { FPUSH(f); }
+      m_yield_ip = k.ip;
+      m_resuming = true;
+#if FORTH_JIT
+      m_jit_yielded = k.native;
+#endif
+    }
+
+  m_budget = budget;
+  m_deadline = std::chrono::steady_clock::now()
+    + std::chrono::milliseconds(budget.milliseconds);
+  m_steps = 0U;
+  m_slice = m_ticks = budgetNextSlice();
+  m_yield_depth = m_exec_depth + 1U;
+  m_yielded = false;
+
+  try
+    {
+      execToken(token);
+    }
+  catch (...)
+    {
+      m_budget = ForthBudget();
+      m_yield_depth = 0U;
+      m_resuming = false;
+#if FORTH_JIT
+      m_jit_yielded = false;
+#endif
+      k.suspended = false;
+      throw;
+    }
+
+  k.steps += m_steps + m_slice - m_ticks;
+  m_budget = ForthBudget();
+  m_yield_depth = 0U;
+  m_steps = 0U;
+  m_slice = m_ticks = budgetNextSlice();
+  k.suspended = m_yielded;
+#if FORTH_JIT
+  k.native = m_jit_yielded;
+  m_jit_yielded = false;
+#endif
+  if (!m_yielded)
+    return true;
+
+  // Move the stacks of the interrupted execution to k
+  m_yielded = false;
+  k.ip = m_yield_ip;
+  k.token = m_yield_token;
+  ++k.suspensions;
+  Cell32 *const dbase = std::min(dsp, m_dsp);
+  k.data.assign(dbase, m_dsp);
+  m_dsp = dbase;
+  k.returns.assign(rsp, m_rsp);
+  m_rsp = rsp;
+  Float64 *const fbase = std::min(fsp, m_fsp);
+  k.floats.assign(fbase, m_fsp);
+  m_fsp = fbase;
+  return false;
+}
+
+// **************************************************************
+//!
+// **************************************************************
+uint32_t Forth::budgetNextSlice() const
+{
+  uint64_t slice = UINT32_MAX;
+
+  if (0U != m_budget.milliseconds)
+    {
+      slice = FORTH_BUDGET_CLOCK_PERIOD;
+    }
+  if ((0U != m_budget.steps) && (m_budget.steps > m_steps))
+    {
+      slice = std::min(slice, m_budget.steps - m_steps);
+    }
+  return static_cast<uint32_t>(slice);
+}
+
+// **************************************************************
+//! Only the execution started by run() can be interrupted: nested
+//! executions and executions outside run() get a new slice.
+// **************************************************************
+uint32_t Forth::budgetSlice()
+{
+  m_steps += m_slice;
+  if (m_exec_depth == m_yield_depth)
+    {
+      if (((0U != m_budget.steps) && (m_steps >= m_budget.steps)) ||
+          ((0U != m_budget.milliseconds) &&
+           (std::chrono::steady_clock::now() >= m_deadline)))
+        {
+          // The slice has already been added to m_steps
+          m_slice = m_ticks = 1U;
+          return 0U;
+        }
+    }
+  m_slice = m_ticks = budgetNextSlice();
+  return m_slice;
 }
 
 // **************************************************************
@@ -335,10 +851,18 @@ const char* Forth::completion(std::string const& partial_name)
 //! \note: prefixes 'b', 'h' and '0x' are not Forth standard.
 // **************************************************************
 bool Forth::toNumber(std::string const& word, Cell32& number) const
+{
+  return toNumber(word.c_str(), word.size(), number);
+}
+
+bool Forth::toNumber(const char* const word, const size_t length, Cell32& number) const
 {
   int base = m_base;
   uint32_t negative = 0;
-  uint32_t i = 0;
+  size_t i = 0;
+
+  if (0U == length)
+    return false;
 
   // sign
   if ('-' == word[i])
@@ -350,21 +874,24 @@ bool Forth::toNumber(std::string const& word, Cell32& number) const
     {
       ++i;
     }
+  const size_t prefix = i;
 
+  // Note: word is not necessary ended by '\0' so check i < length
+  // before reading characters.
   // decimal
-  if (('&' == word[i]) || ('#' == word[i]))
+  if ((i < length) && (('&' == word[i]) || ('#' == word[i])))
     {
       ++i;
       base = 10;
     }
   // binary ('b' is non standard)
-  else if (('b' == word[i]) || ('%' == word[i]))
+  else if ((i < length) && (('b' == word[i]) || ('%' == word[i])))
     {
       ++i;
       base = 2;
     }
   // hexadecimal ('h' is non standard)
-  else if (('h' == word[i]) || ('$' == word[i]))
+  else if ((i < length) && (('h' == word[i]) || ('$' == word[i])))
     {
       ++i;
       base = 16;
@@ -372,7 +899,7 @@ bool Forth::toNumber(std::string const& word, Cell32& number) const
         return false;
     }
   // hexadecimal, if base < 33.
-  else if (('0' == word[i]) && ('x' == word[i + 1]))
+  else if ((i + 1U < length) && ('0' == word[i]) && ('x' == word[i + 1]))
     {
       if (m_base < 33)
         {
@@ -386,10 +913,9 @@ bool Forth::toNumber(std::string const& word, Cell32& number) const
     }
   // numeric value (e.g., ASCII code) an optional ' may be present
   // after the character
-  else if ('\'' == word[i])
+  else if ((i < length) && ('\'' == word[i]))
     {
-      int s = word.size();
-      if ((2 == s) || ((3 == s) && ('\'' == word[i + 2])))
+      if ((2 == length) || ((3 == length) && (i + 2U < length) && ('\'' == word[i + 2])))
         {
           number = (negative ? -word[i + 1] : word[i + 1]);
           return true;
@@ -397,42 +923,100 @@ bool Forth::toNumber(std::string const& word, Cell32& number) const
       return false;
     }
 
-  // Try to convert the string into number
-  try
+  // sign after the base prefix (ie. #-1289 $-12eF)
+  if ((0U == prefix) && (prefix != i) && (i < length))
     {
-      std::size_t sz;
-      unsigned long val = std::stoul(word.substr(i, word.length() - i), &sz, base);
-      number = (negative ? -val : val);
-      return (sz + i) == word.length();
+      if ('-' == word[i])
+        {
+          ++i;
+          negative = 1;
+        }
+      else if ('+' == word[i])
+        {
+          ++i;
+        }
     }
-  catch (const std::invalid_argument& ia)
+
+  // Try to convert the string into number. Digits are parsed here
+  // (instead of std::stoul) to avoid a temporary string and an
+  // exception for each word which is not a number.
+  if (i >= length)
+    return false;
+
+  unsigned long val = 0;
+  bool overflow = false;
+  for (; i < length; ++i)
     {
-      return false;
+      int digit;
+      const char c = word[i];
+
+      if ((c >= '0') && (c <= '9'))
+        digit = c - '0';
+      else if ((c >= 'a') && (c <= 'z'))
+        digit = c - 'a' + 10;
+      else if ((c >= 'A') && (c <= 'Z'))
+        digit = c - 'A' + 10;
+      else
+        return false;
+
+      if (digit >= base)
+        return false;
+
+      if (val > (ULONG_MAX - digit) / base)
+        overflow = true;
+      val = val * base + digit;
     }
-  catch (const std::out_of_range& oor)
+
+  if (!overflow)
     {
-      // Two strategies:
+      number = (negative ? -val : val);
+      return true;
+    }
+
+  // Two strategies:
 #if (FORTH_BEHAVIOR_NUMBER_OUT_OF_RANGE == FORTH_TRUNCATE_OUT_OF_RANGE_NUMBERS)
-      {
-        // 1st strategy: runcate the number with a warning message to
-        // avoid abort the program.
-        number = (negative ? LONG_MIN : LONG_MAX);
-
-        std::pair<size_t, size_t> p = STREAM.position();
-        std::cerr << FORTH_WARNING_COLOR << "[WARNING] " << STREAM.name() << ":"
-                  << p.first << ":" << p.second
-                  << " Out of range number '" + word + "' will be truncated"
-                  << FORTH_NORMAL_COLOR << std::endl;
-        return true;
-      }
+  {
+    // 1st strategy: runcate the number with a warning message to
+    // avoid abort the program.
+    number = (negative ? LONG_MIN : LONG_MAX);
+
+    std::pair<size_t, size_t> p = STREAM.position();
+    std::cerr << FORTH_WARNING_COLOR << "[WARNING] " << STREAM.name() << ":"
+              << p.first << ":" << p.second
+              << " Out of range number '" << std::string(word, length)
+              << "' will be truncated"
+              << FORTH_NORMAL_COLOR << std::endl;
+    return true;
+  }
 #else // FORTH_BEHAVIOR_NUMBER_OUT_OF_RANGE == FORTH_OUT_OF_RANGE_NUMBERS_ARE_WORDS
-      {
-        // 2nd strategy: do not consider the word as a number which
-        // probably result an "unknown word" error message.
-        return false;
-      }
+  {
+    // 2nd strategy: do not consider the word as a number which
+    // probably result an "unknown word" error message.
+    return false;
+  }
 #endif // FORTH_BEHAVIOR_NUMBER_OUT_OF_RANGE
-    }
+}
+
+// **************************************************************
+//! Floating point literals are only accepted in decimal base and
+//! shall contain a dot or an exponent (ie. 1.5 1E3 -2.5E-2) to be
+//! distinguished from integers. Call it after toNumber() failed.
+//! \param word (in) the number to convert
+//! \param number (out) the result of the conversion if the function
+//! returned true (else the number is undefined).
+//! \return false if the word is not a floating point number.
+// **************************************************************
+bool Forth::toFloat(std::string const& word, Float64& number) const
+{
+  if ((10 != m_base) ||
+      (std::string::npos == word.find_first_of(".eE")) ||
+      (std::string::npos == word.find_first_of("0123456789")))
+    return false;
+
+  const char* const str = word.c_str();
+  char* end;
+  number = std::strtod(str, &end);
+  return (str != end) && ('\0' == *end);
 }
 
 // **************************************************************
@@ -440,6 +1024,7 @@ bool Forth::toNumber(std::string const& word, Cell32& number) const
 // **************************************************************
 void Forth::interpreteWordCaseInterprete(std::string const& word)
 {
+  Float64 real;
   Cell32 number;
   Cell16 token;
   bool immediate;
@@ -451,6 +1036,8 @@ void Forth::interpreteWordCaseInterprete(std::string const& word)
           <<"\nExecute word '"
           << word << "'" << "\n"; //<< std::endl;
       }
+      if (m_readonly)
+        checkShared(token, word);
       execToken(token);
     }
   else if (toNumber(word, number))
@@ -463,6 +1050,16 @@ void Forth::interpreteWordCaseInterprete(std::string const& word)
       DPUSH(number);
       isStackUnderOverFlow(forth::DataStack);
     }
+  else if (toFloat(word, real))
+    {
+      if (m_trace) {
+        CPP_LOG(logger::Debug)
+          << "FPUSH number " << word
+          << "\n"; // << std::endl;
+      }
+      checkFloatStack(0, 1);
+      FPUSH(real);
+    }
   else
     {
       UnknownForthWord e(word); throw e;
@@ -474,6 +1071,7 @@ void Forth::interpreteWordCaseInterprete(std::string const& word)
 // **************************************************************
 void Forth::interpreteWordCaseCompile(std::string const& word)
 {
+  Float64 real;
   Cell32 number;
   Cell16 token;
   bool immediate;
@@ -519,6 +1117,16 @@ void Forth::interpreteWordCaseCompile(std::string const& word)
           m_dictionary.appendCell32(number);
         }
     }
+  else if (toFloat(word, real))
+    {
+      if (m_trace) {
+        CPP_LOG(logger::Debug)
+          << "Append float literal " << real
+          << "' in dictionary" << "\n"; //<< std::endl;
+      }
+      m_dictionary.appendCell16(FORTH_PRIMITIVE_FLITERAL);
+      m_dictionary.appendFloat(real);
+    }
   else
     {
       UnknownForthWord e(word); throw e;
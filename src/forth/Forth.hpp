@@ -26,6 +26,8 @@
 
 #  include "ForthDictionary.hpp"
 #  include "ForthClibrary.hpp"
+#  include "ForthProfiler.hpp"
+#  include <chrono>
 #  include <ostream>
 
 // **************************************************************
@@ -40,6 +42,114 @@
 #  define FORTH_BEHAVIOR_NUMBER_OUT_OF_RANGE FORTH_TRUNCATE_OUT_OF_RANGE_NUMBERS
 #endif
 
+// **************************************************************
+// Inner interpreter used for executing compiled definitions when
+// the trace mode is off. The threaded interpreter jumps directly
+// from a primitive to the next one (computed goto when the compiler
+// offers it, else a switch) and keeps IP in a register. Set it to
+// 0 to always use the classic (and slower) loop of execToken().
+// **************************************************************
+#ifndef FORTH_DIRECT_THREADING
+#  define FORTH_DIRECT_THREADING 1
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+#  define FORTH_HAS_COMPUTED_GOTO 1
+#else
+#  define FORTH_HAS_COMPUTED_GOTO 0
+#endif
+
+// **************************************************************
+// When a definition is ended (word ;) frequent sequences of tokens
+// are replaced by superinstructions (a single primitive doing the
+// work of the sequence). Set it to 0 to keep definitions unchanged.
+// **************************************************************
+#ifndef FORTH_SUPERINSTRUCTIONS
+#  define FORTH_SUPERINSTRUCTIONS 1
+#endif
+
+// **************************************************************
+// When a definition is ended its stack effect is computed from the
+// arity of the primitives. Definitions with bounded stack depths are
+// checked when entering and leaving them instead of after each
+// primitive. Set it to 0 to check stacks after each primitive.
+// **************************************************************
+#ifndef FORTH_STACK_EFFECTS
+#  define FORTH_STACK_EFFECTS 1
+#endif
+
+// **************************************************************
+// Tier-2 compiler: colon definitions executed more than a given
+// number of times (Forth word JIT-ON) are translated to C, compiled
+// as a dynamic library and replaced by a call to the native code.
+// Set it to 0 to remove the execution counters.
+// **************************************************************
+#ifndef FORTH_JIT
+#  define FORTH_JIT 1
+#endif
+#if FORTH_JIT
+#  define FORTH_JIT_HIT(t)                                              \
+  if ((0U != m_jit_threshold) && (++m_jit_hits[t] == m_jit_threshold))  \
+    m_jit_pending.push_back(t)
+#else
+#  define FORTH_JIT_HIT(t)
+#endif
+
+// **************************************************************
+// Compact encoding of colon definitions (Forth word COMPACT-ON):
+// when a definition is ended its tokens are replaced by a byte code
+// (one-byte opcodes for the most used primitives, variable-length
+// literals and relative branches) executed by its own decoder loop
+// (see ForthBytecode.cpp). Set it to 0 to remove the encoder.
+// **************************************************************
+#ifndef FORTH_BYTECODE
+#  define FORTH_BYTECODE 1
+#endif
+
+// **************************************************************
+// Execution budget of Forth::run(). Yield points are the entries in
+// colon definitions, the branches and the primitives not executed
+// inline by the threaded interpreter: each iteration of a loop or a
+// recursion meets at least one. The clock is read every given number
+// of yield points. Backward branches of the code compiled by the JIT
+// are yield points too.
+// **************************************************************
+#ifndef FORTH_BUDGET_CLOCK_PERIOD
+#  define FORTH_BUDGET_CLOCK_PERIOD 1024U
+#endif
+
+//! \brief Limits of an execution started by Forth::run() (or
+//! resumed by Forth::resume()). 0 means no limit.
+struct ForthBudget
+{
+  //! Maximal number of yield points.
+  uint64_t steps = 0;
+  //! Maximal duration.
+  uint32_t milliseconds = 0;
+};
+
+//! \brief Execution interrupted by Forth::run() because its budget
+//! was exhausted. Cells it had pushed on the stacks are moved here,
+//! letting the interpreter execute other words before resuming it.
+struct ForthContinuation
+{
+  //! The execution has been interrupted and shall be resumed.
+  bool suspended = false;
+  //! Instruction pointer and token to execute when resuming.
+  Cell32 ip = 0;
+  Cell16 token = 0;
+  //! Cells of the data, return and floating point stacks.
+  std::vector<Cell32> data;
+  std::vector<Cell32> returns;
+  std::vector<Float64> floats;
+  //! Yield points met since the execution started.
+  uint64_t steps = 0;
+  //! Number of times the execution has been interrupted.
+  uint32_t suspensions = 0;
+  //! The execution has been interrupted inside native code of the
+  //! JIT: its state is on the return stack.
+  bool native = false;
+};
+
 //! \class Forth
 //! \brief class containg the whole Forth interpretor context.
 class Forth
@@ -75,11 +185,29 @@ public:
   virtual void displayStack(std::ostream& stream, const forth::StackID id) const;
   //! \brief restore the Forth context to its initial state.
   void abort();
+  //! \brief Execute a token within a budget.
+  bool run(const Cell16 token, ForthBudget const& budget, ForthContinuation& k);
+  //! \brief Continue an execution interrupted by run().
+  bool resume(ForthBudget const& budget, ForthContinuation& k);
+  //! \brief Checksum identifying the primitives and the given script
+  //! files (used for validating a snapshot).
+  uint64_t snapshotChecksum(std::vector<std::string> const& sources) const;
+  //! \brief Save the dictionary and the interpreter state in a binary image.
+  bool saveSnapshot(std::string const& filename, const uint64_t checksum);
+  //! \brief Restore the dictionary and the interpreter state from a
+  //! binary image if it matches the checksum.
+  bool loadSnapshot(std::string const& filename, const uint64_t checksum);
   //! \brief restore the Forth context to its initial state and throw
   //! an exception.
   void abort(std::string const& msg);
   //! \brief Try converting a Forth word as a number.
   bool toNumber(std::string const& word, Cell32& number) const;
+  //! \brief Try converting a Forth word as a number (the word does
+  //! not need to be ended by a null character).
+  bool toNumber(const char* const word, const size_t length, Cell32& number) const;
+  //! \brief Try converting a Forth word as a floating point number
+  //! (decimal digits with a '.' or an exponent).
+  bool toFloat(std::string const& word, Float64& number) const;
   //! \brief Return the name of the stream which triggereg a fault.
   inline const std::string& nameStreamInFault() const
   {
@@ -95,6 +223,9 @@ protected:
   virtual void interpreteWordCaseCompile(std::string const& word);
   //! \brief Create the header of a Forth word in the dictionary.
   void create(std::string const& word);
+  //! \brief Same but the entry gets the given token, whose address
+  //! in the table of execution tokens is not modified.
+  void create(std::string const& word, const Cell16 token);
   //! \brief Get the Forth word in the stream.
   //! Called by Forth words needed to extract the next word. The
   //! stream shall contains at least one word else an exception is
@@ -116,8 +247,70 @@ protected:
   void includeFile(std::string const& filename);
   //! \brief Perform the action of a Forth primitive.
   virtual void execPrimitive(const Cell16 idPrimitive);
+  //! \brief Return the number of cells following the token in a
+  //! definition which are data and not tokens (literals, offsets).
+  virtual uint32_t operands(const Cell16 token) const;
+  //! \brief Peephole optimizer replacing sequences of tokens by
+  //! superinstructions in the given part of the dictionary.
+  void fuseSuperInstructions(const Cell32 from, const Cell32 to);
+  //! \brief Return the stack effect of a primitive (false if unknown).
+  virtual bool stackEffect(const Cell16 token, ForthStackEffect& effect) const;
+  //! \brief Return true if the primitive may write in the dictionary.
+  virtual bool stores(const Cell16 token) const;
+  //! \brief Check a word can be executed by a context sharing its
+  //! dictionary.
+  void checkShared(const Cell16 token, std::string const& word) const;
+  //! \brief Compute and store in the dictionary the bounds of stack
+  //! depths of a colon definition.
+  bool analyzeStackEffect(const Cell16 token);
+  //! \brief Execute the array words (V-words and FV-words).
+  void execArrayPrimitive(const Cell16 idPrimitive);
+  //! \brief Return the memory of an array of the dictionary after
+  //! having checked its bounds.
+  uint8_t *arrayAt(const Cell32 addr, const Cell32 n, const uint32_t size);
+  //! \brief Copy the elements of an array selected by an array of indexes.
+  void arrayGather(const Cell32 src, const Cell32 idx, const Cell32 dst,
+                   const Cell32 n, const uint32_t size);
+  //! \brief Enable the JIT compiler for colon definitions executed
+  //! the given number of times (0 for disabling it).
+  void jit(const uint32_t threshold);
+  //! \brief Compile to native code the hot colon definitions.
+  void jitCompile();
+  //! \brief Translate a colon definition into C code.
+  bool jitTranslate(const Cell16 token, std::string& code,
+                    std::vector<Cell16>& callers, uint32_t& instances,
+                    std::vector<std::string>& resumes) const;
+  //! \brief Execute the native code of a colon definition compiled by
+  //! the JIT.
+  void jitExecute(CFuncHolder const& f);
+  //! \brief Read the dictionary as it was before the JIT patched it.
+  Cell16 jitRead16(const Cell32 address) const;
+  //! \brief Forget the execution counter and the native code of a
+  //! colon definition which will be replaced.
+  void jitForget(const Cell16 token);
+  //! \brief Replace the tokens of a colon definition ending at HERE
+  //! by its compact byte code if it is smaller.
+  bool compactDefinition(const Cell16 token);
+  //! \brief Execute the byte code following the primitive (BYTECODE)
+  //! until an EXIT, a call to a colon definition or a yield.
+  void execBytecode();
   //! \brief Perform the action of a Forth token (byte code).
   virtual void execToken(const Cell16 token);
+  //! \brief Perform the action of a Forth token with the direct
+  //! threaded inner interpreter (no trace).
+  void execTokenThreaded(const Cell16 token);
+  //! \brief Execute the token (or continue the execution saved in
+  //! k) with the budget and move the state of the interrupted
+  //! execution to k.
+  bool execTokenBudgeted(const Cell16 token, ForthBudget const& budget,
+                         ForthContinuation& k, const bool resuming);
+  //! \brief Called when the yield points of the current slice have
+  //! been consumed. Return the number of yield points of the next
+  //! slice or 0 if the execution shall be interrupted.
+  uint32_t budgetSlice();
+  //! \brief Return the number of yield points before the next check
+  //! of the budget.
+  uint32_t budgetNextSlice() const;
   //! \brief Return the depth of the return stack.
 public: // FIXME
   inline int32_t stackDepth(const forth::StackID id) const
@@ -130,6 +323,8 @@ public: // FIXME
         return m_rsp - m_return_stack;
       case forth::AuxStack:
         return m_asp - m_alternative_stack;
+      case forth::FloatStack:
+        return m_fsp - m_float_stack;
       default:
         LOGES("Pretty print this stack %u is not yet implemented", id);
         return 0;
@@ -147,6 +342,21 @@ protected:
   }
   //! \brief Check if the data stack is not under/overflowing.
   int32_t isStackUnderOverFlow(const forth::StackID id) const; // FIXME: a renommer en checkStack
+  //! \brief Check that the floating point stack holds at least in
+  //! values and can receive out values once they are popped.
+  //! \throw OutOfBoundStack else.
+  inline void checkFloatStack(const int32_t in, const int32_t out) const
+  {
+    const int32_t depth = m_fsp - m_float_stack;
+    if (depth < in)
+      {
+        OutOfBoundStack e(forth::FloatStack, depth - in); throw e;
+      }
+    if (depth - in + out > (int32_t) (STACK_SIZE - STACK_UNDERFLOW_MARGIN))
+      {
+        OutOfBoundStack e(forth::FloatStack, depth - in + out); throw e;
+      }
+  }
   //! \brief Change the base of displayed numbers.
   bool changeDisplayBase(const uint8_t base);
 
@@ -166,27 +376,85 @@ protected:
   //! Return stack with a marging of security to prevent against stack
   //! underflow.
   Cell32  *m_return_stack;
+  //! Floating point stack (aligned for vectorized words).
+  alignas(16) Float64 m_float_stack_[STACK_SIZE];
+  //! Bottom of the floating point stack.
+  Float64 *m_float_stack;
   //! Top of Stack
   Cell32  m_tos, m_tos1, m_tos2, m_tos3, m_tos4;
   // Registers
   Cell32 *m_dsp;   //! Data stack pointer
   Cell32 *m_asp;   //! Alternative data stack pointer
   Cell32 *m_rsp;   //! Return stack pointer
-  Cell16  m_ip;    //! Instruction pointer (CFA of the next word to be executed)
+  Float64 *m_fsp;  //! Floating point stack pointer
+  Cell32  m_ip;    //! Instruction pointer (CFA of the next word to be executed)
   int32_t m_base;  //! Base (octal, decimal, hexa) when displaying numbers
   Cell32  m_state; //! compile/execution
   int32_t  m_depth_at_colon; //! Save the stack depth before creating a new Forth word.
-  Cell16  m_last_at_colon;   //! Save the last dictionary entry before creating a new Forth word.
-  Cell16  m_here_at_colon;   //! Save the last dictionary free slot before creating a new Forth word.
+  Cell32  m_last_at_colon;   //! Save the last dictionary entry before creating a new Forth word.
+  Cell32  m_here_at_colon;   //! Save the last dictionary free slot before creating a new Forth word.
   std::string m_creating_word; //! The Forth word currently in creation.
+  Cell16  m_creating_token;  //! Token of the Forth word currently in creation.
   Cell32  m_saved_state; //! Save the interpreter state when enetring in a comment.
   ForthStream m_streams_stack[MAX_OPENED_STREAMS]; //! A stack of streams when script file include other files
   ForthCLib m_dynamic_libs; //! Load C dynamic libs and load them as Forth words.
   uint32_t m_opened_streams; //! Number of streams opened.
   ForthDictionary& m_dictionary; //! Forth dictionary.
   bool  m_trace; //! Trace the execution of a word.
-  Cell16 m_last_completion;
+  bool  m_readonly; //! The dictionary is shared with other contexts: words cannot be created nor write in it.
+  ForthProfiler m_profiler; //! Count and measure executed tokens.
+  Cell32 m_last_completion;
   int32_t m_err_stream;
+  //! Limits of the execution started by run().
+  ForthBudget m_budget;
+  //! End of the execution started by run() when it has a duration.
+  std::chrono::steady_clock::time_point m_deadline;
+  //! Yield points consumed by the previous slices.
+  uint64_t m_steps;
+  //! Size of the current slice of yield points.
+  uint32_t m_slice;
+  //! Remaining yield points of the current slice.
+  uint32_t m_ticks;
+  //! Number of nested calls of execToken().
+  uint32_t m_exec_depth;
+  //! Nesting of the execToken() started by run(): nested executions
+  //! (ie. INCLUDE) cannot be interrupted (0: no run()).
+  uint32_t m_yield_depth;
+  //! The execution has been interrupted (m_yielded) or is resumed
+  //! (m_resuming) at the token m_yield_token of the address m_yield_ip.
+  bool m_yielded;
+  bool m_resuming;
+  Cell32 m_yield_ip;
+  Cell16 m_yield_token;
+#if FORTH_JIT
+  //! \brief Beginning of a colon definition replaced by the JIT.
+  struct JitPatch
+  {
+    Cell32 address;  //! Address of the first token of the definition.
+    Cell16 code[3];  //! Original tokens.
+    Cell16 function; //! Index of the native function.
+  };
+  //! Number of executions before compiling a colon definition (0: JIT disabled).
+  uint32_t m_jit_threshold;
+  //! Number of executions of colon definitions (indexed by token).
+  std::vector<uint32_t> m_jit_hits;
+  //! Hot colon definitions waiting to be compiled.
+  std::vector<Cell16> m_jit_pending;
+  //! Colon definitions replaced by native code.
+  std::vector<JitPatch> m_jit_patches;
+  //! The native code has been interrupted by the budget: its state
+  //! is on the return stack (see jitExecute()).
+  bool m_jit_yielded;
+#endif
+#if FORTH_BYTECODE
+  //! Definitions are compacted when they are ended (COMPACT-ON).
+  bool m_compact;
+#endif
+#if FORTH_DIRECT_THREADING && FORTH_HAS_COMPUTED_GOTO
+  //! Address of the code of each primitive for the threaded interpreter.
+  void *m_threaded_code[FORTH_MAX_PRIMITIVES];
+  bool  m_threaded_ready; //! m_threaded_code has been filled.
+#endif
 };
 
 class ForthStackDiplayer
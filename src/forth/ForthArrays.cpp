@@ -0,0 +1,343 @@
+//=====================================================================
+// SimTaDyn: A GIS in a spreadsheet.
+// Copyright 2018 Quentin Quadrat <lecrapouille@gmail.com>
+//
+// This file is part of SimTaDyn.
+//
+// SimTaDyn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SimTaDyn.  If not, see <http://www.gnu.org/licenses/>.
+//=====================================================================
+
+//! \brief This file contains the array words of the Forth: element
+//! wise operations, reductions and gathers on arrays of cells (V-words)
+//! or of doubles (FV-words) stored contiguously in the dictionary. A
+//! single word processes the whole array, so the interpreter does not
+//! pay the dispatch of tokens for each element.
+//!
+//! Elements are stored in big endian like any other dictionary data
+//! (so @ F@ ! F! can still be used on them). Kernels convert blocks of
+//! elements into local buffers in the host order, compute on them
+//! with simple loops the compiler vectorizes, and convert them back.
+//! The destination array may be one of the source arrays. Arrays are
+//! only bounded by the capacity of the dictionary (DICTIONARY_SIZE):
+//! links of words defined after them are 32 bits.
+
+#include "Forth.hpp"
+#include <algorithm>
+
+//! Number of elements converted at once (fits in the L1 cache).
+#define FORTH_ARRAY_BLOCK 256U
+
+namespace
+{
+  inline uint32_t fromBigEndian(const uint32_t x)
+  {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    return x;
+#else
+    return __builtin_bswap32(x);
+#endif
+  }
+
+  inline uint64_t fromBigEndian(const uint64_t x)
+  {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    return x;
+#else
+    return __builtin_bswap64(x);
+#endif
+  }
+
+  // Cells are exchanged as 32-bits words and doubles as 64-bits words
+  template<typename T> struct Word;
+  template<> struct Word<Cell32>  { typedef uint32_t type; };
+  template<> struct Word<Float64> { typedef uint64_t type; };
+
+  //! Convert count elements into the host order. The end of the
+  //! block is cleared so kernels can always work on whole blocks
+  //! (loops with a constant number of iterations are vectorized).
+  template<typename T>
+  void load(T* const buffer, const uint8_t* src, const uint32_t count)
+  {
+    typedef typename Word<T>::type W;
+    W w[FORTH_ARRAY_BLOCK];
+
+    std::memcpy(w, src, count * sizeof (W));
+    std::memset(w + count, 0, (FORTH_ARRAY_BLOCK - count) * sizeof (W));
+    for (uint32_t i = 0; i < FORTH_ARRAY_BLOCK; ++i)
+      {
+        w[i] = fromBigEndian(w[i]);
+      }
+    std::memcpy(buffer, w, sizeof (w));
+  }
+
+  //! Convert count elements into big endian.
+  template<typename T>
+  void store(uint8_t* dst, const T* const buffer, const uint32_t count)
+  {
+    typedef typename Word<T>::type W;
+    W w[FORTH_ARRAY_BLOCK];
+
+    std::memcpy(w, buffer, sizeof (w));
+    for (uint32_t i = 0; i < FORTH_ARRAY_BLOCK; ++i)
+      {
+        w[i] = fromBigEndian(w[i]);
+      }
+    std::memcpy(dst, w, count * sizeof (W));
+  }
+
+  //! dst[i] = op(a[i], b[i])
+  template<typename T, typename Op>
+  void binaryKernel(const uint8_t* a, const uint8_t* b, uint8_t* dst,
+                    const uint32_t n, Op op)
+  {
+    T x[FORTH_ARRAY_BLOCK];
+    T y[FORTH_ARRAY_BLOCK];
+
+    for (uint32_t i = 0; i < n; i += FORTH_ARRAY_BLOCK)
+      {
+        const uint32_t count = std::min(FORTH_ARRAY_BLOCK, n - i);
+        const uint32_t offset = i * sizeof (T);
+        load(x, a + offset, count);
+        load(y, b + offset, count);
+        for (uint32_t k = 0; k < FORTH_ARRAY_BLOCK; ++k)
+          {
+            x[k] = op(x[k], y[k]);
+          }
+        store(dst + offset, x, count);
+      }
+  }
+
+  //! dst[i] = a[i] * b[i] + c[i]
+  template<typename T>
+  void fmaKernel(const uint8_t* a, const uint8_t* b, const uint8_t* c,
+                 uint8_t* dst, const uint32_t n)
+  {
+    T x[FORTH_ARRAY_BLOCK];
+    T y[FORTH_ARRAY_BLOCK];
+    T z[FORTH_ARRAY_BLOCK];
+
+    for (uint32_t i = 0; i < n; i += FORTH_ARRAY_BLOCK)
+      {
+        const uint32_t count = std::min(FORTH_ARRAY_BLOCK, n - i);
+        const uint32_t offset = i * sizeof (T);
+        load(x, a + offset, count);
+        load(y, b + offset, count);
+        load(z, c + offset, count);
+        for (uint32_t k = 0; k < FORTH_ARRAY_BLOCK; ++k)
+          {
+            x[k] = x[k] * y[k] + z[k];
+          }
+        store(dst + offset, x, count);
+      }
+  }
+
+  //! dst[i] = a[i] * k
+  template<typename T>
+  void scaleKernel(const uint8_t* a, const T k, uint8_t* dst, const uint32_t n)
+  {
+    T x[FORTH_ARRAY_BLOCK];
+
+    for (uint32_t i = 0; i < n; i += FORTH_ARRAY_BLOCK)
+      {
+        const uint32_t count = std::min(FORTH_ARRAY_BLOCK, n - i);
+        const uint32_t offset = i * sizeof (T);
+        load(x, a + offset, count);
+        for (uint32_t j = 0; j < FORTH_ARRAY_BLOCK; ++j)
+          {
+            x[j] = x[j] * k;
+          }
+        store(dst + offset, x, count);
+      }
+  }
+
+  //! Return the sum of a[i]
+  template<typename T>
+  T sumKernel(const uint8_t* a, const uint32_t n)
+  {
+    T x[FORTH_ARRAY_BLOCK];
+    T sum = 0;
+
+    for (uint32_t i = 0; i < n; i += FORTH_ARRAY_BLOCK)
+      {
+        const uint32_t count = std::min(FORTH_ARRAY_BLOCK, n - i);
+        load(x, a + i * sizeof (T), count);
+        for (uint32_t k = 0; k < FORTH_ARRAY_BLOCK; ++k)
+          {
+            sum += x[k];
+          }
+      }
+    return sum;
+  }
+} // namespace
+
+// **************************************************************
+//! \param addr the dictionary address of the first element.
+//! \param n the number of elements.
+//! \param size the size of an element in bytes.
+//! \return the memory holding the array.
+//! \throw OutOfBoundDictionary if the array is not entirely inside
+//! the dictionary.
+// **************************************************************
+uint8_t *Forth::arrayAt(const Cell32 addr, const Cell32 n, const uint32_t size)
+{
+  const uint64_t nbytes = static_cast<uint64_t>(n) * size;
+
+  if (nbytes > m_dictionary.m_capacity)
+    {
+      OutOfBoundDictionary e(addr); throw e;
+    }
+  if (0U != nbytes)
+    {
+      m_dictionary.checkBounds(addr, static_cast<uint32_t>(nbytes - 1U));
+    }
+  return m_dictionary.m_dictionary + addr;
+}
+
+// **************************************************************
+//! Gather elements of size bytes: dst[i] = src[idx[i]] where idx is
+//! an array of cells. All indexes are checked before copying.
+// **************************************************************
+void Forth::arrayGather(const Cell32 src, const Cell32 idx, const Cell32 dst,
+                        const Cell32 n, const uint32_t size)
+{
+  const uint8_t *indexes = arrayAt(idx, n, sizeof (Cell32));
+  uint8_t *to = arrayAt(dst, n, size);
+  Cell32 buffer[FORTH_ARRAY_BLOCK];
+
+  for (uint32_t i = 0; i < n; i += FORTH_ARRAY_BLOCK)
+    {
+      const uint32_t count = std::min(FORTH_ARRAY_BLOCK, n - i);
+      load(buffer, indexes + i * sizeof (Cell32), count);
+      // Check the farthest element read by the block
+      const uint64_t last = src + static_cast<uint64_t>
+        (*std::max_element(buffer, buffer + count)) * size;
+      if (last > UINT32_MAX)
+        {
+          OutOfBoundDictionary e(src); throw e;
+        }
+      arrayAt(static_cast<Cell32>(last), 1U, size);
+      const uint8_t *from = m_dictionary.m_dictionary + src;
+      for (uint32_t k = 0; k < count; ++k)
+        {
+          std::memmove(to + (i + k) * size, from + buffer[k] * size, size);
+        }
+    }
+}
+
+// **************************************************************
+//! Called by execPrimitive() for the V-words and FV-words. Addresses
+//! are dictionary addresses and n the number of elements.
+// **************************************************************
+void Forth::execArrayPrimitive(const Cell16 idPrimitive)
+{
+  switch (idPrimitive)
+    {
+      // ( a b dst n -- )
+    case FORTH_PRIMITIVE_VPLUS:
+    case FORTH_PRIMITIVE_VTIMES:
+    case FORTH_PRIMITIVE_FVPLUS:
+    case FORTH_PRIMITIVE_FVTIMES:
+      {
+        const bool real = (FORTH_PRIMITIVE_FVPLUS == idPrimitive) ||
+          (FORTH_PRIMITIVE_FVTIMES == idPrimitive);
+        const uint32_t size = real ? sizeof (Float64) : sizeof (Cell32);
+        DPOP(m_tos1); DPOP(m_tos2); DPOP(m_tos3);
+        const uint8_t *a = arrayAt(m_tos3, m_tos, size);
+        const uint8_t *b = arrayAt(m_tos2, m_tos, size);
+        uint8_t *dst = arrayAt(m_tos1, m_tos, size);
+        switch (idPrimitive)
+          {
+          case FORTH_PRIMITIVE_VPLUS:
+            binaryKernel<Cell32>(a, b, dst, m_tos, [](Cell32 x, Cell32 y) { return x + y; });
+            break;
+          case FORTH_PRIMITIVE_VTIMES:
+            binaryKernel<Cell32>(a, b, dst, m_tos, [](Cell32 x, Cell32 y) { return x * y; });
+            break;
+          case FORTH_PRIMITIVE_FVPLUS:
+            binaryKernel<Float64>(a, b, dst, m_tos, [](Float64 x, Float64 y) { return x + y; });
+            break;
+          default:
+            binaryKernel<Float64>(a, b, dst, m_tos, [](Float64 x, Float64 y) { return x * y; });
+            break;
+          }
+        DPOP(m_tos);
+      }
+      break;
+
+      // ( a b c dst n -- )
+    case FORTH_PRIMITIVE_VFMA:
+    case FORTH_PRIMITIVE_FVFMA:
+      {
+        const bool real = (FORTH_PRIMITIVE_FVFMA == idPrimitive);
+        const uint32_t size = real ? sizeof (Float64) : sizeof (Cell32);
+        DPOP(m_tos1); DPOP(m_tos2); DPOP(m_tos3); DPOP(m_tos4);
+        const uint8_t *a = arrayAt(m_tos4, m_tos, size);
+        const uint8_t *b = arrayAt(m_tos3, m_tos, size);
+        const uint8_t *c = arrayAt(m_tos2, m_tos, size);
+        uint8_t *dst = arrayAt(m_tos1, m_tos, size);
+        if (real)
+          fmaKernel<Float64>(a, b, c, dst, m_tos);
+        else
+          fmaKernel<Cell32>(a, b, c, dst, m_tos);
+        DPOP(m_tos);
+      }
+      break;
+
+      // ( a k dst n -- )
+    case FORTH_PRIMITIVE_VSCALE:
+      DPOP(m_tos1); DPOP(m_tos2); DPOP(m_tos3);
+      scaleKernel<Cell32>(arrayAt(m_tos3, m_tos, sizeof (Cell32)), m_tos2,
+                          arrayAt(m_tos1, m_tos, sizeof (Cell32)), m_tos);
+      DPOP(m_tos);
+      break;
+
+      // ( a dst n -- ) ( F: k -- )
+    case FORTH_PRIMITIVE_FVSCALE:
+      checkFloatStack(1, 0);
+      DPOP(m_tos1); DPOP(m_tos2);
+      scaleKernel<Float64>(arrayAt(m_tos2, m_tos, sizeof (Float64)), FPICK(0),
+                           arrayAt(m_tos1, m_tos, sizeof (Float64)), m_tos);
+      FNIP();
+      DPOP(m_tos);
+      break;
+
+      // ( a n -- sum )
+    case FORTH_PRIMITIVE_VSUM:
+      DPOP(m_tos1);
+      m_tos = sumKernel<Cell32>(arrayAt(m_tos1, m_tos, sizeof (Cell32)), m_tos);
+      break;
+
+      // ( a n -- ) ( F: -- sum )
+    case FORTH_PRIMITIVE_FVSUM:
+      checkFloatStack(0, 1);
+      DPOP(m_tos1);
+      FPUSH(sumKernel<Float64>(arrayAt(m_tos1, m_tos, sizeof (Float64)), m_tos));
+      DPOP(m_tos);
+      break;
+
+      // ( src idx dst n -- )
+    case FORTH_PRIMITIVE_VGATHER:
+    case FORTH_PRIMITIVE_FVGATHER:
+      DPOP(m_tos1); DPOP(m_tos2); DPOP(m_tos3);
+      arrayGather(m_tos3, m_tos2, m_tos1, m_tos,
+                  (FORTH_PRIMITIVE_FVGATHER == idPrimitive)
+                  ? sizeof (Float64) : sizeof (Cell32));
+      DPOP(m_tos);
+      break;
+
+    default:
+      UnknownForthPrimitive e(idPrimitive, __PRETTY_FUNCTION__); throw e;
+      break;
+    }
+}
@@ -0,0 +1,805 @@
+//=====================================================================
+// SimTaDyn: A GIS in a spreadsheet.
+// Copyright 2018 Quentin Quadrat <lecrapouille@gmail.com>
+//
+// This file is part of SimTaDyn.
+//
+// SimTaDyn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SimTaDyn.  If not, see <http://www.gnu.org/licenses/>.
+//=====================================================================
+
+//! \brief This file contains the compact encoding of colon
+//! definitions (Forth word COMPACT-ON). A compacted definition starts
+//! with the primitive (BYTECODE) followed by a stream of bytes:
+//!
+//! - the most used primitives are one-byte opcodes executed by the
+//!   decoder loop without going back to the inner interpreter,
+//! - literals are small opcodes (0 .. 15) or zigzag LEB128 numbers,
+//! - branches have 8 or 16 bits offsets relative to their opcode,
+//! - other primitives are stored unchanged (with their operands):
+//!   tokens of primitives are lower than 256 so their first byte is
+//!   the opcode 0x00. They read their operands from the dictionary
+//!   as usual,
+//! - calls to colon definitions are the opcode 0x02 followed by the
+//!   token of the definition and by the token (BYTECODE). The decoder
+//!   lets the inner interpreter execute the definition (so budgets,
+//!   profiler and JIT work as usual) and the (BYTECODE) token brings
+//!   it back after the called definition returns.
+//!
+//! The profiler counts (BYTECODE) instead of the primitives executed
+//! inside the decoder.
+
+#include "Forth.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+#if FORTH_BYTECODE
+
+#  define BINARY_OP(op) { m_tos = ((int32_t) DDROP()) op ((int32_t) m_tos); }
+#  define LOGICAL_OP(op) { m_tos = -1 * (((int32_t) DDROP()) op ((int32_t) m_tos)); }
+
+// Read the dictionary without checking bounds (see ForthInner.cpp)
+#  define READ8(a) (dico[(a) & mask])
+#  define READ16(a) ((Cell16) ((dico[(a) & mask] << 8U) | dico[((a) + 1U) & mask]))
+
+// Check stacks with pointers comparisons (see ForthInner.cpp)
+#  define CHECK_STACKS()                                                \
+  if ((m_dsp < dsp_min) || (m_dsp > dsp_max) ||                         \
+      (m_rsp < rsp_min) || (m_rsp > rsp_max))                           \
+    {                                                                   \
+      isStackUnderOverFlow(forth::DataStack);                           \
+      isStackUnderOverFlow(forth::ReturnStack);                         \
+    }
+
+// Branches are yield points. When the budget is exhausted the
+// execution is resumed by the token (BYTECODE) at the address before
+// the next opcode.
+#  define YIELD_POINT()                                                 \
+  if ((0U == --m_ticks) && (0U == budgetSlice()))                       \
+    {                                                                   \
+      m_yielded = true;                                                 \
+      m_yield_ip = pc - 2U;                                             \
+      m_yield_token = FORTH_PRIMITIVE_BYTECODE;                         \
+      m_ip = m_yield_ip;                                                \
+      return ;                                                          \
+    }
+
+namespace
+{
+  //! \brief Opcodes of the byte code.
+  enum ForthOpcode
+    {
+      // First byte of a primitive token stored unchanged
+      FORTH_OPCODE_PRIMITIVE = 0x00,
+      FORTH_OPCODE_EXIT,
+      FORTH_OPCODE_CALL,
+      FORTH_OPCODE_BRANCH8,
+      FORTH_OPCODE_BRANCH16,
+      FORTH_OPCODE_0BRANCH8,
+      FORTH_OPCODE_0BRANCH16,
+      FORTH_OPCODE_LITERAL,
+      FORTH_OPCODE_EXECUTE,
+
+      // Primitives executed by the decoder
+      FORTH_OPCODE_DUP = 0x10,
+      FORTH_OPCODE_QDUP,
+      FORTH_OPCODE_DROP,
+      FORTH_OPCODE_SWAP,
+      FORTH_OPCODE_OVER,
+      FORTH_OPCODE_ROT,
+      FORTH_OPCODE_NIP,
+      FORTH_OPCODE_TUCK,
+      FORTH_OPCODE_PICK,
+      FORTH_OPCODE_DEPTH,
+      FORTH_OPCODE_2DUP,
+      FORTH_OPCODE_2DROP,
+      FORTH_OPCODE_2SWAP,
+      FORTH_OPCODE_2OVER,
+      FORTH_OPCODE_TO_RSTACK,
+      FORTH_OPCODE_FROM_RSTACK,
+      FORTH_OPCODE_2TO_RSTACK,
+      FORTH_OPCODE_2FROM_RSTACK,
+      FORTH_OPCODE_I,
+      FORTH_OPCODE_J,
+      FORTH_OPCODE_CELL,
+      FORTH_OPCODE_CELLS,
+      FORTH_OPCODE_FETCH,
+      FORTH_OPCODE_STORE32,
+      FORTH_OPCODE_STORE16,
+      FORTH_OPCODE_STORE8,
+      FORTH_OPCODE_PLUS,
+      FORTH_OPCODE_MINUS,
+      FORTH_OPCODE_TIMES,
+      FORTH_OPCODE_DIV,
+      FORTH_OPCODE_1PLUS,
+      FORTH_OPCODE_1MINUS,
+      FORTH_OPCODE_2PLUS,
+      FORTH_OPCODE_2MINUS,
+      FORTH_OPCODE_NEGATE,
+      FORTH_OPCODE_ABS,
+      FORTH_OPCODE_AND,
+      FORTH_OPCODE_OR,
+      FORTH_OPCODE_XOR,
+      FORTH_OPCODE_MIN,
+      FORTH_OPCODE_MAX,
+      FORTH_OPCODE_RSHIFT,
+      FORTH_OPCODE_LSHIFT,
+      FORTH_OPCODE_EQUAL,
+      FORTH_OPCODE_NOT_EQUAL,
+      FORTH_OPCODE_LOWER,
+      FORTH_OPCODE_GREATER,
+      FORTH_OPCODE_LOWER_EQUAL,
+      FORTH_OPCODE_GREATER_EQUAL,
+      FORTH_OPCODE_0EQUAL,
+
+      // Literals 0 .. 15
+      FORTH_OPCODE_SMALL_LITERAL = 0xF0
+    };
+
+  //! \brief Instruction of the definition being compacted.
+  struct Instruction
+  {
+    Cell32 address;   //! Address of the token in the definition.
+    Cell16 token;     //! Token (superinstructions are unfused).
+    Cell32 literal;   //! Value of literals.
+    uint32_t target;  //! Index of the instruction a branch jumps to.
+    uint32_t offset;  //! Position in the byte code.
+    uint32_t size;    //! Number of bytes in the byte code.
+  };
+}
+
+// **************************************************************
+//! \return the opcode of the primitive executed by the decoder or
+//! FORTH_OPCODE_PRIMITIVE if the primitive is kept as a token.
+// **************************************************************
+static uint8_t bytecodeOpcode(const Cell16 token)
+{
+  switch (token)
+    {
+    case FORTH_PRIMITIVE_EXIT:          return FORTH_OPCODE_EXIT;
+    case FORTH_PRIMITIVE_EXECUTE:       return FORTH_OPCODE_EXECUTE;
+    case FORTH_PRIMITIVE_DUP:           return FORTH_OPCODE_DUP;
+    case FORTH_PRIMITIVE_QDUP:          return FORTH_OPCODE_QDUP;
+    case FORTH_PRIMITIVE_DROP:          return FORTH_OPCODE_DROP;
+    case FORTH_PRIMITIVE_SWAP:          return FORTH_OPCODE_SWAP;
+    case FORTH_PRIMITIVE_OVER:          return FORTH_OPCODE_OVER;
+    case FORTH_PRIMITIVE_ROT:           return FORTH_OPCODE_ROT;
+    case FORTH_PRIMITIVE_NIP:           return FORTH_OPCODE_NIP;
+    case FORTH_PRIMITIVE_TUCK:          return FORTH_OPCODE_TUCK;
+    case FORTH_PRIMITIVE_PICK:          return FORTH_OPCODE_PICK;
+    case FORTH_PRIMITIVE_DEPTH:         return FORTH_OPCODE_DEPTH;
+    case FORTH_PRIMITIVE_2DUP:          return FORTH_OPCODE_2DUP;
+    case FORTH_PRIMITIVE_2DROP:         return FORTH_OPCODE_2DROP;
+    case FORTH_PRIMITIVE_2SWAP:         return FORTH_OPCODE_2SWAP;
+    case FORTH_PRIMITIVE_2OVER:         return FORTH_OPCODE_2OVER;
+    case FORTH_PRIMITIVE_TO_RSTACK:     return FORTH_OPCODE_TO_RSTACK;
+    case FORTH_PRIMITIVE_FROM_RSTACK:   return FORTH_OPCODE_FROM_RSTACK;
+    case FORTH_PRIMITIVE_2TO_RSTACK:    return FORTH_OPCODE_2TO_RSTACK;
+    case FORTH_PRIMITIVE_2FROM_RSTACK:  return FORTH_OPCODE_2FROM_RSTACK;
+    case FORTH_PRIMITIVE_I:             return FORTH_OPCODE_I;
+    case FORTH_PRIMITIVE_J:             return FORTH_OPCODE_J;
+    case FORTH_PRIMITIVE_CELL:          return FORTH_OPCODE_CELL;
+    case FORTH_PRIMITIVE_CELLS:         return FORTH_OPCODE_CELLS;
+    case FORTH_PRIMITIVE_FETCH:         return FORTH_OPCODE_FETCH;
+    case FORTH_PRIMITIVE_STORE32:       return FORTH_OPCODE_STORE32;
+    case FORTH_PRIMITIVE_STORE16:       return FORTH_OPCODE_STORE16;
+    case FORTH_PRIMITIVE_STORE8:        return FORTH_OPCODE_STORE8;
+    case FORTH_PRIMITIVE_PLUS:          return FORTH_OPCODE_PLUS;
+    case FORTH_PRIMITIVE_MINUS:         return FORTH_OPCODE_MINUS;
+    case FORTH_PRIMITIVE_TIMES:         return FORTH_OPCODE_TIMES;
+    case FORTH_PRIMITIVE_DIV:           return FORTH_OPCODE_DIV;
+    case FORTH_PRIMITIVE_1PLUS:         return FORTH_OPCODE_1PLUS;
+    case FORTH_PRIMITIVE_1MINUS:        return FORTH_OPCODE_1MINUS;
+    case FORTH_PRIMITIVE_2PLUS:         return FORTH_OPCODE_2PLUS;
+    case FORTH_PRIMITIVE_2MINUS:        return FORTH_OPCODE_2MINUS;
+    case FORTH_PRIMITIVE_NEGATE:        return FORTH_OPCODE_NEGATE;
+    case FORTH_PRIMITIVE_ABS:           return FORTH_OPCODE_ABS;
+    case FORTH_PRIMITIVE_AND:           return FORTH_OPCODE_AND;
+    case FORTH_PRIMITIVE_OR:            return FORTH_OPCODE_OR;
+    case FORTH_PRIMITIVE_XOR:           return FORTH_OPCODE_XOR;
+    case FORTH_PRIMITIVE_MIN:           return FORTH_OPCODE_MIN;
+    case FORTH_PRIMITIVE_MAX:           return FORTH_OPCODE_MAX;
+    case FORTH_PRIMITIVE_RSHIFT:        return FORTH_OPCODE_RSHIFT;
+    case FORTH_PRIMITIVE_LSHIFT:        return FORTH_OPCODE_LSHIFT;
+    case FORTH_PRIMITIVE_EQUAL:         return FORTH_OPCODE_EQUAL;
+    case FORTH_PRIMITIVE_NOT_EQUAL:     return FORTH_OPCODE_NOT_EQUAL;
+    case FORTH_PRIMITIVE_LOWER:         return FORTH_OPCODE_LOWER;
+    case FORTH_PRIMITIVE_GREATER:       return FORTH_OPCODE_GREATER;
+    case FORTH_PRIMITIVE_LOWER_EQUAL:   return FORTH_OPCODE_LOWER_EQUAL;
+    case FORTH_PRIMITIVE_GREATER_EQUAL: return FORTH_OPCODE_GREATER_EQUAL;
+    case FORTH_PRIMITIVE_0EQUAL:        return FORTH_OPCODE_0EQUAL;
+    default:                            return FORTH_OPCODE_PRIMITIVE;
+    }
+}
+
+// **************************************************************
+//! Superinstructions are unfused: their next tokens are still in
+//! the definition and get their own opcodes.
+// **************************************************************
+static Cell16 bytecodeUnfuse(const Cell16 token)
+{
+  switch (token)
+    {
+    case FORTH_PRIMITIVE_DUP_TO_RSTACK:     return FORTH_PRIMITIVE_DUP;
+    case FORTH_PRIMITIVE_FROM_RSTACK_1PLUS: return FORTH_PRIMITIVE_FROM_RSTACK;
+    case FORTH_PRIMITIVE_LITERAL_16_PLUS:   return FORTH_PRIMITIVE_LITERAL_16;
+    case FORTH_PRIMITIVE_0EQUAL_0BRANCH:    return FORTH_PRIMITIVE_0EQUAL;
+    default:                                return token;
+    }
+}
+
+// **************************************************************
+//! Literals are zigzag encoded (small negative numbers are small
+//! positive numbers) then stored 7 bits per byte, the highest bit
+//! telling that another byte follows.
+// **************************************************************
+static uint32_t bytecodeLiteral(const Cell32 value, uint8_t *const bytes)
+{
+  uint32_t zigzag = (value << 1U) ^ static_cast<uint32_t>(static_cast<int32_t>(value) >> 31);
+  uint32_t n = 0U;
+
+  while (zigzag >= 0x80U)
+    {
+      bytes[n++] = static_cast<uint8_t>(zigzag | 0x80U);
+      zigzag >>= 7U;
+    }
+  bytes[n++] = static_cast<uint8_t>(zigzag);
+  return n;
+}
+
+// **************************************************************
+//! Called when a definition is ended (word ;) if COMPACT-ON has been
+//! executed. Branches are first encoded with 8 bits offsets and are
+//! widened to 16 bits while their offset does not fit. Definitions
+//! reading the instruction pointer for other reasons than reading
+//! operands ((CREATE), POSTPONE) are kept unchanged like definitions
+//! not smaller once compacted. The stack effect of a compacted
+//! definition is unknown: the decoder checks stacks itself.
+//! \param token the colon definition ending at HERE.
+//! \return true if the definition has been compacted.
+// **************************************************************
+bool Forth::compactDefinition(const Cell16 token)
+{
+  const Cell32 start = m_dictionary.xt(token) + 2U;
+  const Cell32 end = m_dictionary.here();
+  const uint32_t max_primitives = maxPrimitives();
+  std::vector<Instruction> code;
+  uint8_t bytes[8];
+
+  // Decode tokens
+  Cell32 ip = start;
+  while (ip < end)
+    {
+      Instruction i = { ip, bytecodeUnfuse(m_dictionary.read16at(ip)), 0U, 0U, 0U, 0U };
+      const uint32_t n = (i.token < max_primitives) ? operands(i.token) : 0U;
+
+      switch (i.token)
+        {
+        case FORTH_PRIMITIVE_PCREATE:
+        case FORTH_PRIMITIVE_POSTPONE:
+        case FORTH_PRIMITIVE_BYTECODE:
+          return false;
+        case FORTH_PRIMITIVE_BRANCH:
+        case FORTH_PRIMITIVE_0BRANCH:
+          i.size = 2U;
+          break;
+        case FORTH_PRIMITIVE_LITERAL_16:
+        case FORTH_PRIMITIVE_LITERAL_32:
+          i.literal = (FORTH_PRIMITIVE_LITERAL_16 == i.token)
+            ? m_dictionary.read16at(ip + 2U)
+            : m_dictionary.read32at(ip + 2U);
+          i.size = (i.literal < 16U) ? 1U : 1U + bytecodeLiteral(i.literal, bytes);
+          break;
+        default:
+          if (i.token >= max_primitives)
+            {
+              i.size = 5U;
+            }
+          else if (FORTH_OPCODE_PRIMITIVE != bytecodeOpcode(i.token))
+            {
+              i.size = 1U;
+            }
+          else if (i.token <= 0xFFU)
+            {
+              i.size = 2U * (1U + n);
+            }
+          else
+            {
+              // The first byte of the token would not be the opcode 0x00
+              return false;
+            }
+          break;
+        }
+      code.push_back(i);
+      ip += 2U * (1U + n);
+    }
+  if ((ip != end) || (code.empty()))
+    return false;
+
+  // Branches shall land on a token of the definition
+  for (auto& i: code)
+    {
+      if ((FORTH_PRIMITIVE_BRANCH != i.token) && (FORTH_PRIMITIVE_0BRANCH != i.token))
+        continue;
+
+      const Cell32 target = i.address + static_cast<int16_t>(m_dictionary.read16at(i.address + 2U)) + 2U;
+      auto it = std::lower_bound(code.begin(), code.end(), target,
+                                 [](Instruction const& a, const Cell32 t) { return a.address < t; });
+      if ((code.end() == it) || (it->address != target))
+        return false;
+      i.target = static_cast<uint32_t>(it - code.begin());
+    }
+
+  // Place the instructions, widening branches until their offsets fit
+  uint32_t size;
+  bool widened = true;
+  while (widened)
+    {
+      widened = false;
+      size = 0U;
+      for (auto& i: code)
+        {
+          i.offset = size;
+          size += i.size;
+        }
+      for (auto& i: code)
+        {
+          if ((FORTH_PRIMITIVE_BRANCH != i.token) && (FORTH_PRIMITIVE_0BRANCH != i.token))
+            continue;
+
+          const int32_t offset = static_cast<int32_t>(code[i.target].offset - i.offset);
+          if ((2U == i.size) && ((offset < INT8_MIN) || (offset > INT8_MAX)))
+            {
+              i.size = 3U;
+              widened = true;
+            }
+          else if ((offset < INT16_MIN) || (offset > INT16_MAX))
+            {
+              return false;
+            }
+        }
+    }
+
+  // Not worth it
+  if (2U + size >= end - start)
+    return false;
+
+  // Generate the byte code
+  std::vector<uint8_t> bytecode;
+  bytecode.reserve(size);
+  for (auto const& i: code)
+    {
+      const int32_t offset = static_cast<int32_t>(code[i.target].offset - i.offset);
+      const uint8_t opcode = bytecodeOpcode(i.token);
+
+      switch (i.token)
+        {
+        case FORTH_PRIMITIVE_BRANCH:
+        case FORTH_PRIMITIVE_0BRANCH:
+          if (2U == i.size)
+            {
+              bytecode.push_back((FORTH_PRIMITIVE_BRANCH == i.token)
+                                 ? FORTH_OPCODE_BRANCH8 : FORTH_OPCODE_0BRANCH8);
+              bytecode.push_back(static_cast<uint8_t>(offset));
+            }
+          else
+            {
+              bytecode.push_back((FORTH_PRIMITIVE_BRANCH == i.token)
+                                 ? FORTH_OPCODE_BRANCH16 : FORTH_OPCODE_0BRANCH16);
+              bytecode.push_back(static_cast<uint8_t>(offset >> 8));
+              bytecode.push_back(static_cast<uint8_t>(offset));
+            }
+          break;
+        case FORTH_PRIMITIVE_LITERAL_16:
+        case FORTH_PRIMITIVE_LITERAL_32:
+          if (i.literal < 16U)
+            {
+              bytecode.push_back(static_cast<uint8_t>(FORTH_OPCODE_SMALL_LITERAL + i.literal));
+            }
+          else
+            {
+              bytecode.push_back(FORTH_OPCODE_LITERAL);
+              bytecode.insert(bytecode.end(), bytes, bytes + bytecodeLiteral(i.literal, bytes));
+            }
+          break;
+        default:
+          if (i.token >= max_primitives)
+            {
+              bytecode.push_back(FORTH_OPCODE_CALL);
+              bytecode.push_back(static_cast<uint8_t>(i.token >> 8));
+              bytecode.push_back(static_cast<uint8_t>(i.token));
+              bytecode.push_back(static_cast<uint8_t>(FORTH_PRIMITIVE_BYTECODE >> 8));
+              bytecode.push_back(static_cast<uint8_t>(FORTH_PRIMITIVE_BYTECODE));
+            }
+          else if (FORTH_OPCODE_PRIMITIVE != opcode)
+            {
+              bytecode.push_back(opcode);
+            }
+          else
+            {
+              // The token and its operands are kept unchanged
+              for (uint32_t b = 0U; b < i.size; ++b)
+                {
+                  bytecode.push_back(static_cast<uint8_t>(m_dictionary.read8at(i.address + b)));
+                }
+            }
+          break;
+        }
+    }
+
+  // Replace the definition
+  m_dictionary.write16at(start, FORTH_PRIMITIVE_BYTECODE);
+  for (uint32_t b = 0U; b < size; ++b)
+    {
+      m_dictionary.write8at(start + 2U + b, bytecode[b]);
+    }
+  m_dictionary.here(start + 2U + size);
+  m_dictionary.effect(token, ForthWordEffect());
+  return true;
+}
+
+// **************************************************************
+//! Called by the primitive (BYTECODE): IP is the address of this
+//! token and the byte code starts after it. Like execPrimitive()
+//! the decoder leaves with IP on the token before the next token
+//! the inner interpreter shall execute: after an EXIT it is the
+//! return address, after a call it is before the token of the
+//! called definition.
+//! \throw UnknownForthPrimitive if the byte code is malformed.
+//! \throw OutOfBoundStack if the data or the return stack overflowed.
+// **************************************************************
+void Forth::execBytecode()
+{
+  const Cell8 *const dico = m_dictionary.m_dictionary;
+  const Cell32 mask = m_dictionary.capacity() - 1U;
+  const Cell32 *const dsp_min = m_data_stack - 1;
+  const Cell32 *const dsp_max = m_data_stack + (STACK_SIZE - STACK_UNDERFLOW_MARGIN - 1U);
+  const Cell32 *const rsp_min = m_return_stack - 1;
+  const Cell32 *const rsp_max = m_return_stack + (STACK_SIZE - STACK_UNDERFLOW_MARGIN - 1U);
+  Cell32 pc = m_ip + 2U;
+
+  while (true)
+    {
+      // pc is the address after the opcode
+      const Cell8 opcode = READ8(pc);
+      ++pc;
+
+      switch (opcode)
+        {
+          // Token of a primitive: it reads its operands from IP
+        case FORTH_OPCODE_PRIMITIVE:
+          m_ip = pc - 1U;
+          execPrimitive(READ8(pc));
+          pc = m_ip + 2U;
+          break;
+
+        case FORTH_OPCODE_EXIT:
+          FORTH_PROFILE_LEAVE(m_profiler);
+          RPOP(m_ip);
+          return ;
+
+          // The inner interpreter executes the next token (the
+          // called definition) then the token (BYTECODE) after it.
+        case FORTH_OPCODE_CALL:
+          m_ip = pc - 2U;
+          return ;
+
+          // Offsets are relative to the opcode
+        case FORTH_OPCODE_BRANCH8:
+          pc += static_cast<int8_t>(READ8(pc)) - 1;
+          YIELD_POINT();
+          break;
+
+        case FORTH_OPCODE_BRANCH16:
+          pc += static_cast<int16_t>(READ16(pc)) - 1;
+          YIELD_POINT();
+          break;
+
+        case FORTH_OPCODE_0BRANCH8:
+          pc += (0 == m_tos) ? static_cast<int8_t>(READ8(pc)) - 1 : 1;
+          DPOP(m_tos);
+          YIELD_POINT();
+          break;
+
+        case FORTH_OPCODE_0BRANCH16:
+          pc += (0 == m_tos) ? static_cast<int16_t>(READ16(pc)) - 1 : 2;
+          DPOP(m_tos);
+          YIELD_POINT();
+          break;
+
+        case FORTH_OPCODE_LITERAL:
+          {
+            uint32_t zigzag = 0U;
+            uint32_t shift = 0U;
+            Cell8 byte;
+            do
+              {
+                byte = READ8(pc);
+                ++pc;
+                zigzag |= static_cast<uint32_t>(byte & 0x7FU) << shift;
+                shift += 7U;
+              } while ((byte & 0x80U) && (shift < 35U));
+            DPUSH(m_tos);
+            m_tos = (zigzag >> 1U) ^ (0U - (zigzag & 1U));
+          }
+          break;
+
+          // Executed by a nested inner interpreter which may not
+          // restore IP: the decoder keeps its own
+        case FORTH_OPCODE_EXECUTE:
+          m_ip = pc - 1U;
+          execPrimitive(FORTH_PRIMITIVE_EXECUTE);
+          break;
+
+        case FORTH_OPCODE_DUP:
+          DPUSH(m_tos);
+          break;
+
+        case FORTH_OPCODE_QDUP:
+          if (m_tos)
+            {
+              DPUSH(m_tos);
+            }
+          break;
+
+        case FORTH_OPCODE_DROP:
+          DPOP(m_tos);
+          break;
+
+        case FORTH_OPCODE_SWAP:
+          m_tos2 = m_tos;
+          DPOP(m_tos);
+          DPUSH(m_tos2);
+          break;
+
+        case FORTH_OPCODE_OVER:
+          DPUSH(m_tos);
+          m_tos = DPICK(1);
+          break;
+
+        case FORTH_OPCODE_ROT:
+          DPOP(m_tos2);
+          DPOP(m_tos3);
+          DPUSH(m_tos2);
+          DPUSH(m_tos);
+          m_tos = m_tos3;
+          break;
+
+        case FORTH_OPCODE_NIP:
+          DPOP(m_tos1);
+          break;
+
+        case FORTH_OPCODE_TUCK:
+          DPOP(m_tos2);
+          DPUSH(m_tos);
+          DPUSH(m_tos2);
+          break;
+
+        case FORTH_OPCODE_PICK:
+          m_tos = DPICK(m_tos);
+          break;
+
+        case FORTH_OPCODE_DEPTH:
+          DPUSH(m_tos);
+          m_tos = stackDepth(forth::DataStack);
+          break;
+
+        case FORTH_OPCODE_2DUP:
+          DPUSH(m_tos);
+          m_tos2 = DPICK(1);
+          DPUSH(m_tos2);
+          break;
+
+        case FORTH_OPCODE_2DROP:
+          DPOP(m_tos);
+          DPOP(m_tos);
+          break;
+
+        case FORTH_OPCODE_2SWAP:
+          DPOP(m_tos1);
+          DPOP(m_tos2);
+          DPOP(m_tos3);
+          DPUSH(m_tos1);
+          DPUSH(m_tos);
+          DPUSH(m_tos3);
+          m_tos = m_tos2;
+          break;
+
+        case FORTH_OPCODE_2OVER:
+          DPUSH(m_tos);
+          m_tos2 = DPICK(3);
+          DPUSH(m_tos2);
+          m_tos = DPICK(3);
+          break;
+
+        case FORTH_OPCODE_TO_RSTACK:
+          RPUSH(m_tos);
+          DPOP(m_tos);
+          break;
+
+        case FORTH_OPCODE_FROM_RSTACK:
+          DPUSH(m_tos);
+          RPOP(m_tos);
+          break;
+
+        case FORTH_OPCODE_2TO_RSTACK:
+          DPOP(m_tos1);
+          RPUSH(m_tos1);
+          RPUSH(m_tos);
+          DPOP(m_tos);
+          break;
+
+        case FORTH_OPCODE_2FROM_RSTACK:
+          DPUSH(m_tos);
+          RPOP(m_tos);
+          RPOP(m_tos1);
+          DPUSH(m_tos1);
+          break;
+
+        case FORTH_OPCODE_I:
+          DPUSH(m_tos);
+          m_tos = RPICK(0);
+          break;
+
+        case FORTH_OPCODE_J:
+          DPUSH(m_tos);
+          m_tos = RPICK(2);
+          break;
+
+        case FORTH_OPCODE_CELL:
+          DPUSH(m_tos);
+          m_tos = sizeof (Cell32);
+          break;
+
+        case FORTH_OPCODE_CELLS:
+          m_tos = m_tos * sizeof (Cell32);
+          break;
+
+          // Accessing to user data is checked.
+        case FORTH_OPCODE_FETCH:
+          m_tos = m_dictionary.read32at(m_tos);
+          break;
+
+        case FORTH_OPCODE_STORE32:
+          DPOP(m_tos1);
+          m_dictionary.write32at(m_tos, m_tos1);
+          DPOP(m_tos);
+          break;
+
+        case FORTH_OPCODE_STORE16:
+          DPOP(m_tos1);
+          m_dictionary.write16at(m_tos, m_tos1);
+          DPOP(m_tos);
+          break;
+
+        case FORTH_OPCODE_STORE8:
+          DPOP(m_tos1);
+          m_dictionary.write8at(m_tos, m_tos1);
+          DPOP(m_tos);
+          break;
+
+        case FORTH_OPCODE_PLUS:
+          BINARY_OP(+);
+          break;
+
+        case FORTH_OPCODE_MINUS:
+          BINARY_OP(-);
+          break;
+
+        case FORTH_OPCODE_TIMES:
+          BINARY_OP(*);
+          break;
+
+        case FORTH_OPCODE_DIV:
+          BINARY_OP(/);
+          break;
+
+        case FORTH_OPCODE_1PLUS:
+          ++m_tos;
+          break;
+
+        case FORTH_OPCODE_1MINUS:
+          --m_tos;
+          break;
+
+        case FORTH_OPCODE_2PLUS:
+          m_tos += 2;
+          break;
+
+        case FORTH_OPCODE_2MINUS:
+          m_tos -= 2;
+          break;
+
+        case FORTH_OPCODE_NEGATE:
+          m_tos = -m_tos;
+          break;
+
+        case FORTH_OPCODE_ABS:
+          m_tos = std::abs((int32_t) m_tos);
+          break;
+
+        case FORTH_OPCODE_AND:
+          BINARY_OP(&);
+          break;
+
+        case FORTH_OPCODE_OR:
+          BINARY_OP(|);
+          break;
+
+        case FORTH_OPCODE_XOR:
+          BINARY_OP(^);
+          break;
+
+        case FORTH_OPCODE_MIN:
+          DPOP(m_tos1);
+          m_tos = ((int32_t) m_tos < (int32_t) m_tos1) ? m_tos : m_tos1;
+          break;
+
+        case FORTH_OPCODE_MAX:
+          DPOP(m_tos1);
+          m_tos = ((int32_t) m_tos > (int32_t) m_tos1) ? m_tos : m_tos1;
+          break;
+
+        case FORTH_OPCODE_RSHIFT:
+          BINARY_OP(>>);
+          break;
+
+        case FORTH_OPCODE_LSHIFT:
+          BINARY_OP(<<);
+          break;
+
+        case FORTH_OPCODE_EQUAL:
+          LOGICAL_OP(==);
+          break;
+
+        case FORTH_OPCODE_NOT_EQUAL:
+          LOGICAL_OP(!=);
+          break;
+
+        case FORTH_OPCODE_LOWER:
+          LOGICAL_OP(<);
+          break;
+
+        case FORTH_OPCODE_GREATER:
+          LOGICAL_OP(>);
+          break;
+
+        case FORTH_OPCODE_LOWER_EQUAL:
+          LOGICAL_OP(<=);
+          break;
+
+        case FORTH_OPCODE_GREATER_EQUAL:
+          LOGICAL_OP(>=);
+          break;
+
+        case FORTH_OPCODE_0EQUAL:
+          DPUSH(0U);
+          LOGICAL_OP(==);
+          break;
+
+        default:
+          if (opcode >= FORTH_OPCODE_SMALL_LITERAL)
+            {
+              DPUSH(m_tos);
+              m_tos = opcode - FORTH_OPCODE_SMALL_LITERAL;
+              break;
+            }
+          UnknownForthPrimitive e(opcode, __PRETTY_FUNCTION__);
+          throw e;
+        }
+
+      CHECK_STACKS();
+    }
+}
+
+#endif /* FORTH_BYTECODE */
@@ -1,9 +1,15 @@
 #include "ForthClibrary.hpp"
 #include "PathManager.hpp"
+#include "File.hpp"
+#include <algorithm>
+#include <sstream>
+#include <cstdio>
 
 #define ERR_UNBALANCED std::make_pair(false, "Unbalanced C-LIB and END-C-LIB words")
 
 ForthCLib::ForthCLib()
+  : m_first(0),
+    m_closed(true)
 {
 }
 
@@ -11,8 +17,8 @@ ForthCLib::~ForthCLib()
 {
   if (m_file)
     m_file.close();
-  if (nullptr != m_module)
-    delete m_module;
+  for (auto module: m_modules)
+    delete module;
 }
 
 // **************************************************************
@@ -56,6 +62,7 @@ ForthCLib::function(ForthStream &stream)
   bool has_return_code = false;
   std::string param;
   std::string stack;
+  std::string args;
 
   while (stream.hasMoreWords())
     {
@@ -68,7 +75,11 @@ ForthCLib::function(ForthStream &stream)
           if (!has_return_code)
             {
               if (nb_params)
-                stack += ", ";
+                {
+                  stack += ", ";
+                  args += ", ";
+                }
+              args += "args[" + std::to_string(nb_params) + "]";
               ++nb_params;
               stack += "dsp[" + std::to_string(-nb_params) + "]";
             }
@@ -105,6 +116,16 @@ ForthCLib::function(ForthStream &stream)
   holder.func_c_name = "simforth_c_" + func_c_shortname + '_' + param;
   holder.code = "void " + holder.func_c_name + "(Cell32** pdsp)\n{\n  Cell32* dsp = *pdsp;\n  " + code + ";\n}\n";
 
+  // Generate the batched version: a single call for n sets of
+  // parameters stored in an array.
+  holder.params = static_cast<uint8_t>(nb_params);
+  holder.returns = has_return_code;
+  holder.batched = true;
+  holder.code += "void " + holder.func_c_name + "_batch(const Cell32* args, Cell32* res, uint32_t n)\n"
+    "{\n  uint32_t i;\n  (void) res;\n"
+    "  for (i = 0; i < n; ++i, args += " + std::to_string(nb_params) + ")\n    "
+    + (has_return_code ? "res[i] = " : "") + func_c_shortname + "(" + args + ");\n}\n";
+
   // Save it in the file
   m_file << holder.code;
 
@@ -141,6 +162,7 @@ ForthCLib::begin(ForthStream &stream)
   if (!stream.hasMoreWords())
     return std::make_pair(false, "Missing library name");
   m_libname = stream.nextWord();
+  m_first = m_functions.size();
 
   // Create a temporary C file which will contain all generated C code
   // wrapping the function parameters.
@@ -165,29 +187,121 @@ ForthCLib::end()
     return ERR_UNBALANCED;
   m_file.close();
 
-  // Compile generated code into a dynamic library.
-  std::string makefile = PathManager::instance().expand("forth/LibC/Makefile");
-  std::string command = "make -f " + makefile
-    + " BUILD=" + config::tmp_path
-    + " SRCS=" + m_libname + ".c"
-    + " EXTLIBS=\"" + m_extlibs + "\"";
-  system(command.c_str()); // FIXME: tester code de retour
+  return build(m_libname, "", m_first);
+}
+
+// **************************************************************
+//! \param
+// **************************************************************
+std::pair<bool, std::string>
+ForthCLib::compile(std::string const& libname, std::string const& code,
+                   std::vector<CFuncHolder> const& functions)
+{
+  std::string sourcepath(config::tmp_path + libname + ".c");
+  std::ofstream file(sourcepath);
+  if (!file)
+    {
+      return std::make_pair(false, "Failed creating '" + sourcepath + "'");
+    }
+  file << code;
+  file.close();
+
+  const size_t first = m_functions.size();
+  m_functions.insert(m_functions.end(), functions.begin(), functions.end());
+  std::pair<bool, std::string> res = build(libname, "-O2", first);
+  if (!res.first)
+    {
+      m_functions.resize(first);
+    }
+  return res;
+}
+
+// **************************************************************
+//! Libraries are named after the hash of their C code and of their
+//! build options: a library already compiled with the same code (by
+//! this process or by a previous one) is loaded without calling the C
+//! compiler again.
+//! \param libname the name of the C file (without extension) in the
+//! temporary folder.
+//! \param options the C compiler options.
+//! \param first the index in m_functions of the first function of this
+//! library.
+// **************************************************************
+std::pair<bool, std::string>
+ForthCLib::build(std::string const& libname, std::string const& options,
+                 const size_t first)
+{
+  std::string const sourcepath(config::tmp_path + libname + ".c");
+  std::ifstream in(sourcepath, std::ios::in | std::ios::binary);
+  if (!in)
+    {
+      return std::make_pair(false, "Failed reading '" + sourcepath + "'");
+    }
+  std::string const source((std::istreambuf_iterator<char>(in)),
+                           std::istreambuf_iterator<char>());
+  std::string const key(source + '\0' + options + '\0' + m_extlibs);
+  std::ostringstream cached;
+  cached << libname << '-' << std::hex << std::setfill('0') << std::setw(16)
+         << fnv64(key.data(), key.size());
+  std::string const libpath(config::tmp_path + cached.str());
+
+  if (File::exist(libpath + "." G_MODULE_SUFFIX))
+    {
+      LOGI("Reuse the compiled library '%s'", libpath.c_str());
+    }
+  else
+    {
+      // The Makefile is searched in the data path and not relatively to
+      // the current directory.
+      std::string const makefile = PathManager::instance().expand("forth/LibC/Makefile");
+      if (!File::exist(makefile))
+        {
+          return std::make_pair(false, "Failed finding 'forth/LibC/Makefile' in '"
+                                + PathManager::instance().toString() + "'");
+        }
+
+      std::ofstream out(libpath + ".c");
+      if (!(out << source))
+        {
+          return std::make_pair(false, "Failed creating '" + libpath + ".c'");
+        }
+      out.close();
+
+      // Compile generated code into a dynamic library.
+      std::string command = "make -f " + makefile
+        + " BUILD=" + config::tmp_path
+        + " SRCS=" + cached.str() + ".c"
+        + " EXTLIBS=\"" + m_extlibs + "\""
+        + " OPTIM=\"" + options + "\"";
+      if (0 != system(command.c_str()))
+        {
+          return std::make_pair(false, "Failed compiling '" + libpath + ".c'");
+        }
+
+      // Only the library is kept (for the cache)
+      std::remove((libpath + ".c").c_str());
+      std::remove((libpath + ".o").c_str());
+    }
 
   // Find symbols in the dynamic lib and create Forth entries in the dictionary.
-  // FIXME: ok extension .so/.dylib pas necessaire avec gtkmm::Module mais utile pour les log
-  std::string libpath(config::tmp_path + m_libname);
-  m_module = new Glib::Module(libpath);
-  if (!*m_module)
-    return std::make_pair(false, "Failed loading shared libray '" + libpath + "'");
+  Glib::Module* module = new Glib::Module(libpath);
+  if (!*module)
+    {
+      delete module;
+      return std::make_pair(false, "Failed loading shared libray '" + libpath + "'");
+    }
+  m_modules.push_back(module);
 
   bool res = true;
   std::string msg;
-  for (auto &it: m_functions)
+  for (size_t i = first; i < m_functions.size(); ++i)
     {
+      CFuncHolder& it = m_functions[i];
       void* func = nullptr;
-      if (m_module->get_symbol(it.func_c_name, func))
+      if (module->get_symbol(it.func_c_name, func))
         {
           LOGD("Found symbol '%s' in '%s'", it.func_c_name.c_str(), libpath.c_str());
+          it.libpath = libpath;
           it.fun_ptr = reinterpret_cast<forth_c_function>(reinterpret_cast<long>(func)) ;
         }
       else
@@ -195,7 +309,66 @@ ForthCLib::end()
           msg += ("Failed finding symbol '" + it.func_c_name + "' in '" + libpath + ".so\n"); //FIXME .so
           res = false;
         }
+      if ((it.batched) && (module->get_symbol(it.func_c_name + "_batch", func)))
+        {
+          it.batch_ptr = reinterpret_cast<forth_c_batch_function>(reinterpret_cast<long>(func));
+        }
     }
 
   return std::make_pair(res, msg);
 }
+
+// **************************************************************
+//! \param functions the functions to find (func_c_name and libpath
+//! are needed).
+// **************************************************************
+std::pair<bool, std::string>
+ForthCLib::bind(std::vector<CFuncHolder> functions)
+{
+  std::vector<std::pair<std::string, Glib::Module*>> modules;
+
+  for (auto& it: functions)
+    {
+      it.fun_ptr = nullptr;
+      if (it.libpath.empty())
+        continue;
+
+      auto m = std::find_if(modules.begin(), modules.end(),
+                            [&it](std::pair<std::string, Glib::Module*> const& p)
+                            { return p.first == it.libpath; });
+      if (modules.end() == m)
+        {
+          Glib::Module* module = new Glib::Module(it.libpath);
+          if (!*module)
+            {
+              delete module;
+              for (auto& p: modules)
+                delete p.second;
+              return std::make_pair(false, "Failed loading shared libray '" + it.libpath + "'");
+            }
+          modules.push_back(std::make_pair(it.libpath, module));
+          m = modules.end() - 1;
+        }
+
+      void* func = nullptr;
+      if (!m->second->get_symbol(it.func_c_name, func))
+        {
+          for (auto& p: modules)
+            delete p.second;
+          return std::make_pair(false, "Failed finding symbol '" + it.func_c_name
+                                + "' in '" + it.libpath + "'");
+        }
+      it.fun_ptr = reinterpret_cast<forth_c_function>(reinterpret_cast<long>(func));
+      it.batch_ptr = nullptr;
+      if ((it.batched) && (m->second->get_symbol(it.func_c_name + "_batch", func)))
+        {
+          it.batch_ptr = reinterpret_cast<forth_c_batch_function>(reinterpret_cast<long>(func));
+        }
+    }
+
+  for (auto& p: modules)
+    m_modules.push_back(p.second);
+  m_functions = std::move(functions);
+  m_first = m_functions.size();
+  return std::make_pair(true, "");
+}
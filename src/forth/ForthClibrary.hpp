@@ -7,6 +7,14 @@
 #  include <utility>
 
 typedef void (*forth_c_function)(Cell32**);
+//! Batched call: arguments of each call are consecutive cells (in the
+//! order of the C parameters) and results are stored in an array.
+typedef void (*forth_c_batch_function)(const Cell32*, Cell32*, uint32_t);
+//! Native code of a colon definition compiled by the JIT: data stack,
+//! local return stack and its depth, yield points left and the resume
+//! point (0 when called). Return 0 when the definition has been
+//! executed, else the resume point where the budget was exhausted.
+typedef uint32_t (*forth_jit_function)(Cell32**, Cell32*, uint32_t*, uint32_t*, uint32_t);
 
 // A siplifier std::string
 struct CFuncHolder
@@ -15,7 +23,23 @@ struct CFuncHolder
   std::string func_forth_name; // inutile
   std::string func_c_name;
   std::string code;// inutile
-  forth_c_function fun_ptr;
+  std::string libpath; // dynamic library containing the function
+  forth_c_function fun_ptr = nullptr;
+  //! Function called by the batched word (nullptr for the JIT).
+  forth_c_batch_function batch_ptr = nullptr;
+  //! Number of parameters of the C function.
+  uint8_t params = 0;
+  //! The C function returns a value.
+  bool returns = false;
+  //! A batched wrapper (func_c_name + "_batch") has been generated.
+  bool batched = false;
+  //! Native code of a colon definition (see ForthJIT.cpp). fun_ptr
+  //! is then a forth_jit_function.
+  bool jitted = false;
+  //! Lowest and highest depths of the data stack reached by the
+  //! jitted definition, relative to its depth when called.
+  int16_t dmin = 0;
+  int16_t dmax = 0;
 };
 
 // **************************************************************
@@ -61,17 +85,61 @@ public:
   //------------------------------------------------------------------
   std::pair<bool, std::string> end();
 
+  //------------------------------------------------------------------
+  //! \brief Index in m_functions of the first function of the latest
+  //! C library interface.
+  //------------------------------------------------------------------
+  inline size_t first() const
+  {
+    return m_first;
+  }
+
+  //------------------------------------------------------------------
+  //! \brief Compile (with optimizations) a C code generated by the
+  //! Forth itself as a dynamic library, load it and append the given
+  //! functions to m_functions. Used by the JIT compiler.
+  //! \param libname the name of the library (the hash of the code is
+  //! appended: a library already compiled is reused).
+  //! \param code the whole C code (including headers).
+  //! \param functions the functions (only func_c_name is needed) to
+  //! load from the library.
+  //! \return true and an empty string if the library has been compiled
+  //! and all functions have been found, else false and an error message.
+  //------------------------------------------------------------------
+  std::pair<bool, std::string> compile(std::string const& libname,
+                                       std::string const& code,
+                                       std::vector<CFuncHolder> const& functions);
+
+  //------------------------------------------------------------------
+  //! \brief Load the dynamic libraries already compiled of the given
+  //! functions and find their symbols. Functions without library are
+  //! kept with a null pointer. Used when restoring a snapshot.
+  //! \return true and an empty string if all functions have been
+  //! found (m_functions is then replaced), else false and an error
+  //! message (m_functions is unchanged).
+  //------------------------------------------------------------------
+  std::pair<bool, std::string> bind(std::vector<CFuncHolder> functions);
+
   //std::map<std::string, CFuncHolder> m_functions;
   std::vector<CFuncHolder> m_functions;
 
 private:
 
+  //------------------------------------------------------------------
+  //! \brief Compile the C file of a library, load it and find the
+  //! symbols of functions starting from the given index.
+  //------------------------------------------------------------------
+  std::pair<bool, std::string> build(std::string const& libname,
+                                     std::string const& options,
+                                     const size_t first);
+
   std::ofstream m_file;
   std::string m_libname;
   std::string m_sourcepath;
   std::string m_extlibs;
+  size_t m_first;
   bool m_closed;
-  Glib::Module *m_module; // Yeah pointer else local will close file and lost func pointers
+  std::vector<Glib::Module*> m_modules; // Yeah pointer else local will close file and lost func pointers
 };
 
 #endif
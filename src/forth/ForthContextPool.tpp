@@ -0,0 +1,158 @@
+//=====================================================================
+// SimTaDyn: A GIS in a spreadsheet.
+// Copyright 2018 Quentin Quadrat <lecrapouille@gmail.com>
+//
+// This file is part of SimTaDyn.
+//
+// SimTaDyn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SimTaDyn.  If not, see <http://www.gnu.org/licenses/>.
+//=====================================================================
+
+#ifndef FORTH_CONTEXT_POOL_TPP_
+#  define FORTH_CONTEXT_POOL_TPP_
+
+#  include <condition_variable>
+#  include <memory>
+#  include <mutex>
+#  include <vector>
+
+// **************************************************************
+//! \brief Pool of Forth contexts (stacks, registers, base, streams)
+//! sharing the dictionary of an owner Forth. Several threads can
+//! borrow a context and execute already compiled definitions at the
+//! same time. The owner is the only one allowed to modify the
+//! dictionary, and only while no context is borrowed.
+//!
+//! Contexts are created on demand and kept for the next borrowings.
+//! Context shall have a constructor taking an Owner& and a method
+//! attach(Owner&) called when it is borrowed (for resetting stacks
+//! and for getting the latest C functions of the owner).
+//!
+//! Example:
+//! \code
+//! auto context = forth.contexts().borrow();
+//! context->interpreteCell(cell);
+//! \endcode
+//! The context is given back to the pool when context is destroyed.
+// **************************************************************
+template <class Context, class Owner>
+class ForthContextPool
+{
+public:
+
+  // ************************************************************
+  //! \brief Handle on a borrowed context. Give back the context to
+  //! the pool when destroyed.
+  // ************************************************************
+  class Lease
+  {
+  public:
+
+    Lease(ForthContextPool& pool, Context& context)
+      : m_pool(&pool), m_context(&context)
+    {
+    }
+
+    Lease(Lease&& other) noexcept
+      : m_pool(other.m_pool), m_context(other.m_context)
+    {
+      other.m_pool = nullptr;
+    }
+
+    ~Lease()
+    {
+      if (nullptr != m_pool)
+        m_pool->release(*m_context);
+    }
+
+    inline Context& operator*() const { return *m_context; }
+    inline Context* operator->() const { return m_context; }
+
+  private:
+
+    Lease(Lease const&) = delete;
+    Lease& operator=(Lease const&) = delete;
+    Lease& operator=(Lease&&) = delete;
+
+    ForthContextPool* m_pool;
+    Context* m_context;
+  };
+
+  //! \brief Constructor.
+  //! \param owner the Forth owning the dictionary.
+  //! \param max the maximum number of contexts (0 for no limit). When
+  //! reached borrow() waits for a context to be given back.
+  ForthContextPool(Owner& owner, const size_t max = 0U)
+    : m_owner(owner), m_max(max), m_borrowed(0U)
+  {
+  }
+
+  //! \brief Get a free context (thread safe).
+  Lease borrow()
+  {
+    Context* context;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [this]{ return (!m_free.empty()) || (0U == m_max) ||
+                                     (m_contexts.size() < m_max); });
+      if (m_free.empty())
+        {
+          m_contexts.emplace_back(new Context(m_owner));
+          m_free.push_back(m_contexts.back().get());
+        }
+      context = m_free.back();
+      m_free.pop_back();
+      ++m_borrowed;
+    }
+    context->attach(m_owner);
+    return Lease(*this, *context);
+  }
+
+  //! \brief Return the number of contexts currently borrowed.
+  size_t borrowed() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_borrowed;
+  }
+
+  //! \brief Return the number of contexts created so far.
+  size_t size() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_contexts.size();
+  }
+
+private:
+
+  void release(Context& context)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_free.push_back(&context);
+      --m_borrowed;
+    }
+    m_cv.notify_one();
+  }
+
+  Owner& m_owner;
+  const size_t m_max;
+  size_t m_borrowed;
+  mutable std::mutex m_mutex;
+  std::condition_variable m_cv;
+  //! All contexts created.
+  std::vector<std::unique_ptr<Context>> m_contexts;
+  //! Contexts not borrowed.
+  std::vector<Context*> m_free;
+};
+
+#endif /* FORTH_CONTEXT_POOL_TPP_ */
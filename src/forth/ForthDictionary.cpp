@@ -20,24 +20,85 @@
 
 #include "ForthDictionary.hpp"
 #include <cstring>
+#include <new>
+#include <sys/mman.h>
 
 // **************************************************************
 //! Initialize dictionary states to obtain an empty dictionary
 //! (with no Forth words inside).
 // **************************************************************
-ForthDictionary::ForthDictionary()
+ForthDictionary::ForthDictionary(const uint32_t capacity)
+  : m_dictionary(nullptr), m_capacity(0U)
 {
   LOGI("Creating Forth dictionnary");
   m_here = 0U;
   m_last = 0U;
+  m_next_token = FORTH_FIRST_WORD_TOKEN;
 
-  // Useless but valgrind is complaining else
-  std::memset(m_dictionary, 0u, DICTIONARY_SIZE);
+  reserve(capacity);
+  m_xt.resize(65536U, 0U);
+  m_effects.resize(65536U);
 }
 
 ForthDictionary::~ForthDictionary()
 {
   LOGI("Destroying Forth dictionnary");
+  munmap(m_dictionary, m_capacity);
+}
+
+// **************************************************************
+//! Reserve the address space for the whole dictionary. Anonymous
+//! pages are zeroed and allocated by the system when touched, so
+//! there is no need to clear them.
+//! \param capacity the number of bytes (rounded up to a power of
+//! two, used by the inner interpreter for masking addresses).
+//! \throw std::bad_alloc if the memory cannot be reserved.
+// **************************************************************
+void ForthDictionary::reserve(const uint32_t capacity)
+{
+  uint32_t size = 4096U;
+  while ((size < capacity) && (size < (1U << 31U)))
+    size <<= 1U;
+
+  void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (MAP_FAILED == memory)
+    {
+      throw std::bad_alloc();
+    }
+
+  if (nullptr != m_dictionary)
+    {
+      munmap(m_dictionary, m_capacity);
+    }
+  m_dictionary = static_cast<Cell8*>(memory);
+  m_capacity = size;
+}
+
+// **************************************************************
+//! Replace the content of the dictionary by the one of another
+//! dictionary. The capacity is enlarged if needed.
+// **************************************************************
+ForthDictionary& ForthDictionary::operator=(ForthDictionary const& other)
+{
+  if (this != &other)
+    {
+      if (m_capacity < other.m_here)
+        {
+          reserve(other.m_capacity);
+        }
+      std::memcpy(m_dictionary, other.m_dictionary, other.m_here);
+      m_last = other.m_last;
+      m_here = other.m_here;
+      m_xt = other.m_xt;
+      m_next_token = other.m_next_token;
+      m_free_tokens = other.m_free_tokens;
+      m_reused = other.m_reused;
+      m_index = other.m_index;
+      m_indexed = other.m_indexed;
+      m_effects = other.m_effects;
+    }
+  return *this;
 }
 
 // **************************************************************
@@ -71,7 +132,7 @@ void ForthDictionary::add(const Cell16 token, char const* name, const size_t len
     }
 
   // No more space in the m_dictionary ?
-  if (length + 8U > DICTIONARY_SIZE) // 8U = padded(1: flags, 2: NFA, 2: token, 2: EXIT)
+  if (m_here + length + 10U > m_capacity) // 10U = padded(1: flags, 4: NFA, 2: token, 2: EXIT)
     {
       NoSpaceDictionary e; throw e;
     }
@@ -90,10 +151,80 @@ void ForthDictionary::add(const Cell16 token, char const* name, const size_t len
     }
 
   // Store the NFA of the preceding word
-  appendCell16(nfa);
+  appendCell32(nfa);
 
   // Store the token
   appendCell16(token);
+
+  // Index the new entry
+  uint32_t h = hash(name, length);
+  m_index[h].push_back(m_last);
+  m_indexed.push_back(std::make_pair(m_last, h));
+}
+
+// **************************************************************
+//! Append a new entry for a compiled word: its token is the next
+//! free identifier and its address is stored in the table of
+//! execution tokens.
+//! \param name of the Forth word.
+//! \param immediate a boolean indicating if the word shall be interpreted when compiled.
+//! \return the token of the new entry.
+//! \throw MalformedForthWord is the name of the word length is not <= 31
+//! characters.
+//! \throw NoSpaceDictionary if the dictionary or the table of tokens is full.
+// **************************************************************
+Cell16 ForthDictionary::add(std::string const& name, const bool immediate)
+{
+  // Tokens of released words are given when all tokens have been
+  // given once.
+  const bool reuse = (m_next_token >= m_xt.size());
+  if (reuse && m_free_tokens.empty())
+    {
+      NoSpaceDictionary e; throw e;
+    }
+
+  const Cell16 token = static_cast<Cell16>(reuse ? m_free_tokens.back() : m_next_token);
+  add(token, name.c_str(), name.size(), immediate);
+  m_xt[token] = m_here - 2U;
+  if (reuse)
+    {
+      m_free_tokens.pop_back();
+      m_reused.push_back(token);
+    }
+  else
+    {
+      ++m_next_token;
+    }
+  return token;
+}
+
+// **************************************************************
+//! The word will not be executed anymore: its token is given to a
+//! next entry and the memory of released words ending the
+//! dictionary is given back.
+//! \param token the token of a compiled word.
+// **************************************************************
+void ForthDictionary::release(const Cell16 token)
+{
+  if ((token < FORTH_FIRST_WORD_TOKEN) || (0U == m_xt[token]))
+    return ;
+
+  m_xt[token] = 0U;
+  m_effects[token].valid = false;
+  m_free_tokens.push_back(token);
+
+  // Forget entries which are not the current definition of their
+  // token (released or compiled again after them).
+  while (0U != m_last)
+    {
+      const Cell32 length = m_dictionary[m_last] & MASK_FORTH_NAME_SIZE;
+      const Cell16 last_token = read16at(m_last + length + 5U);
+      if ((last_token < FORTH_FIRST_WORD_TOKEN) ||
+          (m_last + length + 5U == m_xt[last_token]))
+        break;
+
+      truncate(m_last - read32at(m_last + length + 1U), m_last);
+    }
 }
 
 // **************************************************************
@@ -105,45 +236,147 @@ void ForthDictionary::add(const Cell16 token, char const* name, const size_t len
 // **************************************************************
 bool ForthDictionary::find(std::string const& name, Cell16& token, bool& immediate) const
 {
-  Cell32 nfa;
-  Cell32 length;
+  return find(name.c_str(), name.size(), token, immediate);
+}
 
-  // last is a Cell16 but for computation with minus operator we need 32bits
-  int32_t ptr = m_last;
+bool ForthDictionary::find(char const* name, const size_t length, Cell16& token, bool& immediate) const
+{
+  int32_t ptr = lookup(name, length, false);
 
-  // 0 (aka NULL) meaning the last m_dictionary entry.  Because we are
-  // using relative addresses as uint16_t to save space we cannot use
-  // NULL
+  if (ptr < 0)
+    return false;
+
+  // Set the param if the word is immediate
+  immediate = (m_dictionary[ptr] & FLAG_IMMEDIATE);
+
+  // Word found in dictionnary
+  token = read16at(ptr + length + 5U);
+  return true;
+}
+
+// **************************************************************
+//! Look for the most recent entry in the hash index instead of
+//! walking the linked list of entries. Entries are checked against
+//! the dictionary (name, flags and LAST) because the dictionary can
+//! be modified directly by Forth words.
+//! \param name (in) the name of the Forth word.
+//! \param length (in) the number of characters of the name.
+//! \param even_smudge (in) if false ignore smudged definitions.
+//! \return the NFA of the entry, else -1 if not found.
+// **************************************************************
+int32_t ForthDictionary::lookup(char const* name, const size_t length, const bool even_smudge) const
+{
+  auto it = m_index.find(hash(name, length));
+  if (m_index.end() == it)
+    return -1;
+
+  std::vector<Cell32> const& nfas = it->second;
+  for (auto nfa = nfas.rbegin(); nfa != nfas.rend(); ++nfa)
+    {
+      Cell8 flags = m_dictionary[*nfa];
+
+      // Ignore words with the SMUDGE bit and words after LAST
+      if ((*nfa > m_last) || ((flags & FLAG_SMUDGE) && !even_smudge))
+        continue;
+
+      // Compare name lengths before comparing strings
+      if ((length == (flags & MASK_FORTH_NAME_SIZE)) &&
+          (0 == std::memcmp(name, &m_dictionary[*nfa + 1U], length)))
+        return *nfa;
+    }
+
+  return -1;
+}
+
+// **************************************************************
+//! Called after the dictionary has been replaced.
+// **************************************************************
+void ForthDictionary::reindex()
+{
+  Cell32 nfa;
+  Cell32 length;
+  Cell32 ptr = m_last;
+  std::vector<Cell32> entries;
+
+  m_index.clear();
+  m_indexed.clear();
+  m_xt.assign(m_xt.size(), 0U);
+  m_next_token = FORTH_FIRST_WORD_TOKEN;
+  m_free_tokens.clear();
+  m_reused.clear();
+  if (0U == m_here)
+    return ;
+
+  // Collect entries from the most recent to the oldest
   do
     {
-      // Get the length of the forth name
+      entries.push_back(ptr);
       length = m_dictionary[ptr] & MASK_FORTH_NAME_SIZE;
+      nfa = read32at(ptr + length + 1U);
+      ptr = ptr - nfa;
+    } while (nfa);
 
-      // Ignore words with the SMUDGE bit */
-      if (!(m_dictionary[ptr] & FLAG_SMUDGE))
+  // Index them by order of creation
+  for (auto it = entries.rbegin(); it != entries.rend(); ++it)
+    {
+      length = m_dictionary[*it] & MASK_FORTH_NAME_SIZE;
+      uint32_t h = hash((char*) &m_dictionary[*it + 1U], length);
+      m_index[h].push_back(*it);
+      m_indexed.push_back(std::make_pair(*it, h));
+
+      // Table of execution tokens of compiled words
+      Cell16 token = read16at(*it + length + 5U);
+      if (token >= FORTH_FIRST_WORD_TOKEN)
         {
-          // Compare name lengths before comparing strings
-          if (length == name.size())
-            {
-              // Same length, check if names mismatch
-              if (0 == std::strncmp(name.c_str(), (char*) &m_dictionary[ptr + 1U], length))
-                {
-                  // Set the param if the word is immediate
-                  immediate = (m_dictionary[ptr] & FLAG_IMMEDIATE);
-
-                  // Word found in dictionnary
-                  token = read16at(ptr + length + 3U);
-                  return true;
-                }
-            }
+          m_xt[token] = *it + length + 5U;
+          if (token >= m_next_token)
+            m_next_token = token + 1U;
         }
+    }
+}
 
-      // Not found: go to the previous word
-      nfa = read16at(ptr + length + 1U);
-      ptr = ptr - nfa;
-    } while (nfa);
+// **************************************************************
+//! Restore LAST and HERE to older values (for example when the
+//! compilation of a word failed) and remove from the hash index
+//! and from the stack effects entries created after.
+//! \param last the new NFA of the most recent entry.
+//! \param here the new first free location.
+// **************************************************************
+void ForthDictionary::truncate(const Cell32 last, const Cell32 here)
+{
+  while ((m_next_token > FORTH_FIRST_WORD_TOKEN) &&
+         (m_xt[m_next_token - 1U] >= here))
+    {
+      --m_next_token;
+      m_xt[m_next_token] = 0U;
+      m_effects[m_next_token].valid = false;
+    }
+  // Released tokens given to forgotten entries are released again
+  while ((!m_reused.empty()) &&
+         ((0U == m_xt[m_reused.back()]) || (m_xt[m_reused.back()] >= here)))
+    {
+      const Cell16 token = m_reused.back();
+      m_reused.pop_back();
+      if (0U != m_xt[token])
+        {
+          m_xt[token] = 0U;
+          m_effects[token].valid = false;
+          m_free_tokens.push_back(token);
+        }
+    }
+  m_last = last;
+  m_here = here;
 
-  return false;
+  while ((!m_indexed.empty()) && (m_indexed.back().first >= here))
+    {
+      auto it = m_index.find(m_indexed.back().second);
+      it->second.pop_back();
+      if (it->second.empty())
+        {
+          m_index.erase(it);
+        }
+      m_indexed.pop_back();
+    }
 }
 
 // **************************************************************
@@ -151,17 +384,14 @@ bool ForthDictionary::find(std::string const& name, Cell16& token, bool& immedia
 //! \param partial_name the begining of a forth word.
 //! \return the address of the first matching name, else return nullptr.
 // **************************************************************
-const char* ForthDictionary::completion(Cell16& last, std::string const& partial_name) const
+const char* ForthDictionary::completion(Cell32& last, std::string const& partial_name) const
 {
   Cell32 nfa;
   Cell32 length;
-
-  // last is a Cell16 but for computation with minus operator we need 32bits
-  int32_t ptr = last;
+  Cell32 ptr = last;
 
   // 0 (aka NULL) meaning the last m_dictionary entry.  Because we are
-  // using relative addresses as uint16_t to save space we cannot use
-  // NULL
+  // using relative addresses we cannot use NULL
   do
     {
       // Get the length of the forth name
@@ -176,19 +406,19 @@ const char* ForthDictionary::completion(Cell16& last, std::string const& partial
                                 partial_name.length()))
             {
               // Go to the previous word
-              nfa = read16at(ptr + length + 1U);
-              last = (Cell16) ptr - nfa;
+              nfa = read32at(ptr + length + 1U);
+              last = ptr - nfa;
 
               return (char*) &m_dictionary[ptr + 1U];
             }
         }
 
       // Not found: go to the previous word
-      nfa = read16at(ptr + length + 1U);
+      nfa = read32at(ptr + length + 1U);
       ptr = ptr - nfa;
     } while (nfa);
 
-  last = (Cell16) ptr;
+  last = ptr;
   return nullptr;
 }
 
@@ -199,38 +429,14 @@ const char* ForthDictionary::completion(Cell16& last, std::string const& partial
 // **************************************************************
 bool ForthDictionary::smudge(std::string const& name)
 {
-  Cell32 nfa;
-  Cell32 length;
-
-  // last is a Cell16 but for computation with minus operator we need 32bits
-  int32_t ptr = m_last;
-
-  // 0 (aka NULL) meaning the last m_dictionary entry.  Because we are
-  // using relative addresses as uint16_t to save space we cannot use
-  // NULL
-  do
-    {
-      // Get the length of the forth name
-      length = m_dictionary[ptr] & MASK_FORTH_NAME_SIZE;
-
-      // Compare name lengths before comparing strings
-      if (length == name.size())
-        {
-          // Same length, check if names mismatch
-          if (0 == std::strncmp(name.c_str(), (char*) &m_dictionary[ptr + 1U], length))
-            {
-              // Toogle the smudge bit
-              m_dictionary[ptr] ^= FLAG_SMUDGE;
-              return true;
-            }
-        }
+  int32_t ptr = lookup(name.c_str(), name.size(), true);
 
-      // Not found: go to the previous word
-      nfa = read16at(ptr + length + 1U);
-      ptr = ptr - nfa;
-    } while (nfa);
+  if (ptr < 0)
+    return false;
 
-  return false;
+  // Toogle the smudge bit
+  m_dictionary[ptr] ^= FLAG_SMUDGE;
+  return true;
 }
 
 // **************************************************************
@@ -257,12 +463,10 @@ std::pair<bool, int32_t> ForthDictionary::find(const Cell16 token, const bool ev
   Cell32 nfa;
   Cell32 length;
 
-  // last is a Cell16 but for computation with minus operator we need 32bits
   int32_t ptr = m_last;
 
   // 0 (aka NULL) meaning the last m_dictionary entry.  Because we are
-  // using relative addresses as uint16_t to save space we cannot use
-  // NULL
+  // using relative addresses we cannot use NULL
   do
     {
       // Get the length of the forth name
@@ -272,7 +476,7 @@ std::pair<bool, int32_t> ForthDictionary::find(const Cell16 token, const bool ev
       if ((0 == (m_dictionary[ptr] & FLAG_SMUDGE)) || (even_smudge))
         {
           // Compare name lengths before comparing strings
-          if (token == read16at(ptr + length + 3U))
+          if (token == read16at(ptr + length + 5U))
             {
               // Word found in dictionnary
               return std::make_pair(true, ptr);
@@ -280,7 +484,7 @@ std::pair<bool, int32_t> ForthDictionary::find(const Cell16 token, const bool ev
         }
 
       // Not found: go to the previous word
-      nfa = read16at(ptr + length + 1U);
+      nfa = read32at(ptr + length + 1U);
       ptr = ptr - nfa;
     } while (nfa);
 
@@ -303,10 +507,10 @@ bool ForthDictionary::dump(std::string const& filename) // FIXME const
       // be sure that LAST will be splited in correct endian but
       // break the const-ness of the function.
       // TODO: ajouter un param ou commence la sauvegarde dans le dico (ex: skip primitives)
-      write16at(m_here, m_last);
+      write32at(m_here, m_last);
 
       // Store all the dictionary including LAST
-      out.write((char*) m_dictionary, (m_here + 2U) * sizeof (Cell8));
+      out.write((char*) m_dictionary, (m_here + 4U) * sizeof (Cell8));
       out.close();
       return true;
     }
@@ -339,6 +543,15 @@ bool ForthDictionary::load(std::string const& filename, const bool replace)
       in.seekg(0, in.end);
       Cell32 length = in.tellg();
       in.seekg(0, in.beg);
+      if ((length < 4U) || (length > m_capacity - (replace ? 0U : m_here)))
+        {
+          std::cerr << "Cannot load the dictionary from the file '"
+                    << filename
+                    << "'. Reason is the image is bigger than the dictionary size."
+                    << std::endl;
+          in.close();
+          return false;
+        }
 
       // Load the dictionary with LAST
       if (replace)
@@ -347,8 +560,8 @@ bool ForthDictionary::load(std::string const& filename, const bool replace)
           in.read((char*) m_dictionary, length);
 
           // Update Forth words LAST and HERE
-          m_here = m_here - 2U; // 2U because LAST was stored in file
-          m_last = read16at(m_here);
+          m_here = length - 4U; // 4U because LAST was stored in file
+          m_last = read32at(m_here);
         }
       else
         {
@@ -360,7 +573,7 @@ bool ForthDictionary::load(std::string const& filename, const bool replace)
           Cell32 word_length = m_dictionary[m_here] & MASK_FORTH_NAME_SIZE;
           try
             {
-              write16at(m_here + word_length + 1U, m_here - m_last);
+              write32at(m_here + word_length + 1U, m_here - m_last);
             }
           catch (const OutOfBoundDictionary& e)
             {
@@ -373,11 +586,15 @@ bool ForthDictionary::load(std::string const& filename, const bool replace)
             }
 
           // Update Forth words LAST and HERE
-          m_here = m_here + length - 2U; // 2U because LAST was stored in file
-          m_last = length - 2U + read16at(m_here);
+          Cell32 origin = m_here;
+          m_here = m_here + length - 4U; // 4U because LAST was stored in file
+          m_last = origin + read32at(m_here);
         }
 
       in.close();
+      reindex();
+      // Definitions will be checked by the inner interpreter
+      m_effects.assign(m_effects.size(), ForthWordEffect());
       return true;
     }
   else
@@ -410,6 +627,19 @@ std::string ForthDictionary::displayToken(const Cell16 token) const
   return stream.str();
 }
 
+// **************************************************************
+//! Slow (walk the whole dictionary): use it for displaying.
+// **************************************************************
+std::string ForthDictionary::name(const Cell16 token) const
+{
+  std::pair<bool, int32_t> res = find(token, true);
+  if (!res.first)
+    return std::string();
+
+  return std::string(reinterpret_cast<const char*>(&m_dictionary[res.second + 1U]),
+                     m_dictionary[res.second] & MASK_FORTH_NAME_SIZE);
+}
+
 // **************************************************************
 //
 // **************************************************************
@@ -445,10 +675,10 @@ void ForthDictionary::display(const int max_primitives) const
       immediate = m_dictionary[ptr] & FLAG_IMMEDIATE;
 
       // Next word in the dictionary (relative address)
-      nfa = read16at(ptr + length + 1U);
+      nfa = read32at(ptr + length + 1U);
 
       // Code Pointer (Exec token)
-      code = read16at(ptr + length + 3U);
+      code = read16at(ptr + length + 5U);
 
       // Select color depending on word flag bits
       if (immediate)
@@ -472,7 +702,7 @@ void ForthDictionary::display(const int max_primitives) const
       std::cout.flags(ifs);
 
       // Word definition
-      def_length = prev - ptr - length - 3U;
+      def_length = prev - ptr - length - 5U;
 
       // primitive
       if (code < max_primitives)
@@ -490,7 +720,7 @@ void ForthDictionary::display(const int max_primitives) const
           grouping = WORD_GROUPING;
           while ((grouping--) && (d < def_length))
             {
-              token = read16at(ptr + length + 3U + d);
+              token = read16at(ptr + length + 5U + d);
               d += 2U;
               std::cout << color << std::setfill('0') << std::setw(4) << std::hex << token << " ";
               std::cout.flags(ifs);
@@ -514,7 +744,7 @@ void ForthDictionary::display(const int max_primitives) const
                 {
                   if (0 == skip)
                     {
-                      uint32_t p = ptr + length + 3U + dd;
+                      uint32_t p = ptr + length + 5U + dd;
                       while (dd < def_length)
                         {
                           std::cout << LITERAL_COLOR << std::setfill('0') << std::setw(2) << std::hex << read8at(p) << " ";
@@ -531,7 +761,7 @@ void ForthDictionary::display(const int max_primitives) const
                 }
 
               if (truncated) { truncated = false; grouping--; }
-              token = read16at(ptr + length + 3U + dd);
+              token = read16at(ptr + length + 5U + dd);
               dd += 2U;
 
               // Not a primitive: display the name
@@ -546,11 +776,8 @@ void ForthDictionary::display(const int max_primitives) const
                     }
                   else
                     {
-                      // From NFA, go back to the begin of word definition
-                      // To get flags
-                      uint32_t j = token - 2U; // -2 fir skiping NFA
-                      while (0 == (m_dictionary[j] & 0x80))
-                        --j;
+                      // Begin of word definition to get flags
+                      uint32_t j = res.second;
 
                       // Colorize
                       if ((smudge) || (m_dictionary[j] & FLAG_SMUDGE))
@@ -643,6 +870,22 @@ void ForthDictionary::display(const int max_primitives) const
                             std::cout.flags(ifs);
                           }
                           break;
+                        case FORTH_PRIMITIVE_FLITERAL:
+                          {
+                            Float64 real = readFloatAt(p);
+                            dd += 8U;
+                            --grouping;
+                            std::cout << color1 << real << " ";
+                            std::cout.flags(ifs);
+                          }
+                          break;
+                        case FORTH_PRIMITIVE_BYTECODE:
+                          // Compact definition: the next bytes are not tokens
+                          std::cout << color << (char *) &m_dictionary[j + 1U] << " "
+                                    << color1 << std::dec << def_length - dd << " bytes ";
+                          std::cout.flags(ifs);
+                          dd = def_length;
+                          break;
                         default:
                           compiled = false;
                           std::cout << color << (char *) &m_dictionary[j + 1U] << " ";
@@ -685,7 +928,7 @@ void ForthDictionary::checkBounds(const uint32_t addr, const uint32_t nb_bytes)
 {
   // FIXME: proteger en ecriture les anciens mots definis
   // FIXME: autoriser en lecture toutes les addr du dico
-  if (/*(addr < m_here_at_colon) &&*/ (addr + nb_bytes >= DICTIONARY_SIZE))
+  if (/*(addr < m_here_at_colon) &&*/ (uint64_t(addr) + nb_bytes >= m_capacity))
     {
       OutOfBoundDictionary e(addr); throw e;
     }
@@ -732,6 +975,23 @@ void ForthDictionary::write32at(const uint32_t addr, const Cell32 data)
   m_dictionary[addr + 3U] = (data >> 0) & 0xFF;
 }
 
+// **************************************************************
+//! The IEEE-754 representation is stored as two big-endian 32-bits
+//! cells (most significant first) like any other dictionary data.
+//! \param data is the double to store at the given address.
+//! \param addr the desired dictionary address.
+//! \throw OutOfBoundDictionary if overflows/underflows is detected.
+// **************************************************************
+void ForthDictionary::writeFloatAt(const uint32_t addr, const Float64 data)
+{
+  uint64_t bits;
+
+  checkBounds(addr, 7U);
+  std::memcpy(&bits, &data, sizeof (bits));
+  write32at(addr, static_cast<Cell32>(bits >> 32));
+  write32at(addr + 4U, static_cast<Cell32>(bits));
+}
+
 // **************************************************************
 //! \param addr the desired dictionary address.
 //! \return the 8-bits data casted as Cell32 read at the given address.
@@ -776,6 +1036,23 @@ Cell32 ForthDictionary::read32at(const uint32_t addr) const
   return res;
 }
 
+// **************************************************************
+//! \param addr the desired dictionary address.
+//! \return the double read at the given address.
+//! \throw OutOfBoundDictionary if overflows/underflows is detected.
+// **************************************************************
+Float64 ForthDictionary::readFloatAt(const uint32_t addr) const
+{
+  checkBounds(addr, 7U);
+  const uint64_t bits =
+    (static_cast<uint64_t>(read32at(addr)) << 32) |
+    static_cast<uint64_t>(read32at(addr + 4U));
+  Float64 res;
+
+  std::memcpy(&res, &bits, sizeof (res));
+  return res;
+}
+
 // **************************************************************
 //! Reserve or release a consecutive number of bytes starting at
 //! ForthDictionary::m_here. Then ForthDictionary::m_here is updated. Values
@@ -26,6 +26,24 @@
 #  include "ForthExceptions.hpp"
 #  include "ForthPrimitives.hpp"
 #  include <cstring>
+#  include <unordered_map>
+#  include <vector>
+
+//! \brief Stack effect of a colon definition computed by
+//! Forth::analyzeStackEffect(). Data stack depths are relative to the
+//! depth when entering the definition. rmax is the maximal number of
+//! cells pushed on the return stack (the return address included).
+struct ForthWordEffect
+{
+  int16_t dmin = 0;
+  int16_t dmax = 0;
+  int16_t delta = 0;
+  int16_t rmax = 0;
+  bool valid = false;
+  //! The definition does not write in the dictionary: contexts
+  //! sharing the dictionary can execute it.
+  bool pure = false;
+};
 
 //! \class ForthDictionary
 //!
@@ -41,7 +59,7 @@
 //!  +--------+-----------------+--------------+-----------+---- - - - -
 //!  | LENGTH/| NAME            | LINK POINTER | TOKEN     | DEFINITION
 //!  | FLAGS  |                 |              |           |
-//!  + 1 byte +- 1 to 31 bytes -+-- 2 bytes ---+--2 bytes--+---- - - - -
+//!  + 1 byte +- 1 to 31 bytes -+-- 4 bytes ---+--2 bytes--+---- - - - -
 //! \endcode
 //!
 //! Example:
@@ -49,19 +67,20 @@
 //! ForthDictionary::dump() saves a dictionary in a binary file. Calling hexdump -C
 //! on this file will give a result similar to this:
 //! \code{.unparsed}
-//! 00000000  84 4e 4f 4f 50 00 00 00  00 c1 28 00 09 00 01  |.NOOP.....(.....|
+//! 00000000  84 4e 4f 4f 50 00 00 00  00 00 00 c1 28 00 00 00  |.NOOP.......(...|
+//! 00000010  0b 00 01                                          |...|
 //! \endcode
 //!
 //! Address 0x00000000 in the dictionary is the entry of the word NOOP.
 //! 0x84 as flags means the word name is 4 characters. 0x4e 0x4f 0x4f 0x50 are
-//! the ASCII code for "NOOP". 0x00 0x00 means the token 0 (primitive
-//! word) 0x00  0x00 is the LFA of the previous name. In this case because
-//! NOOP is the first entry there is no previous word so equivalent to NULL in C
-//! language.
+//! the ASCII code for "NOOP". 0x00 0x00 0x00 0x00 is the LFA of the previous
+//! name. In this case because NOOP is the first entry there is no previous
+//! word so equivalent to NULL in C language. 0x00 0x00 means the token 0
+//! (primitive word).
 //!
-//! Address 0x00000008 in the dictionary is the entry of the word (.
+//! Address 0x0000000b in the dictionary is the entry of the word (.
 //! 0xc1 as flags means the word name is 1 character and immediate. 0x28 is
-//! the ASCII code for (. 0x00 0x09 is LFA pointing to NOOP. 0x00 0x01
+//! the ASCII code for (. 0x00 0x00 0x00 0x0b is LFA pointing to NOOP. 0x00 0x01
 //! is the token 1 (primitive word).
 //!
 //! Description of the figure:
@@ -77,14 +96,22 @@
 //! NAME is the name of the word. Up to 31 caracter (usually ASCII).
 //!
 //! The LINK POINTER contains the RELATIVE address (not absolute) to
-//! the previous entry and it's named LFA. Note that with 2 bytes our
-//! dictionary has a maximum size of 65535 bytes. The most recently
-//! defined word is memorized by the member ForthDictionary::m_last and in
-//! Forth by the word LAST.
+//! the previous entry and it's named LFA. It is stored on 4 bytes so
+//! two consecutive entries can be separated by any number of bytes
+//! (for example a large ALLOT). The most recently defined word is
+//! memorized by the member ForthDictionary::m_last and in Forth by the
+//! word LAST.
 //!
 //! TOKEN is an unique identifier for each word in dictionary. It also
 //! allows to distinguish two kind of Forth words: primitives and
 //! compiled words. Primitives are Forth words calling machine code.
+//! Compiled words get consecutive tokens from FORTH_FIRST_WORD_TOKEN
+//! and a side table (ForthDictionary::xt) gives the address of their
+//! TOKEN field: definitions are stored with 16-bits tokens whatever
+//! the size of the dictionary.
+//! Tokens of words released by ForthDictionary::release (for example
+//! formulae of destroyed spreadsheet cells) are given again to new
+//! entries.
 //!
 //! The DEFINITION of the Forth word is a list of consecutive tokens.
 //! The address of the begining of the definition is named Code Field
@@ -97,24 +124,46 @@
 //! ForthDictionary::m_here and in Forth by the word DP or the word HERE.
 //! Contrary to other Forth virtual machine, here our dictionary does
 //! not need to manage aligned memories (padding) or manage endianess.
+//! The memory is reserved with mmap() for the whole capacity of the
+//! dictionary but the system only allocates pages when they are
+//! touched: a large capacity does not cost memory until it is used.
+//!
+//! Looking for a word by its name does not walk the linked list: a
+//! side hash index (hash of the name -> NFA of entries) is updated by
+//! ForthDictionary::add, ForthDictionary::truncate and
+//! ForthDictionary::load. Flags are read in the header when looking
+//! for a word, so smudged and shadowed words are correctly managed.
 class ForthDictionary
 {
 public:
-  //! \brief Constructor.
-  ForthDictionary();
+  //! \brief Constructor. Reserve capacity bytes (rounded up to a
+  //! power of two).
+  ForthDictionary(const uint32_t capacity = DICTIONARY_SIZE);
   ~ForthDictionary();
+  //! \brief Copy the content of another dictionary.
+  ForthDictionary& operator=(ForthDictionary const& other);
+  ForthDictionary(ForthDictionary const&) = delete;
+  //! \brief Append a new entry for a colon definition and return its
+  //! allocated token.
+  Cell16 add(std::string const& word, const bool immediate);
   void add(const Cell16 token, char const* name, const bool immediate);
   //! \brief Append a new Forth entry in the dictionary.
   void add(const Cell16 token, std::string const& word, const bool immediate);
   void add(const Cell16 token, char const* name, const size_t length, const bool immediate);
   //! \brief Look for a word in the dictionary.
   bool find(std::string const& word, Cell16& token, bool& immediate) const;
+  //! \brief Look for a word in the dictionary (the name does not need
+  //! to be ended by a null character).
+  bool find(char const* name, const size_t length, Cell16& token, bool& immediate) const;
   //! \brief Interface for ForthDictionary::find but hiding output parameters.
   bool exists(std::string const& word) const;
   //! \brief Look for a token in the dictionary.
   std::pair<bool, int32_t> find(const Cell16 token, const bool even_smudge = false) const;
+  //! \brief Return the name of the word having the given token (or
+  //! an empty string if not found). Smudged words are also looked for.
+  std::string name(const Cell16 token) const;
   //! \brief Get the complete name given a partial Forth name (used for auto-completion).
-  const char* completion(Cell16& last, std::string const& partial_word) const;
+  const char* completion(Cell32& last, std::string const& partial_word) const;
   //! \brief Hide or unhide a Forth definition from the user.
   bool smudge(std::string const& word);
   //! \brief Save the whole content of the dictionary in a binary file.
@@ -124,24 +173,50 @@ public:
   //! \brief Pretty print the dictionary in std::cout.
   virtual void display(const int max_primitives) const;
   //! \brief Accessor. Return the most recent entry in the dictionary.
-  inline Cell16 last() const { return m_last; }
+  inline Cell32 last() const { return m_last; }
   //! \brief Accessor. Return the address of the first free location in the dictionary.
-  inline Cell16 here() const { return m_here; }
+  inline Cell32 here() const { return m_here; }
   //! \brief Accessor. Modify the address of the first free location in the dictionary.
-  inline void here(const Cell16 here) { m_here = here; }
+  inline void here(const Cell32 here) { m_here = here; }
+  //! \brief Accessor. Return the number of bytes the dictionary can hold.
+  inline Cell32 capacity() const { return m_capacity; }
+  //! \brief Accessor. Return the address of the TOKEN field of a
+  //! compiled word (its definition starts just after), or 0 if the
+  //! token is not a compiled word.
+  inline Cell32 xt(const Cell16 token) const { return m_xt[token]; }
+  //! \brief Accessor. Change the address of the TOKEN field of a
+  //! compiled word (its definition has been compiled again).
+  inline void xt(const Cell16 token, const Cell32 address) { m_xt[token] = address; }
   //! \brief Reserve or release a chunk of memory in the dictionary.
   void allot(const int32_t nb_bytes);
+  //! \brief Accessor. Return the stack effect of a colon definition.
+  inline ForthWordEffect const& effect(const Cell16 token) const
+  {
+    return m_effects[token];
+  }
+  //! \brief Accessor. Store the stack effect of a colon definition.
+  inline void effect(const Cell16 token, ForthWordEffect const& effect)
+  {
+    m_effects[token] = effect;
+  }
+  //! \brief Forget all entries created after the given LAST and HERE.
+  void truncate(const Cell32 last, const Cell32 here);
+  //! \brief Give back the token of a compiled word which will not be
+  //! executed anymore.
+  void release(const Cell16 token);
   //! \brief Store a byte at the end of the dictionnary. Endianess is hiden.
   //! ForthDictionary::m_here is updated.
   //! \param data is a 32-bits data (casted into Cell8) to store at location ForthDictionary::m_here
   //! \throw OutOfBoundDictionary if overflows/underflows is detected.
   inline void appendCell8(const Cell32 data)
   {
+    checkBounds(m_here, 1U); // HERE shall not wrap
     write8at(m_here, data);
     ++m_here;
   }
   inline void appendCell8(const char data)
   {
+    checkBounds(m_here, 1U); // HERE shall not wrap
     m_dictionary[m_here++] = static_cast<uint8_t>(data);
   }
   //! \brief Store two consecutive bytes at the end of the dictionnary. Endianess is hiden.
@@ -150,6 +225,7 @@ public:
   //! \throw OutOfBoundDictionary if overflows/underflows is detected.
   inline void appendCell16(const Cell32 data)
   {
+    checkBounds(m_here, 2U); // HERE shall not wrap
     write16at(m_here, data);
     ++m_here;
     ++m_here;
@@ -160,18 +236,30 @@ public:
   //! \throw OutOfBoundDictionary if overflows/underflows is detected.
   inline void appendCell32(const Cell32 data)
   {
+    checkBounds(m_here, 4U); // HERE shall not wrap
     write32at(m_here, data);
     ++m_here;
     ++m_here;
     ++m_here;
     ++m_here;
   }
+  //! \brief Store a double (8 consecutive bytes) at the end of the
+  //! dictionnary. Endianess is hiden. ForthDictionary::m_here is updated.
+  //! \throw OutOfBoundDictionary if overflows/underflows is detected.
+  inline void appendFloat(const Float64 data)
+  {
+    checkBounds(m_here, 8U); // HERE shall not wrap
+    writeFloatAt(m_here, data);
+    m_here += 8U;
+  }
   //! \brief Read a byte at given address in the dictionnary. Endianess is hiden.
   Cell32 read8at(const uint32_t addr) const;
   //! \brief Read two consecutive bytes at given address in the dictionnary. Endianess is hiden.
   Cell32 read16at(const uint32_t addr) const;
   //! \brief Read four consecutive bytes at given address in the dictionnary. Endianess is hiden.
   Cell32 read32at(const uint32_t addr) const;
+  //! \brief Read a double (8 consecutive bytes) at given address in the dictionnary. Endianess is hiden.
+  Float64 readFloatAt(const uint32_t addr) const;
   //! \brief Safe move a chunck of memory in the dictionary.
   inline void move(const uint32_t destination,
                    const uint32_t source,
@@ -193,18 +281,56 @@ protected:
   void write16at(const uint32_t addr, const Cell32 data);
   //! \brief Store four consecutive bytes at given address in the dictionnary. Endianess is hiden.
   void write32at(const uint32_t addr, const Cell32 data);
+  //! \brief Store a double (8 consecutive bytes) at given address in the dictionnary. Endianess is hiden.
+  void writeFloatAt(const uint32_t addr, const Float64 data);
   //! \brief Safe guard. Check if given address is inside the dictionary.
   void checkBounds(const uint32_t addr, const uint32_t nb_bytes) const;
+  //! \brief Return the NFA of the most recent entry named name, else -1.
+  int32_t lookup(char const* name, const size_t length, const bool even_smudge) const;
+  //! \brief Rebuild the hash index from the linked list of entries.
+  void reindex();
+  //! \brief Hash function (FNV-1a) for Forth names.
+  static inline uint32_t hash(char const* name, const size_t length)
+  {
+    uint32_t h = 2166136261U;
+    for (size_t i = 0; i < length; ++i)
+      {
+        h = (h ^ static_cast<uint8_t>(name[i])) * 16777619U;
+      }
+    return h;
+  }
 
   //! \brief Allow the Forth context class to modify the dictionary.
   friend class Forth;
 
-  //! The memory of the dictionary.
-  Cell8   m_dictionary[DICTIONARY_SIZE];
+  //! \brief Reserve the memory of the dictionary.
+  void reserve(const uint32_t capacity);
+
+  //! The memory of the dictionary (pages allocated on demand).
+  Cell8  *m_dictionary;
+  //! Number of bytes reserved for the dictionary (power of two).
+  Cell32  m_capacity;
   //! Name Field Address (NFA) of the most recently entry (Forth word: LAST).
-  Cell16  m_last;
+  Cell32  m_last;
   //! Address of the first free location in the dictionary (Forth word: HERE, DP).
-  Cell16  m_here;
+  Cell32  m_here;
+  //! Address of the TOKEN field of compiled words indexed by their token.
+  std::vector<Cell32> m_xt;
+  //! Next token given to a compiled word.
+  Cell32  m_next_token;
+  //! Tokens of released words, given to new entries once all tokens
+  //! have been given.
+  std::vector<Cell16> m_free_tokens;
+  //! Released tokens given to new entries (by order of creation).
+  std::vector<Cell16> m_reused;
+  //! Hash index: hash of a name -> NFA of entries having this hash
+  //! (the most recent entry is at the back).
+  std::unordered_map<uint32_t, std::vector<Cell32>> m_index;
+  //! NFA and hash of the indexed entries by order of creation. Used
+  //! for removing entries when the dictionary is truncated.
+  std::vector<std::pair<Cell32, uint32_t>> m_indexed;
+  //! Stack effects of colon definitions indexed by their token.
+  std::vector<ForthWordEffect> m_effects;
   // FIXME std::string m_name;
 };
 
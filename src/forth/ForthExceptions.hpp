@@ -191,4 +191,30 @@ public:
   }
 };
 
+// **************************************************************
+//
+// **************************************************************
+class ReadOnlyDictionary: public ForthException
+{
+public:
+  ReadOnlyDictionary(std::string const& word)
+    : ForthException(33)
+  {
+    m_msg = "Cannot create the word '" + word + "' in a dictionary shared by several contexts";
+  }
+};
+
+// **************************************************************
+//
+// **************************************************************
+class SharedDictionaryStore: public ForthException
+{
+public:
+  SharedDictionaryStore(std::string const& word)
+    : ForthException(43)
+  {
+    m_msg = "Cannot execute the word '" + word + "' which may write in a dictionary shared by several contexts";
+  }
+};
+
 #endif /* FORTH_EXCEPTIONS_HPP_ */
@@ -36,6 +36,7 @@
 typedef uint32_t       Cell32;
 typedef uint16_t       Cell16;
 typedef uint8_t        Cell8;
+typedef double         Float64;
 
 // Memory cast
 #  define ADDR8(x)       (reinterpret_cast<Cell8*>(x))
@@ -54,14 +55,26 @@ typedef uint8_t        Cell8;
 #  define STACK_UNDERFLOW_MARGIN (8U) // bytes
 //ASSERT_COMPILE_TIME(STACK_UNDERFLOW_MARGIN < STACK_SIZE)
 
-// Memory for the dictionnary
-// 64 Ko is the maximal reachable address with a 16-bits word
-// FIXME: Maybe we can divide / 2 addresses because they are aligned.
-#  define DICTIONARY_SIZE (64U * 1024U) // of bytes
+// Default memory for the dictionnary. Addresses are 32-bits so the
+// size can be changed when building or given to the constructor of
+// ForthDictionary (rounded up to a power of two). Memory pages are
+// only allocated when they are used, so the default leaves room for
+// arrays (ALLOT) bigger than 64 KiB.
+#  ifndef DICTIONARY_SIZE
+#    define DICTIONARY_SIZE (16U * 1024U * 1024U) // of bytes
+#  endif
+
+//! Tokens of colon definitions are identifiers (not addresses)
+//! allocated from this value. It shall be greater than the number of
+//! primitives of all Forth classes.
+#  define FORTH_FIRST_WORD_TOKEN (0x0400U)
+
+//! Value of the instruction pointer when no colon definition is
+//! executed.
+#  define FORTH_NO_IP (0xFFFFFFFFU)
 
 //
 #  define CELL16_MAX_VALUE (65535U)
-// FIXME: COMPIL_ASSERT_TIME((DICTIONARY_SIZE - 1U) <= CELL16_MAX_VALUE)
 
 // Used for aligning 32-bits addresses
 #  define NEXT_MULTIPLE_OF_4(x) (((x) + 3) & ~0x03)
@@ -90,6 +103,15 @@ typedef uint8_t        Cell8;
 #  define ADROP()  (*(--m_asp))              // Discard the top of the stack
 #  define APOP(r)  (r = ADROP())             // Discard the top of the stack, save its value in the register
 
+// Floating point stack. There is no cached top of stack: values are
+// kept contiguous in memory. Words check its depth before using it
+// (see Forth::checkFloatStack).
+#  define FPUSH(f) (*(m_fsp++) = (f))        // Store the float f on the top of stack
+#  define FDROP()  (*(--m_fsp))              // Discard the top of the stack, return its value
+#  define FNIP()   (--m_fsp)                 // Discard the top of the stack
+#  define FPOP(r)  (r = FDROP())             // Discard the top of the stack, save its value in the register r
+#  define FPICK(n) (*(m_fsp - n - 1))        // Look at the nth element of the stack from the top (0 = 1st element)
+
 // Return stack (store calling functions (tokens))
 #  define RPUSH(a)  (*(m_rsp++) = CELL32(a)) // Store an address a on the top of stack
 #  define RPOP(r)   (r = *(--m_rsp))         // Discard the top of the stack
@@ -209,6 +231,20 @@ using ForthConsoleColor = termcolor::color;
 #define DICO_DEFAULT_COLOR                              \
   termcolor::color(termcolor::style::bold, termcolor::fg::gray)
 
+// **************************************************************
+//! FNV-1a hash (64 bits). Used for identifying snapshots and
+//! compiled C libraries.
+// **************************************************************
+static inline uint64_t fnv64(const char* data, const size_t length,
+                             uint64_t h = 14695981039346656037ULL)
+{
+  for (size_t i = 0; i < length; ++i)
+    {
+      h = (h ^ static_cast<uint8_t>(data[i])) * 1099511628211ULL;
+    }
+  return h;
+}
+
 // **************************************************************
 //
 // **************************************************************
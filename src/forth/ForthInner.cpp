@@ -0,0 +1,558 @@
+//=====================================================================
+// SimTaDyn: A GIS in a spreadsheet.
+// Copyright 2018 Quentin Quadrat <lecrapouille@gmail.com>
+//
+// This file is part of SimTaDyn.
+//
+// SimTaDyn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SimTaDyn.  If not, see <http://www.gnu.org/licenses/>.
+//=====================================================================
+
+//! \brief This file contains the direct threaded inner interpreter
+//! of the Forth. The most used primitives (stack, arithmetic,
+//! branches, literals, return stack ...) are executed here without
+//! leaving the loop. Other primitives (and primitives added by
+//! derived classes) are delegated to the virtual execPrimitive().
+
+#include "Forth.hpp"
+
+#if FORTH_DIRECT_THREADING
+
+#  define BINARY_OP(op) { m_tos = ((int32_t) DDROP()) op ((int32_t) m_tos); }
+#  define LOGICAL_OP(op) { m_tos = -1 * (((int32_t) DDROP()) op ((int32_t) m_tos)); }
+
+// Read the dictionary without checking bounds: the address is
+// wrapped inside the dictionary (its capacity is a power of two).
+#  define READ16(a) ((Cell16) ((dico[(a) & mask] << 8U) | dico[((a) + 1U) & mask]))
+#  define READ32(a) ((Cell32) ((READ16(a) << 16U) | READ16((a) + 2U)))
+
+// Check stacks with pointers comparisons (cheap). On fault let
+// isStackUnderOverFlow() throw the exception with the correct depth.
+#  define CHECK_STACKS()                                                \
+  if ((m_dsp < dsp_min) || (m_dsp > dsp_max) ||                         \
+      (m_rsp < rsp_min) || (m_rsp > rsp_max))                           \
+    {                                                                   \
+      isStackUnderOverFlow(forth::DataStack);                           \
+      isStackUnderOverFlow(forth::ReturnStack);                         \
+    }
+
+// List of primitives executed by the threaded interpreter.
+#  define THREADED_PRIMITIVES(X)                                        \
+  X(FORTH_PRIMITIVE_EXIT) X(FORTH_PRIMITIVE_BRANCH)                     \
+  X(FORTH_PRIMITIVE_0BRANCH) X(FORTH_PRIMITIVE_EXECUTE)                 \
+  X(FORTH_PRIMITIVE_LITERAL_16) X(FORTH_PRIMITIVE_LITERAL_32)           \
+  X(FORTH_PRIMITIVE_TO_RSTACK) X(FORTH_PRIMITIVE_2TO_RSTACK)            \
+  X(FORTH_PRIMITIVE_FROM_RSTACK) X(FORTH_PRIMITIVE_2FROM_RSTACK)        \
+  X(FORTH_PRIMITIVE_I) X(FORTH_PRIMITIVE_J)                             \
+  X(FORTH_PRIMITIVE_CELL) X(FORTH_PRIMITIVE_CELLS)                      \
+  X(FORTH_PRIMITIVE_FETCH) X(FORTH_PRIMITIVE_STORE32)                   \
+  X(FORTH_PRIMITIVE_STORE16) X(FORTH_PRIMITIVE_STORE8)                  \
+  X(FORTH_PRIMITIVE_1MINUS) X(FORTH_PRIMITIVE_1PLUS)                    \
+  X(FORTH_PRIMITIVE_2MINUS) X(FORTH_PRIMITIVE_2PLUS)                    \
+  X(FORTH_PRIMITIVE_DROP) X(FORTH_PRIMITIVE_DEPTH)                      \
+  X(FORTH_PRIMITIVE_NIP) X(FORTH_PRIMITIVE_PICK)                        \
+  X(FORTH_PRIMITIVE_DUP) X(FORTH_PRIMITIVE_QDUP)                        \
+  X(FORTH_PRIMITIVE_SWAP) X(FORTH_PRIMITIVE_OVER)                       \
+  X(FORTH_PRIMITIVE_ROT) X(FORTH_PRIMITIVE_TUCK)                        \
+  X(FORTH_PRIMITIVE_2DUP) X(FORTH_PRIMITIVE_2OVER)                      \
+  X(FORTH_PRIMITIVE_2SWAP) X(FORTH_PRIMITIVE_2DROP)                     \
+  X(FORTH_PRIMITIVE_NEGATE) X(FORTH_PRIMITIVE_ABS)                      \
+  X(FORTH_PRIMITIVE_PLUS) X(FORTH_PRIMITIVE_MINUS)                      \
+  X(FORTH_PRIMITIVE_DIV) X(FORTH_PRIMITIVE_TIMES)                       \
+  X(FORTH_PRIMITIVE_RSHIFT) X(FORTH_PRIMITIVE_LSHIFT)                   \
+  X(FORTH_PRIMITIVE_GREATER_EQUAL) X(FORTH_PRIMITIVE_LOWER_EQUAL)       \
+  X(FORTH_PRIMITIVE_GREATER) X(FORTH_PRIMITIVE_LOWER)                   \
+  X(FORTH_PRIMITIVE_EQUAL) X(FORTH_PRIMITIVE_0EQUAL)                    \
+  X(FORTH_PRIMITIVE_NOT_EQUAL) X(FORTH_PRIMITIVE_AND)                   \
+  X(FORTH_PRIMITIVE_OR) X(FORTH_PRIMITIVE_XOR)                          \
+  X(FORTH_PRIMITIVE_MIN) X(FORTH_PRIMITIVE_MAX)                         \
+  X(FORTH_PRIMITIVE_DUP_TO_RSTACK) X(FORTH_PRIMITIVE_FROM_RSTACK_1PLUS) \
+  X(FORTH_PRIMITIVE_LITERAL_16_PLUS) X(FORTH_PRIMITIVE_0EQUAL_0BRANCH)
+
+#if FORTH_HAS_COMPUTED_GOTO
+#  define CODE(p)      code_##p:
+#  define REGISTER(p)  m_threaded_code[p] = &&code_##p;
+#  define DISPATCH()                                                    \
+  do {                                                                  \
+    FORTH_PROFILE_COUNT(m_profiler, token);                             \
+    if (token >= FORTH_MAX_PRIMITIVES) goto not_a_core_primitive;       \
+    goto *m_threaded_code[token];                                       \
+  } while (0)
+#else
+#  define CODE(p)      case p:
+#  define DISPATCH()   goto dispatch
+#endif
+
+// Count a yield point and leave when the budget of Forth::run() is
+// exhausted. The current token is executed when resuming.
+#  define YIELD_POINT()                                                 \
+  if (0U == --m_ticks) goto budget_exhausted
+
+// Leave the primitive: check stacks (except inside a definition
+// whose bounds have been checked when entering it), fetch the next
+// token and jump to its code. IP == FORTH_NO_IP means the executed
+// token was a primitive or the last EXIT of the executed word.
+#  define NEXT()                                                        \
+  do {                                                                  \
+    if (nullptr == guard) { CHECK_STACKS(); }                           \
+    if (FORTH_NO_IP == ip) goto leave;                                  \
+    ip += 2U;                                                           \
+    token = READ16(ip);                                                 \
+    DISPATCH();                                                         \
+  } while (0)
+
+// **************************************************************
+//! Same behavior than the classic loop of execToken() but the
+//! instruction pointer and the dictionary are kept in local
+//! variables and primitives jump directly to the next one. The
+//! member m_ip is only updated when calling execPrimitive() (some
+//! primitives like COMPILE read it) and is restored when leaving
+//! because EXECUTE or INCLUDE can call execToken() recursively.
+//! \param tx the token to execute.
+// **************************************************************
+void Forth::execTokenThreaded(const Cell16 tx)
+{
+#if FORTH_HAS_COMPUTED_GOTO
+  if (!m_threaded_ready)
+    {
+      for (uint32_t i = 0; i < FORTH_MAX_PRIMITIVES; ++i)
+        {
+          m_threaded_code[i] = &&fallback;
+        }
+      THREADED_PRIMITIVES(REGISTER);
+      m_threaded_ready = true;
+    }
+#endif
+
+  const Cell8 *const dico = m_dictionary.m_dictionary;
+  const Cell32 mask = m_dictionary.capacity() - 1U;
+  const Cell32 *const xt = m_dictionary.m_xt.data();
+  const uint32_t max_primitives = maxPrimitives();
+  const Cell32 *const dsp_min = m_data_stack - 1;
+  const Cell32 *const dsp_max = m_data_stack + (STACK_SIZE - STACK_UNDERFLOW_MARGIN - 1U);
+  const Cell32 *const rsp_min = m_return_stack - 1;
+  const Cell32 *const rsp_max = m_return_stack + (STACK_SIZE - STACK_UNDERFLOW_MARGIN - 1U);
+  const Cell32 saved_ip = m_ip;
+#if FORTH_STACK_EFFECTS
+  // Return stack pointer before entering the outermost bounded
+  // definition (see Forth::analyzeStackEffect). Stacks are not
+  // checked until its EXIT.
+  Cell32 *guard = nullptr;
+#else
+  Cell32 *const guard = nullptr;
+#endif
+  Cell32 ip = FORTH_NO_IP;
+  Cell16 token = tx;
+  Cell32 c;
+
+  // Always eat the top of the stack and store the value in a working register.
+  DPOP(m_tos);
+
+  // Continue an execution interrupted by its budget
+  if (m_resuming)
+    {
+      m_resuming = false;
+      ip = m_yield_ip;
+    }
+  DISPATCH();
+
+#if !FORTH_HAS_COMPUTED_GOTO
+ dispatch:
+  FORTH_PROFILE_COUNT(m_profiler, token);
+  if (token >= FORTH_MAX_PRIMITIVES)
+    goto not_a_core_primitive;
+
+  switch (token)
+    {
+#endif
+
+      // Restore the IP when interpreting the definition
+      // of a non primitive word
+      CODE(FORTH_PRIMITIVE_EXIT)
+        FORTH_PROFILE_LEAVE(m_profiler);
+        RPOP(c);
+        ip = c;
+#if FORTH_STACK_EFFECTS
+        if (m_rsp == guard)
+          guard = nullptr;
+#endif
+        NEXT();
+
+      // Change IP (signed offset). Do not forget that IP will be += 2 by NEXT
+      CODE(FORTH_PRIMITIVE_BRANCH)
+        YIELD_POINT();
+        ip += static_cast<int16_t>(READ16(ip + 2U));
+        NEXT();
+
+      // Change IP if top of stack is 0
+      CODE(FORTH_PRIMITIVE_0BRANCH)
+        YIELD_POINT();
+        ip += (0 == m_tos) ? static_cast<int16_t>(READ16(ip + 2U)) : 2;
+        DPOP(m_tos);
+        NEXT();
+
+      // Execute the token without recursion: when the token is a
+      // colon definition its EXIT will come back after EXECUTE.
+      CODE(FORTH_PRIMITIVE_EXECUTE)
+        token = static_cast<Cell16>(m_tos);
+        DPOP(m_tos);
+        DISPATCH();
+
+      CODE(FORTH_PRIMITIVE_LITERAL_16)
+        DPUSH(m_tos);
+        ip += 2U; // Skip primitive LITERAL
+        m_tos = READ16(ip);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_LITERAL_32)
+        DPUSH(m_tos);
+        ip += 2U; // Skip primitive LITERAL
+        m_tos = READ32(ip);
+        ip += 2U; // Skip the number - 2 because of next ip
+        NEXT();
+
+      // ( x -- ) ( R: -- x )
+      CODE(FORTH_PRIMITIVE_TO_RSTACK)
+        RPUSH(m_tos);
+        DPOP(m_tos);
+        NEXT();
+
+      // ( x1 x2 -- ) ( R: -- x1 x2 )
+      CODE(FORTH_PRIMITIVE_2TO_RSTACK)
+        DPOP(m_tos1);
+        RPUSH(m_tos1);
+        RPUSH(m_tos);
+        DPOP(m_tos);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_FROM_RSTACK)
+        DPUSH(m_tos);
+        RPOP(m_tos);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_2FROM_RSTACK)
+        DPUSH(m_tos);
+        RPOP(m_tos);
+        RPOP(m_tos1);
+        DPUSH(m_tos1);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_I)
+        DPUSH(m_tos);
+        m_tos = RPICK(0);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_J)
+        DPUSH(m_tos);
+        m_tos = RPICK(2);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_CELL)
+        DPUSH(m_tos);
+        m_tos = sizeof (Cell32);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_CELLS)
+        m_tos = m_tos * sizeof (Cell32);
+        NEXT();
+
+      // Accessing to user data is checked.
+      CODE(FORTH_PRIMITIVE_FETCH)
+        m_tos = m_dictionary.read32at(m_tos);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_STORE32)
+        DPOP(m_tos1);
+        m_dictionary.write32at(m_tos, m_tos1);
+        DPOP(m_tos);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_STORE16)
+        DPOP(m_tos1);
+        m_dictionary.write16at(m_tos, m_tos1);
+        DPOP(m_tos);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_STORE8)
+        DPOP(m_tos1);
+        m_dictionary.write8at(m_tos, m_tos1);
+        DPOP(m_tos);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_1MINUS)
+        --m_tos;
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_1PLUS)
+        ++m_tos;
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_2MINUS)
+        m_tos -= 2;
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_2PLUS)
+        m_tos += 2;
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_DROP)
+        DPOP(m_tos);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_DEPTH)
+        DPUSH(m_tos);
+        m_tos = stackDepth(forth::DataStack);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_NIP)
+        DPOP(m_tos1);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_PICK)
+        m_tos = DPICK(m_tos);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_DUP)
+        DPUSH(m_tos);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_QDUP)
+        if (m_tos)
+          {
+            DPUSH(m_tos);
+          }
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_SWAP)
+        m_tos2 = m_tos;
+        DPOP(m_tos);
+        DPUSH(m_tos2);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_OVER)
+        DPUSH(m_tos);
+        m_tos = DPICK(1);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_ROT)
+        DPOP(m_tos2);
+        DPOP(m_tos3);
+        DPUSH(m_tos2);
+        DPUSH(m_tos);
+        m_tos = m_tos3;
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_TUCK)
+        DPOP(m_tos2);
+        DPUSH(m_tos);
+        DPUSH(m_tos2);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_2DUP)
+        DPUSH(m_tos);
+        m_tos2 = DPICK(1);
+        DPUSH(m_tos2);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_2OVER)
+        DPUSH(m_tos);
+        m_tos2 = DPICK(3);
+        DPUSH(m_tos2);
+        m_tos = DPICK(3);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_2SWAP)
+        DPOP(m_tos1);
+        DPOP(m_tos2);
+        DPOP(m_tos3);
+        DPUSH(m_tos1);
+        DPUSH(m_tos);
+        DPUSH(m_tos3);
+        m_tos = m_tos2;
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_2DROP)
+        DPOP(m_tos);
+        DPOP(m_tos);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_NEGATE)
+        m_tos = -m_tos;
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_ABS)
+        m_tos = std::abs((int32_t) m_tos);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_PLUS)
+        BINARY_OP(+);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_MINUS)
+        BINARY_OP(-);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_DIV)
+        BINARY_OP(/);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_TIMES)
+        BINARY_OP(*);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_RSHIFT)
+        BINARY_OP(>>);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_LSHIFT)
+        BINARY_OP(<<);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_GREATER_EQUAL)
+        LOGICAL_OP(>=);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_LOWER_EQUAL)
+        LOGICAL_OP(<=);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_GREATER)
+        LOGICAL_OP(>);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_LOWER)
+        LOGICAL_OP(<);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_EQUAL)
+        LOGICAL_OP(==);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_0EQUAL)
+        DPUSH(0U);
+        LOGICAL_OP(==);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_NOT_EQUAL)
+        LOGICAL_OP(!=);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_AND)
+        BINARY_OP(&);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_OR)
+        BINARY_OP(|);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_XOR)
+        BINARY_OP(^);
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_MIN)
+        DPOP(m_tos1);
+        m_tos = ((int32_t) m_tos < (int32_t) m_tos1) ? m_tos : m_tos1;
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_MAX)
+        DPOP(m_tos1);
+        m_tos = ((int32_t) m_tos > (int32_t) m_tos1) ? m_tos : m_tos1;
+        NEXT();
+
+      // Superinstructions: the fused tokens are still stored after
+      // the superinstruction (branches may jump on them), skip them.
+      CODE(FORTH_PRIMITIVE_DUP_TO_RSTACK)
+        RPUSH(m_tos);
+        ip += 2U;
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_FROM_RSTACK_1PLUS)
+        DPUSH(m_tos);
+        RPOP(m_tos);
+        ++m_tos;
+        ip += 2U;
+        NEXT();
+
+      CODE(FORTH_PRIMITIVE_LITERAL_16_PLUS)
+        m_tos += READ16(ip + 2U);
+        ip += 4U;
+        NEXT();
+
+      // 0= then 0BRANCH: branch if the top of stack is not 0
+      CODE(FORTH_PRIMITIVE_0EQUAL_0BRANCH)
+        YIELD_POINT();
+        ip += (0 != m_tos) ? (static_cast<int16_t>(READ16(ip + 4U)) + 2) : 4;
+        DPOP(m_tos);
+        NEXT();
+
+#if !FORTH_HAS_COMPUTED_GOTO
+    default:
+      goto fallback;
+    }
+#endif
+
+ not_a_core_primitive:
+  if (token < max_primitives)
+    goto fallback;
+  YIELD_POINT();
+
+  // Non primitive word: save the next token to exec after the end of
+  // the definition and jump to the first token of the definition.
+  FORTH_PROFILE_ENTER(m_profiler, token);
+  FORTH_JIT_HIT(token);
+  c = ip;
+#if FORTH_STACK_EFFECTS
+  if (nullptr == guard)
+    {
+      ForthWordEffect const& e = m_dictionary.effect(token);
+      if ((e.valid) && (m_dsp + e.dmin >= dsp_min) &&
+          (m_dsp + e.dmax <= dsp_max) && (m_rsp + e.rmax <= rsp_max))
+        {
+          guard = m_rsp;
+        }
+    }
+#endif
+  RPUSH(c);
+  if (nullptr == guard) { CHECK_STACKS(); }
+  ip = xt[token] + 2U;
+  token = READ16(ip);
+  DISPATCH();
+
+  // Other primitives (and primitives of derived classes).
+ fallback:
+  YIELD_POINT();
+  m_ip = ip;
+  execPrimitive(token);
+  ip = m_ip;
+#if FORTH_BYTECODE || FORTH_JIT
+  // Budget exhausted inside a compact definition (see execBytecode)
+  // or inside native code (see jitExecute)
+  if (m_yielded)
+    goto leave;
+#endif
+  NEXT();
+
+ budget_exhausted:
+  if (0U != budgetSlice())
+    DISPATCH();
+  m_yielded = true;
+  m_yield_ip = ip;
+  m_yield_token = token;
+
+ leave:
+  // Store the working register
+  DPUSH(m_tos);
+  m_ip = saved_ip;
+}
+
+#endif /* FORTH_DIRECT_THREADING */
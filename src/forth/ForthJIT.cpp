@@ -0,0 +1,552 @@
+//=====================================================================
+// SimTaDyn: A GIS in a spreadsheet.
+// Copyright 2018 Quentin Quadrat <lecrapouille@gmail.com>
+//
+// This file is part of SimTaDyn.
+//
+// SimTaDyn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SimTaDyn.  If not, see <http://www.gnu.org/licenses/>.
+//=====================================================================
+
+//! \brief This file contains the tier-2 compiler of the Forth: hot
+//! colon definitions are translated into C functions (the top of the
+//! data stack and the return stack are local variables), compiled by
+//! the machinery of ForthCLib and called with the primitive
+//! EXEC_C_FUNC. Only bounded definitions (see analyzeStackEffect) made
+//! of primitives managed here (and calls to such definitions, inlined)
+//! are translated: the native code does not check stacks, they are
+//! checked once before calling it. Backward branches are yield points
+//! of the budget of Forth::run(). Cell formulae referring to other
+//! cells use primitives of SimForth and are not translated.
+
+#include "Forth.hpp"
+#include <algorithm>
+#include <map>
+
+#if FORTH_JIT
+
+//! Maximum number of tokens of a translated definition (inlined
+//! definitions included).
+#define JIT_MAX_TOKENS    4096U
+//! Maximum depth of inlined definitions.
+#define JIT_MAX_INLINING  8U
+//! Size of the local return stack of a native function.
+#define JIT_RSTACK_SIZE   64
+
+// C code of primitives: tos is the top of the data stack, dsp the
+// data stack pointer (dsp[-1] is the second element), rs the return
+// stack and rsp its depth. Primitives whose stack effect depends on
+// data (PICK, ?DUP) make definitions unbounded and are not managed.
+#define C_BINARY_OP(op)   "tos = (Cell32) ((SCell32) *--dsp " op " (SCell32) tos);\n"
+#define C_LOGICAL_OP(op)  "tos = -(Cell32) ((SCell32) *--dsp " op " (SCell32) tos);\n"
+#define C_PUSH            "*dsp++ = tos; "
+// Leave the native code when the budget is exhausted: it is called
+// again with the resume point.
+#define C_YIELD(k)        "if (0U == --*ticks) { *dsp++ = tos; *pdsp = dsp; *prsp = rsp; return " \
+                          + std::to_string(k) + "U; }\n"
+
+// **************************************************************
+//! \return the C code of a primitive without operand, else nullptr.
+// **************************************************************
+static const char* jitPrimitive(const Cell16 token)
+{
+  switch (token)
+    {
+    case FORTH_PRIMITIVE_NOP:      return "";
+    case FORTH_PRIMITIVE_DUP:      return C_PUSH "\n";
+    case FORTH_PRIMITIVE_DROP:     return "tos = *--dsp;\n";
+    case FORTH_PRIMITIVE_NIP:      return "--dsp;\n";
+    case FORTH_PRIMITIVE_SWAP:     return "t = dsp[-1]; dsp[-1] = tos; tos = t;\n";
+    case FORTH_PRIMITIVE_OVER:     return C_PUSH "tos = dsp[-2];\n";
+    case FORTH_PRIMITIVE_ROT:      return "t = dsp[-2]; dsp[-2] = dsp[-1]; dsp[-1] = tos; tos = t;\n";
+    case FORTH_PRIMITIVE_TUCK:     return "dsp[0] = dsp[-1]; dsp[-1] = tos; ++dsp;\n";
+    case FORTH_PRIMITIVE_2DUP:     return "dsp[0] = tos; dsp[1] = dsp[-1]; dsp += 2;\n";
+    case FORTH_PRIMITIVE_2DROP:    return "tos = dsp[-2]; dsp -= 2;\n";
+    case FORTH_PRIMITIVE_2SWAP:    return "t = dsp[-3]; dsp[-3] = dsp[-1]; dsp[-1] = t; "
+                                          "t = dsp[-2]; dsp[-2] = tos; tos = t;\n";
+    case FORTH_PRIMITIVE_2OVER:    return "dsp[0] = tos; dsp[1] = dsp[-3]; tos = dsp[-2]; dsp += 2;\n";
+    case FORTH_PRIMITIVE_1PLUS:    return "++tos;\n";
+    case FORTH_PRIMITIVE_1MINUS:   return "--tos;\n";
+    case FORTH_PRIMITIVE_2PLUS:    return "tos += 2;\n";
+    case FORTH_PRIMITIVE_2MINUS:   return "tos -= 2;\n";
+    case FORTH_PRIMITIVE_NEGATE:   return "tos = -tos;\n";
+    case FORTH_PRIMITIVE_ABS:      return "if ((SCell32) tos < 0) tos = -tos;\n";
+    case FORTH_PRIMITIVE_CELL:     return C_PUSH "tos = sizeof (Cell32);\n";
+    case FORTH_PRIMITIVE_CELLS:    return "tos *= sizeof (Cell32);\n";
+    case FORTH_PRIMITIVE_PLUS:     return C_BINARY_OP("+");
+    case FORTH_PRIMITIVE_MINUS:    return C_BINARY_OP("-");
+    case FORTH_PRIMITIVE_TIMES:    return C_BINARY_OP("*");
+    case FORTH_PRIMITIVE_DIV:      return C_BINARY_OP("/");
+    case FORTH_PRIMITIVE_RSHIFT:   return C_BINARY_OP(">>");
+    case FORTH_PRIMITIVE_LSHIFT:   return C_BINARY_OP("<<");
+    case FORTH_PRIMITIVE_AND:      return C_BINARY_OP("&");
+    case FORTH_PRIMITIVE_OR:       return C_BINARY_OP("|");
+    case FORTH_PRIMITIVE_XOR:      return C_BINARY_OP("^");
+    case FORTH_PRIMITIVE_GREATER:  return C_LOGICAL_OP(">");
+    case FORTH_PRIMITIVE_GREATER_EQUAL: return C_LOGICAL_OP(">=");
+    case FORTH_PRIMITIVE_LOWER:    return C_LOGICAL_OP("<");
+    case FORTH_PRIMITIVE_LOWER_EQUAL:   return C_LOGICAL_OP("<=");
+    case FORTH_PRIMITIVE_EQUAL:    return C_LOGICAL_OP("==");
+    case FORTH_PRIMITIVE_NOT_EQUAL:     return C_LOGICAL_OP("!=");
+    case FORTH_PRIMITIVE_0EQUAL:   return "tos = -(Cell32) (0 == tos);\n";
+    case FORTH_PRIMITIVE_FALSE:    return C_PUSH "tos = 0;\n";
+    case FORTH_PRIMITIVE_TRUE:     return C_PUSH "tos = -1;\n";
+    case FORTH_PRIMITIVE_MIN:      return "t = *--dsp; if ((SCell32) t < (SCell32) tos) tos = t;\n";
+    case FORTH_PRIMITIVE_MAX:      return "t = *--dsp; if ((SCell32) t > (SCell32) tos) tos = t;\n";
+    default:                       return nullptr;
+    }
+}
+
+// **************************************************************
+//! Superinstructions are translated as their first token: the fused
+//! tokens are still stored after them.
+// **************************************************************
+static Cell16 jitUnfuse(const Cell16 token)
+{
+  switch (token)
+    {
+    case FORTH_PRIMITIVE_DUP_TO_RSTACK:     return FORTH_PRIMITIVE_DUP;
+    case FORTH_PRIMITIVE_FROM_RSTACK_1PLUS: return FORTH_PRIMITIVE_FROM_RSTACK;
+    case FORTH_PRIMITIVE_LITERAL_16_PLUS:   return FORTH_PRIMITIVE_LITERAL_16;
+    case FORTH_PRIMITIVE_0EQUAL_0BRANCH:    return FORTH_PRIMITIVE_0EQUAL;
+    default:                                return token;
+    }
+}
+
+// **************************************************************
+//! \param threshold the number of executions of a colon definition
+//! before compiling it. 0 disables the JIT and restores the original
+//! definitions.
+// **************************************************************
+void Forth::jit(const uint32_t threshold)
+{
+  m_jit_threshold = threshold;
+  m_jit_pending.clear();
+  m_jit_hits.assign((0U == threshold) ? 0U : 65536U, 0U);
+  if (0U != threshold)
+    return ;
+
+  // Restore definitions which have not been forgotten
+  for (auto const& it: m_jit_patches)
+    {
+      if ((it.address + 6U <= m_dictionary.here()) &&
+          (FORTH_PRIMITIVE_EXEC_C_FUNC == m_dictionary.read16at(it.address)) &&
+          (it.function == m_dictionary.read16at(it.address + 2U)))
+        {
+          for (uint32_t i = 0; i < 3U; ++i)
+            {
+              m_dictionary.write16at(it.address + 2U * i, it.code[i]);
+            }
+        }
+    }
+  m_jit_patches.clear();
+}
+
+// **************************************************************
+//! Called before the definition of a token is compiled again in
+//! place: the native code of the old definition shall not be
+//! restored over the new one.
+//! \param token the colon definition.
+// **************************************************************
+void Forth::jitForget(const Cell16 token)
+{
+  if (!m_jit_hits.empty())
+    {
+      m_jit_hits[token] = 0U;
+    }
+  m_jit_pending.erase(std::remove(m_jit_pending.begin(), m_jit_pending.end(), token),
+                      m_jit_pending.end());
+
+  const Cell32 address = m_dictionary.xt(token) + 2U;
+  m_jit_patches.erase(std::remove_if(m_jit_patches.begin(), m_jit_patches.end(),
+                                     [address](JitPatch const& patch)
+                                     { return address == patch.address; }),
+                      m_jit_patches.end());
+}
+
+// **************************************************************
+//! \param address an address inside a colon definition.
+// **************************************************************
+Cell16 Forth::jitRead16(const Cell32 address) const
+{
+  for (auto const& it: m_jit_patches)
+    {
+      if ((address >= it.address) && (address < it.address + 6U))
+        return it.code[(address - it.address) / 2U];
+    }
+  return m_dictionary.read16at(address);
+}
+
+// **************************************************************
+//! The definition is read twice: first for finding its end (the
+//! first EXIT after all forward branches) and the targets of its
+//! branches, then for generating the C code. Called definitions are
+//! inlined. The depth of the return stack is checked statically: a
+//! definition shall not touch the return stack of its caller.
+//! \param token the colon definition to translate.
+//! \param code the C code to complete.
+//! \param callers definitions being inlined (recursion is refused).
+//! \param instances counter used for making unique C labels.
+//! \param resumes labels of the targets of backward branches (the
+//! resume point i + 1 is the label resumes[i]).
+//! \return false if the definition cannot be translated.
+// **************************************************************
+bool Forth::jitTranslate(const Cell16 token, std::string& code,
+                         std::vector<Cell16>& callers, uint32_t& instances,
+                         std::vector<std::string>& resumes) const
+{
+  // Compiled words have an execution token
+  if ((token < maxPrimitives()) || (0U == m_dictionary.xt(token)) ||
+      (FORTH_PRIMITIVE_BYTECODE == m_dictionary.read16at(m_dictionary.xt(token) + 2U)) ||
+      (callers.size() >= JIT_MAX_INLINING) ||
+      (std::find(callers.begin(), callers.end(), token) != callers.end()))
+    return false;
+
+  const std::string label("L" + std::to_string(instances++) + "_");
+  std::vector<Cell32> instructions;
+  std::map<Cell32, int32_t> targets; // address -> depth of the return stack
+  Cell32 ip = m_dictionary.xt(token) + 2U;
+  uint32_t forward = ip;
+
+  // Find the end of the definition and targets of branches
+  while (true)
+    {
+      if (instructions.size() >= JIT_MAX_TOKENS)
+        return false;
+
+      const Cell16 t = jitUnfuse(jitRead16(ip));
+      instructions.push_back(ip);
+      if ((FORTH_PRIMITIVE_EXIT == t) && (ip >= forward))
+        break;
+      if ((FORTH_PRIMITIVE_BRANCH == t) || (FORTH_PRIMITIVE_0BRANCH == t))
+        {
+          const Cell32 target = ip + static_cast<int16_t>(jitRead16(ip + 2U)) + 2U;
+          targets[target] = -1;
+          if (target > forward)
+            forward = target;
+        }
+      ip += 2U * (1U + operands(t));
+    }
+
+  // Branches shall land on a token of the definition
+  for (auto const& it: targets)
+    {
+      if (!std::binary_search(instructions.begin(), instructions.end(), it.first))
+        return false;
+    }
+
+  // Generate the code
+  callers.push_back(token);
+  code += "/* " + m_dictionary.name(token) + " */\n";
+
+  bool reachable = true;
+  bool exited = false;
+  int32_t rdepth = 0;
+  for (auto const& i: instructions)
+    {
+      const Cell16 t = jitUnfuse(jitRead16(i));
+      const Cell16 operand = jitRead16(i + 2U);
+      std::map<Cell32, int32_t>::iterator target = targets.find(i);
+
+      // Label and depth of the return stack
+      if (targets.end() != target)
+        {
+          if (!reachable)
+            rdepth = target->second;
+          if ((target->second >= 0) && (target->second != rdepth))
+            return false;
+          target->second = rdepth;
+          code += label + std::to_string(i) + ":\n";
+        }
+      reachable = true;
+
+      const char* c = jitPrimitive(t);
+      if (nullptr != c)
+        {
+          code += c;
+          continue;
+        }
+
+      switch (t)
+        {
+        case FORTH_PRIMITIVE_LITERAL_16:
+          code += C_PUSH "tos = " + std::to_string(operand) + "U;\n";
+          break;
+        case FORTH_PRIMITIVE_LITERAL_32:
+          code += C_PUSH "tos = " + std::to_string((static_cast<Cell32>(operand) << 16U)
+                                                   | jitRead16(i + 4U)) + "U;\n";
+          break;
+        case FORTH_PRIMITIVE_BRANCH:
+        case FORTH_PRIMITIVE_0BRANCH:
+          {
+            const Cell32 address = i + static_cast<int16_t>(operand) + 2U;
+            int32_t& depth = targets[address];
+            if ((depth >= 0) && (depth != rdepth))
+              return false;
+            depth = rdepth;
+
+            // Loops: backward branches are yield points
+            std::string jump("goto " + label + std::to_string(address) + ";");
+            if (address <= i)
+              {
+                resumes.push_back(label + std::to_string(address));
+                jump = "{ " C_YIELD(resumes.size()) + jump + " }";
+              }
+            if (FORTH_PRIMITIVE_BRANCH == t)
+              {
+                code += jump + "\n";
+                reachable = false;
+              }
+            else
+              {
+                code += "t = tos; tos = *--dsp; if (0 == t) " + jump + "\n";
+              }
+          }
+          break;
+        case FORTH_PRIMITIVE_EXIT:
+          if (0 != rdepth)
+            return false;
+          if (i != instructions.back())
+            {
+              code += "goto " + label + "exit;\n";
+              exited = true;
+            }
+          reachable = false;
+          break;
+        case FORTH_PRIMITIVE_TO_RSTACK:
+          if (++rdepth > JIT_RSTACK_SIZE)
+            return false;
+          code += "rs[rsp++] = tos; tos = *--dsp;\n";
+          break;
+        case FORTH_PRIMITIVE_FROM_RSTACK:
+          if (--rdepth < 0)
+            return false;
+          code += C_PUSH "tos = rs[--rsp];\n";
+          break;
+        case FORTH_PRIMITIVE_2TO_RSTACK:
+          if ((rdepth += 2) > JIT_RSTACK_SIZE)
+            return false;
+          code += "rs[rsp++] = *--dsp; rs[rsp++] = tos; tos = *--dsp;\n";
+          break;
+        case FORTH_PRIMITIVE_2FROM_RSTACK:
+          if ((rdepth -= 2) < 0)
+            return false;
+          code += C_PUSH "tos = rs[--rsp]; *dsp++ = rs[--rsp];\n";
+          break;
+        case FORTH_PRIMITIVE_I:
+          if (rdepth < 1)
+            return false;
+          code += C_PUSH "tos = rs[rsp - 1];\n";
+          break;
+        case FORTH_PRIMITIVE_J:
+          if (rdepth < 3)
+            return false;
+          code += C_PUSH "tos = rs[rsp - 3];\n";
+          break;
+        default:
+          // Inline the called definition
+          if (!jitTranslate(t, code, callers, instances, resumes))
+            return false;
+          break;
+        }
+    }
+
+  if (exited)
+    {
+      code += label + "exit: ;\n";
+    }
+  callers.pop_back();
+  return true;
+}
+
+// **************************************************************
+//! Called when no definition is being executed: definitions can be
+//! modified safely. All hot definitions are compiled in a single
+//! library. The three first tokens of a compiled definition are
+//! replaced by EXEC_C_FUNC, the index of the native function and
+//! EXIT (definitions smaller than three tokens are not compiled).
+// **************************************************************
+void Forth::jitCompile()
+{
+  std::string code("#include <stdint.h>\n"
+                   "typedef uint32_t Cell32;\n"
+                   "typedef int32_t SCell32;\n");
+  std::vector<CFuncHolder> functions;
+  std::vector<Cell16> tokens;
+
+  for (auto const& token: m_jit_pending)
+    {
+      std::string body;
+      std::vector<Cell16> callers;
+      std::vector<std::string> resumes;
+      uint32_t instances = 0U;
+
+      // Forgotten definition ?
+      const Cell32 xt = m_dictionary.xt(token);
+      if ((0U == xt) || (xt + 8U > m_dictionary.here()))
+        continue;
+
+      // Not enough space for calling the native code ?
+      const Cell16 first = jitUnfuse(jitRead16(xt + 2U));
+      if ((FORTH_PRIMITIVE_EXIT == first) ||
+          ((0U == operands(first)) &&
+           (FORTH_PRIMITIVE_EXIT == jitRead16(xt + 4U))))
+        continue;
+
+      // The native code does not check stacks: its bounds shall be
+      // known for checking them before calling it.
+      ForthWordEffect const& effect = m_dictionary.effect(token);
+      if (!effect.valid)
+        {
+          LOGI("JIT: '%s' is not bounded", m_dictionary.name(token).c_str());
+          continue;
+        }
+
+      if (!jitTranslate(token, body, callers, instances, resumes))
+        {
+          LOGI("JIT: cannot translate '%s'", m_dictionary.name(token).c_str());
+          continue;
+        }
+
+      std::string entries;
+      for (size_t i = 0; i < resumes.size(); ++i)
+        {
+          entries += "case " + std::to_string(i + 1U) + "U: goto " + resumes[i] + ";\n";
+        }
+
+      CFuncHolder holder;
+      holder.func_c_name = "simforth_jit_" + std::to_string(token);
+      holder.code = "Cell32 " + holder.func_c_name
+        + "(Cell32** pdsp, Cell32* rs, Cell32* prsp, Cell32* ticks, Cell32 entry)\n{\n"
+        "Cell32* dsp = *pdsp;\n"
+        "Cell32 tos = *--dsp;\n"
+        "Cell32 t;\n"
+        "Cell32 rsp = *prsp;\n"
+        "(void) rs; (void) t; (void) ticks;\n"
+        "switch (entry)\n{\n"
+        + entries +
+        "default: break;\n"
+        "}\n"
+        + body +
+        "*dsp++ = tos;\n"
+        "*pdsp = dsp;\n"
+        "return 0U;\n"
+        "}\n";
+      holder.fun_ptr = nullptr;
+      holder.jitted = true;
+      holder.dmin = effect.dmin;
+      holder.dmax = effect.dmax;
+      code += holder.code;
+      functions.push_back(holder);
+      tokens.push_back(token);
+    }
+  m_jit_pending.clear();
+
+  if (functions.empty())
+    return ;
+
+  // The library is named after the hash of the code: hot definitions
+  // already compiled by a previous run are not compiled again.
+  std::pair<bool, std::string> res = m_dynamic_libs.compile("simforth_jit", code, functions);
+  if (!res.first)
+    {
+      LOGE("JIT: %s", res.second.c_str());
+      return ;
+    }
+
+  // Replace definitions by their native code
+  Cell16 function = static_cast<Cell16>(m_dynamic_libs.m_functions.size() - functions.size());
+  for (auto const& token: tokens)
+    {
+      JitPatch patch;
+      patch.address = m_dictionary.xt(token) + 2U;
+      patch.function = function;
+      for (uint32_t i = 0; i < 3U; ++i)
+        {
+          patch.code[i] = m_dictionary.read16at(patch.address + 2U * i);
+        }
+      m_jit_patches.push_back(patch);
+
+      m_dictionary.write16at(patch.address, FORTH_PRIMITIVE_EXEC_C_FUNC);
+      m_dictionary.write16at(patch.address + 2U, function);
+      m_dictionary.write16at(patch.address + 4U, FORTH_PRIMITIVE_EXIT);
+      LOGI("JIT: '%s' compiled", m_dictionary.name(token).c_str());
+      ++function;
+    }
+}
+
+// **************************************************************
+//! Stacks are checked once before calling the native code with the
+//! stack effect of the definition. When the budget of Forth::run()
+//! is exhausted inside a loop, the local return stack, its depth,
+//! the depth of the data stack since the call and the resume point
+//! are pushed on the return stack: the execution is continued by the
+//! same token EXEC_C_FUNC.
+//! \param f the native code of a colon definition.
+//! \throw OutOfBoundStack if the data stack would overflow or
+//! underflow.
+// **************************************************************
+void Forth::jitExecute(CFuncHolder const& f)
+{
+  Cell32 rs[JIT_RSTACK_SIZE];
+  Cell32 rsp = 0U;
+  Cell32 entry = 0U;
+  int32_t called = stackDepth(forth::DataStack);
+
+  // Continue the native code interrupted by its budget
+  if (m_jit_yielded)
+    {
+      m_jit_yielded = false;
+      Cell32 c;
+      RPOP(entry);
+      RPOP(c);
+      called -= static_cast<int32_t>(c);
+      RPOP(rsp);
+      for (Cell32 i = rsp; i > 0U; --i)
+        {
+          RPOP(rs[i - 1U]);
+        }
+    }
+
+  if (called + f.dmin < 0)
+    {
+      OutOfBoundStack e(forth::DataStack, called + f.dmin); throw e;
+    }
+  if (called + f.dmax >= static_cast<int32_t>(STACK_SIZE - STACK_UNDERFLOW_MARGIN))
+    {
+      OutOfBoundStack e(forth::DataStack, called + f.dmax); throw e;
+    }
+
+  forth_jit_function native = reinterpret_cast<forth_jit_function>(reinterpret_cast<long>(f.fun_ptr));
+  while (0U != (entry = native(&m_dsp, rs, &rsp, &m_ticks, entry)))
+    {
+      if (0U != budgetSlice())
+        continue;
+
+      for (Cell32 i = 0U; i < rsp; ++i)
+        {
+          RPUSH(rs[i]);
+        }
+      RPUSH(rsp);
+      RPUSH(static_cast<Cell32>(stackDepth(forth::DataStack) - called));
+      RPUSH(entry);
+      isStackUnderOverFlow(forth::ReturnStack);
+      m_jit_yielded = true;
+      m_yielded = true;
+      m_yield_ip = m_ip - 2U;
+      m_yield_token = FORTH_PRIMITIVE_EXEC_C_FUNC;
+      return ;
+    }
+}
+
+#endif /* FORTH_JIT */
@@ -19,9 +19,13 @@
 //=====================================================================
 
 #include "Forth.hpp"
+#include <cmath>
 
 #  define BINARY_OP(op) { m_tos = ((int32_t) DDROP()) op ((int32_t) m_tos); } // Pop a value, apply it the operation op with the content of the register tos (Top Of Stack)
 #  define LOGICAL_OP(op) { m_tos = -1 * (((int32_t) DDROP()) op ((int32_t) m_tos)); }
+#  define FBINARY_OP(op) { checkFloatStack(2, 1); FPICK(1) = FPICK(1) op FPICK(0); FNIP(); } // Apply op on the two floats on the top of the float stack
+#  define FUNARY_FUNC(f) { checkFloatStack(1, 1); FPICK(0) = f(FPICK(0)); } // Apply f on the top of the float stack
+#  define FLOGICAL_OP(op) { checkFloatStack(2, 0); DPUSH(m_tos); m_tos = -1 * (FPICK(1) op FPICK(0)); m_fsp -= 2; }
 
 // **************************************************************
 //! \param idPrimitive the token of a primitive else an exception
@@ -78,11 +82,21 @@ void Forth::execPrimitive(const Cell16 idPrimitive)
       m_state = forth::Interprete;
       if (m_depth_at_colon != stackDepth(forth::DataStack))
         {
-          m_dictionary.m_last = m_last_at_colon;
-          m_dictionary.m_here = m_here_at_colon;
+          m_dictionary.truncate(m_last_at_colon, m_here_at_colon);
           ModifiedStackDepth e(m_creating_word);
           throw e;
         }
+#if FORTH_SUPERINSTRUCTIONS
+      fuseSuperInstructions(m_dictionary.xt(m_creating_token) + 2U,
+                            m_dictionary.here());
+#endif
+#if FORTH_STACK_EFFECTS
+      analyzeStackEffect(m_creating_token);
+#endif
+#if FORTH_BYTECODE
+      if (m_compact)
+        compactDefinition(m_creating_token);
+#endif
       break;
 
       // Push in data stack the next free slot in the dictionary
@@ -98,6 +112,9 @@ void Forth::execPrimitive(const Cell16 idPrimitive)
       create(nextWord());
       m_dictionary.appendCell16(FORTH_PRIMITIVE_PCREATE);
       m_dictionary.appendCell16(FORTH_PRIMITIVE_EXIT);
+#if FORTH_STACK_EFFECTS
+      analyzeStackEffect(m_creating_token);
+#endif
       break;
 
     case FORTH_PRIMITIVE_BUILDS:
@@ -134,6 +151,78 @@ void Forth::execPrimitive(const Cell16 idPrimitive)
       m_trace = false;
       break;
 
+    case FORTH_PRIMITIVE_PROFILE_ON:
+      m_profiler.start();
+      break;
+
+    case FORTH_PRIMITIVE_PROFILE_OFF:
+      m_profiler.stop();
+      break;
+
+      // Display the profiler statistics
+    case FORTH_PRIMITIVE_PROFILE_DISPLAY:
+      m_profiler.report(std::cout, m_dictionary);
+      break;
+
+      // Export call stacks as folded stacks in the given file
+    case FORTH_PRIMITIVE_PROFILE_FOLDED:
+      {
+        std::string const& filename = nextWord();
+        std::ofstream file(filename);
+        if (!file.is_open())
+          {
+            abort("Failed opening the file '" + filename + "'");
+          }
+        m_profiler.folded(file, m_dictionary);
+      }
+      break;
+
+      // Start the profiler and count pairs and triples of tokens
+    case FORTH_PRIMITIVE_PROFILE_SEQUENCES:
+      m_profiler.start(true);
+      break;
+
+      // Display the most executed pairs and triples of tokens
+    case FORTH_PRIMITIVE_DISPLAY_SEQUENCES:
+      m_profiler.sequences(std::cout, m_dictionary, 20U);
+      break;
+
+      // ( n -- ) compile to native code definitions executed n times
+    case FORTH_PRIMITIVE_JIT_ON:
+#if FORTH_JIT
+      jit(((int32_t) m_tos <= 0) ? 1U : m_tos);
+#else
+      std::cerr << FORTH_WARNING_COLOR
+                << "[WARNING] The Forth JIT has not been compiled (see FORTH_JIT)"
+                << FORTH_NORMAL_COLOR << std::endl;
+#endif
+      DPOP(m_tos);
+      break;
+
+      // Restore compiled definitions
+    case FORTH_PRIMITIVE_JIT_OFF:
+#if FORTH_JIT
+      jit(0U);
+#endif
+      break;
+
+      // Next definitions are compacted as byte code
+    case FORTH_PRIMITIVE_COMPACT_ON:
+#if FORTH_BYTECODE
+      m_compact = true;
+#else
+      std::cerr << FORTH_WARNING_COLOR
+                << "[WARNING] The Forth byte code has not been compiled (see FORTH_BYTECODE)"
+                << FORTH_NORMAL_COLOR << std::endl;
+#endif
+      break;
+
+    case FORTH_PRIMITIVE_COMPACT_OFF:
+#if FORTH_BYTECODE
+      m_compact = false;
+#endif
+      break;
+
     case FORTH_PRIMITIVE_SMUDGE:
       {
         std::string const& word = nextWord();
@@ -217,8 +306,16 @@ void Forth::execPrimitive(const Cell16 idPrimitive)
        abort("COUCOU");
        break;
 
+       // The token is dropped before the nested execution which
+       // pops and pushes back the top of the stack.
      case FORTH_PRIMITIVE_EXECUTE:
-       execToken(m_tos);
+       {
+         const Cell16 token = static_cast<Cell16>(m_tos);
+         const Cell32 ip = m_ip;
+         execToken(token);
+         m_ip = ip;
+         DPOP(m_tos);
+       }
        break;
 
      case FORTH_PRIMITIVE_LBRACKET:
@@ -315,7 +412,7 @@ void Forth::execPrimitive(const Cell16 idPrimitive)
 
       // Change IP
     case FORTH_PRIMITIVE_BRANCH:
-      m_ip += m_dictionary.read16at(m_ip + 2U);
+      m_ip += static_cast<int16_t>(m_dictionary.read16at(m_ip + 2U));
       // Do not forget that m_ip will be += 2 next iteration
       break;
 
@@ -323,7 +420,7 @@ void Forth::execPrimitive(const Cell16 idPrimitive)
     case FORTH_PRIMITIVE_0BRANCH:
       if (0 == m_tos)
         {
-          m_ip += m_dictionary.read16at(m_ip + 2U);
+          m_ip += static_cast<int16_t>(m_dictionary.read16at(m_ip + 2U));
         }
       else
         {
@@ -333,6 +430,51 @@ void Forth::execPrimitive(const Cell16 idPrimitive)
       DPOP(m_tos);
       break;
 
+      // Superinstructions: the fused tokens are still stored after
+      // the superinstruction, skip them.
+
+      // DUP >R
+    case FORTH_PRIMITIVE_DUP_TO_RSTACK:
+      RPUSH(m_tos);
+      m_ip += 2U;
+      break;
+
+      // R> 1+
+    case FORTH_PRIMITIVE_FROM_RSTACK_1PLUS:
+      DPUSH(m_tos);
+      RPOP(m_tos);
+      ++m_tos;
+      m_ip += 2U;
+      break;
+
+      // LITERAL16 n +
+    case FORTH_PRIMITIVE_LITERAL_16_PLUS:
+      m_tos += m_dictionary.read16at(m_ip + 2U);
+      m_ip += 4U;
+      break;
+
+      // 0= 0BRANCH offset
+    case FORTH_PRIMITIVE_0EQUAL_0BRANCH:
+      if (0 != m_tos)
+        {
+          m_ip += static_cast<int16_t>(m_dictionary.read16at(m_ip + 4U)) + 2U;
+        }
+      else
+        {
+          m_ip += 4U;
+        }
+      DPOP(m_tos);
+      break;
+
+      // Compact definition: execute the byte code following the token
+    case FORTH_PRIMITIVE_BYTECODE:
+#if FORTH_BYTECODE
+      execBytecode();
+#else
+      abort("The Forth byte code has not been compiled (see FORTH_BYTECODE)");
+#endif
+      break;
+
       // Move x to the return stack.
       // ( x -- ) ( R: -- x )
     case FORTH_PRIMITIVE_TO_RSTACK:
@@ -657,6 +799,154 @@ void Forth::execPrimitive(const Cell16 idPrimitive)
       displayStack(std::cout, forth::DataStack);
       DPOP(m_tos);
       break;
+
+      // Floating point words. Data stack effects are known by
+      // forthPrimitiveEffect() but the float stack is checked here.
+    case FORTH_PRIMITIVE_FLITERAL:
+      checkFloatStack(0, 1);
+      m_ip += 2U; // Skip primitive FLITERAL
+      FPUSH(m_dictionary.readFloatAt(m_ip));
+      m_ip += 6U; // Skip the number - 2 because of next ip
+      break;
+    case FORTH_PRIMITIVE_FPLUS:
+      FBINARY_OP(+);
+      break;
+    case FORTH_PRIMITIVE_FMINUS:
+      FBINARY_OP(-);
+      break;
+    case FORTH_PRIMITIVE_FTIMES:
+      FBINARY_OP(*);
+      break;
+    case FORTH_PRIMITIVE_FDIV:
+      FBINARY_OP(/);
+      break;
+    case FORTH_PRIMITIVE_FNEGATE:
+      FUNARY_FUNC(-);
+      break;
+    case FORTH_PRIMITIVE_FABS:
+      FUNARY_FUNC(std::fabs);
+      break;
+    case FORTH_PRIMITIVE_FSQRT:
+      FUNARY_FUNC(std::sqrt);
+      break;
+    case FORTH_PRIMITIVE_FSIN:
+      FUNARY_FUNC(std::sin);
+      break;
+    case FORTH_PRIMITIVE_FCOS:
+      FUNARY_FUNC(std::cos);
+      break;
+    case FORTH_PRIMITIVE_FMIN:
+      checkFloatStack(2, 1);
+      FPICK(1) = std::fmin(FPICK(1), FPICK(0));
+      FNIP();
+      break;
+    case FORTH_PRIMITIVE_FMAX:
+      checkFloatStack(2, 1);
+      FPICK(1) = std::fmax(FPICK(1), FPICK(0));
+      FNIP();
+      break;
+      // ( F: y x -- r )
+    case FORTH_PRIMITIVE_FATAN2:
+      checkFloatStack(2, 1);
+      FPICK(1) = std::atan2(FPICK(1), FPICK(0));
+      FNIP();
+      break;
+    case FORTH_PRIMITIVE_FDUP:
+      checkFloatStack(1, 2);
+      m_fsp[0] = FPICK(0);
+      ++m_fsp;
+      break;
+    case FORTH_PRIMITIVE_FDROP:
+      checkFloatStack(1, 0);
+      FNIP();
+      break;
+    case FORTH_PRIMITIVE_FSWAP:
+      checkFloatStack(2, 2);
+      std::swap(FPICK(0), FPICK(1));
+      break;
+    case FORTH_PRIMITIVE_FOVER:
+      checkFloatStack(2, 3);
+      m_fsp[0] = FPICK(1);
+      ++m_fsp;
+      break;
+    case FORTH_PRIMITIVE_FDEPTH:
+      DPUSH(m_tos);
+      m_tos = stackDepth(forth::FloatStack);
+      break;
+      // ( f-addr -- ) ( F: -- r )
+    case FORTH_PRIMITIVE_FFETCH:
+      checkFloatStack(0, 1);
+      FPUSH(m_dictionary.readFloatAt(m_tos));
+      DPOP(m_tos);
+      break;
+      // ( f-addr -- ) ( F: r -- )
+    case FORTH_PRIMITIVE_FSTORE:
+      checkFloatStack(1, 0);
+      m_dictionary.writeFloatAt(m_tos, FPICK(0));
+      FNIP();
+      DPOP(m_tos);
+      break;
+    case FORTH_PRIMITIVE_FCOMMA:
+      checkFloatStack(1, 0);
+      m_dictionary.appendFloat(FDROP());
+      break;
+    case FORTH_PRIMITIVE_FLOATS:
+      m_tos = m_tos * sizeof (Float64);
+      break;
+    case FORTH_PRIMITIVE_FLOAT_PLUS:
+      m_tos += sizeof (Float64);
+      break;
+    case FORTH_PRIMITIVE_S_TO_F:
+      checkFloatStack(0, 1);
+      FPUSH(static_cast<Float64>(static_cast<int32_t>(m_tos)));
+      DPOP(m_tos);
+      break;
+    case FORTH_PRIMITIVE_F_TO_S:
+      checkFloatStack(1, 0);
+      DPUSH(m_tos);
+      m_tos = static_cast<Cell32>(static_cast<int32_t>(FDROP()));
+      break;
+    case FORTH_PRIMITIVE_FLOWER:
+      FLOGICAL_OP(<);
+      break;
+    case FORTH_PRIMITIVE_FEQUAL:
+      FLOGICAL_OP(==);
+      break;
+    case FORTH_PRIMITIVE_F0EQUAL:
+      checkFloatStack(1, 0);
+      DPUSH(m_tos);
+      m_tos = -1 * (0.0 == FDROP());
+      break;
+    case FORTH_PRIMITIVE_F0LOWER:
+      checkFloatStack(1, 0);
+      DPUSH(m_tos);
+      m_tos = -1 * (0.0 > FDROP());
+      break;
+    case FORTH_PRIMITIVE_FDISP:
+      checkFloatStack(1, 0);
+      std::cout << FDROP() << " ";
+      break;
+    case FORTH_PRIMITIVE_DISPLAY_FSTACK:
+      displayStack(std::cout, forth::FloatStack);
+      break;
+
+
+      // Arrays
+    case FORTH_PRIMITIVE_VPLUS:
+    case FORTH_PRIMITIVE_VTIMES:
+    case FORTH_PRIMITIVE_VFMA:
+    case FORTH_PRIMITIVE_VSCALE:
+    case FORTH_PRIMITIVE_VSUM:
+    case FORTH_PRIMITIVE_VGATHER:
+    case FORTH_PRIMITIVE_FVPLUS:
+    case FORTH_PRIMITIVE_FVTIMES:
+    case FORTH_PRIMITIVE_FVFMA:
+    case FORTH_PRIMITIVE_FVSCALE:
+    case FORTH_PRIMITIVE_FVSUM:
+    case FORTH_PRIMITIVE_FVGATHER:
+      execArrayPrimitive(idPrimitive);
+      break;
+
     case FORTH_PRIMITIVE_BEGIN_C_LIB:
       {
         std::pair<bool, std::string> res = m_dynamic_libs.begin(STREAM);
@@ -671,14 +961,19 @@ void Forth::execPrimitive(const Cell16 idPrimitive)
         std::pair<bool, std::string> res = m_dynamic_libs.end(/*nth*/); // FIXME
         if (res.first)
           {
-            uint16_t i = 0;
-            for (auto it: m_dynamic_libs/*[nth]*/.m_functions)
+            uint16_t i = m_dynamic_libs.first();
+            for (; i < m_dynamic_libs.m_functions.size(); ++i)
               {
-                create(it.func_forth_name);
+                create(m_dynamic_libs.m_functions[i].func_forth_name);
                 m_dictionary.appendCell16(FORTH_PRIMITIVE_EXEC_C_FUNC);
                 m_dictionary.appendCell16(i);
                 m_dictionary.appendCell16(FORTH_PRIMITIVE_EXIT);
-                ++i;
+
+                // Batched version: name[] ( args results n -- )
+                create(m_dynamic_libs.m_functions[i].func_forth_name + "[]");
+                m_dictionary.appendCell16(FORTH_PRIMITIVE_EXEC_C_BATCH);
+                m_dictionary.appendCell16(i);
+                m_dictionary.appendCell16(FORTH_PRIMITIVE_EXIT);
               }
           }
         else
@@ -694,11 +989,54 @@ void Forth::execPrimitive(const Cell16 idPrimitive)
       //std::cout << "Pile avant: ";
       //displayStack(std::cout, forth::DataStack);
 
+#if FORTH_JIT
+      if (m_dynamic_libs.m_functions[m_tos].jitted)
+        {
+          jitExecute(m_dynamic_libs.m_functions[m_tos]);
+          DPOP(m_tos);
+          break;
+        }
+#endif
       m_dynamic_libs/*[nth]*/.m_functions[m_tos].fun_ptr(&m_dsp);
       //std::cout << "Pile apres: ";
       //displayStack(std::cout, forth::DataStack);
       DPOP(m_tos);
       break;
+
+      // ( args results n -- ) Call n times the C function. args is an
+      // array of n * params cells and results an array of n cells
+      // (unused if the function returns nothing). Arrays are converted
+      // once so the C function is called a single time.
+    case FORTH_PRIMITIVE_EXEC_C_BATCH:
+      {
+        m_ip += 2U; // Skip the index of pointer function
+        CFuncHolder const& f = m_dynamic_libs.m_functions[m_dictionary.read16at(m_ip)];
+        if (nullptr == f.batch_ptr)
+          {
+            abort("No batched version of the C function " + f.func_forth_name);
+          }
+        DPOP(m_tos1); // results
+        DPOP(m_tos2); // args
+        arrayAt(m_tos2, m_tos, f.params * sizeof (Cell32));
+        if (f.returns)
+          {
+            arrayAt(m_tos1, m_tos, sizeof (Cell32));
+          }
+
+        std::vector<Cell32> args(static_cast<size_t>(m_tos) * f.params);
+        std::vector<Cell32> results(f.returns ? m_tos : 0U);
+        for (size_t i = 0; i < args.size(); ++i)
+          {
+            args[i] = m_dictionary.read32at(m_tos2 + 4U * i);
+          }
+        f.batch_ptr(args.data(), results.data(), m_tos);
+        for (size_t i = 0; i < results.size(); ++i)
+          {
+            m_dictionary.write32at(m_tos1 + 4U * i, results[i]);
+          }
+        DPOP(m_tos);
+      }
+      break;
     case FORTH_PRIMITIVE_C_FUNCTION:
       {
         std::pair<bool, std::string> res = m_dynamic_libs.function(STREAM);
@@ -765,6 +1103,16 @@ void Forth::boot()
   m_dictionary.add(FORTH_PRIMITIVE_STATE, FORTH_DICO_ENTRY("STATE"), 0);
   m_dictionary.add(FORTH_PRIMITIVE_TRACE_ON, FORTH_DICO_ENTRY("TRACE.ON"), 0);
   m_dictionary.add(FORTH_PRIMITIVE_TRACE_OFF, FORTH_DICO_ENTRY("TRACE.OFF"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_PROFILE_ON, FORTH_DICO_ENTRY("PROFILE-ON"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_PROFILE_OFF, FORTH_DICO_ENTRY("PROFILE-OFF"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_PROFILE_DISPLAY, FORTH_DICO_ENTRY(".PROFILE"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_PROFILE_FOLDED, FORTH_DICO_ENTRY("PROFILE-FOLDED"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_PROFILE_SEQUENCES, FORTH_DICO_ENTRY("PROFILE-SEQUENCES"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_DISPLAY_SEQUENCES, FORTH_DICO_ENTRY(".SEQUENCES"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_JIT_ON, FORTH_DICO_ENTRY("JIT-ON"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_JIT_OFF, FORTH_DICO_ENTRY("JIT-OFF"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_COMPACT_ON, FORTH_DICO_ENTRY("COMPACT-ON"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_COMPACT_OFF, FORTH_DICO_ENTRY("COMPACT-OFF"), 0);
 
   // Words
   m_dictionary.add(FORTH_PRIMITIVE_TICK, FORTH_DICO_ENTRY("'"), FLAG_IMMEDIATE);
@@ -800,6 +1148,13 @@ void Forth::boot()
   m_dictionary.add(FORTH_PRIMITIVE_2TO_RSTACK, FORTH_DICO_ENTRY("2>R"), 0);
   m_dictionary.add(FORTH_PRIMITIVE_2FROM_RSTACK, FORTH_DICO_ENTRY("2R>"), 0);
 
+  // Superinstructions
+  m_dictionary.add(FORTH_PRIMITIVE_DUP_TO_RSTACK, FORTH_DICO_ENTRY("(DUP>R)"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FROM_RSTACK_1PLUS, FORTH_DICO_ENTRY("(R>1+)"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_LITERAL_16_PLUS, FORTH_DICO_ENTRY("(LITERAL16+)"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_0EQUAL_0BRANCH, FORTH_DICO_ENTRY("(0=0BRANCH)"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_BYTECODE, FORTH_DICO_ENTRY("(BYTECODE)"), 0);
+
   // Loop
   //m_dictionary.add(FORTH_PRIMITIVE_DO, FORTH_DICO_ENTRY("(DO)"), 0);
   //m_dictionary.add(FORTH_PRIMITIVE_LOOP, FORTH_DICO_ENTRY("(LOOP)"), 0);
@@ -879,6 +1234,53 @@ void Forth::boot()
   m_dictionary.add(FORTH_PRIMITIVE_CARRIAGE_RETURN, FORTH_DICO_ENTRY("CR"), 0);
   m_dictionary.add(FORTH_PRIMITIVE_DISPLAY_DSTACK, FORTH_DICO_ENTRY(".S"), 0);
 
+  // Floating point
+  m_dictionary.add(FORTH_PRIMITIVE_FLITERAL, FORTH_DICO_ENTRY("(FLITERAL)"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FPLUS, FORTH_DICO_ENTRY("F+"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FMINUS, FORTH_DICO_ENTRY("F-"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FTIMES, FORTH_DICO_ENTRY("F*"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FDIV, FORTH_DICO_ENTRY("F/"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FNEGATE, FORTH_DICO_ENTRY("FNEGATE"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FABS, FORTH_DICO_ENTRY("FABS"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FMIN, FORTH_DICO_ENTRY("FMIN"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FMAX, FORTH_DICO_ENTRY("FMAX"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FSQRT, FORTH_DICO_ENTRY("FSQRT"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FSIN, FORTH_DICO_ENTRY("FSIN"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FCOS, FORTH_DICO_ENTRY("FCOS"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FATAN2, FORTH_DICO_ENTRY("FATAN2"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FDUP, FORTH_DICO_ENTRY("FDUP"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FDROP, FORTH_DICO_ENTRY("FDROP"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FSWAP, FORTH_DICO_ENTRY("FSWAP"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FOVER, FORTH_DICO_ENTRY("FOVER"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FDEPTH, FORTH_DICO_ENTRY("FDEPTH"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FFETCH, FORTH_DICO_ENTRY("F@"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FSTORE, FORTH_DICO_ENTRY("F!"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FCOMMA, FORTH_DICO_ENTRY("F,"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FLOATS, FORTH_DICO_ENTRY("FLOATS"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FLOAT_PLUS, FORTH_DICO_ENTRY("FLOAT+"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_S_TO_F, FORTH_DICO_ENTRY("S>F"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_F_TO_S, FORTH_DICO_ENTRY("F>S"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FLOWER, FORTH_DICO_ENTRY("F<"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FEQUAL, FORTH_DICO_ENTRY("F="), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_F0EQUAL, FORTH_DICO_ENTRY("F0="), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_F0LOWER, FORTH_DICO_ENTRY("F0<"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FDISP, FORTH_DICO_ENTRY("F."), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_DISPLAY_FSTACK, FORTH_DICO_ENTRY("F.S"), 0);
+
+  // Arrays
+  m_dictionary.add(FORTH_PRIMITIVE_VPLUS, FORTH_DICO_ENTRY("V+"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_VTIMES, FORTH_DICO_ENTRY("V*"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_VFMA, FORTH_DICO_ENTRY("V*+"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_VSCALE, FORTH_DICO_ENTRY("VSCALE"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_VSUM, FORTH_DICO_ENTRY("VSUM"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_VGATHER, FORTH_DICO_ENTRY("VGATHER"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FVPLUS, FORTH_DICO_ENTRY("FV+"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FVTIMES, FORTH_DICO_ENTRY("FV*"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FVFMA, FORTH_DICO_ENTRY("FV*+"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FVSCALE, FORTH_DICO_ENTRY("FVSCALE"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FVSUM, FORTH_DICO_ENTRY("FVSUM"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_FVGATHER, FORTH_DICO_ENTRY("FVGATHER"), 0);
+
   // C dynamic lib
   m_dictionary.add(FORTH_PRIMITIVE_BEGIN_C_LIB, FORTH_DICO_ENTRY("C-LIB"), 0);
   m_dictionary.add(FORTH_PRIMITIVE_END_C_LIB, FORTH_DICO_ENTRY("END-C-LIB"), 0);
@@ -886,10 +1288,14 @@ void Forth::boot()
   m_dictionary.add(FORTH_PRIMITIVE_C_FUNCTION, FORTH_DICO_ENTRY("C-FUNCTION"), 0);
   m_dictionary.add(FORTH_PRIMITIVE_C_CODE, FORTH_DICO_ENTRY("\\C"), 0);
   m_dictionary.add(FORTH_PRIMITIVE_EXEC_C_FUNC, FORTH_DICO_ENTRY("(EXEC-C)"), 0);
+  m_dictionary.add(FORTH_PRIMITIVE_EXEC_C_BATCH, FORTH_DICO_ENTRY("(EXEC-C[])"), 0);
 
   // Hide some words to user
   m_dictionary.smudge("(CREATE)");
   m_dictionary.smudge("(EXEC-C)");
+  m_dictionary.smudge("(EXEC-C[])");
+  m_dictionary.smudge("(FLITERAL)");
+  m_dictionary.smudge("(BYTECODE)");
 
   m_last_completion = dictionary().last();
 }
@@ -21,6 +21,8 @@
 #ifndef FORTH_PRIMITIVES_HPP_
 #  define FORTH_PRIMITIVES_HPP_
 
+#  include <cstdint>
+
 #define FORTH_DICO_ENTRY(a) a, ((sizeof a) - 1U)
 
 enum ForthPrimitives
@@ -46,6 +48,16 @@ enum ForthPrimitives
     FORTH_PRIMITIVE_STATE,
     FORTH_PRIMITIVE_TRACE_ON,
     FORTH_PRIMITIVE_TRACE_OFF,
+    FORTH_PRIMITIVE_PROFILE_ON,
+    FORTH_PRIMITIVE_PROFILE_OFF,
+    FORTH_PRIMITIVE_PROFILE_DISPLAY,
+    FORTH_PRIMITIVE_PROFILE_FOLDED,
+    FORTH_PRIMITIVE_PROFILE_SEQUENCES,
+    FORTH_PRIMITIVE_DISPLAY_SEQUENCES,
+    FORTH_PRIMITIVE_JIT_ON,
+    FORTH_PRIMITIVE_JIT_OFF,
+    FORTH_PRIMITIVE_COMPACT_ON,
+    FORTH_PRIMITIVE_COMPACT_OFF,
 
     // Words
     FORTH_PRIMITIVE_TICK,
@@ -163,11 +175,298 @@ enum ForthPrimitives
     FORTH_PRIMITIVE_C_FUNCTION,
     FORTH_PRIMITIVE_C_CODE,
     FORTH_PRIMITIVE_EXEC_C_FUNC,
+    FORTH_PRIMITIVE_EXEC_C_BATCH,
 
     // Files
     FORTH_PRIMITIVE_INCLUDE,
 
+    // Floating point
+    FORTH_PRIMITIVE_FLITERAL,
+    FORTH_PRIMITIVE_FPLUS,
+    FORTH_PRIMITIVE_FMINUS,
+    FORTH_PRIMITIVE_FTIMES,
+    FORTH_PRIMITIVE_FDIV,
+    FORTH_PRIMITIVE_FNEGATE,
+    FORTH_PRIMITIVE_FABS,
+    FORTH_PRIMITIVE_FMIN,
+    FORTH_PRIMITIVE_FMAX,
+    FORTH_PRIMITIVE_FSQRT,
+    FORTH_PRIMITIVE_FSIN,
+    FORTH_PRIMITIVE_FCOS,
+    FORTH_PRIMITIVE_FATAN2,
+    FORTH_PRIMITIVE_FDUP,
+    FORTH_PRIMITIVE_FDROP,
+    FORTH_PRIMITIVE_FSWAP,
+    FORTH_PRIMITIVE_FOVER,
+    FORTH_PRIMITIVE_FDEPTH,
+    FORTH_PRIMITIVE_FFETCH,
+    FORTH_PRIMITIVE_FSTORE,
+    FORTH_PRIMITIVE_FCOMMA,
+    FORTH_PRIMITIVE_FLOATS,
+    FORTH_PRIMITIVE_FLOAT_PLUS,
+    FORTH_PRIMITIVE_S_TO_F,
+    FORTH_PRIMITIVE_F_TO_S,
+    FORTH_PRIMITIVE_FLOWER,
+    FORTH_PRIMITIVE_FEQUAL,
+    FORTH_PRIMITIVE_F0EQUAL,
+    FORTH_PRIMITIVE_F0LOWER,
+    FORTH_PRIMITIVE_FDISP,
+    FORTH_PRIMITIVE_DISPLAY_FSTACK,
+
+    // Arrays (see ForthArrays.cpp)
+    FORTH_PRIMITIVE_VPLUS,
+    FORTH_PRIMITIVE_VTIMES,
+    FORTH_PRIMITIVE_VFMA,
+    FORTH_PRIMITIVE_VSCALE,
+    FORTH_PRIMITIVE_VSUM,
+    FORTH_PRIMITIVE_VGATHER,
+    FORTH_PRIMITIVE_FVPLUS,
+    FORTH_PRIMITIVE_FVTIMES,
+    FORTH_PRIMITIVE_FVFMA,
+    FORTH_PRIMITIVE_FVSCALE,
+    FORTH_PRIMITIVE_FVSUM,
+    FORTH_PRIMITIVE_FVGATHER,
+
+    // Superinstructions (fused by Forth::fuseSuperInstructions)
+    FORTH_PRIMITIVE_DUP_TO_RSTACK,
+    FORTH_PRIMITIVE_FROM_RSTACK_1PLUS,
+    FORTH_PRIMITIVE_LITERAL_16_PLUS,
+    FORTH_PRIMITIVE_0EQUAL_0BRANCH,
+
+    // Compact definitions (see ForthBytecode.cpp)
+    FORTH_PRIMITIVE_BYTECODE,
+
     FORTH_MAX_PRIMITIVES
   };
 
+//! \brief Stack effect of a primitive: number of cells consumed and
+//! produced on the data stack and on the return stack. The floating
+//! point stack is checked by the F-words themselves.
+struct ForthStackEffect
+{
+  int8_t in;
+  int8_t out;
+  int8_t rin;
+  int8_t rout;
+};
+
+#define FORTH_STACK_EFFECT(i, o, ri, ro)                                \
+  effect = { i, o, ri, ro }; return true
+
+// **************************************************************
+//! Arity of primitives used by the static analysis of definitions
+//! (Forth::analyzeStackEffect). Words whose effect depends on data
+//! (PICK, ?DUP, EXECUTE ...) or parsing the stream are unknown.
+//! EXIT and branches are managed by the analysis.
+//! \return false if the effect of the primitive is unknown.
+// **************************************************************
+inline bool forthPrimitiveEffect(const uint32_t token, ForthStackEffect& effect)
+{
+  switch (token)
+    {
+    case FORTH_PRIMITIVE_NOP:
+    case FORTH_PRIMITIVE_BRANCH:
+    case FORTH_PRIMITIVE_CARRIAGE_RETURN:
+    case FORTH_PRIMITIVE_DISPLAY_DSTACK:
+    case FORTH_PRIMITIVE_BINARY:
+    case FORTH_PRIMITIVE_OCTAL:
+    case FORTH_PRIMITIVE_HEXADECIMAL:
+    case FORTH_PRIMITIVE_DECIMAL:
+    case FORTH_PRIMITIVE_FLITERAL:
+    case FORTH_PRIMITIVE_FPLUS:
+    case FORTH_PRIMITIVE_FMINUS:
+    case FORTH_PRIMITIVE_FTIMES:
+    case FORTH_PRIMITIVE_FDIV:
+    case FORTH_PRIMITIVE_FNEGATE:
+    case FORTH_PRIMITIVE_FABS:
+    case FORTH_PRIMITIVE_FMIN:
+    case FORTH_PRIMITIVE_FMAX:
+    case FORTH_PRIMITIVE_FSQRT:
+    case FORTH_PRIMITIVE_FSIN:
+    case FORTH_PRIMITIVE_FCOS:
+    case FORTH_PRIMITIVE_FATAN2:
+    case FORTH_PRIMITIVE_FDUP:
+    case FORTH_PRIMITIVE_FDROP:
+    case FORTH_PRIMITIVE_FSWAP:
+    case FORTH_PRIMITIVE_FOVER:
+    case FORTH_PRIMITIVE_FCOMMA:
+    case FORTH_PRIMITIVE_FDISP:
+    case FORTH_PRIMITIVE_DISPLAY_FSTACK:
+      FORTH_STACK_EFFECT(0, 0, 0, 0);
+
+    case FORTH_PRIMITIVE_LITERAL_16:
+    case FORTH_PRIMITIVE_LITERAL_32:
+    case FORTH_PRIMITIVE_PCREATE:
+    case FORTH_PRIMITIVE_STATE:
+    case FORTH_PRIMITIVE_HERE:
+    case FORTH_PRIMITIVE_LAST:
+    case FORTH_PRIMITIVE_CELL:
+    case FORTH_PRIMITIVE_GET_BASE:
+    case FORTH_PRIMITIVE_FALSE:
+    case FORTH_PRIMITIVE_TRUE:
+    case FORTH_PRIMITIVE_DEPTH:
+    case FORTH_PRIMITIVE_I:
+    case FORTH_PRIMITIVE_J:
+    case FORTH_PRIMITIVE_FDEPTH:
+    case FORTH_PRIMITIVE_F_TO_S:
+    case FORTH_PRIMITIVE_FLOWER:
+    case FORTH_PRIMITIVE_FEQUAL:
+    case FORTH_PRIMITIVE_F0EQUAL:
+    case FORTH_PRIMITIVE_F0LOWER:
+      FORTH_STACK_EFFECT(0, 1, 0, 0);
+
+    case FORTH_PRIMITIVE_FETCH:
+    case FORTH_PRIMITIVE_CELLS:
+    case FORTH_PRIMITIVE_ABS:
+    case FORTH_PRIMITIVE_NEGATE:
+    case FORTH_PRIMITIVE_1PLUS:
+    case FORTH_PRIMITIVE_2PLUS:
+    case FORTH_PRIMITIVE_1MINUS:
+    case FORTH_PRIMITIVE_2MINUS:
+    case FORTH_PRIMITIVE_0EQUAL:
+    case FORTH_PRIMITIVE_LITERAL_16_PLUS:
+    case FORTH_PRIMITIVE_FLOATS:
+    case FORTH_PRIMITIVE_FLOAT_PLUS:
+      FORTH_STACK_EFFECT(1, 1, 0, 0);
+
+    case FORTH_PRIMITIVE_0BRANCH:
+    case FORTH_PRIMITIVE_0EQUAL_0BRANCH:
+    case FORTH_PRIMITIVE_DROP:
+    case FORTH_PRIMITIVE_ALLOT:
+    case FORTH_PRIMITIVE_COMMA8:
+    case FORTH_PRIMITIVE_COMMA16:
+    case FORTH_PRIMITIVE_COMMA32:
+    case FORTH_PRIMITIVE_SET_BASE:
+    case FORTH_PRIMITIVE_DISP:
+    case FORTH_PRIMITIVE_UDISP:
+    case FORTH_PRIMITIVE_FFETCH:
+    case FORTH_PRIMITIVE_FSTORE:
+    case FORTH_PRIMITIVE_S_TO_F:
+      FORTH_STACK_EFFECT(1, 0, 0, 0);
+
+    case FORTH_PRIMITIVE_MIN:
+    case FORTH_PRIMITIVE_MAX:
+    case FORTH_PRIMITIVE_PLUS:
+    case FORTH_PRIMITIVE_MINUS:
+    case FORTH_PRIMITIVE_TIMES:
+    case FORTH_PRIMITIVE_DIV:
+    case FORTH_PRIMITIVE_RSHIFT:
+    case FORTH_PRIMITIVE_LSHIFT:
+    case FORTH_PRIMITIVE_GREATER:
+    case FORTH_PRIMITIVE_GREATER_EQUAL:
+    case FORTH_PRIMITIVE_LOWER:
+    case FORTH_PRIMITIVE_LOWER_EQUAL:
+    case FORTH_PRIMITIVE_EQUAL:
+    case FORTH_PRIMITIVE_NOT_EQUAL:
+    case FORTH_PRIMITIVE_AND:
+    case FORTH_PRIMITIVE_OR:
+    case FORTH_PRIMITIVE_XOR:
+    case FORTH_PRIMITIVE_NIP:
+      FORTH_STACK_EFFECT(2, 1, 0, 0);
+
+    case FORTH_PRIMITIVE_STORE8:
+    case FORTH_PRIMITIVE_STORE16:
+    case FORTH_PRIMITIVE_STORE32:
+    case FORTH_PRIMITIVE_2DROP:
+    case FORTH_PRIMITIVE_FVSUM:
+      FORTH_STACK_EFFECT(2, 0, 0, 0);
+
+    case FORTH_PRIMITIVE_VSUM:        FORTH_STACK_EFFECT(2, 1, 0, 0);
+    case FORTH_PRIMITIVE_FVSCALE:     FORTH_STACK_EFFECT(3, 0, 0, 0);
+
+    case FORTH_PRIMITIVE_VPLUS:
+    case FORTH_PRIMITIVE_VTIMES:
+    case FORTH_PRIMITIVE_VSCALE:
+    case FORTH_PRIMITIVE_VGATHER:
+    case FORTH_PRIMITIVE_FVPLUS:
+    case FORTH_PRIMITIVE_FVTIMES:
+    case FORTH_PRIMITIVE_FVGATHER:
+      FORTH_STACK_EFFECT(4, 0, 0, 0);
+
+    case FORTH_PRIMITIVE_VFMA:
+    case FORTH_PRIMITIVE_FVFMA:
+      FORTH_STACK_EFFECT(5, 0, 0, 0);
+
+    case FORTH_PRIMITIVE_CMOVE:       FORTH_STACK_EFFECT(3, 0, 0, 0);
+    case FORTH_PRIMITIVE_EXEC_C_BATCH: FORTH_STACK_EFFECT(3, 0, 0, 0);
+    case FORTH_PRIMITIVE_DUP:         FORTH_STACK_EFFECT(1, 2, 0, 0);
+    case FORTH_PRIMITIVE_SWAP:        FORTH_STACK_EFFECT(2, 2, 0, 0);
+    case FORTH_PRIMITIVE_OVER:        FORTH_STACK_EFFECT(2, 3, 0, 0);
+    case FORTH_PRIMITIVE_ROT:         FORTH_STACK_EFFECT(3, 3, 0, 0);
+    case FORTH_PRIMITIVE_TUCK:        FORTH_STACK_EFFECT(2, 3, 0, 0);
+    case FORTH_PRIMITIVE_2DUP:        FORTH_STACK_EFFECT(2, 4, 0, 0);
+    case FORTH_PRIMITIVE_2SWAP:       FORTH_STACK_EFFECT(4, 4, 0, 0);
+    case FORTH_PRIMITIVE_2OVER:       FORTH_STACK_EFFECT(4, 6, 0, 0);
+    case FORTH_PRIMITIVE_TO_RSTACK:   FORTH_STACK_EFFECT(1, 0, 0, 1);
+    case FORTH_PRIMITIVE_2TO_RSTACK:  FORTH_STACK_EFFECT(2, 0, 0, 2);
+    case FORTH_PRIMITIVE_FROM_RSTACK: FORTH_STACK_EFFECT(0, 1, 1, 0);
+    case FORTH_PRIMITIVE_2FROM_RSTACK:      FORTH_STACK_EFFECT(0, 2, 2, 0);
+    case FORTH_PRIMITIVE_DUP_TO_RSTACK:     FORTH_STACK_EFFECT(1, 1, 0, 1);
+    case FORTH_PRIMITIVE_FROM_RSTACK_1PLUS: FORTH_STACK_EFFECT(0, 1, 1, 0);
+
+    default:
+      return false;
+    }
+}
+
+// **************************************************************
+//! Primitives writing in the dictionary (stores, definitions,
+//! destination of arrays) or whose effect is unknown (EXECUTE, C
+//! functions). Definitions using them cannot be executed by contexts
+//! sharing the dictionary (Forth::analyzeStackEffect).
+// **************************************************************
+inline bool forthPrimitiveStores(const uint32_t token)
+{
+  switch (token)
+    {
+    case FORTH_PRIMITIVE_LOAD_SHARED_LIB:
+    case FORTH_PRIMITIVE_SYMBOL:
+    case FORTH_PRIMITIVE_COLON:
+    case FORTH_PRIMITIVE_SEMICOLON:
+    case FORTH_PRIMITIVE_CREATE:
+    case FORTH_PRIMITIVE_BUILDS:
+    case FORTH_PRIMITIVE_DOES:
+    case FORTH_PRIMITIVE_IMMEDIATE:
+    case FORTH_PRIMITIVE_SMUDGE:
+    case FORTH_PRIMITIVE_JIT_ON:
+    case FORTH_PRIMITIVE_COMPILE:
+    case FORTH_PRIMITIVE_ICOMPILE:
+    case FORTH_PRIMITIVE_POSTPONE:
+    case FORTH_PRIMITIVE_EXECUTE:
+    case FORTH_PRIMITIVE_RBRACKET:
+    case FORTH_PRIMITIVE_ALLOT:
+    case FORTH_PRIMITIVE_COMMA8:
+    case FORTH_PRIMITIVE_COMMA16:
+    case FORTH_PRIMITIVE_COMMA32:
+    case FORTH_PRIMITIVE_STORE8:
+    case FORTH_PRIMITIVE_STORE16:
+    case FORTH_PRIMITIVE_STORE32:
+    case FORTH_PRIMITIVE_CMOVE:
+    case FORTH_PRIMITIVE_BEGIN_C_LIB:
+    case FORTH_PRIMITIVE_END_C_LIB:
+    case FORTH_PRIMITIVE_ADD_EXT_C_LIB:
+    case FORTH_PRIMITIVE_C_FUNCTION:
+    case FORTH_PRIMITIVE_C_CODE:
+    case FORTH_PRIMITIVE_EXEC_C_FUNC:
+    case FORTH_PRIMITIVE_EXEC_C_BATCH:
+    case FORTH_PRIMITIVE_INCLUDE:
+    case FORTH_PRIMITIVE_FSTORE:
+    case FORTH_PRIMITIVE_FCOMMA:
+    case FORTH_PRIMITIVE_VPLUS:
+    case FORTH_PRIMITIVE_VTIMES:
+    case FORTH_PRIMITIVE_VFMA:
+    case FORTH_PRIMITIVE_VSCALE:
+    case FORTH_PRIMITIVE_VGATHER:
+    case FORTH_PRIMITIVE_FVPLUS:
+    case FORTH_PRIMITIVE_FVTIMES:
+    case FORTH_PRIMITIVE_FVFMA:
+    case FORTH_PRIMITIVE_FVSCALE:
+    case FORTH_PRIMITIVE_FVGATHER:
+      return true;
+
+    default:
+      return false;
+    }
+}
+
 #endif /* FORTH_PRIMITIVES_HPP_ */
@@ -0,0 +1,304 @@
+//=====================================================================
+// SimTaDyn: A GIS in a spreadsheet.
+// Copyright 2018 Quentin Quadrat <lecrapouille@gmail.com>
+//
+// This file is part of SimTaDyn.
+//
+// SimTaDyn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SimTaDyn.  If not, see <http://www.gnu.org/licenses/>.
+//=====================================================================
+
+#include "ForthProfiler.hpp"
+#include <algorithm>
+#include <chrono>
+#if defined(__i386__) || defined(__x86_64__)
+#  include <x86intrin.h>
+#endif
+
+//! Number of possible tokens.
+#define PROFILER_MAX_TOKENS (1U << (8U * sizeof (Cell16)))
+
+// **************************************************************
+//! Memory for statistics is allocated on the first call of
+//! ForthProfiler::start() to avoid penalizing Forth contexts which
+//! never profile.
+// **************************************************************
+ForthProfiler::ForthProfiler()
+  : m_current(0U),
+    m_running(false),
+    m_sequences(false)
+{
+  m_previous[0] = m_previous[1] = NO_TOKEN;
+}
+
+// **************************************************************
+//!
+// **************************************************************
+uint64_t ForthProfiler::now()
+{
+#if defined(__i386__) || defined(__x86_64__)
+  return __rdtsc();
+#else
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>
+    (std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// **************************************************************
+//!
+// **************************************************************
+void ForthProfiler::start(const bool sequences)
+{
+#if FORTH_PROFILING
+  if (m_tokens.empty())
+    {
+      reset();
+    }
+  m_running = true;
+  m_sequences = sequences;
+  m_previous[0] = m_previous[1] = NO_TOKEN;
+#else
+  (void) sequences;
+  std::cerr << FORTH_WARNING_COLOR
+            << "[WARNING] The Forth profiler has not been compiled (see FORTH_PROFILING)"
+            << FORTH_NORMAL_COLOR << std::endl;
+#endif
+}
+
+// **************************************************************
+//! Colon definitions still executing are measured until now.
+// **************************************************************
+void ForthProfiler::stop()
+{
+  const uint64_t time = now();
+
+  while (!m_frames.empty())
+    {
+      close(time);
+    }
+  m_running = false;
+  m_sequences = false;
+}
+
+// **************************************************************
+//!
+// **************************************************************
+void ForthProfiler::reset()
+{
+  TokenStats zero = { 0U, 0U, 0U, 0U };
+  Node root = { 0U, 0U, 0U, 0U, 0U };
+
+  m_tokens.assign(PROFILER_MAX_TOKENS, zero);
+  m_nodes.clear();
+  m_nodes.push_back(root);
+  m_frames.clear();
+  m_pairs.clear();
+  m_triples.clear();
+  m_current = 0U;
+}
+
+// **************************************************************
+//! Called when the Forth context is aborted: the return stack has
+//! been cleared so colon definitions will never call EXIT.
+// **************************************************************
+void ForthProfiler::unwind()
+{
+  while (!m_frames.empty())
+    {
+      --m_tokens[m_nodes[m_frames.back().node].token].active;
+      m_frames.pop_back();
+    }
+  m_current = 0U;
+}
+
+// **************************************************************
+//! Callees of a node are stored as a linked list (few callees
+//! per word).
+// **************************************************************
+uint32_t ForthProfiler::child(const uint32_t parent, const Cell16 token)
+{
+  uint32_t n = m_nodes[parent].child;
+
+  while (0U != n)
+    {
+      if (token == m_nodes[n].token)
+        return n;
+      n = m_nodes[n].sibling;
+    }
+
+  Node node = { token, parent, 0U, m_nodes[parent].child, 0U };
+  n = static_cast<uint32_t>(m_nodes.size());
+  m_nodes.push_back(node);
+  m_nodes[parent].child = n;
+  return n;
+}
+
+// **************************************************************
+//! \param time the current time in ticks.
+// **************************************************************
+void ForthProfiler::close(const uint64_t time)
+{
+  Frame const frame = m_frames.back();
+  m_frames.pop_back();
+
+  const uint64_t elapsed = time - frame.start;
+  const uint64_t self = elapsed - std::min(elapsed, frame.children);
+  Node& node = m_nodes[frame.node];
+  TokenStats& stats = m_tokens[node.token];
+
+  node.self += self;
+  stats.exclusive += self;
+  if (0U == --stats.active)
+    {
+      // Do not count several times recursive calls
+      stats.inclusive += elapsed;
+    }
+
+  m_current = node.parent;
+  if (!m_frames.empty())
+    {
+      m_frames.back().children += elapsed;
+    }
+}
+
+// **************************************************************
+//! Primitives are only counted: measuring them would cost more
+//! than executing them.
+// **************************************************************
+void ForthProfiler::report(std::ostream& os, ForthDictionary const& dictionary) const
+{
+  std::vector<Cell16> tokens;
+  std::ios_base::fmtflags ifs(os.flags());
+
+  for (uint32_t t = 0; t < m_tokens.size(); ++t)
+    {
+      if (0U != m_tokens[t].calls)
+        tokens.push_back(static_cast<Cell16>(t));
+    }
+
+  std::sort(tokens.begin(), tokens.end(), [this](Cell16 a, Cell16 b)
+            {
+              if (m_tokens[a].exclusive != m_tokens[b].exclusive)
+                return m_tokens[a].exclusive > m_tokens[b].exclusive;
+              return m_tokens[a].calls > m_tokens[b].calls;
+            });
+
+  os << std::left << std::setw(32) << "Word" << std::right
+     << std::setw(8) << "Token"
+     << std::setw(14) << "Calls"
+     << std::setw(18) << "Inclusive"
+     << std::setw(18) << "Exclusive" << std::endl;
+  for (auto const& t: tokens)
+    {
+      std::string name = dictionary.name(t);
+      os << std::left << std::setw(32) << (name.empty() ? "?" : name) << std::right
+         << std::setw(8) << std::hex << t << std::dec
+         << std::setw(14) << m_tokens[t].calls
+         << std::setw(18) << m_tokens[t].inclusive
+         << std::setw(18) << m_tokens[t].exclusive << std::endl;
+    }
+  os.flags(ifs);
+}
+
+// **************************************************************
+//! Only call stacks with a non null exclusive time are exported.
+// **************************************************************
+void ForthProfiler::folded(std::ostream& os, ForthDictionary const& dictionary) const
+{
+  std::vector<std::string> names(m_nodes.size());
+
+  // Parents are always created before their children so the path of
+  // a node can be built from the path of its parent.
+  for (uint32_t n = 1U; n < m_nodes.size(); ++n)
+    {
+      std::string name = dictionary.name(m_nodes[n].token);
+      if (name.empty())
+        name = "?";
+      names[n] = (0U == m_nodes[n].parent)
+        ? name : names[m_nodes[n].parent] + ';' + name;
+
+      if (0U != m_nodes[n].self)
+        {
+          os << names[n] << ' ' << m_nodes[n].self << '\n';
+        }
+    }
+  os.flush();
+}
+
+// **************************************************************
+//! Sequences are counted in the order tokens are dispatched inside
+//! a definition: calling or leaving a definition breaks the sequence.
+// **************************************************************
+void ForthProfiler::sequence(const Cell16 token)
+{
+  if (NO_TOKEN != m_previous[0])
+    {
+      ++m_pairs[(m_previous[0] << 16U) | token];
+      if (NO_TOKEN != m_previous[1])
+        {
+          ++m_triples[(static_cast<uint64_t>(m_previous[1]) << 32U) |
+                      (m_previous[0] << 16U) | token];
+        }
+    }
+  m_previous[1] = m_previous[0];
+  m_previous[0] = token;
+}
+
+// **************************************************************
+//! Display the most frequent entries of a map of sequences.
+// **************************************************************
+template<class K>
+static void displaySequences(std::ostream& os, ForthDictionary const& dictionary,
+                             std::unordered_map<K, uint64_t> const& sequences,
+                             const uint32_t length, const uint32_t count)
+{
+  std::vector<std::pair<K, uint64_t>> sorted(sequences.begin(), sequences.end());
+  std::sort(sorted.begin(), sorted.end(), [](std::pair<K, uint64_t> const& a,
+                                             std::pair<K, uint64_t> const& b)
+            {
+              return a.second > b.second;
+            });
+  if (sorted.size() > count)
+    sorted.resize(count);
+
+  for (auto const& it: sorted)
+    {
+      std::string names;
+      for (uint32_t i = length; i-- > 0U; )
+        {
+          std::string name = dictionary.name(static_cast<Cell16>(it.first >> (16U * i)));
+          names += (name.empty() ? "?" : name);
+          if (0U != i)
+            names += ' ';
+        }
+      os << std::left << std::setw(48) << names << std::right
+         << std::setw(14) << it.second << std::endl;
+    }
+}
+
+// **************************************************************
+//! \param count the maximum number of pairs and triples displayed.
+// **************************************************************
+void ForthProfiler::sequences(std::ostream& os, ForthDictionary const& dictionary,
+                              const uint32_t count) const
+{
+  std::ios_base::fmtflags ifs(os.flags());
+
+  os << std::left << std::setw(48) << "Pairs" << std::right
+     << std::setw(14) << "Calls" << std::endl;
+  displaySequences(os, dictionary, m_pairs, 2U, count);
+  os << std::left << std::setw(48) << "Triples" << std::right
+     << std::setw(14) << "Calls" << std::endl;
+  displaySequences(os, dictionary, m_triples, 3U, count);
+  os.flags(ifs);
+}
@@ -0,0 +1,177 @@
+//=====================================================================
+// SimTaDyn: A GIS in a spreadsheet.
+// Copyright 2018 Quentin Quadrat <lecrapouille@gmail.com>
+//
+// This file is part of SimTaDyn.
+//
+// SimTaDyn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SimTaDyn.  If not, see <http://www.gnu.org/licenses/>.
+//=====================================================================
+
+#ifndef FORTH_PROFILER_HPP_
+#  define FORTH_PROFILER_HPP_
+
+//! \brief This file contains a profiler for the Forth inner
+//! interpreter. It counts the number of times each token is executed
+//! and measures the inclusive and exclusive time spent in colon
+//! definitions. Call stacks are stored in a tree which can be
+//! exported as folded stacks for flame graphs tools.
+
+#  include "ForthDictionary.hpp"
+#  include <ostream>
+#  include <vector>
+#  include <unordered_map>
+
+// **************************************************************
+// Set to 1 for compiling the profiler hooks in the inner interpreters.
+// When set to 0 hooks are empty and the Forth words PROFILE-ON,
+// PROFILE-OFF, .PROFILE only display a warning.
+// **************************************************************
+#ifndef FORTH_PROFILING
+#  define FORTH_PROFILING 0
+#endif
+
+#if FORTH_PROFILING
+#  define FORTH_PROFILE_COUNT(p, t) if ((p).running()) (p).count(t)
+#  define FORTH_PROFILE_ENTER(p, t) if ((p).running()) (p).enter(t)
+#  define FORTH_PROFILE_LEAVE(p)    if ((p).running()) (p).leave()
+#else
+#  define FORTH_PROFILE_COUNT(p, t)
+#  define FORTH_PROFILE_ENTER(p, t)
+#  define FORTH_PROFILE_LEAVE(p)
+#endif
+
+//! \class ForthProfiler
+//! \brief Collect per token statistics of the Forth inner interpreter.
+//! Timings are given in ticks: CPU cycles (time stamp counter) on x86
+//! else nanoseconds.
+class ForthProfiler
+{
+public:
+  //! \brief Constructor. The profiler is stopped.
+  ForthProfiler();
+  //! \brief Start (or continue) collecting statistics.
+  //! \param sequences if set, also count the pairs and triples of
+  //! consecutive tokens (slower) for finding new superinstructions.
+  void start(const bool sequences = false);
+  //! \brief Stop collecting statistics. Opened calls are closed.
+  void stop();
+  //! \brief Forget all collected statistics.
+  void reset();
+  //! \brief Forget opened calls without measuring them (on abort).
+  void unwind();
+  //! \brief Accessor. Is the profiler collecting statistics ?
+  inline bool running() const
+  {
+    return m_running;
+  }
+  //! \brief A token is going to be executed.
+  inline void count(const Cell16 token)
+  {
+    ++m_tokens[token].calls;
+    if (m_sequences)
+      {
+        sequence(token);
+      }
+  }
+  //! \brief Start the execution of a colon definition.
+  inline void enter(const Cell16 token)
+  {
+    m_previous[0] = m_previous[1] = NO_TOKEN;
+    m_current = child(m_current, token);
+    ++m_tokens[token].active;
+    Frame frame = { m_current, now(), 0U };
+    m_frames.push_back(frame);
+  }
+  //! \brief End the execution of the most recent colon definition.
+  inline void leave()
+  {
+    m_previous[0] = m_previous[1] = NO_TOKEN;
+    // Entered before the profiler was started
+    if (m_frames.empty())
+      return ;
+    close(now());
+  }
+  //! \brief Display the statistics of executed tokens sorted by
+  //! exclusive time then by number of calls.
+  void report(std::ostream& os, ForthDictionary const& dictionary) const;
+  //! \brief Export call stacks as folded stacks (one line per stack:
+  //! words separated by ';' followed by the number of ticks).
+  void folded(std::ostream& os, ForthDictionary const& dictionary) const;
+  //! \brief Display the most executed pairs and triples of tokens.
+  void sequences(std::ostream& os, ForthDictionary const& dictionary,
+                 const uint32_t count) const;
+  //! \brief Current time in ticks.
+  static uint64_t now();
+
+private:
+
+  //! \brief Return the node of the call tree for the token called by
+  //! the given node. Create it if not existing.
+  uint32_t child(const uint32_t parent, const Cell16 token);
+  //! \brief Measure the most recent colon definition and pop it.
+  void close(const uint64_t time);
+  //! \brief Count the pair and the triple ended by the token.
+  void sequence(const Cell16 token);
+
+  //! No token executed before (start of a definition).
+  static const uint32_t NO_TOKEN = 0xFFFFFFFFU;
+
+  //! \brief Statistics of a token.
+  struct TokenStats
+  {
+    uint64_t calls;     //! Number of executions.
+    uint64_t inclusive; //! Ticks spent in the word and its callees.
+    uint64_t exclusive; //! Ticks spent in the word without callees.
+    uint32_t active;    //! Recursion depth (inclusive time counted once).
+  };
+
+  //! \brief Node of the call tree (a call stack).
+  struct Node
+  {
+    Cell16   token;     //! Colon definition.
+    uint32_t parent;    //! Caller node.
+    uint32_t child;     //! First callee node (0 if none).
+    uint32_t sibling;   //! Next callee of the parent (0 if none).
+    uint64_t self;      //! Exclusive ticks spent in this call stack.
+  };
+
+  //! \brief Colon definition being executed.
+  struct Frame
+  {
+    uint32_t node;      //! Node in the call tree.
+    uint64_t start;     //! Ticks when entered.
+    uint64_t children;  //! Ticks spent in callees.
+  };
+
+  //! Statistics indexed by token (allocated on the first start).
+  std::vector<TokenStats> m_tokens;
+  //! Call tree. Node 0 is the root (the interpreter).
+  std::vector<Node> m_nodes;
+  //! Stack of colon definitions being executed.
+  std::vector<Frame> m_frames;
+  //! Number of executions of two consecutive tokens (key: t1 t2).
+  std::unordered_map<uint32_t, uint64_t> m_pairs;
+  //! Number of executions of three consecutive tokens (key: t1 t2 t3).
+  std::unordered_map<uint64_t, uint64_t> m_triples;
+  //! The two last executed tokens of the current definition.
+  uint32_t m_previous[2];
+  //! Node of the colon definition being executed.
+  uint32_t m_current;
+  //! Statistics are being collected.
+  bool m_running;
+  //! Pairs and triples of tokens are counted.
+  bool m_sequences;
+};
+
+#endif /* FORTH_PROFILER_HPP_ */
@@ -0,0 +1,347 @@
+//=====================================================================
+// SimTaDyn: A GIS in a spreadsheet.
+// Copyright 2018 Quentin Quadrat <lecrapouille@gmail.com>
+//
+// This file is part of SimTaDyn.
+//
+// SimTaDyn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SimTaDyn.  If not, see <http://www.gnu.org/licenses/>.
+//=====================================================================
+
+
+//! \brief This file contains the snapshot of the Forth interpreter: a
+//! binary image of the dictionary and of the interpreter state saved
+//! after interpreting the system scripts and restored at the next
+//! boot instead of interpreting them again.
+//!
+//! \code{.unparsed}
+//! +-------+---------+------------+----------+------+------+------+
+//! | MAGIC | VERSION | PRIMITIVES | CHECKSUM | HERE | LAST | BASE |
+//! +-------+---------+------------+----------+------+------+------+
+//! | DICTIONARY (HERE bytes) | STACK EFFECTS | C FUNCTIONS | CRC  |
+//! +-------------------------+---------------+-------------+------+
+//! \endcode
+//!
+//! Numbers are stored in big endian like in the dictionary. CRC is
+//! the hash of all previous bytes. CHECKSUM is given by the caller
+//! (see Forth::snapshotChecksum) and identifies the sources and the
+//! primitives used for building the image.
+
+#include "Forth.hpp"
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+//! Change it when the layout of the image changes.
+#define FORTH_SNAPSHOT_VERSION  5U
+#define FORTH_SNAPSHOT_MAGIC    "SFIM"
+
+// **************************************************************
+//! Serialize numbers and strings in big endian.
+// **************************************************************
+class SnapshotWriter
+{
+public:
+
+  void number(const uint64_t value, const uint32_t bytes)
+  {
+    for (uint32_t i = bytes; i > 0U; --i)
+      {
+        m_buffer.push_back(static_cast<char>((value >> (8U * (i - 1U))) & 0xFFU));
+      }
+  }
+
+  void string(std::string const& str)
+  {
+    number(str.size(), 2U);
+    m_buffer.append(str);
+  }
+
+  std::string m_buffer;
+};
+
+// **************************************************************
+//! Deserialize numbers and strings. Reading outside the image sets
+//! the failure flag and returns 0.
+// **************************************************************
+class SnapshotReader
+{
+public:
+
+  SnapshotReader(std::string const& buffer)
+    : m_buffer(buffer), m_pos(0U), m_failed(false)
+  {
+  }
+
+  uint64_t number(const uint32_t bytes)
+  {
+    uint64_t value = 0U;
+    if (!available(bytes))
+      return 0U;
+    for (uint32_t i = 0U; i < bytes; ++i)
+      {
+        value = (value << 8U) | static_cast<uint8_t>(m_buffer[m_pos++]);
+      }
+    return value;
+  }
+
+  std::string string()
+  {
+    const uint32_t length = number(2U);
+    if (!available(length))
+      return std::string();
+    m_pos += length;
+    return m_buffer.substr(m_pos - length, length);
+  }
+
+  const char* data(const uint32_t length)
+  {
+    if (!available(length))
+      return nullptr;
+    m_pos += length;
+    return m_buffer.data() + m_pos - length;
+  }
+
+  bool available(const uint32_t length)
+  {
+    m_failed = m_failed || (m_pos + length > m_buffer.size());
+    return !m_failed;
+  }
+
+  std::string const& m_buffer;
+  size_t m_pos;
+  bool m_failed;
+};
+
+// **************************************************************
+//! The checksum covers the content of the source files and the
+//! dictionary as filled by boot() (names and tokens of primitives).
+//! \param sources the script files interpreted after boot().
+//! \return 0 if a file cannot be read.
+// **************************************************************
+uint64_t Forth::snapshotChecksum(std::vector<std::string> const& sources) const
+{
+  uint64_t h = fnv64(reinterpret_cast<const char*>(m_dictionary.m_dictionary),
+                     m_dictionary.here());
+
+  for (auto const& filename: sources)
+    {
+      std::ifstream in(filename, std::ios::in | std::ios::binary);
+      if (!in)
+        return 0U;
+
+      std::string content((std::istreambuf_iterator<char>(in)),
+                          std::istreambuf_iterator<char>());
+      h = fnv64(content.data(), content.size(), h);
+    }
+  return h;
+}
+
+// **************************************************************
+//! Definitions replaced by the JIT are saved with their original
+//! tokens (native functions are not saved). The image is written in
+//! a temporary file then renamed, so concurrent processes never read
+//! a partial image.
+//! \param filename the path of the image.
+//! \param checksum the value returned by snapshotChecksum().
+//! \return a boolean indicating if the process succeeded.
+// **************************************************************
+bool Forth::saveSnapshot(std::string const& filename, const uint64_t checksum)
+{
+  SnapshotWriter w;
+  const Cell32 here = m_dictionary.here();
+
+  w.m_buffer.append(FORTH_SNAPSHOT_MAGIC);
+  w.number(FORTH_SNAPSHOT_VERSION, 4U);
+  w.number(maxPrimitives(), 4U);
+  w.number(checksum, 8U);
+  w.number(here, 4U);
+  w.number(m_dictionary.last(), 4U);
+  w.number(static_cast<uint32_t>(m_base), 4U);
+
+  // Dictionary
+#if FORTH_JIT
+  const size_t origin = w.m_buffer.size();
+#endif
+  w.m_buffer.append(reinterpret_cast<const char*>(m_dictionary.m_dictionary), here);
+#if FORTH_JIT
+  for (auto const& it: m_jit_patches)
+    {
+      for (uint32_t i = 0; (i < 3U) && (it.address + 2U * i + 1U < here); ++i)
+        {
+          w.m_buffer[origin + it.address + 2U * i] = static_cast<char>(it.code[i] >> 8U);
+          w.m_buffer[origin + it.address + 2U * i + 1U] = static_cast<char>(it.code[i] & 0xFFU);
+        }
+    }
+#endif
+
+  // Stack effects of definitions
+  const uint32_t tokens = m_dictionary.m_effects.size();
+  uint32_t count = 0U;
+  for (uint32_t token = 0U; token < tokens; ++token)
+    {
+      count += m_dictionary.effect(token).valid;
+    }
+  w.number(count, 2U);
+  for (uint32_t token = 0U; token < tokens; ++token)
+    {
+      ForthWordEffect const& e = m_dictionary.effect(token);
+      if (e.valid)
+        {
+          w.number(token, 2U);
+          w.number(static_cast<uint16_t>(e.dmin), 2U);
+          w.number(static_cast<uint16_t>(e.dmax), 2U);
+          w.number(static_cast<uint16_t>(e.delta), 2U);
+          w.number(static_cast<uint16_t>(e.rmax), 2U);
+          w.number(e.pure, 1U);
+        }
+    }
+
+  // C functions. Native code of the JIT is not kept (the libraries
+  // are removed when the process ends).
+  w.number(m_dynamic_libs.m_functions.size(), 2U);
+  for (auto const& it: m_dynamic_libs.m_functions)
+    {
+      const bool jitted = (0 == it.func_c_name.compare(0, 13U, "simforth_jit_"));
+      w.string(it.func_forth_name);
+      w.string(it.func_c_name);
+      w.string(jitted ? std::string() : it.libpath);
+      w.number(it.params, 1U);
+      w.number(it.returns, 1U);
+      w.number(it.batched, 1U);
+    }
+
+  w.number(fnv64(w.m_buffer.data(), w.m_buffer.size()), 8U);
+
+  std::string tmp(filename + "." + std::to_string(getpid()));
+  std::ofstream out(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out.is_open())
+    {
+      LOGW("Cannot save the snapshot in '%s': %s", tmp.c_str(), strerror(errno));
+      return false;
+    }
+  out.write(w.m_buffer.data(), w.m_buffer.size());
+  out.close();
+  if ((!out) || (0 != std::rename(tmp.c_str(), filename.c_str())))
+    {
+      LOGW("Cannot save the snapshot in '%s': %s", filename.c_str(), strerror(errno));
+      std::remove(tmp.c_str());
+      return false;
+    }
+  return true;
+}
+
+// **************************************************************
+//! The image is read with a single read and checked entirely before
+//! modifying the interpreter: on failure the interpreter is unchanged
+//! and the caller shall interpret the sources.
+//! \param filename the path of the image.
+//! \param checksum the value returned by snapshotChecksum(). It shall
+//! be the same than the one used for saving the image.
+//! \return a boolean indicating if the interpreter has been restored.
+// **************************************************************
+bool Forth::loadSnapshot(std::string const& filename, const uint64_t checksum)
+{
+  std::ifstream in(filename, std::ios::in | std::ios::binary | std::ios::ate);
+  if (!in)
+    return false;
+
+  std::string buffer(static_cast<size_t>(in.tellg()), '\0');
+  in.seekg(0, in.beg);
+  in.read(&buffer[0], buffer.size());
+  if ((!in) || (buffer.size() < 8U))
+    return false;
+
+  // Integrity and compatibility
+  SnapshotReader r(buffer);
+  const size_t payload = buffer.size() - 8U;
+  const char* magic = r.data(4U);
+  if ((nullptr == magic) || (0 != std::memcmp(magic, FORTH_SNAPSHOT_MAGIC, 4U)) ||
+      (FORTH_SNAPSHOT_VERSION != r.number(4U)) ||
+      (maxPrimitives() != r.number(4U)) ||
+      (0U == checksum) || (checksum != r.number(8U)))
+    {
+      LOGI("Snapshot '%s' is outdated", filename.c_str());
+      return false;
+    }
+  {
+    SnapshotReader crc(buffer);
+    crc.m_pos = payload;
+    if (fnv64(buffer.data(), payload) != crc.number(8U))
+      {
+        LOGW("Snapshot '%s' is corrupted", filename.c_str());
+        return false;
+      }
+  }
+
+  const Cell32 here = r.number(4U);
+  const Cell32 last = r.number(4U);
+  const int32_t base = static_cast<int32_t>(r.number(4U));
+  const char* dictionary = r.data(here);
+
+  std::vector<std::pair<Cell16, ForthWordEffect>> effects(r.number(2U));
+  for (auto& it: effects)
+    {
+      it.first = r.number(2U);
+      it.second.dmin = static_cast<int16_t>(r.number(2U));
+      it.second.dmax = static_cast<int16_t>(r.number(2U));
+      it.second.delta = static_cast<int16_t>(r.number(2U));
+      it.second.rmax = static_cast<int16_t>(r.number(2U));
+      it.second.pure = (0U != r.number(1U));
+      it.second.valid = true;
+    }
+
+  std::vector<CFuncHolder> functions(r.number(2U));
+  for (auto& it: functions)
+    {
+      it.func_forth_name = r.string();
+      it.func_c_name = r.string();
+      it.libpath = r.string();
+      it.params = static_cast<uint8_t>(r.number(1U));
+      it.returns = (0U != r.number(1U));
+      it.batched = (0U != r.number(1U));
+    }
+
+  if ((r.m_failed) || (r.m_pos != payload) || (last >= here) ||
+      (here > m_dictionary.capacity()))
+    {
+      LOGW("Snapshot '%s' is malformed", filename.c_str());
+      return false;
+    }
+
+  std::pair<bool, std::string> res = m_dynamic_libs.bind(functions);
+  if (!res.first)
+    {
+      LOGW("Snapshot '%s': %s", filename.c_str(), res.second.c_str());
+      return false;
+    }
+
+  // Restore the interpreter
+#if FORTH_JIT
+  const uint32_t threshold = m_jit_threshold;
+  jit(0U);
+  jit(threshold);
+#endif
+  std::memcpy(m_dictionary.m_dictionary, dictionary, here);
+  m_dictionary.m_here = here;
+  m_dictionary.m_last = last;
+  m_dictionary.reindex();
+  m_dictionary.m_effects.assign(m_dictionary.m_effects.size(), ForthWordEffect());
+  for (auto const& it: effects)
+    {
+      m_dictionary.effect(it.first, it.second);
+    }
+  m_base = base;
+  m_last_completion = m_dictionary.last();
+  return true;
+}
@@ -19,6 +19,7 @@
 //=====================================================================
 
 #include "ForthStream.hpp"
+#include <algorithm>
 
 // **************************************************************
 //! When calling this constructor, no stream was opened. You need
@@ -29,6 +30,7 @@ ForthStream::ForthStream()
 {
   // 64 is enough for storing correct Forth words (32 char max)
   m_word.reserve(64U);
+  m_word_start = m_word_length = 0;
   m_mode = NOTHING_TO_READ;
   init();
   m_str = "";
@@ -69,27 +71,50 @@ void ForthStream::init()
   m_cursor_last = m_cursor_next = m_cursor_prev = m_lines = 0;
   m_eol = m_eof = true;
   m_word = "";
+  m_word_start = m_word_length = 0;
   //m_word_picked = true;
 }
 
 // **************************************************************
 //! \param filename the script Forth stored in an ascii file.
+//! \param whole if set the file is read in a single shot and words
+//! are extracted from this buffer like for a string. Else the file
+//! is read line by line.
 //! \return a boolean indicating if the file could be opned with success.
 // **************************************************************
-bool ForthStream::loadFile(std::string const& filename)
+bool ForthStream::loadFile(std::string const& filename, const bool whole)
 {
   close();
   init();
 
   m_filename = filename;
-  m_infile.open(filename, std::ios::in);
-  if (m_infile.is_open())
+  m_infile.open(filename, std::ios::in | std::ios::binary);
+  if (!m_infile.is_open())
+    {
+      // Do not read again the previous string
+      m_mode = NOTHING_TO_READ;
+      return false;
+    }
+
+  if (!whole)
     {
       m_mode = READ_FILE;
       refill();
       return true;
     }
-  return false;
+
+  // Read the whole file with a single memory allocation
+  m_infile.seekg(0, std::ios::end);
+  std::streamoff size = m_infile.tellg();
+  if (size < 0) size = 0;
+  m_str.resize(static_cast<size_t>(size));
+  m_infile.seekg(0, std::ios::beg);
+  m_infile.read(&m_str[0], size);
+  m_str.resize(static_cast<size_t>(m_infile.gcount()));
+  m_infile.close();
+  m_infile.clear();
+  m_mode = READ_BUFFER;
+  return true;
 }
 
 // **************************************************************
@@ -116,7 +141,7 @@ void ForthStream::skipLine()
   m_eol = true;
   //++m_lines;
 
-  if (READ_STRING == m_mode)
+  if ((READ_STRING == m_mode) || (READ_BUFFER == m_mode))
     {
       // Go to the next end of file markor.
       m_cursor_prev = m_cursor_last;
@@ -153,6 +178,31 @@ std::string ForthStream::getLine()
   return line;
 }
 
+// **************************************************************
+//! For files read line by line the line counter is incremented by
+//! refill(). For a file loaded as a whole buffer the line is computed
+//! here, only when needed (i.e. on errors), to keep the word
+//! extraction fast.
+// **************************************************************
+std::pair<size_t, size_t> ForthStream::position() const
+{
+  if (READ_BUFFER != m_mode)
+    return std::make_pair(m_lines, m_cursor_prev + 1U);
+
+  size_t end = std::min(m_cursor_prev, m_str.size());
+  size_t lines = 1U;
+  size_t bol = 0U;
+  for (size_t i = 0; i < end; ++i)
+    {
+      if ('\n' == m_str[i])
+        {
+          ++lines;
+          bol = i + 1U;
+        }
+    }
+  return std::make_pair(lines, end - bol + 1U);
+}
+
 // **************************************************************
 //! \return if next line was loaded.
 // **************************************************************
@@ -210,7 +260,8 @@ bool ForthStream::hasMoreWords()
 
 // **************************************************************
 //! \return true if a word has been found, else return false.
-//! The word extracted is saved as m_word
+//! The word extracted is not copied: only its position and its
+//! length in m_str are saved.
 // **************************************************************
 bool ForthStream::split()
 {
@@ -233,7 +284,9 @@ bool ForthStream::split()
   if ((std::string::npos != m_cursor_next) || (std::string::npos != m_cursor_last))
     {
       // Found a word
-      m_word = m_str.substr(m_cursor_last, m_cursor_next - m_cursor_last);
+      m_word_start = m_cursor_last;
+      m_word_length = ((std::string::npos == m_cursor_next)
+                       ? m_str.size() : m_cursor_next) - m_cursor_last;
 
       // Convert the word to upper case
       //std::transform(m_word.begin(), m_word.end(), m_word.begin(), ::toupper);
@@ -35,7 +35,9 @@ public:
   //! \brief Destructor. Close the opened stream.
   ~ForthStream();
   //! \brief For feeding a Forth interpreter with an ascii file.
-  bool loadFile(std::string const& filename);
+  //! \param whole if true the whole file is loaded in a single buffer
+  //! (words are not copied), else the file is read line by line.
+  bool loadFile(std::string const& filename, const bool whole = true);
   //! \brief For feeding a Forth interpreter with a string.
   void loadString(std::string const& str,
                   std::string const& name = "<string>");
@@ -46,20 +48,20 @@ public:
   //! \brief Return the current line
   std::string getLine();
   //! \brief Accessor. Return the current extracted Forth word
-  //! called by ForthStream::hasMoreWords().
+  //! called by ForthStream::hasMoreWords(). The word is copied in
+  //! a buffer reused by all words: memory is only allocated for a
+  //! word longer than the previous ones.
   inline const std::string& nextWord() const
   {
     //m_word_picked = true;
     //std::cout << "nextWord '" << m_word << "'" << std::endl;
+    m_word.assign(m_str, m_word_start, m_word_length);
     return m_word;
   }
   //! \brief Accessor. Give the current cursor (line and column)
   //! of the opened stream.
   //! \return the current line and column
-  std::pair<size_t, size_t> position() const
-  {
-    return std::make_pair(m_lines, m_cursor_prev + 1U);
-  }
+  std::pair<size_t, size_t> position() const;
   //! \brief Accessor. Give the name of the opened stream.
   //! \return the filename currently reading, else return "" if reading
   //! a string.
@@ -88,7 +90,8 @@ protected:
   {
     NOTHING_TO_READ,
     READ_FILE,
-    READ_STRING
+    READ_STRING,
+    READ_BUFFER  // Whole file loaded in m_str
   };
 
   // white-space characters (from isspace() doc)
@@ -98,7 +101,9 @@ protected:
   std::ifstream m_infile; // Opened file
   std::string m_filename; // The file name to read
   std::string m_str;      // The string to read
-  std::string m_word;     // The Forth word read (token)
+  mutable std::string m_word; // The Forth word read (token)
+  size_t m_word_start;    // Position of the Forth word read in m_str
+  size_t m_word_length;   // Number of characters of the Forth word read
   size_t m_cursor_last;   // Split iterator on Forth words
   size_t m_cursor_next;   // Split iterator on Forth words
   size_t m_cursor_prev;
@@ -0,0 +1,519 @@
+//=====================================================================
+// SimForth: A Forth for SimTaDyn project.
+// Copyright 2018 Quentin Quadrat <lecrapouille@gmail.com>
+//
+// This file is part of SimTaDyn.
+//
+// SimTaDyn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SimTaDyn.  If not, see <http://www.gnu.org/licenses/>.
+//=====================================================================
+
+//! \brief This file contains micro-benchmarks of the Forth
+//! interpreter: inner interpreter, dictionary lookups, outer
+//! interpreter, file parsing and calls of C functions. Results are
+//! written as JSON for tracking regressions between releases.
+
+#include "Forth.hpp"
+#include "PathManager.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+// **************************************************************
+//! \brief Result of a benchmark: the best duration of several runs.
+// **************************************************************
+struct BenchResult
+{
+  std::string name;
+  //! What is counted by operations (words, calls, lookups, bytes).
+  std::string unit;
+  uint64_t operations;
+  double seconds;
+  //! Not empty if the benchmark could not be run.
+  std::string skipped;
+};
+
+// **************************************************************
+//! \brief Run the benchmarks on a booted Forth.
+// **************************************************************
+class Benchmark
+{
+public:
+
+  Benchmark(Forth& forth, const uint32_t runs, const uint32_t iterations,
+            const uint32_t vocabulary)
+    : m_forth(forth), m_runs(runs), m_iterations(iterations),
+      m_vocabulary(vocabulary)
+  {
+  }
+
+  //! \brief Inner interpreter: primitives, calls of colon
+  //! definitions and branches executed inside DO LOOP.
+  void dispatch();
+  //! \brief Dictionary lookups of existing and missing words
+  //! among a large vocabulary.
+  void lookup();
+  //! \brief Outer interpreter: words interpreted and definitions
+  //! compiled from a string.
+  void interprete();
+  //! \brief Parsing of an included file.
+  void include();
+  //! \brief Calls of C functions (one by one and batched).
+  void cfunction();
+  //! \brief Compact definitions (COMPACT-ON): dispatch benchmarks
+  //! and size of definitions compared to tokens.
+  void bytecode();
+  //! \brief Write results as JSON.
+  void json(std::ostream& os) const;
+  //! \brief Display results for humans.
+  void display(std::ostream& os) const;
+
+private:
+
+  //! \brief Interprete Forth code needed by a benchmark.
+  //! \throw std::runtime_error if the code failed.
+  void forth(std::string const& code);
+  //! \brief Execute a Forth word m_runs times and record its best
+  //! duration.
+  void measureWord(std::string const& name, std::string const& word,
+                   std::string const& unit, const uint64_t operations);
+  //! \brief Call fun m_runs times and record its best duration.
+  template<class Function>
+  void measure(std::string const& name, std::string const& unit,
+               const uint64_t operations, Function fun);
+
+  Forth& m_forth;
+  //! Number of runs of each benchmark (the best one is kept).
+  const uint32_t m_runs;
+  //! Number of iterations of loops.
+  const uint32_t m_iterations;
+  //! Number of words created for dictionary lookups.
+  const uint32_t m_vocabulary;
+  std::vector<BenchResult> m_results;
+};
+
+// **************************************************************
+//!
+// **************************************************************
+void Benchmark::forth(std::string const& code)
+{
+  std::pair<bool, std::string> res = m_forth.interpreteString(code, "<benchmark>");
+  if (!res.first)
+    {
+      throw std::runtime_error(res.second + " in '" + code.substr(0, 64) + "'");
+    }
+}
+
+// **************************************************************
+//!
+// **************************************************************
+template<class Function>
+void Benchmark::measure(std::string const& name, std::string const& unit,
+                        const uint64_t operations, Function fun)
+{
+  double best = 0.0;
+
+  for (uint32_t run = 0; run < m_runs; ++run)
+    {
+      auto start = std::chrono::steady_clock::now();
+      fun();
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      if ((0 == run) || (elapsed.count() < best))
+        {
+          best = elapsed.count();
+        }
+    }
+  if (0 != m_forth.stackDepth(forth::DataStack))
+    {
+      throw std::runtime_error(name + " did not leave an empty data stack");
+    }
+  m_results.push_back(BenchResult{ name, unit, operations, best, "" });
+}
+
+// **************************************************************
+//!
+// **************************************************************
+void Benchmark::measureWord(std::string const& name, std::string const& word,
+                            std::string const& unit, const uint64_t operations)
+{
+  measure(name, unit, operations, [&]() { forth(word); });
+}
+
+// **************************************************************
+//! Words of the loop bodies are counted as written in the source
+//! (LOOP counts as a single word).
+// **************************************************************
+void Benchmark::dispatch()
+{
+  const std::string n = std::to_string(m_iterations);
+
+  forth(": BENCH-PRIMITIVES 0 " + n + " 0 DO 1+ DUP DROP DUP SWAP DROP LOOP DROP ;");
+  measureWord("dispatch/primitives", "BENCH-PRIMITIVES", "words",
+              7ULL * m_iterations);
+
+  forth(": BENCH-INC 1+ ;");
+  forth(": BENCH-CALLS 0 " + n + " 0 DO BENCH-INC BENCH-INC BENCH-INC BENCH-INC LOOP DROP ;");
+  measureWord("dispatch/calls", "BENCH-CALLS", "calls",
+              4ULL * m_iterations);
+
+  forth(": BENCH-BRANCHES 0 " + n + " 0 DO I 1 AND IF 1+ ELSE 1- THEN LOOP DROP ;");
+  measureWord("dispatch/branches", "BENCH-BRANCHES", "words",
+              6ULL * m_iterations);
+}
+
+// **************************************************************
+//!
+// **************************************************************
+void Benchmark::lookup()
+{
+  std::vector<std::string> hits;
+  std::vector<std::string> misses;
+  std::ostringstream code;
+
+  hits.reserve(m_vocabulary);
+  misses.reserve(m_vocabulary);
+  for (uint32_t i = 0; i < m_vocabulary; ++i)
+    {
+      hits.push_back("BENCH-WORD-" + std::to_string(i));
+      misses.push_back("BENCH-MISS-" + std::to_string(i));
+      code << ": " << hits.back() << ' ' << i << " ;\n";
+    }
+
+  // Creating the vocabulary also measures the compilation
+  std::string const definitions = code.str();
+  auto start = std::chrono::steady_clock::now();
+  forth(definitions);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  m_results.push_back(BenchResult{ "interprete/definitions", "definitions",
+                                   m_vocabulary, elapsed.count(), "" });
+
+  // Lookups are fast: look for the vocabulary several times
+  const uint32_t passes = 100U;
+  ForthDictionary const& dictionary = m_forth.dictionary();
+  uint64_t found = 0;
+  measure("lookup/hit", "lookups", static_cast<uint64_t>(passes) * m_vocabulary, [&]()
+  {
+    Cell16 token;
+    bool immediate;
+    for (uint32_t pass = 0; pass < passes; ++pass)
+      {
+        for (auto const& word: hits)
+          {
+            found += dictionary.find(word, token, immediate);
+          }
+      }
+  });
+  measure("lookup/miss", "lookups", static_cast<uint64_t>(passes) * m_vocabulary, [&]()
+  {
+    Cell16 token;
+    bool immediate;
+    for (uint32_t pass = 0; pass < passes; ++pass)
+      {
+        for (auto const& word: misses)
+          {
+            found += dictionary.find(word, token, immediate);
+          }
+      }
+  });
+  if (found != static_cast<uint64_t>(m_runs) * passes * m_vocabulary)
+    {
+      throw std::runtime_error("Words of the vocabulary have not been found");
+    }
+}
+
+// **************************************************************
+//!
+// **************************************************************
+void Benchmark::interprete()
+{
+  const uint32_t lines = 10000U;
+  std::ostringstream code;
+
+  for (uint32_t i = 0; i < lines; ++i)
+    {
+      code << "1 2 + DROP " << i << " DUP * DROP\n";
+    }
+  std::string const script = code.str();
+  measureWord("interprete/string", script, "words", 8ULL * lines);
+}
+
+// **************************************************************
+//!
+// **************************************************************
+void Benchmark::include()
+{
+  const uint32_t lines = 10000U;
+  std::string const filename = config::tmp_path + "benchmark-include.fs";
+  std::ofstream file(filename);
+  for (uint32_t i = 0; i < lines; ++i)
+    {
+      file << "( line " << i << " ) 1 2 + DROP " << i << " DUP * DROP \\ comment\n";
+    }
+  const uint64_t bytes = static_cast<uint64_t>(file.tellp());
+  file.close();
+  if (!file)
+    {
+      m_results.push_back(BenchResult{ "include/file", "bytes", 0, 0.0,
+                                       "cannot write '" + filename + "'" });
+      return ;
+    }
+
+  measure("include/file", "bytes", bytes, [&]()
+  {
+    std::pair<bool, std::string> res = m_forth.interpreteFile(filename);
+    if (!res.first)
+      {
+        throw std::runtime_error(res.second);
+      }
+  });
+}
+
+// **************************************************************
+//! The C library is compiled by the first run of the benchmark
+//! (the cache of compiled libraries is used by next runs).
+// **************************************************************
+void Benchmark::cfunction()
+{
+  const uint32_t cells = 4096U;
+  const uint32_t batches = std::max(1U, m_iterations / cells);
+  std::string const filename = config::tmp_path + "benchmark-clib.fs";
+  std::ofstream file(filename);
+  file << "C-LIB libbenchmark\n"
+       << "\\C int bench_inc(int a) { return a + 1; }\n"
+       << "C-FUNCTION BENCH-CINC bench_inc n -- n\n"
+       << "END-C-LIB\n";
+  file.close();
+
+  std::pair<bool, std::string> res = m_forth.interpreteFile(filename);
+  if (!res.first)
+    {
+      m_results.push_back(BenchResult{ "cfunction/call", "calls", 0, 0.0, res.second });
+      m_results.push_back(BenchResult{ "cfunction/batch", "calls", 0, 0.0, res.second });
+      m_forth.abort();
+      return ;
+    }
+
+  const std::string n = std::to_string(m_iterations);
+  const std::string c = std::to_string(cells);
+  forth(": BENCH-C-CALLS 0 " + n + " 0 DO BENCH-CINC LOOP DROP ;");
+  measureWord("cfunction/call", "BENCH-C-CALLS", "calls", m_iterations);
+
+  forth("CREATE BENCH-ARGS " + c + " CELLS ALLOT");
+  forth("CREATE BENCH-RESULTS " + c + " CELLS ALLOT");
+  forth(": BENCH-C-BATCH " + std::to_string(batches) +
+        " 0 DO BENCH-ARGS BENCH-RESULTS " + c + " BENCH-CINC[] LOOP ;");
+  measureWord("cfunction/batch", "BENCH-C-BATCH", "calls",
+              static_cast<uint64_t>(batches) * cells);
+}
+
+// **************************************************************
+//! Same words than dispatch() but compacted. Sizes are the bytes of
+//! dictionary taken by the same definitions compiled as tokens then
+//! compacted (their compilation time is the duration).
+// **************************************************************
+void Benchmark::bytecode()
+{
+  const std::string n = std::to_string(m_iterations);
+
+  forth("COMPACT-ON");
+  forth(": BENCH-C-PRIMITIVES 0 " + n + " 0 DO 1+ DUP DROP DUP SWAP DROP LOOP DROP ;");
+  measureWord("bytecode/primitives", "BENCH-C-PRIMITIVES", "words",
+              7ULL * m_iterations);
+
+  forth(": BENCH-C-INC 1+ ;");
+  forth(": BENCH-C-CALLS 0 " + n + " 0 DO BENCH-C-INC BENCH-C-INC BENCH-C-INC BENCH-C-INC LOOP DROP ;");
+  measureWord("bytecode/calls", "BENCH-C-CALLS", "calls",
+              4ULL * m_iterations);
+
+  forth(": BENCH-C-BRANCHES 0 " + n + " 0 DO I 1 AND IF 1+ ELSE 1- THEN LOOP DROP ;");
+  measureWord("bytecode/branches", "BENCH-C-BRANCHES", "words",
+              6ULL * m_iterations);
+  forth("COMPACT-OFF");
+
+  const uint32_t definitions = std::max(1U, m_vocabulary / 10U);
+  for (auto const& mode: { "tokens", "compact" })
+    {
+      std::ostringstream code;
+      for (uint32_t i = 0; i < definitions; ++i)
+        {
+          code << ": BENCH-" << mode << '-' << i << " DUP " << i << " + OVER * 0= IF 1+ ELSE "
+               << 1000U * i << " - THEN 0 10 0 DO I + LOOP SWAP DROP ;\n";
+        }
+
+      std::string const script = code.str();
+      const Cell32 here = m_forth.dictionary().here();
+      if (0 == strcmp("compact", mode))
+        forth("COMPACT-ON");
+      auto start = std::chrono::steady_clock::now();
+      forth(script);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      forth("COMPACT-OFF");
+      m_results.push_back(BenchResult{ std::string("bytecode/size/") + mode, "bytes",
+                                       m_forth.dictionary().here() - here,
+                                       elapsed.count(), "" });
+    }
+}
+
+// **************************************************************
+//!
+// **************************************************************
+void Benchmark::json(std::ostream& os) const
+{
+  os << "{\n"
+     << "  \"project\": \"" << config::project_name << "\",\n"
+     << "  \"version\": \"" << config::major_version << '.' << config::minor_version << "\",\n"
+     << "  \"branch\": \"" << config::git_branch << "\",\n"
+     << "  \"sha1\": \"" << config::git_sha1 << "\",\n"
+     << "  \"runs\": " << m_runs << ",\n"
+     << "  \"results\": [";
+
+  for (size_t i = 0; i < m_results.size(); ++i)
+    {
+      BenchResult const& r = m_results[i];
+      os << (i ? "," : "") << "\n    { \"name\": \"" << r.name
+         << "\", \"unit\": \"" << r.unit << "\", ";
+      if (r.skipped.empty())
+        {
+          os << "\"operations\": " << r.operations
+             << ", \"seconds\": " << r.seconds
+             << ", \"per_second\": "
+             << ((r.seconds > 0.0) ? static_cast<double>(r.operations) / r.seconds : 0.0)
+             << " }";
+        }
+      else
+        {
+          std::string reason(r.skipped);
+          std::replace(reason.begin(), reason.end(), '"', '\'');
+          std::replace(reason.begin(), reason.end(), '\\', '/');
+          os << "\"skipped\": \"" << reason << "\" }";
+        }
+    }
+  os << "\n  ]\n}\n";
+}
+
+// **************************************************************
+//!
+// **************************************************************
+void Benchmark::display(std::ostream& os) const
+{
+  for (auto const& r: m_results)
+    {
+      os << r.name << ": ";
+      if (r.skipped.empty())
+        {
+          os << static_cast<double>(r.operations) / r.seconds << ' '
+             << r.unit << "/s (" << r.operations << " in "
+             << r.seconds << " s)" << std::endl;
+        }
+      else
+        {
+          os << "skipped (" << r.skipped << ")" << std::endl;
+        }
+    }
+}
+
+static void usage(const char* fun)
+{
+  std::cout << "Usage:   " << fun << " [-option] [argument]" << std::endl;
+  std::cout << "option:  " << "-h              Show this usage" << std::endl;
+  std::cout << "         " << "-d path         Add a path where to find forth/system.fs and forth/LibC" << std::endl;
+  std::cout << "         " << "-o file         Write JSON results in a file (default benchmark.json)" << std::endl;
+  std::cout << "         " << "-r runs         Number of runs of each benchmark, the best is kept (default 5)" << std::endl;
+  std::cout << "         " << "-n iterations   Number of iterations of loops (default 10000000)" << std::endl;
+  std::cout << "         " << "-w words        Size of the vocabulary for lookups (default 10000)" << std::endl;
+}
+
+int main(int argc,char *argv[])
+{
+  std::string output("benchmark.json");
+  uint32_t runs = 5U;
+  uint32_t iterations = 10000000U;
+  uint32_t vocabulary = 10000U;
+  int opt;
+
+  // Call it before Logger constructor
+  if (!File::mkdir(config::tmp_path))
+    {
+      std::cerr << "Failed creating the temporary directory '"
+                << config::tmp_path << "'" << std::endl;
+    }
+
+  while ((opt = getopt(argc, argv, "hd:o:r:n:w:")) != -1)
+    {
+      switch (opt)
+        {
+        case 'd':
+          PathManager::instance().add(optarg);
+          break;
+        case 'o':
+          output = optarg;
+          break;
+        case 'r':
+          runs = std::max(1, atoi(optarg));
+          break;
+        case 'n':
+          iterations = std::max(1, atoi(optarg));
+          break;
+        case 'w':
+          vocabulary = std::max(1, atoi(optarg));
+          break;
+        default:
+          usage(argv[0]);
+          return 1;
+        }
+    }
+
+  // Large enough for the vocabulary of lookups (pages are allocated lazily)
+  ForthDictionary dico(256U * 1024U * 1024U);
+  Forth forth(dico);
+  forth.boot();
+  std::pair<bool, std::string> res =
+    forth.interpreteFile(PathManager::instance().expand("forth/system.fs"));
+  if (!res.first)
+    {
+      forth.ok(res);
+      return 1;
+    }
+
+  Benchmark benchmark(forth, runs, iterations, vocabulary);
+  try
+    {
+      benchmark.dispatch();
+      benchmark.lookup();
+      benchmark.interprete();
+      benchmark.include();
+      benchmark.cfunction();
+      benchmark.bytecode();
+    }
+  catch (std::exception const& e)
+    {
+      std::cerr << "Benchmark failed: " << e.what() << std::endl;
+      return 1;
+    }
+
+  // Forth displays its messages on the standard output: save JSON
+  // results in a file.
+  benchmark.display(std::cout);
+  std::ofstream file(output);
+  benchmark.json(file);
+  if (!file)
+    {
+      std::cerr << "Failed writing '" << output << "'" << std::endl;
+      return 1;
+    }
+
+  return 0;
+}
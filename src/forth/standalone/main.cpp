@@ -31,6 +31,8 @@ static void usage(const char* fun)
   std::cout << "         " << "-l dico         Load a SimForth dictionary file and smash the current dictionary" << std::endl;
   std::cout << "         " << "-a dico         load a SimForth dictionary file and append to the current dictionary" << std::endl;
   std::cout << "         " << "-d dico         Dump the current dictionary into a binary file" << std::endl;
+  std::cout << "         " << "-s image        Save the interpreter (dictionary, C functions) in a snapshot file" << std::endl;
+  std::cout << "         " << "-r image        Restore the interpreter from a snapshot file" << std::endl;
   std::cout << "         " << "-f file         Interprete a SimForth script file (ascii)" << std::endl;
   std::cout << "         " << "-e string       Interprete a SimForth script string (ascii)" << std::endl;
   std::cout << "         " << "-p              Pretty print the dictionary with or without color (depending on option -x)" << std::endl;
@@ -73,8 +75,10 @@ int main(int argc,char *argv[])
   // Boot the default core. Even if the user will load
   // a dictionary instead
   forth.boot();
+  // Snapshots are compatible if they have been made with the same primitives
+  const uint64_t checksum = forth.snapshotChecksum({});
 
-  while ((opt = getopt(argc, argv, "hua:l:d:f:e:pix")) != -1)
+  while ((opt = getopt(argc, argv, "hua:l:d:s:r:f:e:pix")) != -1)
   {
     switch (opt)
       {
@@ -106,6 +110,29 @@ int main(int argc,char *argv[])
           }
         break;
 
+        // Save the interpreter in a snapshot
+      case 's':
+        if (forth.saveSnapshot(optarg, checksum))
+          {
+            std::cout << "Snapshot successfully saved in file '"
+                      << optarg << "'" << std::endl;
+          }
+        break;
+
+        // Restore the interpreter from a snapshot
+      case 'r':
+        if (forth.loadSnapshot(optarg, checksum))
+          {
+            std::cout << "Snapshot successfully restored from file '"
+                      << optarg << "'" << std::endl;
+          }
+        else
+          {
+            std::cerr << "Snapshot '" << optarg << "' is missing or has been made "
+                      << "by another version of SimForth" << std::endl;
+          }
+        break;
+
         // Execute a script file
       case 'f':
         res = forth.interpreteFile(optarg);
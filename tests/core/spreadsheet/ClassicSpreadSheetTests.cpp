@@ -20,6 +20,8 @@
 
 #include "ClassicSpreadSheetTests.hpp"
 #include "PathManager.hpp"
+#include <algorithm>
+#include <fstream>
 
 // Register the test suite
 CPPUNIT_TEST_SUITE_REGISTRATION(ClassicSpreadSheetTests);
@@ -131,3 +133,644 @@ void ClassicSpreadSheetTests::testInput5()
   CPPUNIT_ASSERT(std::make_pair(true, 10) == sheet.value(2, 1));
   CPPUNIT_ASSERT(std::make_pair(true, 4)  == sheet.value(2, 2));
 }
+
+//--------------------------------------------------------------------------
+void ClassicSpreadSheetTests::testDirty()
+{
+  ClassicSpreadSheet sheet("SheetDirty");
+  eatSpreadsheet(sheet, "input1.txt", std::make_pair(true, "ok"));
+  SimForth& forth = SimForth::instance();
+
+  // B2 is modified without being marked as dirty: it keeps its value
+  sheet.cell(1, 1)->formulae("100");
+  // A2 and the cells depending on it are evaluated again
+  sheet.formulae(*sheet.cell(0, 1), "10");
+  std::pair<bool, std::string> res = sheet.evaluateDirty(forth);
+  CPPUNIT_ASSERT_EQUAL(true, res.first);
+  CPPUNIT_ASSERT(std::make_pair(true, 10) == sheet.value(0, 0));
+  CPPUNIT_ASSERT(std::make_pair(true, 10) == sheet.value(0, 1));
+  CPPUNIT_ASSERT(std::make_pair(true, 10) == sheet.value(0, 2));
+  CPPUNIT_ASSERT(std::make_pair(true, 5)  == sheet.value(1, 0));
+  CPPUNIT_ASSERT(std::make_pair(true, 3)  == sheet.value(1, 1));
+  CPPUNIT_ASSERT(std::make_pair(true, 2)  == sheet.value(1, 2));
+
+  // Nothing is dirty: nothing changes
+  res = sheet.evaluateDirty(forth);
+  CPPUNIT_ASSERT_EQUAL(true, res.first);
+  CPPUNIT_ASSERT(std::make_pair(true, 3)  == sheet.value(1, 1));
+
+  // Marking B2 as dirty evaluates its new formulae
+  sheet.dirty(*sheet.cell(1, 1));
+  res = sheet.evaluateDirty(forth);
+  CPPUNIT_ASSERT_EQUAL(true, res.first);
+  CPPUNIT_ASSERT(std::make_pair(true, 10)  == sheet.value(0, 0));
+  CPPUNIT_ASSERT(std::make_pair(true, 100) == sheet.value(1, 1));
+  CPPUNIT_ASSERT(std::make_pair(true, 2)   == sheet.value(1, 0));
+  CPPUNIT_ASSERT(std::make_pair(true, 0)   == sheet.value(1, 2));
+}
+
+//--------------------------------------------------------------------------
+//! Evaluate the spreadsheet serially then in parallel and check both
+//! evaluations give the same values.
+static std::pair<bool, std::string> compareEvaluations(std::string const& filename)
+{
+  SimForth& forth = SimForth::instance();
+  ClassicSpreadSheet serial("Serial");
+  ClassicSpreadSheet parallel("Parallel");
+
+  CPPUNIT_ASSERT_MESSAGE(filename, serial.readInput(filename));
+  CPPUNIT_ASSERT_MESSAGE(filename, parallel.readInput(filename));
+  serial.parse(forth);
+  std::pair<bool, std::string> res1 = serial.evaluate(forth);
+  parallel.parse(forth);
+  std::pair<bool, std::string> res2 = parallel.evaluateParallel(forth, 4u);
+
+  CPPUNIT_ASSERT_EQUAL(res1.first, res2.first);
+  for (size_t row = 0; row < serial.m_row; ++row)
+    {
+      for (size_t col = 0; col < serial.m_col; ++col)
+        {
+          CPPUNIT_ASSERT(serial.value(row, col) == parallel.value(row, col));
+          CPPUNIT_ASSERT(serial.cell(row, col)->fvalue() == parallel.cell(row, col)->fvalue());
+          CPPUNIT_ASSERT_EQUAL(serial.cell(row, col)->isFloat(),
+                               parallel.cell(row, col)->isFloat());
+        }
+    }
+  return res2;
+}
+
+//--------------------------------------------------------------------------
+void ClassicSpreadSheetTests::testParallel()
+{
+  for (auto const& file: { "input1.txt", "input2.txt", "input3.txt", "input4.txt", "input5.txt" })
+    {
+      compareEvaluations(PathManager::instance().expand(
+             "../src/core/standalone/ClassicSpreadSheet/examples/" + std::string(file)));
+    }
+
+  // Wide wavefronts: each row depends on the previous one. The first
+  // column holds floating point values.
+  const size_t cols = 40u;
+  const size_t rows = 26u;
+  std::string filename = config::tmp_path + "parallel.txt";
+  std::ofstream file(filename);
+  file << cols << " " << rows << std::endl;
+  for (size_t row = 0; row < rows; ++row)
+    {
+      const std::string previous(1, static_cast<char>('A' + row - 1u));
+      for (size_t col = 0; col < cols; ++col)
+        {
+          if (0 == row)
+            file << col << std::endl;
+          else if (0 == col)
+            file << "F:" << previous << "1 1.5E0 F*" << std::endl;
+          else
+            file << previous << col + 1u << " " << previous
+                 << (col + 1u) % cols + 1u << " + 2 /" << std::endl;
+        }
+    }
+  file.close();
+  CPPUNIT_ASSERT_EQUAL(true, compareEvaluations(filename).first);
+}
+
+//--------------------------------------------------------------------------
+void ClassicSpreadSheetTests::testBudget()
+{
+  SimForth& forth = SimForth::instance();
+  forth.boot();
+
+  // A1 loops for a long time. A2 and B2 do not depend on it.
+  std::string filename = config::tmp_path + "budget.txt";
+  std::ofstream file(filename);
+  file << "2 2" << std::endl
+       << "0 100000 0 DO 1+ LOOP" << std::endl
+       << "3 4 +" << std::endl
+       << "A1 1 +" << std::endl
+       << "5" << std::endl;
+  file.close();
+
+  ClassicSpreadSheet sheet("Budget");
+  CPPUNIT_ASSERT_MESSAGE(filename, sheet.readInput(filename));
+  sheet.parse(forth);
+
+  // A1 is suspended while the other cells are evaluated, then resumed
+  ForthBudget budget;
+  budget.steps = 1000;
+  sheet.budget(budget);
+  std::pair<bool, std::string> res = sheet.evaluate(forth);
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1U), sheet.suspendedCells().size());
+  CPPUNIT_ASSERT(sheet.cell(0, 0) == sheet.suspendedCells()[0]);
+  CPPUNIT_ASSERT(std::make_pair(true, 100000) == sheet.value(0, 0));
+  CPPUNIT_ASSERT(std::make_pair(true, 7) == sheet.value(0, 1));
+  CPPUNIT_ASSERT(std::make_pair(true, 100001) == sheet.value(1, 0));
+  CPPUNIT_ASSERT(std::make_pair(true, 5) == sheet.value(1, 1));
+
+  // Too few suspensions allowed: the evaluation fails
+  sheet.budget(budget, 5U);
+  res = sheet.evaluate(forth);
+  CPPUNIT_ASSERT_EQUAL(false, res.first);
+  CPPUNIT_ASSERT_EQUAL(0, forth.stackDepth(forth::ReturnStack));
+
+  // Without budget nothing is suspended
+  sheet.budget(ForthBudget());
+  res = sheet.evaluate(forth);
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT_EQUAL(true, sheet.suspendedCells().empty());
+  CPPUNIT_ASSERT(std::make_pair(true, 100001) == sheet.value(1, 0));
+}
+
+//--------------------------------------------------------------------------
+void ClassicSpreadSheetTests::testReadInput()
+{
+  // Files bigger than a chunk are split and read concurrently. Lines
+  // after the last cell are ignored.
+  const size_t cols = 300u;
+  const size_t rows = 100u;
+  std::string filename = config::tmp_path + "chunks.txt";
+  std::ofstream file(filename);
+  file << cols << " " << rows << std::endl;
+  for (size_t row = 0; row < rows; ++row)
+    {
+      for (size_t col = 0; col < cols; ++col)
+        {
+          file << row << " " << col << " +" << std::endl;
+        }
+    }
+  file << "1 2 +" << std::endl << "3 4 +" << std::endl;
+  file.close();
+
+  ClassicSpreadSheet sheet("Chunks");
+  CPPUNIT_ASSERT_MESSAGE(filename, sheet.readInput(filename));
+  CPPUNIT_ASSERT_EQUAL(cols, sheet.m_col);
+  CPPUNIT_ASSERT_EQUAL(rows, sheet.m_row);
+  const Key first = sheet.cell(0, 0)->id();
+  for (size_t row = 0; row < rows; ++row)
+    {
+      for (size_t col = 0; col < cols; ++col)
+        {
+          ASpreadSheetCell* cell = sheet.cell(row, col);
+          CPPUNIT_ASSERT_EQUAL(first + row * cols + col, static_cast<size_t>(cell->id()));
+          CPPUNIT_ASSERT_EQUAL(std::to_string(row) + " " + std::to_string(col) + " +",
+                               cell->formulae());
+        }
+    }
+
+  // Missing lines give empty cells. The last line has no end of line.
+  filename = config::tmp_path + "short.txt";
+  file.open(filename);
+  file << "3 2" << std::endl << "1" << std::endl << "A1 1 +" << std::endl
+       << std::endl << "4";
+  file.close();
+  CPPUNIT_ASSERT_MESSAGE(filename, sheet.readInput(filename));
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3U), sheet.m_col);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2U), sheet.m_row);
+  CPPUNIT_ASSERT_EQUAL(std::string("1"), sheet.cell(0, 0)->formulae());
+  CPPUNIT_ASSERT_EQUAL(std::string("A1 1 +"), sheet.cell(0, 1)->formulae());
+  CPPUNIT_ASSERT_EQUAL(std::string(""), sheet.cell(0, 2)->formulae());
+  CPPUNIT_ASSERT_EQUAL(std::string("4"), sheet.cell(1, 0)->formulae());
+  CPPUNIT_ASSERT_EQUAL(std::string(""), sheet.cell(1, 1)->formulae());
+  CPPUNIT_ASSERT_EQUAL(std::string(""), sheet.cell(1, 2)->formulae());
+  CPPUNIT_ASSERT_EQUAL(sheet.cell(0, 0)->id() + 5U, sheet.cell(1, 2)->id());
+
+  // Missing dimensions
+  filename = config::tmp_path + "empty.txt";
+  file.open(filename);
+  file.close();
+  CPPUNIT_ASSERT_EQUAL(false, sheet.readInput(filename));
+}
+
+//--------------------------------------------------------------------------
+//! Check the cycle is made of the given cells (in any order).
+static void checkCycle(std::vector<ASpreadSheetCell*> cycle,
+                       std::vector<ASpreadSheetCell*> expected)
+{
+  std::sort(cycle.begin(), cycle.end());
+  std::sort(expected.begin(), expected.end());
+  CPPUNIT_ASSERT(expected == cycle);
+}
+
+//--------------------------------------------------------------------------
+void ClassicSpreadSheetTests::testCycles()
+{
+  SimForth& forth = SimForth::instance();
+
+  // A1 and A2 depend on each other
+  ClassicSpreadSheet sheet("SheetCycle");
+  eatSpreadsheet(sheet, "input2.txt",
+                 std::make_pair(false, "Aborting 'CircularDependencyFound: Unable to solve the spreadsheet'"));
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1U), sheet.cycles().size());
+  checkCycle(sheet.cycles()[0], { sheet.cell(0, 0), sheet.cell(0, 1) });
+
+  // Breaking the cycle
+  sheet.formulae(*sheet.cell(0, 1), "4 5 *");
+  std::pair<bool, std::string> res = sheet.evaluate(forth);
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT_EQUAL(true, sheet.cycles().empty());
+  CPPUNIT_ASSERT(std::make_pair(true, 20) == sheet.value(0, 0));
+  CPPUNIT_ASSERT(std::make_pair(true, 20) == sheet.value(0, 2));
+  CPPUNIT_ASSERT(std::make_pair(true, 8) == sheet.value(1, 0));
+
+  // Values of the previous evaluation are forgotten when a cycle
+  // appears again
+  sheet.formulae(*sheet.cell(0, 1), "A3 1 +");
+  res = sheet.evaluate(forth);
+  CPPUNIT_ASSERT_EQUAL(false, res.first);
+  forth.ok(res);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1U), sheet.cycles().size());
+  checkCycle(sheet.cycles()[0], { sheet.cell(0, 0), sheet.cell(0, 1), sheet.cell(0, 2) });
+  CPPUNIT_ASSERT_EQUAL(false, sheet.value(0, 0).first);
+  CPPUNIT_ASSERT_EQUAL(false, sheet.value(0, 2).first);
+  CPPUNIT_ASSERT_EQUAL(false, sheet.value(1, 0).first);
+  CPPUNIT_ASSERT(std::make_pair(true, 3) == sheet.value(1, 1));
+
+  // A cell depending on itself
+  ClassicSpreadSheet sheet3("SheetSelfCycle");
+  eatSpreadsheet(sheet3, "input3.txt",
+                 std::make_pair(false, "Aborting 'CircularDependencyFound: Unable to solve the spreadsheet'"));
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1U), sheet3.cycles().size());
+  checkCycle(sheet3.cycles()[0], { sheet3.cell(0, 1) });
+}
+
+//--------------------------------------------------------------------------
+void ClassicSpreadSheetTests::testStep()
+{
+  SimForth& forth = SimForth::instance();
+  forth.boot();
+
+  // A1 and B2 count steps, B3 accumulates a float. A3 and B1 are
+  // constant. P: refers to the value of the previous step.
+  std::string filename = config::tmp_path + "step.txt";
+  std::ofstream file(filename);
+  file << "3 2" << std::endl
+       << "P:A1 1+" << std::endl
+       << "A1 2 *" << std::endl
+       << "5" << std::endl
+       << "A3 3 +" << std::endl
+       << "P:B2 A1 +" << std::endl
+       << "FP:B3 0.5E0 F+" << std::endl;
+  file.close();
+
+  ClassicSpreadSheet sheet("SheetStep");
+  CPPUNIT_ASSERT_MESSAGE(filename, sheet.readInput(filename));
+  sheet.parse(forth);
+
+  // References to the previous step do not make cycles
+  std::pair<bool, std::string> res = sheet.step(forth);
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT_EQUAL(true, sheet.cycles().empty());
+  CPPUNIT_ASSERT(std::make_pair(true, 1) == sheet.value(0, 0));
+  CPPUNIT_ASSERT(std::make_pair(true, 2) == sheet.value(0, 1));
+  CPPUNIT_ASSERT(std::make_pair(true, 8) == sheet.value(1, 0));
+  CPPUNIT_ASSERT(std::make_pair(true, 1) == sheet.value(1, 1));
+  CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5, sheet.cell(1, 2)->fvalue().second, 1e-12);
+  CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1U), sheet.stats().steps);
+  CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(6U), sheet.stats().evaluatedCells);
+
+  // Constant cells are not evaluated again
+  res = sheet.step(forth, 9U);
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT(std::make_pair(true, 10) == sheet.value(0, 0));
+  CPPUNIT_ASSERT(std::make_pair(true, 20) == sheet.value(0, 1));
+  CPPUNIT_ASSERT(std::make_pair(true, 8) == sheet.value(1, 0));
+  CPPUNIT_ASSERT(std::make_pair(true, 55) == sheet.value(1, 1));
+  CPPUNIT_ASSERT_DOUBLES_EQUAL(5.0, sheet.cell(1, 2)->fvalue().second, 1e-12);
+  CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(10U), sheet.stats().steps);
+  CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(42U), sheet.stats().evaluatedCells);
+  CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(18U), sheet.stats().memoizedCells);
+  CPPUNIT_ASSERT_EQUAL(static_cast<Cell32>(9), sheet.previousValue(*sheet.cell(0, 0)));
+  CPPUNIT_ASSERT_DOUBLES_EQUAL(4.5, sheet.previousFloat(*sheet.cell(1, 2)), 1e-12);
+
+  // Modified cells and the ones depending on them are evaluated again
+  sheet.formulae(*sheet.cell(0, 2), "7");
+  res = sheet.step(forth);
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT(std::make_pair(true, 11) == sheet.value(0, 0));
+  CPPUNIT_ASSERT(std::make_pair(true, 10) == sheet.value(1, 0));
+  CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(48U), sheet.stats().evaluatedCells);
+
+  // Cycles between values of the same step are still refused
+  sheet.formulae(*sheet.cell(0, 2), "B1");
+  res = sheet.step(forth);
+  CPPUNIT_ASSERT_EQUAL(false, res.first);
+  forth.ok(res);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1U), sheet.cycles().size());
+  sheet.formulae(*sheet.cell(0, 2), "7");
+
+  // Restarting the simulation
+  sheet.resetSimulation();
+  res = sheet.step(forth);
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT(std::make_pair(true, 1) == sheet.value(0, 0));
+  CPPUNIT_ASSERT(std::make_pair(true, 1) == sheet.value(1, 1));
+  CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1U), sheet.stats().steps);
+}
+
+//--------------------------------------------------------------------------
+void ClassicSpreadSheetTests::testCellValues()
+{
+  // Columns of a standalone store
+  CellValues values(100U, 4U);
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(4U), values.size());
+  CPPUNIT_ASSERT_EQUAL(static_cast<Key>(100U), values.firstKey());
+  CPPUNIT_ASSERT_EQUAL(2U, values.index(102U));
+  CPPUNIT_ASSERT_EQUAL(false, values.evaluated(0U));
+
+  values.set(0U, 3);
+  values.set(1U, 2.5);
+  values.set(3U, -1);
+  CPPUNIT_ASSERT_EQUAL(3, values.value(0U));
+  CPPUNIT_ASSERT_EQUAL(false, values.isFloat(0U));
+  CPPUNIT_ASSERT_EQUAL(2, values.value(1U));
+  CPPUNIT_ASSERT_DOUBLES_EQUAL(2.5, values.fvalue(1U), 1e-12);
+  CPPUNIT_ASSERT_EQUAL(true, values.isFloat(1U));
+  CPPUNIT_ASSERT_EQUAL(false, values.evaluated(2U));
+  CPPUNIT_ASSERT_DOUBLES_EQUAL(4.5, values.sum(), 1e-12);
+  CPPUNIT_ASSERT(std::vector<int32_t>({ 3, 2, 0, -1 }) == values.values());
+  CPPUNIT_ASSERT(std::vector<uint8_t>({ 1u, 1u, 0u, 1u }) == values.evaluated());
+  CPPUNIT_ASSERT(std::vector<uint8_t>({ 0u, 1u, 0u, 0u }) == values.isFloat());
+
+  CellValues other(0U, 1U);
+  other.copy(0U, values, 1U);
+  CPPUNIT_ASSERT_EQUAL(true, other.evaluated(0U));
+  CPPUNIT_ASSERT_EQUAL(true, other.isFloat(0U));
+  CPPUNIT_ASSERT_DOUBLES_EQUAL(2.5, other.fvalue(0U), 1e-12);
+
+  values.reset(1U);
+  CPPUNIT_ASSERT_EQUAL(false, values.evaluated(1U));
+  CPPUNIT_ASSERT_EQUAL(0, values.value(1U));
+  CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0, values.sum(), 1e-12);
+  values.clear();
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0U), values.size());
+
+  // Store filled by the evaluation of a spreadsheet
+  ClassicSpreadSheet sheet("SheetValues");
+  eatSpreadsheet(sheet, "input1.txt", std::make_pair(true, "ok"));
+  CellValues const& columns = sheet.values();
+  CPPUNIT_ASSERT_EQUAL(sheet.m_row * sheet.m_col, columns.size());
+  CPPUNIT_ASSERT_EQUAL(sheet.cell(0, 0)->id(), columns.firstKey());
+  Float64 sum = 0.0;
+  for (size_t row = 0; row < sheet.m_row; ++row)
+    {
+      for (size_t col = 0; col < sheet.m_col; ++col)
+        {
+          const uint32_t i = columns.index(sheet.cell(row, col)->id());
+          CPPUNIT_ASSERT_EQUAL(true, columns.evaluated(i));
+          CPPUNIT_ASSERT_EQUAL(false, columns.isFloat(i));
+          CPPUNIT_ASSERT_EQUAL(sheet.value(row, col).second, columns.value(i));
+          sum += columns.value(i);
+        }
+    }
+  CPPUNIT_ASSERT_DOUBLES_EQUAL(72.0, sum, 1e-12);
+  CPPUNIT_ASSERT_DOUBLES_EQUAL(sum, columns.sum(), 1e-12);
+}
+
+//--------------------------------------------------------------------------
+//! Number of tokens given to words of the dictionary.
+static size_t usedTokens(ForthDictionary const& dico)
+{
+  return dico.m_xt.size() - std::count(dico.m_xt.begin(), dico.m_xt.end(), 0U);
+}
+
+//--------------------------------------------------------------------------
+void ClassicSpreadSheetTests::testFormulaeEdit()
+{
+  SimForth& forth = SimForth::instance();
+  ForthDictionary const& dico = forth.dictionary();
+  ClassicSpreadSheet sheet("SheetEdit");
+  eatSpreadsheet(sheet, "input1.txt", std::make_pair(true, "ok"));
+  const size_t tokens = usedTokens(dico);
+
+  // Formulae of a cell edited many times reuse the word of the cell
+  const char* formulae[] = { "4 6 +", "2 3 + 2 * 1 + 1 -", "10" };
+  std::pair<bool, std::string> res;
+  for (uint32_t i = 0; i < 3u; ++i)
+    {
+      sheet.formulae(*sheet.cell(0, 1), formulae[i]);
+      res = sheet.evaluateDirty(forth);
+      CPPUNIT_ASSERT_EQUAL(true, res.first);
+    }
+  const Cell32 here = dico.here();
+  for (uint32_t i = 0; i < 100u; ++i)
+    {
+      sheet.formulae(*sheet.cell(0, 1), formulae[i % 3u]);
+      res = sheet.evaluateDirty(forth);
+      CPPUNIT_ASSERT_EQUAL(true, res.first);
+      CPPUNIT_ASSERT(std::make_pair(true, 10) == sheet.value(0, 1));
+      CPPUNIT_ASSERT_EQUAL(here, dico.here());
+      CPPUNIT_ASSERT_EQUAL(tokens, usedTokens(dico));
+    }
+
+  // The spreadsheet gives back the words of its cells before
+  // destroying them
+  {
+    ClassicSpreadSheet other("SheetOther");
+    CPPUNIT_ASSERT(other.readInput(PathManager::instance().expand(
+      "../src/core/standalone/ClassicSpreadSheet/examples/input1.txt")));
+    other.parse(forth);
+    res = other.evaluate(forth);
+    CPPUNIT_ASSERT_EQUAL(true, res.first);
+    CPPUNIT_ASSERT(usedTokens(dico) > tokens);
+  }
+  CPPUNIT_ASSERT_EQUAL(tokens, usedTokens(dico));
+}
+
+//--------------------------------------------------------------------------
+//! Cells referencing the given cell (read from the CSR arrays).
+static std::vector<ASpreadSheetCell*> dependents(ClassicSpreadSheet const& sheet,
+                                                 ASpreadSheetCell const& cell)
+{
+  const size_t k = cell.id() - sheet.m_firstKey;
+  CPPUNIT_ASSERT(k + 1U < sheet.m_depOffsets.size());
+  std::vector<ASpreadSheetCell*> cells(sheet.m_dependents.begin() + sheet.m_depOffsets[k],
+                                       sheet.m_dependents.begin() + sheet.m_depOffsets[k + 1U]);
+  std::sort(cells.begin(), cells.end());
+  return cells;
+}
+
+//--------------------------------------------------------------------------
+//! Check the CSR arrays of the spreadsheet against its references:
+//! dependents of each key are exactly the cells referencing it.
+static void checkDependencies(ClassicSpreadSheet const& sheet)
+{
+  const size_t nb_cells = sheet.m_row * sheet.m_col;
+  CPPUNIT_ASSERT_EQUAL(nb_cells, sheet.m_cells.size());
+  CPPUNIT_ASSERT_EQUAL(sheet.cell(0, 0)->id(), sheet.m_firstKey);
+  CPPUNIT_ASSERT_EQUAL(nb_cells + 1U, sheet.m_depOffsets.size());
+
+  size_t edges = 0U;
+  for (size_t i = 0; i < nb_cells; ++i)
+    {
+      ASpreadSheetCell* cell = &sheet.m_arena[i];
+      std::vector<ASpreadSheetCell*> expected;
+      for (size_t j = 0; j < nb_cells; ++j)
+        {
+          std::vector<ASpreadSheetCell*> const& refs = sheet.m_arena[j].references();
+          if (std::find(refs.begin(), refs.end(), cell) != refs.end())
+            expected.push_back(&sheet.m_arena[j]);
+        }
+      std::sort(expected.begin(), expected.end());
+      CPPUNIT_ASSERT(expected == dependents(sheet, *cell));
+      edges += expected.size();
+    }
+  CPPUNIT_ASSERT_EQUAL(edges, sheet.m_dependents.size());
+}
+
+//--------------------------------------------------------------------------
+//! Write a spreadsheet of the given size in a temporary file and
+//! evaluate it.
+static void loadSheet(ClassicSpreadSheet& sheet, std::string const& dimension,
+                      std::vector<std::string> const& formulae)
+{
+  SimForth& forth = SimForth::instance();
+  std::string filename = config::tmp_path + "dependencies.txt";
+  std::ofstream file(filename);
+  file << dimension << std::endl;
+  for (const auto& it: formulae)
+    file << it << std::endl;
+  file.close();
+
+  CPPUNIT_ASSERT_MESSAGE(filename, sheet.readInput(filename));
+  sheet.parse(forth);
+  std::pair<bool, std::string> res = sheet.evaluate(forth);
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+}
+
+//--------------------------------------------------------------------------
+void ClassicSpreadSheetTests::testDependencies()
+{
+  SimForth& forth = SimForth::instance();
+  forth.boot();
+
+  // A1 is referenced three times, B1 and A2 by a single cell
+  ClassicSpreadSheet sheet("SheetDependencies");
+  loadSheet(sheet, "3 2", { "1", "A1 1 +", "A1 A2 +", "A3", "5", "B2 A1 *" });
+  ASpreadSheetCell* A1 = sheet.cell(0, 0);
+  ASpreadSheetCell* A2 = sheet.cell(0, 1);
+  ASpreadSheetCell* A3 = sheet.cell(0, 2);
+  ASpreadSheetCell* B1 = sheet.cell(1, 0);
+  ASpreadSheetCell* B2 = sheet.cell(1, 1);
+  ASpreadSheetCell* B3 = sheet.cell(1, 2);
+  checkDependencies(sheet);
+  std::vector<ASpreadSheetCell*> expected = { A2, A3, B3 };
+  std::sort(expected.begin(), expected.end());
+  CPPUNIT_ASSERT(expected == dependents(sheet, *A1));
+  CPPUNIT_ASSERT(std::vector<ASpreadSheetCell*>({ A3 }) == dependents(sheet, *A2));
+  CPPUNIT_ASSERT(std::vector<ASpreadSheetCell*>({ B1 }) == dependents(sheet, *A3));
+  CPPUNIT_ASSERT(std::vector<ASpreadSheetCell*>({ B3 }) == dependents(sheet, *B2));
+  CPPUNIT_ASSERT(dependents(sheet, *B1).empty());
+  CPPUNIT_ASSERT(dependents(sheet, *B3).empty());
+  CPPUNIT_ASSERT(std::make_pair(true, 3) == sheet.value(1, 0));
+  CPPUNIT_ASSERT(std::make_pair(true, 5) == sheet.value(1, 2));
+
+  // A3 references B2 instead of A1 and A2
+  sheet.formulae(*A3, "B2 2 *");
+  std::pair<bool, std::string> res = sheet.evaluateDirty(forth);
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  checkDependencies(sheet);
+  expected = { A2, B3 };
+  std::sort(expected.begin(), expected.end());
+  CPPUNIT_ASSERT(expected == dependents(sheet, *A1));
+  CPPUNIT_ASSERT(dependents(sheet, *A2).empty());
+  expected = { A3, B3 };
+  std::sort(expected.begin(), expected.end());
+  CPPUNIT_ASSERT(expected == dependents(sheet, *B2));
+  CPPUNIT_ASSERT(std::make_pair(true, 10) == sheet.value(0, 2));
+  CPPUNIT_ASSERT(std::make_pair(true, 10) == sheet.value(1, 0));
+
+  // B3 no longer references any cell: a change of A1 is only
+  // propagated to A2
+  sheet.formulae(*B3, "7");
+  sheet.formulae(*A1, "2");
+  res = sheet.evaluateDirty(forth);
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  checkDependencies(sheet);
+  CPPUNIT_ASSERT(std::vector<ASpreadSheetCell*>({ A2 }) == dependents(sheet, *A1));
+  CPPUNIT_ASSERT(std::vector<ASpreadSheetCell*>({ A3 }) == dependents(sheet, *B2));
+  CPPUNIT_ASSERT(std::make_pair(true, 3) == sheet.value(0, 1));
+  CPPUNIT_ASSERT(std::make_pair(true, 10) == sheet.value(1, 0));
+  CPPUNIT_ASSERT(std::make_pair(true, 7) == sheet.value(1, 2));
+
+  // More cells with new keys: the arrays are indexed from the new
+  // smallest key
+  const Key first = sheet.m_firstKey;
+  loadSheet(sheet, "4 2", { "1", "A1 A1 +", "A2 A1 -", "A3", "A4 2 +", "B1", "B2", "B3 A1 +" });
+  CPPUNIT_ASSERT(sheet.m_firstKey > first);
+  checkDependencies(sheet);
+  CPPUNIT_ASSERT(std::make_pair(true, 4) == sheet.value(1, 3));
+
+  // Less cells
+  loadSheet(sheet, "2 1", { "4", "A1 A1 *" });
+  checkDependencies(sheet);
+  CPPUNIT_ASSERT(std::vector<ASpreadSheetCell*>({ sheet.cell(0, 1) }) ==
+                 dependents(sheet, *sheet.cell(0, 0)));
+  CPPUNIT_ASSERT(std::make_pair(true, 16) == sheet.value(0, 1));
+}
+
+//--------------------------------------------------------------------------
+void ClassicSpreadSheetTests::testParseCell()
+{
+  SimForth& forth = SimForth::instance();
+  forth.boot();
+
+  // A cell referenced several times is a single reference
+  ClassicSpreadSheet sheet("SheetParse");
+  loadSheet(sheet, "3 2", { "2", "3", "A1 A1 + A2 A1 * +", "A3 A3 A3 + +", "F:A2 F>S A2 +", "1 2 +" });
+  ASpreadSheetCell* A1 = sheet.cell(0, 0);
+  ASpreadSheetCell* A2 = sheet.cell(0, 1);
+  ASpreadSheetCell* A3 = sheet.cell(0, 2);
+  ASpreadSheetCell* B1 = sheet.cell(1, 0);
+  ASpreadSheetCell* B2 = sheet.cell(1, 1);
+  ASpreadSheetCell* B3 = sheet.cell(1, 2);
+  CPPUNIT_ASSERT(std::vector<ASpreadSheetCell*>({ A1, A2 }) == A3->references());
+  CPPUNIT_ASSERT(std::vector<ASpreadSheetCell*>({ A3 }) == B1->references());
+  CPPUNIT_ASSERT(std::vector<ASpreadSheetCell*>({ A2 }) == B2->references());
+  CPPUNIT_ASSERT(B3->references().empty());
+  CPPUNIT_ASSERT(std::make_pair(true, 10) == sheet.value(0, 2));
+  CPPUNIT_ASSERT(std::make_pair(true, 30) == sheet.value(1, 0));
+  CPPUNIT_ASSERT(std::make_pair(true, 6) == sheet.value(1, 1));
+  // Only names of cells are interned
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3U), sheet.m_names.size());
+
+  // Values of the previous step are not dependencies
+  sheet.formulae(*B3, "P:A1 A1 FP:A2 P:A1 + +");
+  CPPUNIT_ASSERT(std::vector<ASpreadSheetCell*>({ A1 }) == B3->references());
+  CPPUNIT_ASSERT(std::vector<ASpreadSheetCell*>({ A1, A2 }) == B3->previousReferences());
+
+  // Words which are not cells of the spreadsheet are not references
+  sheet.formulae(*B3, "Z9 A0 A4 C1 a1 A1X 1A A F: P: 12 DUP");
+  CPPUNIT_ASSERT(B3->references().empty());
+  CPPUNIT_ASSERT(B3->previousReferences().empty());
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3U), sheet.m_names.size());
+  std::pair<bool, std::string> res = sheet.evaluateDirty(forth);
+  CPPUNIT_ASSERT_EQUAL(false, res.first);
+  forth.ok(res);
+
+  // References are kept while the formulae is unchanged
+  std::vector<ASpreadSheetCell*> const* refs = &A3->references();
+  A3->parse();
+  CPPUNIT_ASSERT(refs == &A3->references());
+  CPPUNIT_ASSERT(std::vector<ASpreadSheetCell*>({ A1, A2 }) == A3->references());
+
+  // and found again when it changes
+  sheet.formulae(*B3, "1 2 +");
+  sheet.formulae(*A3, "B2 B2 *");
+  CPPUNIT_ASSERT(std::vector<ASpreadSheetCell*>({ B2 }) == A3->references());
+  res = sheet.evaluateDirty(forth);
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT(std::make_pair(true, 36) == sheet.value(0, 2));
+  CPPUNIT_ASSERT(std::make_pair(true, 108) == sheet.value(1, 0));
+  CPPUNIT_ASSERT(std::make_pair(true, 3) == sheet.value(1, 2));
+  sheet.formulae(*A3, "7");
+  CPPUNIT_ASSERT(A3->references().empty());
+  res = sheet.evaluateDirty(forth);
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT(std::make_pair(true, 21) == sheet.value(1, 0));
+
+  // Interned names are forgotten with the cells
+  loadSheet(sheet, "2 1", { "5", "A1 A1 *" });
+  CPPUNIT_ASSERT(std::vector<ASpreadSheetCell*>({ sheet.cell(0, 0) }) ==
+                 sheet.cell(0, 1)->references());
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1U), sheet.m_names.size());
+  CPPUNIT_ASSERT(std::make_pair(true, 25) == sheet.value(0, 1));
+}
@@ -40,6 +40,16 @@ class ClassicSpreadSheetTests : public CppUnit::TestFixture
   CPPUNIT_TEST(testInput3);
   CPPUNIT_TEST(testInput4);
   CPPUNIT_TEST(testInput5);
+  CPPUNIT_TEST(testDirty);
+  CPPUNIT_TEST(testParallel);
+  CPPUNIT_TEST(testBudget);
+  CPPUNIT_TEST(testReadInput);
+  CPPUNIT_TEST(testCycles);
+  CPPUNIT_TEST(testStep);
+  CPPUNIT_TEST(testCellValues);
+  CPPUNIT_TEST(testFormulaeEdit);
+  CPPUNIT_TEST(testDependencies);
+  CPPUNIT_TEST(testParseCell);
   CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -51,6 +61,16 @@ public:
   void testInput3();
   void testInput4();
   void testInput5();
+  void testDirty();
+  void testParallel();
+  void testBudget();
+  void testReadInput();
+  void testCycles();
+  void testStep();
+  void testCellValues();
+  void testFormulaeEdit();
+  void testDependencies();
+  void testParseCell();
 };
 
 #endif /* CLASSIC_SPREADSHEET_TESTS_HPP_ */
@@ -0,0 +1,1083 @@
+//=====================================================================
+// SimTaDyn: A GIS in a spreadsheet.
+// Copyright 2018 Quentin Quadrat <lecrapouille@gmail.com>
+//
+// This file is part of SimTaDyn.
+//
+// SimTaDyn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SimTaDyn.  If not, see <http://www.gnu.org/licenses/>.
+//=====================================================================
+
+#include "ForthTests.hpp"
+#include "SimTaDynForth.hpp"
+#include "PathManager.hpp"
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <sys/stat.h>
+
+// Register the test suite
+CPPUNIT_TEST_SUITE_REGISTRATION(ForthTests);
+
+//--------------------------------------------------------------------------
+void ForthTests::setUp()
+{
+}
+
+//--------------------------------------------------------------------------
+void ForthTests::tearDown()
+{
+}
+
+//--------------------------------------------------------------------------
+//! Load the primitives and the words of the Forth system (DO LOOP,
+//! IF THEN ...).
+static void boot(Forth& forth)
+{
+  forth.boot();
+  std::pair<bool, std::string> res =
+    forth.interpreteFile(PathManager::instance().expand("forth/system.fs"));
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+}
+
+//--------------------------------------------------------------------------
+//! Interprete the script and check it left the expected value on the
+//! top of the data stack (which is then dropped).
+static void checkTop(Forth& forth, std::string const& script, const Cell32 expected)
+{
+  std::pair<bool, std::string> res = forth.interpreteString(script);
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT(forth.stackDepth(forth::DataStack) > 0);
+  CPPUNIT_ASSERT_EQUAL(expected, forth.m_tos);
+  CPPUNIT_ASSERT(forth.interpreteString("DROP").first);
+}
+
+//--------------------------------------------------------------------------
+void ForthTests::testProfiler()
+{
+  ForthDictionary dico;
+  Forth forth(dico);
+  forth.boot();
+
+  std::pair<bool, std::string> res = forth.interpreteString(": SQ DUP * ; : CUBE DUP SQ * ;");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  Cell16 sq, cube;
+  bool immediate;
+  CPPUNIT_ASSERT(dico.find("SQ", sq, immediate));
+  CPPUNIT_ASSERT(dico.find("CUBE", cube, immediate));
+
+  // Hooks called by the inner interpreter when executing CUBE twice
+  ForthProfiler profiler;
+  CPPUNIT_ASSERT_EQUAL(false, profiler.running());
+  profiler.start(true);
+  CPPUNIT_ASSERT_EQUAL(true, profiler.running());
+  for (int i = 0; i < 2; ++i)
+    {
+      profiler.count(cube);
+      profiler.enter(cube);
+      profiler.count(FORTH_PRIMITIVE_DUP);
+      profiler.count(sq);
+      profiler.enter(sq);
+      profiler.count(FORTH_PRIMITIVE_DUP);
+      profiler.count(FORTH_PRIMITIVE_TIMES);
+      profiler.leave();
+      profiler.count(FORTH_PRIMITIVE_TIMES);
+      profiler.leave();
+    }
+  profiler.stop();
+
+  CPPUNIT_ASSERT_EQUAL(2UL, static_cast<unsigned long>(profiler.m_tokens[cube].calls));
+  CPPUNIT_ASSERT_EQUAL(2UL, static_cast<unsigned long>(profiler.m_tokens[sq].calls));
+  CPPUNIT_ASSERT_EQUAL(4UL, static_cast<unsigned long>(profiler.m_tokens[FORTH_PRIMITIVE_DUP].calls));
+  CPPUNIT_ASSERT(profiler.m_tokens[cube].inclusive >= profiler.m_tokens[sq].inclusive);
+  CPPUNIT_ASSERT(profiler.m_tokens[cube].inclusive >= profiler.m_tokens[cube].exclusive);
+  CPPUNIT_ASSERT(profiler.m_frames.empty());
+
+  // Sequences are broken by calls: DUP * is only counted inside SQ
+  CPPUNIT_ASSERT_EQUAL(2UL, static_cast<unsigned long>
+                       (profiler.m_pairs[(FORTH_PRIMITIVE_DUP << 16U) | FORTH_PRIMITIVE_TIMES]));
+  CPPUNIT_ASSERT_EQUAL(2UL, static_cast<unsigned long>
+                       (profiler.m_pairs[(FORTH_PRIMITIVE_DUP << 16U) | sq]));
+
+  std::ostringstream report, folded, sequences;
+  profiler.report(report, dico);
+  CPPUNIT_ASSERT(std::string::npos != report.str().find("CUBE"));
+  profiler.folded(folded, dico);
+  CPPUNIT_ASSERT(std::string::npos != folded.str().find("CUBE;SQ "));
+  profiler.sequences(sequences, dico, 10U);
+  CPPUNIT_ASSERT(std::string::npos != sequences.str().find("DUP *"));
+
+  profiler.reset();
+  CPPUNIT_ASSERT_EQUAL(0UL, static_cast<unsigned long>(profiler.m_tokens[cube].calls));
+
+  // Same through the Forth words
+  res = forth.interpreteString("PROFILE-ON 3 CUBE DROP 2 CUBE DROP PROFILE-OFF");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT_EQUAL(2UL, static_cast<unsigned long>(forth.m_profiler.m_tokens[cube].calls));
+  CPPUNIT_ASSERT_EQUAL(2UL, static_cast<unsigned long>(forth.m_profiler.m_tokens[sq].calls));
+}
+
+//--------------------------------------------------------------------------
+//! Return the first token of the definition of the word.
+static Cell16 firstToken(ForthDictionary const& dico, std::string const& word)
+{
+  Cell16 token;
+  bool immediate;
+  CPPUNIT_ASSERT_MESSAGE(word, dico.find(word, token, immediate));
+  return dico.read16at(dico.xt(token) + 2U);
+}
+
+//--------------------------------------------------------------------------
+void ForthTests::testJIT()
+{
+#if FORTH_JIT && FORTH_STACK_EFFECTS
+  ForthDictionary dico;
+  Forth forth(dico);
+  boot(forth);
+
+  std::pair<bool, std::string> res = forth.interpreteString(
+    ": SUM 0 100 0 DO I + LOOP ; "
+    ": J2 DUP 0= IF DROP 7 ELSE DUP * 1+ THEN >R R> ; "
+    ": REC DUP 0= IF EXIT THEN 1- REC ;");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+
+  // Definitions executed 3 times are compiled to native code
+  res = forth.interpreteString("3 JIT-ON SUM DROP SUM DROP SUM DROP 0 J2 DROP 3 J2 DROP 0 J2 DROP 4 REC 4 REC 4 REC");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT_EQUAL(static_cast<Cell16>(FORTH_PRIMITIVE_EXEC_C_FUNC), firstToken(dico, "SUM"));
+  CPPUNIT_ASSERT_EQUAL(static_cast<Cell16>(FORTH_PRIMITIVE_EXEC_C_FUNC), firstToken(dico, "J2"));
+  // Recursive definitions stay interpreted
+  CPPUNIT_ASSERT(FORTH_PRIMITIVE_EXEC_C_FUNC != firstToken(dico, "REC"));
+
+  // Native code gives the same results
+  checkTop(forth, "SUM", 4950);
+  checkTop(forth, "0 J2", 7);
+  checkTop(forth, "3 J2", 10);
+  checkTop(forth, "5 REC", 0);
+
+  // Loops of the native code are suspended by the budget
+  res = forth.interpreteString(": SPIN 0 100000 0 DO 1+ LOOP ; SPIN DROP SPIN DROP SPIN DROP 11");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT_EQUAL(static_cast<Cell16>(FORTH_PRIMITIVE_EXEC_C_FUNC), firstToken(dico, "SPIN"));
+  Cell16 spin;
+  bool immediate;
+  CPPUNIT_ASSERT(dico.find("SPIN", spin, immediate));
+  ForthBudget budget;
+  budget.steps = 1000;
+  ForthContinuation k;
+  const int32_t depth = forth.stackDepth(forth::DataStack);
+  CPPUNIT_ASSERT_EQUAL(false, forth.run(spin, budget, k));
+  CPPUNIT_ASSERT_EQUAL(true, k.native);
+  CPPUNIT_ASSERT_EQUAL(depth, forth.stackDepth(forth::DataStack));
+  CPPUNIT_ASSERT_EQUAL(0, forth.stackDepth(forth::ReturnStack));
+  checkTop(forth, "3 J2", 10);
+  while (!forth.resume(budget, k))
+    {
+    }
+  CPPUNIT_ASSERT(k.suspensions > 50U);
+  checkTop(forth, "", 100000);
+  checkTop(forth, "", 11);
+
+  // Unbounded definitions are not compiled (the native code does not
+  // check stacks)
+  res = forth.interpreteString(": NTH PICK ; 1 2 1 NTH 1 2 1 NTH 1 2 1 NTH");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT(FORTH_PRIMITIVE_EXEC_C_FUNC != firstToken(dico, "NTH"));
+  checkTop(forth, "1 2 1 NTH", 1);
+
+  // Disabling the JIT restores the definitions
+  res = forth.interpreteString("JIT-OFF");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT(FORTH_PRIMITIVE_EXEC_C_FUNC != firstToken(dico, "SUM"));
+  checkTop(forth, "SUM", 4950);
+  checkTop(forth, "3 J2", 10);
+#endif
+}
+
+//--------------------------------------------------------------------------
+void ForthTests::testSnapshot()
+{
+  ForthDictionary dico;
+  Forth forth(dico);
+  boot(forth);
+
+  std::pair<bool, std::string> res = forth.interpreteString(
+    ": SQ DUP * ; : SUM 0 10 0 DO I SQ + LOOP ; HEX");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  const std::string filename = config::tmp_path + "ForthTests.img";
+  CPPUNIT_ASSERT(forth.saveSnapshot(filename, 42U));
+  const Cell32 here = dico.here();
+  const Cell32 last = dico.last();
+
+  res = forth.interpreteString("DECIMAL : AFTER 1 ;");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+
+  // Snapshots made from other sources are refused
+  CPPUNIT_ASSERT_EQUAL(false, forth.loadSnapshot(filename, 43U));
+  CPPUNIT_ASSERT(dico.exists("AFTER"));
+
+  // Words defined after the snapshot are forgotten
+  CPPUNIT_ASSERT_EQUAL(true, forth.loadSnapshot(filename, 42U));
+  CPPUNIT_ASSERT_EQUAL(false, dico.exists("AFTER"));
+  CPPUNIT_ASSERT_EQUAL(here, dico.here());
+  CPPUNIT_ASSERT_EQUAL(last, dico.last());
+  // The base is restored (hexadecimal)
+  checkTop(forth, "SUM", 0x11D);
+
+  // A new interpreter boots from the snapshot
+  ForthDictionary dico2;
+  Forth forth2(dico2);
+  forth2.boot();
+  CPPUNIT_ASSERT_EQUAL(true, forth2.loadSnapshot(filename, 42U));
+  checkTop(forth2, "DECIMAL SUM", 285);
+  Cell16 token;
+  bool immediate;
+  CPPUNIT_ASSERT(dico2.find("SQ", token, immediate));
+  CPPUNIT_ASSERT(dico2.effect(token).valid && dico2.effect(token).pure);
+  CPPUNIT_ASSERT_EQUAL(dico.effect(token).delta, dico2.effect(token).delta);
+  CPPUNIT_ASSERT_EQUAL(dico.effect(token).dmin, dico2.effect(token).dmin);
+  CPPUNIT_ASSERT_EQUAL(dico.effect(token).dmax, dico2.effect(token).dmax);
+}
+
+//--------------------------------------------------------------------------
+void ForthTests::testContextPool()
+{
+  SimForth& forth = SimForth::instance();
+  forth.boot();
+  forth.m_spreadsheet = nullptr;
+
+  std::pair<bool, std::string> res = forth.interpreteString(
+    ": POOLSQ DUP * ; CREATE POOLV 4 ALLOT : POOLSTORE POOLV ! ; : POOLREAD POOLV @ ; 7 POOLV !");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+
+  auto& pool = forth.contexts();
+  const size_t size = std::max<size_t>(2U, pool.size());
+  {
+    auto c1 = pool.borrow();
+    auto c2 = pool.borrow();
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2U), pool.borrowed());
+    CPPUNIT_ASSERT_EQUAL(size, pool.size());
+
+    // Contexts have their own stacks
+    res = c1->interpreteString("3 POOLSQ");
+    CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+    checkTop(*c2, "4 POOLSQ", 16);
+    checkTop(*c1, "POOLREAD", 7);
+    CPPUNIT_ASSERT_EQUAL(1, c1->stackDepth(forth::DataStack));
+    CPPUNIT_ASSERT_EQUAL(static_cast<Cell32>(9), c1->m_tos);
+
+    // The shared dictionary cannot be modified
+    CPPUNIT_ASSERT_EQUAL(false, c1->interpreteString(": POOLNEW 1 ;").first);
+    CPPUNIT_ASSERT_EQUAL(false, forth.dictionary().exists("POOLNEW"));
+    CPPUNIT_ASSERT_EQUAL(false, c1->interpreteString("5 POOLV !").first);
+    CPPUNIT_ASSERT_EQUAL(false, c2->interpreteString("5 POOLSTORE").first);
+    checkTop(*c2, "POOLREAD", 7);
+  }
+  CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0U), pool.borrowed());
+
+  // Contexts are reused by the next borrowings
+  {
+    auto c3 = pool.borrow();
+    CPPUNIT_ASSERT_EQUAL(size, pool.size());
+    CPPUNIT_ASSERT_EQUAL(0, c3->stackDepth(forth::DataStack));
+  }
+
+  // Contexts execute concurrently
+  std::vector<std::thread> threads;
+  std::vector<int> failures(4U, 0);
+  for (size_t t = 0; t < failures.size(); ++t)
+    {
+      threads.emplace_back([&pool, &failures, t]()
+      {
+        auto context = pool.borrow();
+        for (Cell32 i = 0; i < 1000; ++i)
+          {
+            if ((!context->interpreteString(std::to_string(i) + " POOLSQ").first) ||
+                (i * i != context->m_tos) ||
+                (!context->interpreteString("DROP").first))
+              {
+                ++failures[t];
+              }
+          }
+      });
+    }
+  for (auto& thread: threads)
+    {
+      thread.join();
+    }
+  for (auto const& failure: failures)
+    {
+      CPPUNIT_ASSERT_EQUAL(0, failure);
+    }
+}
+
+//--------------------------------------------------------------------------
+void ForthTests::testBigAllot()
+{
+  ForthDictionary dico;
+  Forth forth(dico);
+  forth.boot();
+
+  // Words defined after more than 64 KiB of data are linked to the
+  // previous ones
+  std::pair<bool, std::string> res = forth.interpreteString(
+    ": BEFORE 40 ; CREATE BIG 100000 ALLOT : AFTER BEFORE 2 + ;");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  checkTop(forth, "AFTER", 42);
+
+  Cell16 before, after;
+  bool immediate;
+  CPPUNIT_ASSERT(dico.find("BEFORE", before, immediate));
+  CPPUNIT_ASSERT(dico.find("AFTER", after, immediate));
+  CPPUNIT_ASSERT(dico.xt(after) - dico.xt(before) > 65536U);
+
+  // Links are followed when the dictionary is loaded again
+  std::string filename = config::tmp_path + "bigallot.bin";
+  CPPUNIT_ASSERT(dico.dump(filename));
+  ForthDictionary dico2;
+  CPPUNIT_ASSERT(dico2.load(filename));
+  Cell16 token;
+  CPPUNIT_ASSERT(dico2.find("BEFORE", token, immediate) && (before == token));
+  CPPUNIT_ASSERT(dico2.find("AFTER", token, immediate) && (after == token));
+  CPPUNIT_ASSERT_EQUAL(dico.last(), dico2.last());
+}
+
+//--------------------------------------------------------------------------
+//! Interprete the script and check it left the expected value on the
+//! top of the floating point stack (which is then dropped).
+static void checkFloat(Forth& forth, std::string const& script, const Float64 expected)
+{
+  std::pair<bool, std::string> res = forth.interpreteString(script);
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT(forth.stackDepth(forth::FloatStack) > 0);
+  CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, *(forth.m_fsp - 1), 1e-12);
+  CPPUNIT_ASSERT(forth.interpreteString("FDROP").first);
+}
+
+//--------------------------------------------------------------------------
+void ForthTests::testFloat()
+{
+  ForthDictionary dico;
+  Forth forth(dico);
+  boot(forth);
+
+  // Literals
+  Float64 f;
+  CPPUNIT_ASSERT(forth.toFloat("1.5E2", f));
+  CPPUNIT_ASSERT_DOUBLES_EQUAL(150.0, f, 1e-12);
+  CPPUNIT_ASSERT(forth.toFloat("-3.25", f));
+  CPPUNIT_ASSERT_DOUBLES_EQUAL(-3.25, f, 1e-12);
+  CPPUNIT_ASSERT_EQUAL(false, forth.toFloat("E", f));
+  CPPUNIT_ASSERT_EQUAL(false, forth.toFloat("1.5x", f));
+  CPPUNIT_ASSERT_EQUAL(false, forth.toFloat("42", f));
+
+  // Arithmetic in interpretation and in definitions
+  checkFloat(forth, "2.0E0 FSQRT FDUP F*", 2.0);
+  checkFloat(forth, "7 S>F 2.0 F/", 3.5);
+  checkFloat(forth, "2.0 1.0 FSWAP F-", -1.0);
+  checkFloat(forth, "-2.5 FABS", 2.5);
+  std::pair<bool, std::string> res = forth.interpreteString(": FHYP FDUP F* FSWAP FDUP F* F+ FSQRT ;");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  checkFloat(forth, "3.0 4.0 FHYP", 5.0);
+  checkTop(forth, "7 S>F 2.0 F/ F>S", 3);
+  checkTop(forth, "-1.0 F0<", -1);
+  checkTop(forth, "1.0 2.0 F<", -1);
+  checkTop(forth, "FDEPTH", 0);
+  checkTop(forth, "1.0 2.0 FDEPTH FDROP FDROP", 2);
+
+  // Floats in memory
+  res = forth.interpreteString("CREATE FV 2 FLOATS ALLOT 1.5 FV F! -3.25E0 FV FLOAT+ F!");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  checkFloat(forth, "FV F@ FV FLOAT+ F@ F+", -1.75);
+  checkTop(forth, "FV FLOAT+ FV -", 8);
+
+  // Underflow of the floating point stack
+  CPPUNIT_ASSERT_EQUAL(0, forth.stackDepth(forth::FloatStack));
+  res = forth.interpreteString("FDROP");
+  CPPUNIT_ASSERT_EQUAL(false, res.first);
+  res = forth.interpreteString("1.0 F+");
+  CPPUNIT_ASSERT_EQUAL(false, res.first);
+}
+
+//--------------------------------------------------------------------------
+void ForthTests::testArrays()
+{
+  ForthDictionary dico;
+  Forth forth(dico);
+  boot(forth);
+
+  std::pair<bool, std::string> res = forth.interpreteString(
+    "CREATE VA 1000 CELLS ALLOT CREATE VB 1000 CELLS ALLOT CREATE VI 3 CELLS ALLOT "
+    ": VINIT 1000 0 DO I VA I CELLS + ! 2 VB I CELLS + ! LOOP ; VINIT");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+
+  // Integer arrays
+  checkTop(forth, "VA 1000 VSUM", 499500);
+  checkTop(forth, "VA 0 VSUM", 0);
+  checkTop(forth, "VA VB VA 1000 V+ VA 1000 VSUM", 501500);
+  checkTop(forth, "VA VB VB 1000 V* VB 1000 VSUM", 1003000);
+  checkTop(forth, "VA VB VA VA 1000 V*+ VA 999 CELLS + @", 2005003);
+  checkTop(forth, "VA -1 VA 1000 VSCALE VA @", -10);
+  res = forth.interpreteString("5 VI ! 0 VI CELL + ! 999 VI 2 CELLS + ! VA VI VB 3 VGATHER");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  checkTop(forth, "VB @", -105);
+  checkTop(forth, "VB CELL + @", -10);
+  checkTop(forth, "VB 2 CELLS + @ VA 999 CELLS + @ -", 0);
+
+  // Floating point arrays
+  res = forth.interpreteString(
+    "CREATE FA 300 FLOATS ALLOT CREATE FB 300 FLOATS ALLOT "
+    ": FINIT 300 0 DO I S>F FA I FLOATS + F! 0.5 FB I FLOATS + F! LOOP ; FINIT");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  checkFloat(forth, "FA FB FB 300 FV+ FB 300 FVSUM", 45000.0);
+  checkFloat(forth, "FA FB FA 300 FV* FA 299 FLOATS + F@", 299.0 * 299.5);
+  checkFloat(forth, "2.0 FB FB 300 FVSCALE FB FLOAT+ F@", 3.0);
+  checkFloat(forth, "FB FB FB FB 300 FV*+ FB F@", 2.0);
+  checkFloat(forth, "FB VI FA 3 FVGATHER FA F@ FB 5 FLOATS + F@ F-", 0.0);
+
+  // Arrays beyond the end of the dictionary are refused
+  CPPUNIT_ASSERT_EQUAL(false, forth.interpreteString("VA VB VA 100000000 V+").first);
+  CPPUNIT_ASSERT_EQUAL(false, forth.interpreteString("123456789 VI ! VA VI VB 1 VGATHER").first);
+  CPPUNIT_ASSERT_EQUAL(0, forth.stackDepth(forth::DataStack));
+
+  // Arrays bigger than 64 KiB
+  res = forth.interpreteString(
+    "CREATE WA 30000 CELLS ALLOT CREATE WB 30000 CELLS ALLOT "
+    ": WINIT 30000 0 DO I WA I CELLS + ! 1 WB I CELLS + ! LOOP ; WINIT");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  checkTop(forth, "WA WB WA 30000 V+ WA 30000 VSUM", 450015000);
+  checkTop(forth, "WA 29999 CELLS + @", 30000);
+}
+
+//--------------------------------------------------------------------------
+void ForthTests::testBudget()
+{
+  ForthDictionary dico;
+  Forth forth(dico);
+  boot(forth);
+
+  std::pair<bool, std::string> res = forth.interpreteString(
+    ": SPIN 0 100000 0 DO 1+ LOOP ; : SQ DUP * ; 11 22");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  Cell16 spin;
+  bool immediate;
+  CPPUNIT_ASSERT(dico.find("SPIN", spin, immediate));
+
+  // Executions exhausting their budget are suspended and their cells
+  // are removed from the stacks
+  ForthBudget budget;
+  budget.steps = 1000;
+  ForthContinuation k;
+  CPPUNIT_ASSERT_EQUAL(false, forth.run(spin, budget, k));
+  CPPUNIT_ASSERT_EQUAL(true, k.suspended);
+  CPPUNIT_ASSERT_EQUAL(1U, k.suspensions);
+  CPPUNIT_ASSERT_EQUAL(2, forth.stackDepth(forth::DataStack));
+  CPPUNIT_ASSERT_EQUAL(0, forth.stackDepth(forth::ReturnStack));
+
+  // Other words can be executed before resuming
+  checkTop(forth, "3 SQ", 9);
+  uint32_t slices = 1U;
+  while (!forth.resume(budget, k))
+    {
+      ++slices;
+    }
+  CPPUNIT_ASSERT_EQUAL(false, k.suspended);
+  CPPUNIT_ASSERT(slices > 50U);
+  CPPUNIT_ASSERT_EQUAL(slices, k.suspensions);
+  checkTop(forth, "", 100000);
+  checkTop(forth, "", 22);
+  checkTop(forth, "", 11);
+
+  // Without limits the execution is not suspended
+  CPPUNIT_ASSERT_EQUAL(true, forth.run(spin, ForthBudget(), k));
+  CPPUNIT_ASSERT_EQUAL(false, k.suspended);
+  checkTop(forth, "", 100000);
+  CPPUNIT_ASSERT_EQUAL(0, forth.stackDepth(forth::DataStack));
+}
+
+#if FORTH_BYTECODE
+//--------------------------------------------------------------------------
+//! Return the number of bytes of the definition of the word (the last
+//! one of the dictionary).
+static uint32_t lastDefinitionSize(ForthDictionary const& dico, std::string const& word)
+{
+  Cell16 token;
+  bool immediate;
+  CPPUNIT_ASSERT_MESSAGE(word, dico.find(word, token, immediate));
+  return dico.here() - dico.xt(token);
+}
+#endif
+
+//--------------------------------------------------------------------------
+void ForthTests::testCompact()
+{
+#if FORTH_BYTECODE
+  ForthDictionary dico;
+  Forth forth(dico);
+  boot(forth);
+
+  const std::string body = " DUP >R R> 1+ + 7 + 100000 + -1 + 300 - 65535 + 15 + 16 + -100000 - ;";
+  std::pair<bool, std::string> res = forth.interpreteString(": PLAIN" + body);
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  const uint32_t plain = lastDefinitionSize(dico, "PLAIN");
+
+  // Definitions are compiled to byte code
+  res = forth.interpreteString("COMPACT-ON : COMPACT" + body);
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT(lastDefinitionSize(dico, "COMPACT") < plain);
+  CPPUNIT_ASSERT_EQUAL(static_cast<Cell16>(FORTH_PRIMITIVE_BYTECODE), firstToken(dico, "COMPACT"));
+  checkTop(forth, "5 COMPACT", 265283);
+  checkTop(forth, "5 PLAIN", 265283);
+
+  // Branches, loops, recursion and calls
+  res = forth.interpreteString(
+    ": K2 0= IF 11 ELSE 22 THEN ; "
+    ": K3 0 1000 0 DO I + LOOP ; "
+    ": K4 DUP * COMPACT ; "
+    ": KREC DUP 0= IF EXIT THEN 1- KREC ;");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  checkTop(forth, "0 K2", 11);
+  checkTop(forth, "3 K2", 22);
+  checkTop(forth, "K3", 499500);
+  checkTop(forth, "3 K4", 265291);
+  checkTop(forth, "10 KREC", 0);
+
+  // Errors are still detected
+  res = forth.interpreteString(": KU DROP DROP DROP DROP ; KU");
+  CPPUNIT_ASSERT_EQUAL(false, res.first);
+  forth.ok(res);
+  res = forth.interpreteString(": KA 2000000000 @ ; KA");
+  CPPUNIT_ASSERT_EQUAL(false, res.first);
+  forth.ok(res);
+  checkTop(forth, "K3", 499500);
+  CPPUNIT_ASSERT_EQUAL(0, forth.stackDepth(forth::ReturnStack));
+
+  // Back to threaded code
+  res = forth.interpreteString("COMPACT-OFF : P2 1 2 + ;");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT(FORTH_PRIMITIVE_BYTECODE != firstToken(dico, "P2"));
+  checkTop(forth, "P2", 3);
+#endif
+}
+
+//--------------------------------------------------------------------------
+void ForthTests::testStackEffect()
+{
+  ForthDictionary dico;
+  Forth forth(dico);
+  boot(forth);
+
+  std::pair<bool, std::string> res = forth.interpreteString(": ADD3 + + ;");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+#if FORTH_STACK_EFFECTS
+  Cell16 token;
+  bool immediate;
+  CPPUNIT_ASSERT(dico.find("ADD3", token, immediate));
+  CPPUNIT_ASSERT(dico.effect(token).valid);
+  CPPUNIT_ASSERT_EQUAL(static_cast<int16_t>(-3), dico.effect(token).dmin);
+  CPPUNIT_ASSERT_EQUAL(static_cast<int16_t>(-2), dico.effect(token).delta);
+#endif
+
+  // Bounded definitions detect underflows when they are entered
+  checkTop(forth, "1 2 3 ADD3", 6);
+  res = forth.interpreteString("ADD3");
+  CPPUNIT_ASSERT_EQUAL(false, res.first);
+  forth.ok(res);
+  res = forth.interpreteString("1 ADD3");
+  CPPUNIT_ASSERT_EQUAL(false, res.first);
+  forth.ok(res);
+
+#if FORTH_JIT && FORTH_STACK_EFFECTS
+  // And so does their native code
+  res = forth.interpreteString("3 JIT-ON 1 2 3 ADD3 DROP 1 2 3 ADD3 DROP 1 2 3 ADD3 DROP");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  CPPUNIT_ASSERT_EQUAL(static_cast<Cell16>(FORTH_PRIMITIVE_EXEC_C_FUNC), firstToken(dico, "ADD3"));
+  checkTop(forth, "1 2 3 ADD3", 6);
+  res = forth.interpreteString("ADD3");
+  CPPUNIT_ASSERT_EQUAL(false, res.first);
+  forth.ok(res);
+  res = forth.interpreteString("1 ADD3");
+  CPPUNIT_ASSERT_EQUAL(false, res.first);
+  forth.ok(res);
+  checkTop(forth, "1 2 3 ADD3", 6);
+  CPPUNIT_ASSERT_EQUAL(0, forth.stackDepth(forth::DataStack));
+#endif
+}
+
+//--------------------------------------------------------------------------
+void ForthTests::testToNumber()
+{
+  ForthDictionary dico;
+  Forth forth(dico);
+  forth.boot();
+  Cell32 number;
+
+  CPPUNIT_ASSERT_EQUAL(true, forth.toNumber("1289", number));
+  CPPUNIT_ASSERT_EQUAL(1289, static_cast<int32_t>(number));
+  CPPUNIT_ASSERT_EQUAL(true, forth.toNumber("-1289", number));
+  CPPUNIT_ASSERT_EQUAL(-1289, static_cast<int32_t>(number));
+
+  // The sign is accepted before or after the base prefix
+  CPPUNIT_ASSERT_EQUAL(true, forth.toNumber("#-1289", number));
+  CPPUNIT_ASSERT_EQUAL(-1289, static_cast<int32_t>(number));
+  CPPUNIT_ASSERT_EQUAL(true, forth.toNumber("$-12eF", number));
+  CPPUNIT_ASSERT_EQUAL(-4847, static_cast<int32_t>(number));
+  CPPUNIT_ASSERT_EQUAL(true, forth.toNumber("%-10010110", number));
+  CPPUNIT_ASSERT_EQUAL(-150, static_cast<int32_t>(number));
+  CPPUNIT_ASSERT_EQUAL(true, forth.toNumber("-$12eF", number));
+  CPPUNIT_ASSERT_EQUAL(-4847, static_cast<int32_t>(number));
+  CPPUNIT_ASSERT_EQUAL(true, forth.toNumber("#+12", number));
+  CPPUNIT_ASSERT_EQUAL(12, static_cast<int32_t>(number));
+
+  // Malformed numbers
+  CPPUNIT_ASSERT_EQUAL(false, forth.toNumber("-#-12", number));
+  CPPUNIT_ASSERT_EQUAL(false, forth.toNumber("#-", number));
+  CPPUNIT_ASSERT_EQUAL(false, forth.toNumber("$-12G", number));
+  CPPUNIT_ASSERT_EQUAL(false, forth.toNumber("--12", number));
+
+  // Only the given length is read
+  CPPUNIT_ASSERT_EQUAL(true, forth.toNumber("#-128xyz", 5U, number));
+  CPPUNIT_ASSERT_EQUAL(-128, static_cast<int32_t>(number));
+}
+
+//--------------------------------------------------------------------------
+//! Extract all words of the stream with their line and check if they
+//! ended their line.
+static std::string walkStream(ForthStream& stream)
+{
+  std::ostringstream words;
+
+  while (stream.hasMoreWords())
+    {
+      words << stream.nextWord() << '@' << stream.position().first
+            << (stream.eol() ? "$ " : " ");
+    }
+  return words.str();
+}
+
+//--------------------------------------------------------------------------
+void ForthTests::testStream()
+{
+  const std::string script(": SQ DUP * ;\n\n  \t 3 SQ\n( comment ) .\nLAST");
+  const std::string expected(":@1 SQ@1 DUP@1 *@1 ;@1$ 3@3 SQ@3$ (@4 comment@4 )@4 .@4$ LAST@5$ ");
+  const std::string filename = config::tmp_path + "ForthTests.fs";
+  std::ofstream file(filename);
+  file << script;
+  file.close();
+
+  // File loaded in a single buffer
+  ForthStream stream;
+  CPPUNIT_ASSERT_EQUAL(true, stream.loadFile(filename));
+  CPPUNIT_ASSERT_EQUAL(expected, walkStream(stream));
+  CPPUNIT_ASSERT_EQUAL(false, stream.hasMoreWords());
+
+  // File read line by line
+  CPPUNIT_ASSERT_EQUAL(true, stream.loadFile(filename, false));
+  CPPUNIT_ASSERT_EQUAL(expected, walkStream(stream));
+
+  // The word buffer is reused by the next words
+  stream.loadString("LONGWORD A");
+  CPPUNIT_ASSERT(stream.hasMoreWords());
+  CPPUNIT_ASSERT_EQUAL(std::string("LONGWORD"), stream.nextWord());
+  CPPUNIT_ASSERT(stream.hasMoreWords());
+  CPPUNIT_ASSERT_EQUAL(std::string("A"), stream.nextWord());
+  CPPUNIT_ASSERT(stream.m_word.capacity() >= 8U);
+  CPPUNIT_ASSERT_EQUAL(false, stream.hasMoreWords());
+
+  // Missing files
+  CPPUNIT_ASSERT_EQUAL(false, stream.loadFile(filename + ".none"));
+  CPPUNIT_ASSERT_EQUAL(false, stream.hasMoreWords());
+}
+
+//--------------------------------------------------------------------------
+//! Interprete the script with both interpreters and check they give
+//! the expected result and the same stacks.
+static void compareLoops(Forth& threaded, Forth& classic, std::string const& script,
+                         const bool expected = true)
+{
+  std::pair<bool, std::string> res1 = threaded.interpreteString(script);
+  std::pair<bool, std::string> res2 = classic.interpreteString(script);
+
+  CPPUNIT_ASSERT_EQUAL_MESSAGE(script + ": " + res1.second, expected, res1.first);
+  CPPUNIT_ASSERT_EQUAL_MESSAGE(script, res1.first, res2.first);
+  CPPUNIT_ASSERT_EQUAL_MESSAGE(script, res1.second, res2.second);
+  if (res1.first)
+    {
+      const int32_t depth = threaded.stackDepth(forth::DataStack);
+      CPPUNIT_ASSERT_EQUAL_MESSAGE(script, depth, classic.stackDepth(forth::DataStack));
+      CPPUNIT_ASSERT_EQUAL_MESSAGE(script, threaded.stackDepth(forth::ReturnStack),
+                                   classic.stackDepth(forth::ReturnStack));
+      // At rest the whole stack is stored in memory: the working
+      // register holding the top of the stack may be stale.
+      for (int32_t i = 0; i < depth; ++i)
+        {
+          CPPUNIT_ASSERT_EQUAL_MESSAGE(script, threaded.m_data_stack[i], classic.m_data_stack[i]);
+        }
+    }
+  else
+    {
+      threaded.ok(res1);
+      classic.ok(res2);
+      classic.m_trace = true;
+    }
+}
+
+//--------------------------------------------------------------------------
+void ForthTests::testInnerLoops()
+{
+  ForthDictionary dico1;
+  ForthDictionary dico2;
+  Forth threaded(dico1);
+  Forth classic(dico2);
+  boot(threaded);
+  boot(classic);
+
+  // The classic loop of execToken() is used when tracing
+  classic.m_trace = true;
+
+  compareLoops(threaded, classic, ": SQ DUP * ; : SUM 0 SWAP 0 DO I SQ + LOOP ;");
+  compareLoops(threaded, classic, "10 SUM 3 SQ");
+  compareLoops(threaded, classic, ": FACT DUP 1 > IF DUP 1- FACT * THEN ; 10 FACT");
+  compareLoops(threaded, classic, ": UNTIL COMPILE 0BRANCH HERE - S, ; IMMEDIATE");
+  compareLoops(threaded, classic, ": CNT 0 BEGIN 1+ DUP 100 = UNTIL ; CNT");
+  compareLoops(threaded, classic, ": R3 >R >R >R R> R> R> ; 1 2 3 R3");
+  compareLoops(threaded, classic, ": SIGN DUP 0 < IF DROP -1 ELSE 0> IF 1 ELSE 0 THEN THEN ; -5 SIGN 0 SIGN 7 SIGN");
+  compareLoops(threaded, classic, "' SQ 9 SWAP EXECUTE");
+  compareLoops(threaded, classic, ": EX EXECUTE 1+ ; : EX2 EX 2 * ; 4 ' SQ EX 5 ' SQ EX2");
+  compareLoops(threaded, classic, "1 2 3 ROT OVER TUCK NIP 2DUP");
+  compareLoops(threaded, classic, "2 3 SWAP - 7 /");
+  checkTop(threaded, "5 ' SQ EX2", 52);
+  checkTop(classic, "5 ' SQ EX2", 52);
+
+  // Errors (stacks are reset)
+  threaded.abort();
+  classic.abort();
+  classic.m_trace = true;
+  compareLoops(threaded, classic, "DROP DROP", false);
+  compareLoops(threaded, classic, ": UF DROP DROP ; UF", false);
+  compareLoops(threaded, classic, "1 NOT-A-WORD", false);
+  compareLoops(threaded, classic, ": DEEP 1 DEEP ; DEEP", false);
+  compareLoops(threaded, classic, "10 SUM");
+}
+
+//--------------------------------------------------------------------------
+//! Return the token of the word found in the dictionary, else 0.
+static Cell16 findToken(ForthDictionary& dico, std::string const& name)
+{
+  Cell16 token;
+  bool immediate;
+
+  return dico.find(name, token, immediate) ? token : 0U;
+}
+
+//--------------------------------------------------------------------------
+//! Search two names of five characters having the same hash (FNV-1a
+//! has no collision between names of four characters).
+static std::pair<std::string, std::string> hashCollision()
+{
+  const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  std::unordered_map<uint32_t, std::string> names;
+  std::string name(5U, ' ');
+
+  for (size_t i = 0; i < 36U * 36U * 36U * 36U * 36U; ++i)
+    {
+      size_t n = i;
+      for (size_t c = 0; c < 5U; ++c, n /= 36U)
+        name[c] = alphabet[n % 36U];
+
+      auto it = names.insert(std::make_pair(ForthDictionary::hash(name.c_str(), 5U), name));
+      if (!it.second)
+        return std::make_pair(it.first->second, name);
+    }
+  return std::make_pair(std::string(), std::string());
+}
+
+//--------------------------------------------------------------------------
+void ForthTests::testHashIndex()
+{
+  ForthDictionary dico;
+  Forth forth(dico);
+  boot(forth);
+
+  // Redefinition: the most recent entry is found
+  const Cell32 here = dico.here();
+  std::pair<bool, std::string> res = forth.interpreteString(": W 1 ;");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  const Cell16 w1 = findToken(dico, "W");
+  const Cell32 here1 = dico.here();
+  res = forth.interpreteString(": W 2 ;");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  const Cell16 w2 = findToken(dico, "W");
+  CPPUNIT_ASSERT(0U != w1);
+  CPPUNIT_ASSERT(0U != w2);
+  CPPUNIT_ASSERT(w1 != w2);
+  checkTop(forth, "W", 2);
+
+  // Smudged entries are hidden
+  CPPUNIT_ASSERT(dico.smudge("W"));
+  CPPUNIT_ASSERT_EQUAL(w1, findToken(dico, "W"));
+  CPPUNIT_ASSERT(dico.lookup("W", 1U, true) > dico.lookup("W", 1U, false));
+  CPPUNIT_ASSERT(dico.smudge("W"));
+  CPPUNIT_ASSERT_EQUAL(w2, findToken(dico, "W"));
+
+  // Release: the previous definition is found again and the memory
+  // of the released last entry is given back
+  dico.release(w2);
+  CPPUNIT_ASSERT_EQUAL(w1, findToken(dico, "W"));
+  CPPUNIT_ASSERT_EQUAL(here1, dico.here());
+  checkTop(forth, "W", 1);
+  dico.release(w1);
+  CPPUNIT_ASSERT_EQUAL(static_cast<Cell16>(0U), findToken(dico, "W"));
+  CPPUNIT_ASSERT_EQUAL(here, dico.here());
+
+  // Case and length: names sharing the same prefix are distinct
+  res = forth.interpreteString(": abc 1 ; : ABC 2 ; : AB 3 ; : ABCD 4 ; : A 5 ;");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  checkTop(forth, "abc", 1);
+  checkTop(forth, "ABC", 2);
+  checkTop(forth, "AB", 3);
+  checkTop(forth, "ABCD", 4);
+  checkTop(forth, "A", 5);
+  CPPUNIT_ASSERT_EQUAL(static_cast<Cell16>(0U), findToken(dico, "Abc"));
+  CPPUNIT_ASSERT_EQUAL(static_cast<Cell16>(0U), findToken(dico, "ABCDE"));
+
+  // Two names in the same bucket of the hash index
+  std::pair<std::string, std::string> names = hashCollision();
+  CPPUNIT_ASSERT(!names.first.empty());
+  CPPUNIT_ASSERT_EQUAL(ForthDictionary::hash(names.first.c_str(), 5U),
+                       ForthDictionary::hash(names.second.c_str(), 5U));
+  res = forth.interpreteString(": " + names.first + " 10 ; : " + names.second + " 20 ;");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  checkTop(forth, names.first, 10);
+  checkTop(forth, names.second, 20);
+  res = forth.interpreteString(": " + names.first + " 30 ;");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  checkTop(forth, names.first, 30);
+  checkTop(forth, names.second, 20);
+
+  // Reindex: the index rebuilt from the linked list gives the same
+  // entries
+  const Cell16 abc = findToken(dico, "ABC");
+  const Cell16 first = findToken(dico, names.first);
+  const Cell16 second = findToken(dico, names.second);
+  dico.reindex();
+  CPPUNIT_ASSERT_EQUAL(abc, findToken(dico, "ABC"));
+  CPPUNIT_ASSERT_EQUAL(first, findToken(dico, names.first));
+  CPPUNIT_ASSERT_EQUAL(second, findToken(dico, names.second));
+  CPPUNIT_ASSERT_EQUAL(static_cast<Cell16>(0U), findToken(dico, "W"));
+  checkTop(forth, "abc", 1);
+  checkTop(forth, names.first, 30);
+  checkTop(forth, names.second, 20);
+  res = forth.interpreteString(": ABC 6 ;");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  checkTop(forth, "ABC", 6);
+  checkTop(forth, "1 2 + DUP *", 9);
+}
+
+//--------------------------------------------------------------------------
+//! Replace the superinstructions of the last definition by their
+//! first token (the fused tokens are still stored after them).
+//! \return the number of superinstructions.
+static uint32_t unfuse(Forth& forth, std::string const& word, const bool replace)
+{
+  Cell16 token;
+  bool immediate;
+  CPPUNIT_ASSERT_MESSAGE(word, forth.m_dictionary.find(word, token, immediate));
+
+  uint32_t count = 0U;
+  Cell32 ip = forth.m_dictionary.xt(token) + 2U;
+  while (ip < forth.m_dictionary.here())
+    {
+      const Cell16 t = forth.m_dictionary.read16at(ip);
+      Cell16 first = t;
+      switch (t)
+        {
+        case FORTH_PRIMITIVE_LITERAL_16_PLUS:   first = FORTH_PRIMITIVE_LITERAL_16; break;
+        case FORTH_PRIMITIVE_0EQUAL_0BRANCH:    first = FORTH_PRIMITIVE_0EQUAL; break;
+        case FORTH_PRIMITIVE_DUP_TO_RSTACK:     first = FORTH_PRIMITIVE_DUP; break;
+        case FORTH_PRIMITIVE_FROM_RSTACK_1PLUS: first = FORTH_PRIMITIVE_FROM_RSTACK; break;
+        default: break;
+        }
+      if (first != t)
+        {
+          ++count;
+          if (replace)
+            forth.m_dictionary.write16at(ip, first);
+        }
+      ip += 2U * (1U + forth.operands(t));
+    }
+  return count;
+}
+
+//--------------------------------------------------------------------------
+//! Compile the definition with both interpreters, then unfuse it in
+//! the second one.
+//! \return the number of superinstructions of the definition.
+static uint32_t defineUnfused(Forth& fused, Forth& plain, std::string const& word,
+                              std::string const& definition)
+{
+  std::pair<bool, std::string> res = fused.interpreteString(": " + word + " " + definition + " ;");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  res = plain.interpreteString(": " + word + " " + definition + " ;");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+
+  const uint32_t count = unfuse(plain, word, true);
+  CPPUNIT_ASSERT_EQUAL(count, unfuse(fused, word, false));
+  CPPUNIT_ASSERT_EQUAL(0U, unfuse(plain, word, false));
+  return count;
+}
+
+//--------------------------------------------------------------------------
+void ForthTests::testSuperInstructions()
+{
+#if FORTH_SUPERINSTRUCTIONS
+  ForthDictionary dico1;
+  ForthDictionary dico2;
+  Forth fused(dico1);
+  Forth plain(dico2);
+  boot(fused);
+  boot(plain);
+
+  // Literal then +
+  CPPUNIT_ASSERT_EQUAL(1U, defineUnfused(fused, plain, "P1", "5 +"));
+  compareLoops(fused, plain, "3 P1 -10 P1 0 P1");
+  CPPUNIT_ASSERT(defineUnfused(fused, plain, "P2", "1000 + 3 + 7 -") >= 2U);
+  compareLoops(fused, plain, "-2000 P2 0 P2");
+  checkTop(fused, "3 P1", 8);
+
+  // 0= then 0BRANCH
+  CPPUNIT_ASSERT_EQUAL(1U, defineUnfused(fused, plain, "Z0", "0= IF 11 ELSE 22 THEN"));
+  compareLoops(fused, plain, "0 Z0 5 Z0 -1 Z0");
+  checkTop(fused, "0 Z0", 11);
+  checkTop(fused, "-1 Z0", 22);
+
+  // Backward branches over a fused pair (LOOP compiles R> 1+ and
+  // 0= 0BRANCH)
+  compareLoops(fused, plain, ": UNTIL COMPILE 0BRANCH HERE - S, ; IMMEDIATE");
+  CPPUNIT_ASSERT_EQUAL(1U, defineUnfused(fused, plain, "CNT", "0 BEGIN 1+ DUP 100 < 0= UNTIL"));
+  compareLoops(fused, plain, "CNT");
+  checkTop(fused, "CNT", 100);
+  CPPUNIT_ASSERT_EQUAL(3U, defineUnfused(fused, plain, "SUMP", "0 10 0 DO I 3 + + LOOP"));
+  compareLoops(fused, plain, "SUMP");
+  checkTop(fused, "SUMP", 75);
+
+  // Forward branches landing on the second token of a fused pair
+  CPPUNIT_ASSERT_EQUAL(1U, defineUnfused(fused, plain, "LAND", "IF 0= THEN IF 1 ELSE 2 THEN"));
+  compareLoops(fused, plain, "0 0 LAND 5 0 LAND 0 1 LAND 5 1 LAND");
+  checkTop(fused, "0 0 LAND", 2);
+  checkTop(fused, "5 0 LAND", 1);
+  checkTop(fused, "0 1 LAND", 1);
+  checkTop(fused, "5 1 LAND", 2);
+  CPPUNIT_ASSERT_EQUAL(1U, defineUnfused(fused, plain, "L3", "IF 5 THEN +"));
+  compareLoops(fused, plain, "2 3 1 L3 2 3 0 L3");
+  checkTop(fused, "2 3 0 L3", 5);
+
+  // Return stack pairs
+  CPPUNIT_ASSERT_EQUAL(2U, defineUnfused(fused, plain, "RD", "DUP >R R> 1+ +"));
+  compareLoops(fused, plain, "4 RD");
+  checkTop(fused, "4 RD", 9);
+#endif
+}
+
+//--------------------------------------------------------------------------
+//! Build a C library with the given code and return the path of the
+//! compiled library (without extension).
+static std::string buildCLib(Forth& forth, std::string const& code)
+{
+  std::pair<bool, std::string> res = forth.interpreteString(
+    "C-LIB forthtests_clib\n"
+    "\\C static int total = 0;\n"
+    "\\C int sub3(int a, int b, int c) { return " + code + "; }\n"
+    "\\C void acc(int a, int b) { total += a * b; }\n"
+    "\\C int get_total(void) { return total; }\n"
+    "C-FUNCTION SUB3 sub3 n n n -- n\n"
+    "C-FUNCTION ACC acc n n\n"
+    "C-FUNCTION TOTAL get_total -- n\n"
+    "END-C-LIB\n");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+
+  std::vector<CFuncHolder> const& functions = forth.m_dynamic_libs.m_functions;
+  CPPUNIT_ASSERT(functions.size() >= 3U);
+  const std::string libpath = functions.back().libpath;
+  CPPUNIT_ASSERT(!libpath.empty());
+  CPPUNIT_ASSERT_EQUAL(libpath, functions[functions.size() - 3U].libpath);
+  CPPUNIT_ASSERT(File::exist(libpath + "." G_MODULE_SUFFIX));
+  CPPUNIT_ASSERT_EQUAL(false, File::exist(libpath + ".c"));
+  return libpath;
+}
+
+//--------------------------------------------------------------------------
+//! Date of the last modification of the file (in nanoseconds).
+static uint64_t modified(std::string const& path)
+{
+  struct stat st;
+  CPPUNIT_ASSERT_EQUAL(0, stat(path.c_str(), &st));
+  return static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000U + st.st_mtim.tv_nsec;
+}
+
+//--------------------------------------------------------------------------
+void ForthTests::testCLibCache()
+{
+  ForthDictionary dico;
+  Forth forth(dico);
+  boot(forth);
+
+  // Miss: the library is compiled
+  const std::string libpath = buildCLib(forth, "a - b * c");
+  const std::string library = libpath + "." G_MODULE_SUFFIX;
+  std::remove(library.c_str());
+  CPPUNIT_ASSERT_EQUAL(libpath, buildCLib(forth, "a - b * c"));
+  const uint64_t date = modified(library);
+  checkTop(forth, "4 3 2 SUB3", -10);
+
+  // Hit: the same code is not compiled again
+  CPPUNIT_ASSERT_EQUAL(libpath, buildCLib(forth, "a - b * c"));
+  CPPUNIT_ASSERT_EQUAL(date, modified(library));
+  checkTop(forth, "4 3 2 SUB3", -10);
+
+  // Miss: a change of the code gives another library
+  const std::string other = buildCLib(forth, "a + b * c");
+  CPPUNIT_ASSERT(other != libpath);
+  CPPUNIT_ASSERT_EQUAL(date, modified(library));
+  checkTop(forth, "4 3 2 SUB3", 14);
+
+  // Batched calls give the same results than single calls. Arguments
+  // are in the order of the C parameters: the first one is on the
+  // top of the stack for a single call.
+  std::pair<bool, std::string> res = forth.interpreteString(
+    "CREATE ARGS 2 , 3 , 4 , 10 , -1 , 1 , -5 , 2 , 3 , "
+    "CREATE RES 0 , 0 , 0 , 0 , "
+    "-1 RES 3 CELLS + ! ARGS RES 3 SUB3[]");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  checkTop(forth, "4 3 2 SUB3", 14);
+  checkTop(forth, "RES @", 14);
+  checkTop(forth, "1 -1 10 SUB3", 9);
+  checkTop(forth, "RES CELL + @", 9);
+  checkTop(forth, "3 2 -5 SUB3", 1);
+  checkTop(forth, "RES 2 CELLS + @", 1);
+  checkTop(forth, "RES 3 CELLS + @", -1);
+
+  // Batched calls of a function returning nothing
+  checkTop(forth, "TOTAL", 0);
+  res = forth.interpreteString("ARGS 0 4 ACC[] 3 5 ACC");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  checkTop(forth, "TOTAL", 6 + 40 - 1 - 10 + 15);
+  res = forth.interpreteString("ARGS RES 0 SUB3[]");
+  CPPUNIT_ASSERT_MESSAGE(res.second, res.first);
+  checkTop(forth, "RES @", 14);
+
+  // Arrays outside the dictionary are refused
+  res = forth.interpreteString("ARGS 2000000000 3 SUB3[]");
+  CPPUNIT_ASSERT_EQUAL(false, res.first);
+  forth.ok(res);
+}
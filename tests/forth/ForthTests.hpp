@@ -0,0 +1,78 @@
+//=====================================================================
+// SimTaDyn: A GIS in a spreadsheet.
+// Copyright 2018 Quentin Quadrat <lecrapouille@gmail.com>
+//
+// This file is part of SimTaDyn.
+//
+// SimTaDyn is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SimTaDyn.  If not, see <http://www.gnu.org/licenses/>.
+//=====================================================================
+
+#ifndef FORTH_TESTS_HPP_
+#  define FORTH_TESTS_HPP_
+
+#  include <cppunit/TestFixture.h>
+#  include <cppunit/TestResult.h>
+#  include <cppunit/extensions/HelperMacros.h>
+
+#  define protected public
+#  define private public
+#  include "Forth.hpp"
+#  undef protected
+#  undef private
+
+class ForthTests : public CppUnit::TestFixture
+{
+  // CppUnit macros for setting up the test suite
+  CPPUNIT_TEST_SUITE(ForthTests);
+  CPPUNIT_TEST(testProfiler);
+  CPPUNIT_TEST(testJIT);
+  CPPUNIT_TEST(testSnapshot);
+  CPPUNIT_TEST(testContextPool);
+  CPPUNIT_TEST(testBigAllot);
+  CPPUNIT_TEST(testFloat);
+  CPPUNIT_TEST(testArrays);
+  CPPUNIT_TEST(testBudget);
+  CPPUNIT_TEST(testCompact);
+  CPPUNIT_TEST(testStackEffect);
+  CPPUNIT_TEST(testToNumber);
+  CPPUNIT_TEST(testStream);
+  CPPUNIT_TEST(testInnerLoops);
+  CPPUNIT_TEST(testHashIndex);
+  CPPUNIT_TEST(testSuperInstructions);
+  CPPUNIT_TEST(testCLibCache);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void testProfiler();
+  void testJIT();
+  void testSnapshot();
+  void testContextPool();
+  void testBigAllot();
+  void testFloat();
+  void testArrays();
+  void testBudget();
+  void testCompact();
+  void testStackEffect();
+  void testToNumber();
+  void testStream();
+  void testInnerLoops();
+  void testHashIndex();
+  void testSuperInstructions();
+  void testCLibCache();
+};
+
+#endif /* FORTH_TESTS_HPP_ */
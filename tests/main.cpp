@@ -51,6 +51,9 @@
 #include "GLShadersTests.hpp"
 #include "GLProgramTests.hpp"
 
+// --- Forth ----------------------------------------------------------
+#include "ForthTests.hpp"
+
 // --- Loader ---------------------------------------------------------
 //#include "ResourcesTests.hpp"
 #include "SimTaDynFileLoaderTests.hpp"
@@ -215,6 +218,31 @@ static void testOpenGL(CppUnit::TextUi::TestRunner& runner)
   runner.addTest(suite);
 }
 
+//--------------------------------------------------------------------------
+static void testForth(CppUnit::TextUi::TestRunner& runner)
+{
+  CppUnit::TestSuite* suite;
+
+  suite = new CppUnit::TestSuite("ForthTests");
+  suite->addTest(new CppUnit::TestCaller<ForthTests>("Profiler", &ForthTests::testProfiler));
+  suite->addTest(new CppUnit::TestCaller<ForthTests>("JIT", &ForthTests::testJIT));
+  suite->addTest(new CppUnit::TestCaller<ForthTests>("Snapshot", &ForthTests::testSnapshot));
+  suite->addTest(new CppUnit::TestCaller<ForthTests>("ContextPool", &ForthTests::testContextPool));
+  suite->addTest(new CppUnit::TestCaller<ForthTests>("BigAllot", &ForthTests::testBigAllot));
+  suite->addTest(new CppUnit::TestCaller<ForthTests>("Float", &ForthTests::testFloat));
+  suite->addTest(new CppUnit::TestCaller<ForthTests>("Arrays", &ForthTests::testArrays));
+  suite->addTest(new CppUnit::TestCaller<ForthTests>("Budget", &ForthTests::testBudget));
+  suite->addTest(new CppUnit::TestCaller<ForthTests>("Compact", &ForthTests::testCompact));
+  suite->addTest(new CppUnit::TestCaller<ForthTests>("StackEffect", &ForthTests::testStackEffect));
+  suite->addTest(new CppUnit::TestCaller<ForthTests>("ToNumber", &ForthTests::testToNumber));
+  suite->addTest(new CppUnit::TestCaller<ForthTests>("Stream", &ForthTests::testStream));
+  suite->addTest(new CppUnit::TestCaller<ForthTests>("InnerLoops", &ForthTests::testInnerLoops));
+  suite->addTest(new CppUnit::TestCaller<ForthTests>("HashIndex", &ForthTests::testHashIndex));
+  suite->addTest(new CppUnit::TestCaller<ForthTests>("SuperInstructions", &ForthTests::testSuperInstructions));
+  suite->addTest(new CppUnit::TestCaller<ForthTests>("CLibCache", &ForthTests::testCLibCache));
+  runner.addTest(suite);
+}
+
 //--------------------------------------------------------------------------
 static void testLoader(CppUnit::TextUi::TestRunner& runner)
 {
@@ -242,6 +270,16 @@ static void testCore(CppUnit::TextUi::TestRunner& runner)
   suite->addTest(new CppUnit::TestCaller<ClassicSpreadSheetTests>("Spreadsheet 3", &ClassicSpreadSheetTests::testInput3));
   suite->addTest(new CppUnit::TestCaller<ClassicSpreadSheetTests>("Spreadsheet 4", &ClassicSpreadSheetTests::testInput4));
   suite->addTest(new CppUnit::TestCaller<ClassicSpreadSheetTests>("Spreadsheet 5", &ClassicSpreadSheetTests::testInput5));*/
+  suite->addTest(new CppUnit::TestCaller<ClassicSpreadSheetTests>("Dirty cells", &ClassicSpreadSheetTests::testDirty));
+  suite->addTest(new CppUnit::TestCaller<ClassicSpreadSheetTests>("Parallel evaluation", &ClassicSpreadSheetTests::testParallel));
+  suite->addTest(new CppUnit::TestCaller<ClassicSpreadSheetTests>("Evaluation budget", &ClassicSpreadSheetTests::testBudget));
+  suite->addTest(new CppUnit::TestCaller<ClassicSpreadSheetTests>("Chunked loading", &ClassicSpreadSheetTests::testReadInput));
+  suite->addTest(new CppUnit::TestCaller<ClassicSpreadSheetTests>("Circular dependencies", &ClassicSpreadSheetTests::testCycles));
+  suite->addTest(new CppUnit::TestCaller<ClassicSpreadSheetTests>("Simulation steps", &ClassicSpreadSheetTests::testStep));
+  suite->addTest(new CppUnit::TestCaller<ClassicSpreadSheetTests>("Cell values", &ClassicSpreadSheetTests::testCellValues));
+  suite->addTest(new CppUnit::TestCaller<ClassicSpreadSheetTests>("Formulae edition", &ClassicSpreadSheetTests::testFormulaeEdit));
+  suite->addTest(new CppUnit::TestCaller<ClassicSpreadSheetTests>("Dependencies", &ClassicSpreadSheetTests::testDependencies));
+  suite->addTest(new CppUnit::TestCaller<ClassicSpreadSheetTests>("Parse cells", &ClassicSpreadSheetTests::testParseCell));
   runner.addTest(suite);
 }
 
@@ -263,6 +301,7 @@ static bool run_tests(bool const has_xdisplay)
   testGraph(runner);
   // Travis-CI does not support export display
   if (has_xdisplay) testOpenGL(runner);
+  testForth(runner);
   testLoader(runner);
   testCore(runner);
 